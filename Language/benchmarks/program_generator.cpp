@@ -0,0 +1,491 @@
+#include "program_generator.h"
+
+#include <assert.h>
+#include <string.h>
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef enum StatementKind
+{
+    StatementKind_ASSIGN      = 0,
+    StatementKind_DEEP_ASSIGN = 1,
+    StatementKind_DECLARE     = 2,
+    StatementKind_PRINT       = 3,
+    StatementKind_IF          = 4,
+    StatementKind_WHILE       = 5,
+} StatementKind;
+
+const size_t STATEMENT_KINDS_NUMBER = 6;
+
+typedef struct Generator
+{
+    char*    text;
+    size_t   size;
+    size_t   capacity;
+    bool     out_of_memory;
+
+    uint64_t random_state;
+    const unsigned* weights;        // by StatementKind
+    size_t   variables_number;      // v0 ... are declared
+    size_t   counters_number;       // loop counters i0 ...
+} Generator;
+
+static void generateStatement(Generator* generator, size_t nesting);
+static void generateBlock(Generator* generator, size_t nesting);
+static void generateExpression(Generator* generator, size_t depth);
+static void generateCondition(Generator* generator);
+static void generateVariable(Generator* generator);
+static void indent(Generator* generator, size_t nesting);
+static StatementKind pickStatement(Generator* generator, size_t nesting);
+static uint64_t nextRandom(Generator* generator);
+static size_t randomBelow(Generator* generator, size_t bound);
+static void appendText(Generator* generator, const char* text);
+static void appendNumber(Generator* generator, uint64_t number);
+static bool growText(Generator* generator, size_t needed);
+
+// Relative frequencies of StatementKind per ProgramShape.
+static const unsigned SHAPE_WEIGHTS[PROGRAM_SHAPES_NUMBER][STATEMENT_KINDS_NUMBER] = {
+    /* EXPRESSIONS */ { 1, 12, 0, 0, 0, 0 },
+    /* STATEMENTS  */ { 16, 0, 1, 1, 0, 0 },
+    /* IDENTIFIERS */ { 1, 0, 12, 0, 0, 0 },
+    /* CONTROL     */ { 4, 0, 1, 0, 4, 3 },
+    /* MIXED       */ { 6, 2, 2, 1, 2, 1 },
+};
+
+static const char* const SHAPE_NAMES[PROGRAM_SHAPES_NUMBER] = {
+    "expressions", "statements", "identifiers", "control", "mixed",
+};
+
+// Identifiers of different lengths, so the lexer does not see only short ones.
+static const char* const VARIABLE_PREFIXES[] = {
+    "v", "total_", "index", "value_of_item_", "x",
+};
+static const size_t VARIABLE_PREFIXES_NUMBER =
+    sizeof(VARIABLE_PREFIXES) / sizeof(VARIABLE_PREFIXES[0]);
+
+static const size_t INITIAL_VARIABLES  = 8;
+static const size_t MAX_NESTING        = 3;
+static const size_t MAX_BLOCK_LENGTH   = 4;
+static const size_t MAX_SHALLOW_DEPTH  = 3;
+static const size_t MAX_DEEP_DEPTH     = 24;
+static const size_t MAX_LOOP_TRIPS     = 4;
+static const size_t INITIAL_CAPACITY   = 4096;
+
+
+// public ---------------------------------------------------------------------
+
+
+char* generateProgram(ProgramShape shape, size_t bytes, uint64_t seed, size_t* length)
+{
+    assert((size_t)shape < PROGRAM_SHAPES_NUMBER);
+    assert(length != NULL);
+
+    Generator generator = {
+        .text          = NULL,
+        .size          = 0,
+        .capacity      = 0,
+        .out_of_memory = false,
+        .random_state  = seed * 0x9E3779B97F4A7C15ull + 1,
+        .weights       = SHAPE_WEIGHTS[shape],
+        .variables_number = 0,
+        .counters_number  = 0,
+    };
+    if (!growText(&generator, bytes + INITIAL_CAPACITY))
+    {
+        return NULL;
+    }
+
+    for (size_t variable = 0; variable < INITIAL_VARIABLES; variable++)
+    {
+        appendText(&generator, "var ");
+        appendText(&generator, VARIABLE_PREFIXES[variable % VARIABLE_PREFIXES_NUMBER]);
+        appendNumber(&generator, variable);
+        generator.variables_number++;
+        appendText(&generator, " = ");
+        appendNumber(&generator, randomBelow(&generator, 100) + 1);
+        appendText(&generator, ";\n");
+    }
+
+    while (generator.size < bytes && !generator.out_of_memory)
+    {
+        generateStatement(&generator, 0);
+    }
+
+    appendText(&generator, "print(");
+    appendText(&generator, VARIABLE_PREFIXES[0]);
+    appendText(&generator, "0);\n");
+
+    if (generator.out_of_memory)
+    {
+        free(generator.text);
+        return NULL;
+    }
+
+    *length = generator.size;
+
+    return generator.text;
+}
+
+
+const char* programShapeToString(ProgramShape shape)
+{
+    return (size_t)shape < PROGRAM_SHAPES_NUMBER ? SHAPE_NAMES[shape] : "unknown";
+}
+
+
+bool programShapeFromString(const char* name, ProgramShape* shape)
+{
+    assert(name  != NULL);
+    assert(shape != NULL);
+
+    for (size_t candidate = 0; candidate < PROGRAM_SHAPES_NUMBER; candidate++)
+    {
+        if (strcmp(name, SHAPE_NAMES[candidate]) == 0)
+        {
+            *shape = (ProgramShape)candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static void generateStatement(Generator* generator, size_t nesting)
+{
+    assert(generator != NULL);
+
+    indent(generator, nesting);
+    switch (pickStatement(generator, nesting))
+    {
+        case StatementKind_ASSIGN:
+            generateVariable(generator);
+            appendText(generator, " = ");
+            generateExpression(generator, 1 + randomBelow(generator, MAX_SHALLOW_DEPTH));
+            appendText(generator, ";\n");
+            break;
+
+        case StatementKind_DEEP_ASSIGN:
+            generateVariable(generator);
+            appendText(generator, " = ");
+            generateExpression(generator, MAX_DEEP_DEPTH / 2 + randomBelow(generator, MAX_DEEP_DEPTH / 2));
+            appendText(generator, ";\n");
+            break;
+
+        case StatementKind_DECLARE:
+        {
+            // The new variable is only readable once its initializer is written.
+            size_t variable = generator->variables_number;
+            appendText(generator, "var ");
+            appendText(generator, VARIABLE_PREFIXES[variable % VARIABLE_PREFIXES_NUMBER]);
+            appendNumber(generator, variable);
+            appendText(generator, " = ");
+            generateExpression(generator, 1 + randomBelow(generator, MAX_SHALLOW_DEPTH));
+            appendText(generator, ";\n");
+            generator->variables_number++;
+            break;
+        }
+
+        case StatementKind_PRINT:
+            appendText(generator, "print(");
+            generateExpression(generator, 1 + randomBelow(generator, MAX_SHALLOW_DEPTH));
+            appendText(generator, ");\n");
+            break;
+
+        case StatementKind_IF:
+            appendText(generator, "if (");
+            generateCondition(generator);
+            appendText(generator, ") ");
+            generateBlock(generator, nesting);
+            while (randomBelow(generator, 3) == 0)
+            {
+                appendText(generator, " else if (");
+                generateCondition(generator);
+                appendText(generator, ") ");
+                generateBlock(generator, nesting);
+            }
+            if (randomBelow(generator, 2) == 0)
+            {
+                appendText(generator, " else ");
+                generateBlock(generator, nesting);
+            }
+            appendText(generator, "\n");
+            break;
+
+        case StatementKind_WHILE:
+        {
+            // A counter of its own resets when an enclosing loop comes round.
+            size_t counter = generator->counters_number++;
+            appendText(generator, "var i");
+            appendNumber(generator, counter);
+            appendText(generator, " = 0;\n");
+            indent(generator, nesting);
+            appendText(generator, "while (i");
+            appendNumber(generator, counter);
+            appendText(generator, " < ");
+            appendNumber(generator, 2 + randomBelow(generator, MAX_LOOP_TRIPS - 1));
+            appendText(generator, ") {\n");
+            size_t length = 1 + randomBelow(generator, MAX_BLOCK_LENGTH);
+            for (size_t statement = 0; statement < length; statement++)
+            {
+                generateStatement(generator, nesting + 1);
+            }
+            indent(generator, nesting + 1);
+            appendText(generator, "i");
+            appendNumber(generator, counter);
+            appendText(generator, " = i");
+            appendNumber(generator, counter);
+            appendText(generator, " + 1;\n");
+            indent(generator, nesting);
+            appendText(generator, "}\n");
+            break;
+        }
+
+        default:
+            assert(0 && "Unknown statement kind");
+            break;
+    }
+}
+
+
+static void generateBlock(Generator* generator, size_t nesting)
+{
+    assert(generator != NULL);
+
+    appendText(generator, "{\n");
+    size_t length = 1 + randomBelow(generator, MAX_BLOCK_LENGTH);
+    for (size_t statement = 0; statement < length; statement++)
+    {
+        generateStatement(generator, nesting + 1);
+    }
+    indent(generator, nesting);
+    appendText(generator, "}");
+}
+
+
+// Numbers only: + - * on anything, / and % by non-zero literals.
+static void generateExpression(Generator* generator, size_t depth)
+{
+    assert(generator != NULL);
+
+    if (depth == 0)
+    {
+        switch (randomBelow(generator, 8))
+        {
+            case 0:  appendNumber(generator, randomBelow(generator, 1000)); break;
+            case 1:  appendText(generator, "0.5");                          break;
+            default: generateVariable(generator);                           break;
+        }
+        return;
+    }
+
+    switch (randomBelow(generator, 6))
+    {
+        case 0:
+            appendText(generator, "-");
+            generateExpression(generator, 0);
+            return;
+
+        case 1:
+            appendText(generator, "(");
+            generateExpression(generator, depth - 1);
+            appendText(generator, randomBelow(generator, 2) == 0 ? " / " : " % ");
+            appendNumber(generator, 1 + randomBelow(generator, 9));
+            appendText(generator, ")");
+            return;
+
+        default:
+        {
+            // One side stays shallow, so depth grows the text linearly.
+            static const char* const OPERATORS[] = { " + ", " - ", " * " };
+            bool deep_left = randomBelow(generator, 2) == 0;
+            appendText(generator, "(");
+            generateExpression(generator, deep_left ? depth - 1 : randomBelow(generator, 2));
+            appendText(generator, OPERATORS[randomBelow(generator, 3)]);
+            generateExpression(generator, deep_left ? randomBelow(generator, 2) : depth - 1);
+            appendText(generator, ")");
+            return;
+        }
+    }
+}
+
+
+static void generateCondition(Generator* generator)
+{
+    assert(generator != NULL);
+
+    static const char* const COMPARISONS[] = { " < ", " > ", " <= ", " >= ", " == ", " != " };
+
+    bool negated = randomBelow(generator, 8) == 0;
+    appendText(generator, negated ? "!(" : "");
+    generateExpression(generator, randomBelow(generator, 2));
+    appendText(generator, COMPARISONS[randomBelow(generator, 6)]);
+    generateExpression(generator, randomBelow(generator, 2));
+    if (randomBelow(generator, 4) == 0)
+    {
+        appendText(generator, randomBelow(generator, 2) == 0 ? " && " : " || ");
+        generateVariable(generator);
+        appendText(generator, COMPARISONS[randomBelow(generator, 6)]);
+        appendNumber(generator, randomBelow(generator, 100));
+    }
+    appendText(generator, negated ? ")" : "");
+}
+
+
+// Reads or writes one of the declared variables, recent ones more often.
+static void generateVariable(Generator* generator)
+{
+    assert(generator != NULL);
+
+    size_t declared = generator->variables_number;
+    size_t variable = 0;
+    if (declared > 0)
+    {
+        variable = randomBelow(generator, 2) == 0 || declared <= INITIAL_VARIABLES
+                 ? randomBelow(generator, declared)
+                 : declared - 1 - randomBelow(generator, INITIAL_VARIABLES);
+    }
+
+    appendText(generator, VARIABLE_PREFIXES[variable % VARIABLE_PREFIXES_NUMBER]);
+    appendNumber(generator, variable);
+}
+
+
+static void indent(Generator* generator, size_t nesting)
+{
+    assert(generator != NULL);
+
+    for (size_t level = 0; level < nesting; level++)
+    {
+        appendText(generator, "    ");
+    }
+}
+
+
+// Blocks stop nesting at MAX_NESTING, which bounds both the recursion and
+// the number of times a statement can run.
+static StatementKind pickStatement(Generator* generator, size_t nesting)
+{
+    assert(generator != NULL);
+
+    const unsigned* weights = generator->weights;
+    unsigned total = 0;
+    for (size_t kind = 0; kind < STATEMENT_KINDS_NUMBER; kind++)
+    {
+        bool nests = kind == StatementKind_IF || kind == StatementKind_WHILE;
+        total += nests && nesting >= MAX_NESTING ? 0 : weights[kind];
+    }
+
+    if (total == 0)
+    {
+        return StatementKind_ASSIGN;
+    }
+
+    unsigned pick = (unsigned)randomBelow(generator, total);
+    for (size_t kind = 0; kind < STATEMENT_KINDS_NUMBER; kind++)
+    {
+        bool nests = kind == StatementKind_IF || kind == StatementKind_WHILE;
+        unsigned weight = nests && nesting >= MAX_NESTING ? 0 : weights[kind];
+        if (pick < weight)
+        {
+            return (StatementKind)kind;
+        }
+        pick -= weight;
+    }
+
+    return StatementKind_ASSIGN;
+}
+
+
+// xorshift64*, so a seed gives the same program on every platform.
+static uint64_t nextRandom(Generator* generator)
+{
+    assert(generator != NULL);
+
+    uint64_t state = generator->random_state;
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    generator->random_state = state;
+
+    return state * 0x2545F4914F6CDD1Dull;
+}
+
+
+static size_t randomBelow(Generator* generator, size_t bound)
+{
+    assert(generator != NULL);
+    assert(bound > 0);
+
+    return (size_t)(nextRandom(generator) >> 11) % bound;
+}
+
+
+static void appendText(Generator* generator, const char* text)
+{
+    assert(generator != NULL);
+    assert(text      != NULL);
+
+    size_t length = strlen(text);
+    if (!growText(generator, generator->size + length + 1))
+    {
+        return;
+    }
+
+    memcpy(generator->text + generator->size, text, length + 1);
+    generator->size += length;
+}
+
+
+static void appendNumber(Generator* generator, uint64_t number)
+{
+    assert(generator != NULL);
+
+    char digits[24] = {};
+    size_t position = sizeof(digits) - 1;
+    do
+    {
+        digits[--position] = (char)('0' + number % 10);
+        number /= 10;
+    } while (number > 0);
+
+    appendText(generator, digits + position);
+}
+
+
+static bool growText(Generator* generator, size_t needed)
+{
+    assert(generator != NULL);
+
+    if (generator->out_of_memory)
+    {
+        return false;
+    }
+    if (needed <= generator->capacity)
+    {
+        return true;
+    }
+
+    size_t capacity = generator->capacity > 0 ? generator->capacity : INITIAL_CAPACITY;
+    while (capacity < needed)
+    {
+        capacity *= 2;
+    }
+
+    char* text = (char*)realloc(generator->text, capacity);
+    if (text == NULL)
+    {
+        generator->out_of_memory = true;
+        return false;
+    }
+
+    generator->text     = text;
+    generator->capacity = capacity;
+
+    return true;
+}
@@ -0,0 +1,29 @@
+#ifndef PROGRAM_GENERATOR_H
+#define PROGRAM_GENERATOR_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef enum ProgramShape
+{
+    ProgramShape_EXPRESSIONS = 0,   // assignments of deeply nested expressions
+    ProgramShape_STATEMENTS  = 1,   // a long flat list of short statements
+    ProgramShape_IDENTIFIERS = 2,   // a new variable in almost every statement
+    ProgramShape_CONTROL     = 3,   // nested while loops and if/else chains
+    ProgramShape_MIXED       = 4,   // all of the above
+} ProgramShape;
+
+const size_t PROGRAM_SHAPES_NUMBER = 5;
+
+// Writes a program of about bytes bytes that parses, type-checks and runs
+// without errors: every variable is declared before it is read, values
+// are numbers, divisors are non-zero literals and loops run at most four
+// times, at most three deep, so run time grows linearly with the size.
+// The same shape, size and seed always give the same text. Returns a
+// malloc'ed string, or NULL when out of memory.
+char* generateProgram(ProgramShape shape, size_t bytes, uint64_t seed, size_t* length);
+
+const char* programShapeToString(ProgramShape shape);
+bool programShapeFromString(const char* name, ProgramShape* shape);
+
+#endif
@@ -0,0 +1,792 @@
+// Throughput of the lexer, the parser and the VM on generated programs of
+// growing size, from a few kilobytes up to a gigabyte, so that a phase
+// which stops scaling linearly shows up as a falling rate. Every size is
+// measured after warmup runs, over several repetitions, and reported as a
+// mean with a 95% confidence interval; results can be saved as a baseline
+// and later runs compared against it. make bench runs it after the fixed
+// benchmarks; SYNTHETIC_OPTIONS passes flags, see --help.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "program_generator.h"
+#include "lexical_analysis.h"
+#include "syntactic_analysis.h"
+#include "tree_node_structure.h"
+#include "resolver.h"
+#include "compiler.h"
+#include "vm.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct Summary
+{
+    double mean;
+    double half_width;      // of the 95% confidence interval
+} Summary;
+
+typedef struct Measurement
+{
+    ProgramShape shape;
+    size_t       bytes;
+    size_t       tokens_number;
+    size_t       nodes_number;
+    Summary      lex_rate;      // tokens per second
+    Summary      parse_rate;    // nodes per second
+    Summary      run_seconds;
+    bool         ran;
+} Measurement;
+
+typedef struct BaselineEntry
+{
+    char   shape[16];
+    size_t bytes;
+    char   metric[24];
+    double mean;
+    double half_width;
+} BaselineEntry;
+
+typedef struct Baseline
+{
+    BaselineEntry* entries;
+    size_t         entries_number;
+    size_t         entries_capacity;
+} Baseline;
+
+typedef struct Settings
+{
+    bool        shapes[PROGRAM_SHAPES_NUMBER];
+    size_t      min_bytes;
+    size_t      max_bytes;
+    size_t      step;
+    uint64_t    seed;
+    int         warmup;
+    int         repetitions;
+    size_t      run_max_bytes;
+    const char* baseline_path;
+    const char* save_path;
+    const char* emit_path;
+} Settings;
+
+static bool parseSettings(Settings* settings, int argc, char** argv);
+static bool parseSize(const char* text, size_t* size);
+static bool parseCount(const char* text, int* count);
+static bool measure(const Settings* settings, ProgramShape shape, size_t bytes,
+                    FILE* output, Measurement* measurement);
+static double lexOnce(const char* source, size_t* tokens_number);
+static double parseOnce(const char* source, size_t* nodes_number);
+static double runOnce(const char* source, FILE* output, bool* succeeded);
+static Summary summarize(const double* samples, size_t number);
+static void printMeasurement(const Measurement* measurement, const Measurement* previous);
+static void compareWithBaseline(const Baseline* baseline, const Measurement* measurement);
+static void compareMetric(const Baseline* baseline, const Measurement* measurement,
+                          const char* metric, Summary current, bool higher_is_better);
+static void saveMeasurement(FILE* file, const Measurement* measurement);
+static bool loadBaseline(const char* path, Baseline* baseline);
+static bool growArray(void** array, size_t* capacity, size_t element_size);
+static bool emitProgram(const Settings* settings);
+static void formatSize(size_t bytes, char* text, size_t text_size);
+static double secondsNow(void);
+static void printUsage(const char* program_name);
+
+static const int    MAX_REPETITIONS = 100;
+static const size_t DEFAULT_MIN_BYTES = 1 << 10;
+static const size_t DEFAULT_MAX_BYTES = 1 << 20;
+static const size_t DEFAULT_RUN_MAX_BYTES = 16 << 20;
+static const uint32_t JIT_THRESHOLD = 100;
+
+// Two-sided 95% quantiles of Student's t for 1 to 30 degrees of freedom;
+// beyond that the normal 1.96 is close enough.
+static const double T_QUANTILES[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+     2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+     2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+static const size_t T_QUANTILES_NUMBER = sizeof(T_QUANTILES) / sizeof(T_QUANTILES[0]);
+
+
+// public ---------------------------------------------------------------------
+
+
+int main(int argc, char** argv)
+{
+    Settings settings = {
+        .shapes        = { true, true, true, true, true },
+        .min_bytes     = DEFAULT_MIN_BYTES,
+        .max_bytes     = DEFAULT_MAX_BYTES,
+        .step          = 4,
+        .seed          = 1,
+        .warmup        = 1,
+        .repetitions   = 5,
+        .run_max_bytes = DEFAULT_RUN_MAX_BYTES,
+        .baseline_path = NULL,
+        .save_path     = NULL,
+        .emit_path     = NULL,
+    };
+
+    if (!parseSettings(&settings, argc, argv))
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (settings.emit_path != NULL)
+    {
+        return emitProgram(&settings) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    Baseline baseline = {};
+    if (settings.baseline_path != NULL && !loadBaseline(settings.baseline_path, &baseline))
+    {
+        fprintf(stderr, "Cannot read baseline %s\n", settings.baseline_path);
+        return EXIT_FAILURE;
+    }
+
+    FILE* saved = NULL;
+    if (settings.save_path != NULL)
+    {
+        saved = fopen(settings.save_path, "w");
+        if (saved == NULL)
+        {
+            fprintf(stderr, "Cannot write %s\n", settings.save_path);
+            free(baseline.entries);
+            return EXIT_FAILURE;
+        }
+        fprintf(saved, "# shape\tbytes\tmetric\tmean\thalf_width\n");
+    }
+
+    // Programs print; the output is not what is measured.
+    FILE* output = fopen("/dev/null", "w");
+    if (output == NULL)
+    {
+        fprintf(stderr, "Cannot open /dev/null\n");
+        free(baseline.entries);
+        if (saved != NULL)
+        {
+            fclose(saved);
+        }
+        return EXIT_FAILURE;
+    }
+
+    printf("synthetic programs, seed %lu, %d warmup + %d runs, mean +- 95%% CI\n",
+           settings.seed, settings.warmup, settings.repetitions);
+    printf("%-12s %9s %11s %11s  %-19s %-19s %-19s %9s\n",
+           "shape", "size", "tokens", "nodes", "lex Mtokens/s", "parse Mnodes/s", "run ms",
+           "ns/node");
+
+    bool failed = false;
+    for (size_t shape = 0; shape < PROGRAM_SHAPES_NUMBER && !failed; shape++)
+    {
+        if (!settings.shapes[shape])
+        {
+            continue;
+        }
+
+        Measurement previous = {};
+        for (size_t bytes = settings.min_bytes; bytes <= settings.max_bytes && !failed;
+             bytes *= settings.step)
+        {
+            Measurement measurement = {};
+            if (!measure(&settings, (ProgramShape)shape, bytes, output, &measurement))
+            {
+                failed = true;
+                break;
+            }
+
+            printMeasurement(&measurement, previous.bytes > 0 ? &previous : NULL);
+            compareWithBaseline(&baseline, &measurement);
+            if (saved != NULL)
+            {
+                saveMeasurement(saved, &measurement);
+            }
+            previous = measurement;
+
+            if (bytes > settings.max_bytes / settings.step)
+            {
+                break;
+            }
+        }
+    }
+
+    fclose(output);
+    free(baseline.entries);
+    if (saved != NULL && fclose(saved) != 0)
+    {
+        fprintf(stderr, "Cannot write %s\n", settings.save_path);
+        failed = true;
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static bool parseSettings(Settings* settings, int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* argument = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (strcmp(argument, "--shape") == 0 && has_value)
+        {
+            const char* name = argv[++i];
+            ProgramShape shape = ProgramShape_MIXED;
+            if (strcmp(name, "all") == 0)
+            {
+                for (size_t candidate = 0; candidate < PROGRAM_SHAPES_NUMBER; candidate++)
+                {
+                    settings->shapes[candidate] = true;
+                }
+                continue;
+            }
+            if (!programShapeFromString(name, &shape))
+            {
+                fprintf(stderr, "Unknown shape: %s\n", name);
+                return false;
+            }
+            for (size_t candidate = 0; candidate < PROGRAM_SHAPES_NUMBER; candidate++)
+            {
+                settings->shapes[candidate] = candidate == (size_t)shape;
+            }
+        }
+        else if (strcmp(argument, "--min-size") == 0 && has_value)
+        {
+            if (!parseSize(argv[++i], &settings->min_bytes))
+            {
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--max-size") == 0 && has_value)
+        {
+            if (!parseSize(argv[++i], &settings->max_bytes))
+            {
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--size") == 0 && has_value)
+        {
+            if (!parseSize(argv[++i], &settings->min_bytes))
+            {
+                return false;
+            }
+            settings->max_bytes = settings->min_bytes;
+        }
+        else if (strcmp(argument, "--step") == 0 && has_value)
+        {
+            int step = 0;
+            if (!parseCount(argv[++i], &step) || step < 2)
+            {
+                fprintf(stderr, "Step must be at least 2\n");
+                return false;
+            }
+            settings->step = (size_t)step;
+        }
+        else if (strcmp(argument, "--seed") == 0 && has_value)
+        {
+            int seed = 0;
+            if (!parseCount(argv[++i], &seed))
+            {
+                return false;
+            }
+            settings->seed = (uint64_t)seed;
+        }
+        else if (strcmp(argument, "--warmup") == 0 && has_value)
+        {
+            if (!parseCount(argv[++i], &settings->warmup))
+            {
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--repetitions") == 0 && has_value)
+        {
+            if (!parseCount(argv[++i], &settings->repetitions)
+             || settings->repetitions < 1 || settings->repetitions > MAX_REPETITIONS)
+            {
+                fprintf(stderr, "Repetitions must be between 1 and %d\n", MAX_REPETITIONS);
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--run-max-size") == 0 && has_value)
+        {
+            if (!parseSize(argv[++i], &settings->run_max_bytes))
+            {
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--baseline") == 0 && has_value)
+        {
+            settings->baseline_path = argv[++i];
+        }
+        else if (strcmp(argument, "--save-baseline") == 0 && has_value)
+        {
+            settings->save_path = argv[++i];
+        }
+        else if (strcmp(argument, "--emit") == 0 && has_value)
+        {
+            settings->emit_path = argv[++i];
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if (settings->min_bytes == 0 || settings->min_bytes > settings->max_bytes)
+    {
+        fprintf(stderr, "The smallest size must be positive and not above the largest\n");
+        return false;
+    }
+
+    return true;
+}
+
+
+// A number of bytes with an optional K, M or G suffix (powers of 1024).
+static bool parseSize(const char* text, size_t* size)
+{
+    char* end = NULL;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text)
+    {
+        fprintf(stderr, "Bad size: %s\n", text);
+        return false;
+    }
+
+    switch (*end)
+    {
+        case 'K': case 'k': value <<= 10; end++; break;
+        case 'M': case 'm': value <<= 20; end++; break;
+        case 'G': case 'g': value <<= 30; end++; break;
+        default:                                 break;
+    }
+
+    if (*end != '\0')
+    {
+        fprintf(stderr, "Bad size: %s\n", text);
+        return false;
+    }
+
+    *size = (size_t)value;
+
+    return true;
+}
+
+
+static bool parseCount(const char* text, int* count)
+{
+    char* end = NULL;
+    long value = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || value < 0 || value > 1000000000)
+    {
+        fprintf(stderr, "Bad number: %s\n", text);
+        return false;
+    }
+
+    *count = (int)value;
+
+    return true;
+}
+
+
+// Runs each phase warmup times unmeasured and then repetitions times.
+static bool measure(const Settings* settings, ProgramShape shape, size_t bytes,
+                    FILE* output, Measurement* measurement)
+{
+    size_t length = 0;
+    char* source = generateProgram(shape, bytes, settings->seed, &length);
+    if (source == NULL)
+    {
+        fprintf(stderr, "Out of memory generating %lu bytes\n", bytes);
+        return false;
+    }
+
+    *measurement = (Measurement){
+        .shape = shape,
+        .bytes = bytes,
+        .ran   = bytes <= settings->run_max_bytes,
+    };
+
+    double lex_rates[MAX_REPETITIONS];
+    double parse_rates[MAX_REPETITIONS];
+    double run_times[MAX_REPETITIONS];
+    int runs = settings->warmup + settings->repetitions;
+    bool succeeded = true;
+    for (int run = 0; run < runs && succeeded; run++)
+    {
+        int sample = run - settings->warmup;
+
+        double lex_seconds = lexOnce(source, &measurement->tokens_number);
+        double parse_seconds = parseOnce(source, &measurement->nodes_number);
+        double run_seconds = measurement->ran ? runOnce(source, output, &succeeded) : 0;
+
+        if (sample >= 0)
+        {
+            lex_rates[sample]   = (double)measurement->tokens_number / lex_seconds;
+            parse_rates[sample] = (double)measurement->nodes_number / parse_seconds;
+            run_times[sample]   = run_seconds;
+        }
+    }
+    free(source);
+
+    if (!succeeded)
+    {
+        fprintf(stderr, "The %s program of %lu bytes failed to run (seed %lu)\n",
+                programShapeToString(shape), bytes, settings->seed);
+        return false;
+    }
+
+    size_t samples = (size_t)settings->repetitions;
+    measurement->lex_rate    = summarize(lex_rates, samples);
+    measurement->parse_rate  = summarize(parse_rates, samples);
+    measurement->run_seconds = summarize(run_times, samples);
+
+    return true;
+}
+
+
+// The nextToken loop on its own, as the parser would drive it.
+static double lexOnce(const char* source, size_t* tokens_number)
+{
+    Lexer lexer = {};
+    initLexer(&lexer, source);
+
+    double start = secondsNow();
+    size_t tokens = 0;
+    for (Token token = nextToken(&lexer);
+         token.type != TOKEN_EOF && token.type != TOKEN_ERROR;
+         token = nextToken(&lexer))
+    {
+        tokens++;
+    }
+    double seconds = secondsNow() - start;
+
+    *tokens_number = tokens;
+
+    return seconds;
+}
+
+
+// Lexing and parsing into the tree; freeing it is not counted.
+static double parseOnce(const char* source, size_t* nodes_number)
+{
+    Lexer lexer = {};
+    initLexer(&lexer, source);
+    Parser parser = {};
+    initParser(&parser, &lexer);
+
+    double start = secondsNow();
+    parseProgram(&parser);
+    double seconds = secondsNow() - start;
+
+    *nodes_number = parser.ast->nodes_number;
+    dtorParser(&parser);
+
+    return seconds;
+}
+
+
+// Name resolution, compilation and the run on the VM with the JIT, as
+// --no-optimize would do them; parsing is not counted.
+static double runOnce(const char* source, FILE* output, bool* succeeded)
+{
+    Lexer lexer = {};
+    initLexer(&lexer, source);
+    Parser parser = {};
+    initParser(&parser, &lexer);
+    parseProgram(&parser);
+
+    double start = secondsNow();
+    Resolution resolution = {};
+    Chunk chunk = {};
+    chunkCtor(&chunk);
+    bool resolved = resolveProgram(parser.ast, &resolution) == ResolverState_OK;
+    bool compiled = resolved
+                 && compileProgram(parser.ast, &resolution, NULL, &chunk) == CompilerState_OK;
+
+    VM vm = {};
+    VMState state = compiled ? vmCtor(&vm, &chunk, output) : VMState_OK;
+    if (compiled && state == VMState_OK)
+    {
+        state = vmEnableJit(&vm, JIT_THRESHOLD);
+    }
+    if (compiled && state == VMState_OK)
+    {
+        state = vmRun(&vm);
+    }
+    double seconds = secondsNow() - start;
+
+    if (compiled)
+    {
+        vmDtor(&vm);
+    }
+    chunkDtor(&chunk);
+    resolutionDtor(&resolution);
+    dtorParser(&parser);
+
+    *succeeded = *succeeded && compiled && state == VMState_OK;
+
+    return seconds;
+}
+
+
+static Summary summarize(const double* samples, size_t number)
+{
+    double sum = 0;
+    for (size_t sample = 0; sample < number; sample++)
+    {
+        sum += samples[sample];
+    }
+    double mean = sum / (double)number;
+
+    if (number < 2)
+    {
+        return (Summary){ .mean = mean, .half_width = 0 };
+    }
+
+    double squares = 0;
+    for (size_t sample = 0; sample < number; sample++)
+    {
+        squares += (samples[sample] - mean) * (samples[sample] - mean);
+    }
+    double deviation = sqrt(squares / (double)(number - 1));
+    double quantile = number - 1 <= T_QUANTILES_NUMBER ? T_QUANTILES[number - 2] : 1.96;
+
+    return (Summary){ .mean = mean, .half_width = quantile * deviation / sqrt((double)number) };
+}
+
+
+// ns/node is the parse time per node; its ratio to the smaller size before
+// it, which stays near 1 while parsing scales linearly, is shown next to it.
+static void printMeasurement(const Measurement* measurement, const Measurement* previous)
+{
+    char size[16] = {};
+    formatSize(measurement->bytes, size, sizeof(size));
+
+    char lex[32] = {};
+    char parse[32] = {};
+    char run[32] = {};
+    snprintf(lex, sizeof(lex), "%.2f +- %.2f",
+             measurement->lex_rate.mean / 1e6, measurement->lex_rate.half_width / 1e6);
+    snprintf(parse, sizeof(parse), "%.2f +- %.2f",
+             measurement->parse_rate.mean / 1e6, measurement->parse_rate.half_width / 1e6);
+    if (measurement->ran)
+    {
+        snprintf(run, sizeof(run), "%.3f +- %.3f",
+                 measurement->run_seconds.mean * 1e3, measurement->run_seconds.half_width * 1e3);
+    }
+    else
+    {
+        snprintf(run, sizeof(run), "-");
+    }
+
+    double node_ns = 1e9 / measurement->parse_rate.mean;
+    printf("%-12s %9s %11lu %11lu  %-19s %-19s %-19s %9.1f",
+           programShapeToString(measurement->shape), size,
+           measurement->tokens_number, measurement->nodes_number,
+           lex, parse, run, node_ns);
+    if (previous != NULL)
+    {
+        printf("  x%.2f", node_ns / (1e9 / previous->parse_rate.mean));
+    }
+    printf("\n");
+}
+
+
+static void compareWithBaseline(const Baseline* baseline, const Measurement* measurement)
+{
+    if (baseline->entries_number == 0)
+    {
+        return;
+    }
+
+    compareMetric(baseline, measurement, "lex_tokens_per_s", measurement->lex_rate, true);
+    compareMetric(baseline, measurement, "parse_nodes_per_s", measurement->parse_rate, true);
+    if (measurement->ran)
+    {
+        compareMetric(baseline, measurement, "run_s", measurement->run_seconds, false);
+    }
+}
+
+
+// A change counts only when the two confidence intervals do not overlap.
+static void compareMetric(const Baseline* baseline, const Measurement* measurement,
+                          const char* metric, Summary current, bool higher_is_better)
+{
+    const char* shape = programShapeToString(measurement->shape);
+    for (size_t entry = 0; entry < baseline->entries_number; entry++)
+    {
+        const BaselineEntry* saved = &baseline->entries[entry];
+        if (saved->bytes != measurement->bytes || strcmp(saved->shape, shape) != 0
+         || strcmp(saved->metric, metric) != 0 || saved->mean <= 0)
+        {
+            continue;
+        }
+
+        double change = (current.mean / saved->mean - 1) * 100;
+        bool separated = fabs(current.mean - saved->mean) > current.half_width + saved->half_width;
+        bool better = (current.mean > saved->mean) == higher_is_better;
+        printf("    %-18s %+7.1f%% against the baseline%s\n", metric, change,
+               !separated ? "" : better ? ", faster" : ", SLOWER");
+        return;
+    }
+}
+
+
+static void saveMeasurement(FILE* file, const Measurement* measurement)
+{
+    const char* shape = programShapeToString(measurement->shape);
+    fprintf(file, "%s\t%lu\tlex_tokens_per_s\t%.6g\t%.6g\n", shape, measurement->bytes,
+            measurement->lex_rate.mean, measurement->lex_rate.half_width);
+    fprintf(file, "%s\t%lu\tparse_nodes_per_s\t%.6g\t%.6g\n", shape, measurement->bytes,
+            measurement->parse_rate.mean, measurement->parse_rate.half_width);
+    if (measurement->ran)
+    {
+        fprintf(file, "%s\t%lu\trun_s\t%.6g\t%.6g\n", shape, measurement->bytes,
+                measurement->run_seconds.mean, measurement->run_seconds.half_width);
+    }
+}
+
+
+static bool loadBaseline(const char* path, Baseline* baseline)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    char line[256] = {};
+    bool loaded = true;
+    while (loaded && fgets(line, sizeof(line), file) != NULL)
+    {
+        BaselineEntry entry = {};
+        if (line[0] == '#'
+         || sscanf(line, "%15s %lu %23s %lf %lf", entry.shape, &entry.bytes, entry.metric,
+                   &entry.mean, &entry.half_width) != 5)
+        {
+            continue;
+        }
+
+        if (baseline->entries_number == baseline->entries_capacity
+         && !growArray((void**)&baseline->entries, &baseline->entries_capacity,
+                       sizeof(BaselineEntry)))
+        {
+            loaded = false;
+            break;
+        }
+        baseline->entries[baseline->entries_number++] = entry;
+    }
+
+    fclose(file);
+
+    return loaded;
+}
+
+
+static bool growArray(void** array, size_t* capacity, size_t element_size)
+{
+    size_t new_capacity = *capacity == 0 ? 16 : *capacity * 2;
+    void* new_array = realloc(*array, new_capacity * element_size);
+    if (new_array == NULL)
+    {
+        return false;
+    }
+
+    *array    = new_array;
+    *capacity = new_capacity;
+
+    return true;
+}
+
+
+// Writes the program of the first chosen shape at the smallest size.
+static bool emitProgram(const Settings* settings)
+{
+    size_t shape = 0;
+    while (shape + 1 < PROGRAM_SHAPES_NUMBER && !settings->shapes[shape])
+    {
+        shape++;
+    }
+
+    size_t length = 0;
+    char* source = generateProgram((ProgramShape)shape, settings->min_bytes, settings->seed, &length);
+    if (source == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+
+    FILE* file = fopen(settings->emit_path, "w");
+    bool written = file != NULL && fwrite(source, 1, length, file) == length;
+    if (file != NULL && fclose(file) != 0)
+    {
+        written = false;
+    }
+    free(source);
+
+    if (!written)
+    {
+        fprintf(stderr, "Cannot write %s\n", settings->emit_path);
+    }
+
+    return written;
+}
+
+
+static void formatSize(size_t bytes, char* text, size_t text_size)
+{
+    if (bytes >= (1 << 30) && bytes % (1 << 30) == 0)
+    {
+        snprintf(text, text_size, "%lu GiB", bytes >> 30);
+    }
+    else if (bytes >= (1 << 20) && bytes % (1 << 20) == 0)
+    {
+        snprintf(text, text_size, "%lu MiB", bytes >> 20);
+    }
+    else if (bytes >= (1 << 10) && bytes % (1 << 10) == 0)
+    {
+        snprintf(text, text_size, "%lu KiB", bytes >> 10);
+    }
+    else
+    {
+        snprintf(text, text_size, "%lu B", bytes);
+    }
+}
+
+
+static double secondsNow(void)
+{
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+
+static void printUsage(const char* program_name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --shape NAME         expressions, statements, identifiers, control, mixed\n"
+            "                       or all (default)\n"
+            "  --min-size N         smallest program, in bytes, K, M or G (default 1K)\n"
+            "  --max-size N         largest program (default 1M, up to 1G and beyond)\n"
+            "  --size N             only this size\n"
+            "  --step N             each size is N times the one before (default 4)\n"
+            "  --seed N             seed of the generator (default 1)\n"
+            "  --warmup N           unmeasured runs per size (default 1)\n"
+            "  --repetitions N      measured runs per size (default 5)\n"
+            "  --run-max-size N     run programs on the VM up to this size (default 16M)\n"
+            "  --save-baseline PATH save the results to PATH\n"
+            "  --baseline PATH      compare with results saved before\n"
+            "  --emit PATH          write the program of --shape and --size to PATH\n",
+            program_name);
+}
@@ -0,0 +1,198 @@
+// Microbenchmarks of the run-time value representation. The makefile
+// builds this file twice, NaN-boxed and with -DVALUE_TAGGED_UNION, and
+// runs both: make bench-values.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "value.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct Benchmark
+{
+    const char* name;
+    double    (*run)(const Value* values, size_t number);
+} Benchmark;
+
+static double runChecked(const Value* values, size_t number);
+static double runStack(const Value* values, size_t number);
+static double runTruthy(const Value* values, size_t number);
+static double runEquals(const Value* values, size_t number);
+static void fillNumbers(Value* values, size_t number);
+static void fillMixed(Value* values, size_t number);
+static double secondsNow(void);
+
+static const size_t VALUES_NUMBER = 1 << 20;    // 8 or 16 MiB, more than the caches
+static const int    REPEATS       = 64;
+
+static const char* const STRINGS[] = { "", "a", "abc", "value" };
+
+
+// public ---------------------------------------------------------------------
+
+
+int main(void)
+{
+    Value* numbers = (Value*)calloc(VALUES_NUMBER, sizeof(Value));
+    Value* mixed   = (Value*)calloc(VALUES_NUMBER, sizeof(Value));
+    if (numbers == NULL || mixed == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        free(numbers);
+        free(mixed);
+        return EXIT_FAILURE;
+    }
+
+    fillNumbers(numbers, VALUES_NUMBER);
+    fillMixed(mixed, VALUES_NUMBER);
+
+    const Benchmark benchmarks[] = {
+        { .name = "checked add",  .run = runChecked },
+        { .name = "stack add",    .run = runStack   },
+        { .name = "truthy",       .run = runTruthy  },
+        { .name = "equals",       .run = runEquals  },
+    };
+
+#ifdef VALUE_TAGGED_UNION
+    printf("tagged union, %lu bytes per value\n", sizeof(Value));
+#else
+    printf("NaN boxing, %lu bytes per value\n", sizeof(Value));
+#endif
+
+    double checksum = 0;
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+    {
+        const Value* values = i < 2 ? numbers : mixed;
+
+        double start = secondsNow();
+        for (int repeat = 0; repeat < REPEATS; repeat++)
+        {
+            checksum += benchmarks[i].run(values, VALUES_NUMBER);
+        }
+        double elapsed = secondsNow() - start;
+
+        printf("  %-12s %6.3f ns/value\n", benchmarks[i].name,
+               elapsed * 1e9 / ((double)VALUES_NUMBER * REPEATS));
+    }
+
+    // Keeps the loops from being optimized away.
+    printf("  checksum     %g\n", checksum);
+
+    free(numbers);
+    free(mixed);
+
+    return EXIT_SUCCESS;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+// The VM's ADD on doubles: both tags are checked before they are added.
+static double runChecked(const Value* values, size_t number)
+{
+    Value sum = valueNumber(0);
+    for (size_t i = 0; i < number; i++)
+    {
+        if (valueIsDouble(sum) && valueIsDouble(values[i]))
+        {
+            sum = valueNumber(valueAsDouble(sum) + valueAsDouble(values[i]));
+        }
+    }
+
+    return valueAsDouble(sum);
+}
+
+
+// Pushes pairs onto an operand stack, adds them there and pops the result,
+// so values move through memory as they do in the VM.
+static double runStack(const Value* values, size_t number)
+{
+    Value  stack[64] = {};
+    Value* sp = stack;
+    double total = 0;
+
+    for (size_t i = 0; i + 1 < number; i += 2)
+    {
+        *sp++ = values[i];
+        *sp++ = values[i + 1];
+        if (valueIsDouble(sp[-2]) && valueIsDouble(sp[-1]))
+        {
+            sp[-2] = valueNumber(valueAsDouble(sp[-2]) + valueAsDouble(sp[-1]));
+        }
+        sp--;
+        total += valueAsDouble(*--sp);
+    }
+
+    return total;
+}
+
+
+static double runTruthy(const Value* values, size_t number)
+{
+    size_t truthy = 0;
+    for (size_t i = 0; i < number; i++)
+    {
+        truthy += valueIsTruthy(values[i]);
+    }
+
+    return (double)truthy;
+}
+
+
+static double runEquals(const Value* values, size_t number)
+{
+    size_t equal = 0;
+    for (size_t i = 1; i < number; i++)
+    {
+        equal += valueEquals(values[i - 1], values[i]);
+    }
+
+    return (double)equal;
+}
+
+
+static void fillNumbers(Value* values, size_t number)
+{
+    for (size_t i = 0; i < number; i++)
+    {
+        values[i] = valueNumber((double)(i % 1000) * 0.5);
+    }
+}
+
+
+// Mostly numbers, as in real programs, with bools and strings between them.
+static void fillMixed(Value* values, size_t number)
+{
+    unsigned state = 12345;
+    for (size_t i = 0; i < number; i++)
+    {
+        state = state * 1103515245 + 12345;
+        unsigned kind = (state >> 16) % 8;
+        if (kind < 5)
+        {
+            values[i] = valueNumber((double)((state >> 8) % 3));
+        }
+        else if (kind < 7)
+        {
+            values[i] = valueBool(kind == 5);
+        }
+        else
+        {
+            values[i] = valueString(STRINGS[(state >> 4) % 4]);
+        }
+    }
+}
+
+
+static double secondsNow(void)
+{
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
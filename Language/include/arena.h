@@ -0,0 +1,47 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+
+typedef struct ArenaChunk ArenaChunk;
+typedef struct ArenaObject ArenaObject;
+
+// Bump allocator for objects that live as long as the arena, e.g. the
+// copies of string constants. Objects from arenaAllocObject, such as the
+// strings, boxes and arrays a run builds, can instead go away while the
+// arena lives: its owner marks the ones it can still reach and arenaSweep
+// frees the others.
+typedef struct Arena
+{
+    ArenaChunk*  head;
+    size_t       allocated_bytes;
+    size_t       reserved_bytes;
+    ArenaObject* objects;           // newest first
+    ArenaObject* free_objects;      // swept small objects, reused first
+    size_t       object_bytes;      // of objects, headers included
+    size_t       sweep_threshold;   // object_bytes worth a mark and sweep
+} Arena;
+
+void arenaCtor(Arena* arena);
+void* arenaAlloc(Arena* arena, size_t size);
+char* arenaStrndup(Arena* arena, const char* text, size_t length);
+void arenaReset(Arena* arena);
+void arenaDtor(Arena* arena);
+
+// An object arenaSweep frees unless arenaMarkObject was called on it since
+// the last sweep; aligned like arenaAlloc. Freed objects of up to 16 bytes
+// are kept for the next small ones, so a run that keeps replacing boxed
+// integers reuses the same memory.
+void* arenaAllocObject(Arena* arena, size_t size);
+void arenaMarkObject(void* object);
+void arenaSweep(Arena* arena);
+
+// True once the objects allocated since the last sweep outweigh the ones
+// it kept (and at least a megabyte), so sweeping costs a constant time per
+// allocated byte.
+static inline bool arenaShouldSweep(const Arena* arena)
+{
+    return arena->object_bytes >= arena->sweep_threshold;
+}
+
+#endif
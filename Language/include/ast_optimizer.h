@@ -0,0 +1,40 @@
+#ifndef AST_OPTIMIZER_H
+#define AST_OPTIMIZER_H
+
+#include <stdlib.h>
+
+#include "tree.h"
+
+typedef struct OptimizerStatistics
+{
+    size_t folded_expressions;    // constant subtrees replaced by their value
+    size_t simplified_identities; // x*1, x-0, x/1, !!x, ...
+    size_t propagated_constants;  // variable reads replaced by the constant they hold
+    size_t resolved_branches;     // ifs whose condition is a constant
+    size_t removed_loops;         // while loops whose condition is falsy
+    size_t unreachable_statements;// statements after a loop that never ends
+    size_t reused_expressions;    // subexpressions replaced by a saved value
+    size_t hoisted_expressions;   // loop-invariant expressions computed before the loop
+    size_t reduced_multiplications;// i * k replaced by a running sum
+    size_t unrolled_loops;        // loops given an unrolled copy
+    size_t temporaries;           // compiler-generated "$tN" variables
+    size_t nodes_removed;         // nodes no longer reachable from the root
+} OptimizerStatistics;
+
+// Folds NUMBER, INTEGER and BOOL subtrees for every operator and applies
+// identities that hold for every double and integer, rewriting the tree in
+// place. Only the integer literals 1 and 0 qualify: x * 1.0 turns an integer
+// into a double. x*0 is kept because x may be NaN, infinite or negative,
+// and x+0 is kept because -0 + 0 is +0, while x + -0 makes integers doubles.
+// Operations that would fail at run time (true + 1) are left for the
+// backend to report. statistics may be NULL.
+void foldConstants(Tree* ast, OptimizerStatistics* statistics);
+
+// Removes code that can never run once conditions are constant: an if with
+// a constant condition becomes the chosen branch, while loops with a falsy
+// condition disappear, nested blocks are spliced into their parent list and
+// statements after a loop that never ends are dropped. Variables that lose
+// every assignment read as 0, exactly as before. Run foldConstants first.
+void eliminateDeadCode(Tree* ast, OptimizerStatistics* statistics);
+
+#endif
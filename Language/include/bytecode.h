@@ -0,0 +1,188 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "value.h"
+#include "arena.h"
+
+// Every instruction is one 32-bit word: the opcode in the low byte and an
+// unsigned 24-bit operand (slot, constant index or absolute jump target)
+// in the rest.
+typedef uint32_t Instruction;
+
+typedef enum Opcode
+{
+    OP_CONSTANT      = 0,
+    OP_TRUE          = 1,
+    OP_FALSE         = 2,
+    OP_LOAD          = 3,
+    OP_STORE         = 4,
+    OP_POP           = 5,
+    OP_ADD           = 6,
+    OP_SUBTRACT      = 7,
+    OP_MULTIPLY      = 8,
+    OP_DIVIDE        = 9,
+    OP_MODULO        = 10,
+    OP_EQUAL         = 11,
+    OP_NOT_EQUAL     = 12,
+    OP_LESS          = 13,
+    OP_GREATER       = 14,
+    OP_LESS_EQUAL    = 15,
+    OP_GREATER_EQUAL = 16,
+    OP_NOT           = 17,
+    OP_NEGATE        = 18,
+    OP_TRUTHY        = 19,
+    OP_JUMP          = 20,
+    OP_JUMP_IF_FALSE = 21,
+    OP_JUMP_IF_TRUE  = 22,
+    OP_PRINT         = 23,
+    OP_HALT          = 24,
+
+    // Operands proven to be doubles by type inference, so these compute on
+    // the raw doubles without checking a tag.
+    OP_ADD_DOUBLE           = 25,
+    OP_SUBTRACT_DOUBLE      = 26,
+    OP_MULTIPLY_DOUBLE      = 27,
+    OP_DIVIDE_DOUBLE        = 28,
+    OP_MODULO_DOUBLE        = 29,
+    OP_LESS_DOUBLE          = 30,
+    OP_GREATER_DOUBLE       = 31,
+    OP_LESS_EQUAL_DOUBLE    = 32,
+    OP_GREATER_EQUAL_DOUBLE = 33,
+    OP_NEGATE_DOUBLE        = 34,
+
+    // Written by the peephole pass only. Each one does the work of the two
+    // plain instructions instructionUnfuse splits it into, in one dispatch.
+    OP_STORE_KEEP                 = 35,     // STORE x, LOAD x
+    OP_JUMP_IF_LESS               = 36,     // LESS, JUMP_IF_TRUE
+    OP_JUMP_IF_NOT_LESS           = 37,     // LESS, JUMP_IF_FALSE
+    OP_JUMP_IF_GREATER            = 38,
+    OP_JUMP_IF_NOT_GREATER        = 39,
+    OP_JUMP_IF_LESS_EQUAL         = 40,
+    OP_JUMP_IF_NOT_LESS_EQUAL     = 41,
+    OP_JUMP_IF_GREATER_EQUAL      = 42,
+    OP_JUMP_IF_NOT_GREATER_EQUAL  = 43,
+    OP_JUMP_IF_EQUAL              = 44,     // EQUAL, JUMP_IF_TRUE
+    OP_JUMP_IF_NOT_EQUAL          = 45,     // EQUAL, JUMP_IF_FALSE
+
+    // Superinstructions for the most frequent pairs make profile-pairs
+    // found in the benchmarks. Their operand holds two 12-bit fields.
+    OP_LOAD_CONSTANT              = 46,     // LOAD slot, CONSTANT index
+    OP_STORE_LOAD                 = 47,     // STORE slot, LOAD slot
+    OP_CONSTANT_BINARY            = 48,     // CONSTANT index, then a binary opcode
+    OP_LOAD_BINARY                = 49,     // LOAD slot, then a binary opcode
+
+    // Pops a value and jumps through chunk->switches[operand], or falls
+    // through when no case matches. Written for else-if equality ladders.
+    OP_SWITCH                     = 50,
+
+    // Arrays: a[i], appending one element, wrapping a number into a
+    // one-element array, len() and array(n, x).
+    OP_INDEX                      = 51,
+    OP_APPEND                     = 52,
+    OP_ARRAY                      = 53,
+    OP_LENGTH                     = 54,
+    OP_FILL                       = 55,
+} Opcode;
+
+const int OPCODES_NUMBER = 56;
+
+const int      OPERAND_SHIFT = 8;
+const uint32_t OPCODE_MASK   = 0xFF;
+const uint32_t MAX_OPERAND   = (1u << 24) - 1;
+
+const int      PAIRED_OPERAND_SHIFT = 12;
+const uint32_t MAX_PAIRED_OPERAND   = (1u << 12) - 1;
+
+static inline Instruction makeInstruction(Opcode opcode, uint32_t operand)
+{
+    return (uint32_t)opcode | (operand << OPERAND_SHIFT);
+}
+
+static inline Opcode instructionOpcode(Instruction instruction)
+{
+    return (Opcode)(instruction & OPCODE_MASK);
+}
+
+static inline uint32_t instructionOperand(Instruction instruction)
+{
+    return instruction >> OPERAND_SHIFT;
+}
+
+static inline uint32_t makePairedOperand(uint32_t first, uint32_t second)
+{
+    return first | (second << PAIRED_OPERAND_SHIFT);
+}
+
+static inline uint32_t operandFirst(uint32_t operand)
+{
+    return operand & MAX_PAIRED_OPERAND;
+}
+
+static inline uint32_t operandSecond(uint32_t operand)
+{
+    return operand >> PAIRED_OPERAND_SHIFT;
+}
+
+// The cases of one OP_SWITCH. A dense table covers every integer from
+// minimum on, and the ones that are no case jump where the SWITCH falls
+// through; a sparse one keeps its case values sorted in keys for a binary
+// search. Both hold one jump target per entry.
+typedef struct SwitchTable
+{
+    int64_t*  keys;             // NULL for a dense table
+    int64_t   minimum;
+    uint32_t* targets;
+    uint32_t  entries_number;
+} SwitchTable;
+
+typedef struct Chunk
+{
+    Instruction* code;
+    int*         lines;
+    size_t       code_size;
+    size_t       code_capacity;
+
+    Value*       constants;
+    size_t       constants_number;
+    size_t       constants_capacity;
+
+    const char** slot_names;    // owned by names_arena
+    size_t       slots_number;
+    size_t       max_stack;
+
+    SwitchTable* switches;      // keys and targets are owned by the chunk
+    size_t       switches_number;
+    size_t       switches_capacity;
+
+    Arena        names_arena;   // copies of string constants, boxed integers and slot names
+} Chunk;
+
+void chunkCtor(Chunk* chunk);
+bool chunkWrite(Chunk* chunk, Instruction instruction, int line);
+bool chunkAddConstant(Chunk* chunk, Value value, uint32_t* index);
+
+// Takes over the arrays of table, also when it fails.
+bool chunkAddSwitch(Chunk* chunk, SwitchTable table, uint32_t* index);
+
+// The entry of table whose case equals value, as valueEquals decides, or
+// entries_number when there is none.
+uint32_t switchTableFind(const SwitchTable* table, Value value);
+void chunkDtor(Chunk* chunk);
+
+const char* opcodeToString(Opcode opcode);
+int opcodeStackEffect(Opcode opcode);
+bool opcodeHasJumpTarget(Opcode opcode);
+
+// The TokenType valueBinaryOperation or valueUnaryOperation takes for an
+// operator opcode, TOKEN_ERROR for the others.
+int opcodeOperation(Opcode opcode);
+
+// Writes the plain instructions a fused one stands for to parts and returns
+// 2; any other instruction is copied to parts[0] and 1 is returned.
+size_t instructionUnfuse(Instruction instruction, Instruction parts[2]);
+void chunkDisassemble(const Chunk* chunk, FILE* output);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef C_CODEGEN_H
+#define C_CODEGEN_H
+
+#include <stdio.h>
+
+#include "tree.h"
+#include "resolver.h"
+#include "type_inference.h"
+
+typedef enum CCodegenState
+{
+    CCodegenState_OK          = 0,
+    CCodegenState_BAD_TREE    = 1,
+    CCodegenState_WRITE_ERROR = 2,
+    CCodegenState_UNSUPPORTED = 3,
+} CCodegenState;
+
+// Emits the program as one standalone C99 file that builds with
+// "cc -O2 program.c -lm" and prints and fails exactly as the tree walker
+// does. Every variable is a local of main, if and while become C branches
+// and loops, and each expression is computed into its own temporary in
+// evaluation order. The runtime the code calls is copied into the file:
+// a tagged Value and inline operations with the same integer, double and
+// string semantics as value.cpp. types may be NULL; with them arithmetic
+// and comparisons on numbers skip their type checks. Arrays have no C
+// counterpart yet: they are reported on stderr and give UNSUPPORTED.
+CCodegenState generateCSource(Tree* ast, const Resolution* resolution,
+                              const TypeInference* types, FILE* output);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef COMMON_SUBEXPRESSIONS_H
+#define COMMON_SUBEXPRESSIONS_H
+
+#include "tree.h"
+#include "ast_optimizer.h"
+
+// Local common subexpression elimination over straight-line statement runs.
+// Expressions get value numbers from (operation, operand value numbers);
+// assigning a variable gives it a new number, so nothing computed from its
+// old value matches afterwards. A repeated expression reads the variable
+// that already holds the value, or a "$tN" temporary assigned right before
+// the statement with the first occurrence. if and while statements end the
+// run; their bodies are separate runs. Returns false when out of memory,
+// leaving a tree that is still correct.
+bool eliminateCommonSubexpressions(Tree* ast, OptimizerStatistics* statistics);
+
+#endif
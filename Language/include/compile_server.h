@@ -0,0 +1,72 @@
+#ifndef COMPILE_SERVER_H
+#define COMPILE_SERVER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+// One run of the driver as a client asked for it: the client's arguments
+// (argv[0] is its program name) and, when it read the program from stdin,
+// the source text; otherwise the path in argv is read on the server, from
+// the client's working directory.
+typedef struct CompileRequest
+{
+    int          argc;
+    char**       argv;
+    const char*  source;        // NULL to read the path in argv
+} CompileRequest;
+
+// What the server calls for each request. key gives everything the output
+// depends on as key_length bytes allocated from arena, which lives until
+// the request is answered, or false when the run also has other effects
+// (written files, timings) and must not come from the cache. A cached
+// result is only reused for the very same bytes. run returns
+// the exit code and is called in a child process, so it may end it with
+// exit(); both write to stdout and stderr, which the server sends back to
+// the client. key runs in the server itself, right before run, and may
+// leave what it loaded in context for run to use.
+typedef struct CompileServerHandler
+{
+    bool  (*key)(const CompileRequest* request, Arena* arena, const char** key,
+                 size_t* key_length, void* context);
+    int   (*run)(const CompileRequest* request, void* context);
+    void*   context;
+} CompileServerHandler;
+
+typedef struct CompileServerStatistics
+{
+    uint64_t requests;
+    uint64_t cache_hits;
+    uint64_t failed_requests;   // malformed, cut off, timed out or from another user
+} CompileServerStatistics;
+
+// Listens on a Unix domain socket at socket_path and serves one request
+// at a time until a client asks it to shut down, so a run skips exec,
+// dynamic linking and libc startup: it happens in a child forked from the
+// server. The child keeps nothing for later runs, so what carries over
+// from one request to the next is the cache of recent results with a
+// key. Each run happens in the client's working directory with its
+// output captured. A stale socket file left by a server that died is
+// replaced, but not a file that is not this user's socket, and clients
+// running as another user are turned away. A client that stops sending
+// or reading for ten seconds is dropped so it cannot hold up the others. False when the socket cannot be set up; the reason is on
+// stderr.
+bool compileServerServe(const char* socket_path, const CompileServerHandler* handler,
+                        CompileServerStatistics* statistics);
+
+// Forwards the arguments to the server at socket_path, writes what the run
+// printed to stdout and stderr and returns its exit code, or EXIT_FAILURE
+// with a message when the server cannot be reached. source may be NULL.
+int compileClientRun(const char* socket_path, int argc, char** argv, const char* source);
+
+// Asks the server at socket_path to stop after the running request.
+bool compileClientShutdown(const char* socket_path);
+
+// The socket the client uses when none is given: language.sock in
+// $XDG_RUNTIME_DIR, or else in /tmp/language-<uid>, which is created with
+// mode 0700. False with the reason on stderr when that directory is not
+// this user's alone, since whoever can write to it could pose as the server.
+bool compileServerDefaultPath(char* buffer, size_t buffer_size);
+
+#endif
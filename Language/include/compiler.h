@@ -0,0 +1,26 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "tree.h"
+#include "resolver.h"
+#include "bytecode.h"
+#include "type_inference.h"
+
+typedef enum CompilerState
+{
+    CompilerState_OK           = 0,
+    CompilerState_TOO_LARGE    = 1,
+    CompilerState_BAD_TREE     = 2,
+    CompilerState_MEMORY_ERROR = 3,
+} CompilerState;
+
+// Lowers a resolved AST into chunk. The chunk copies every string it needs,
+// so it stays valid after the tree is destroyed. With types (may be NULL)
+// arithmetic and comparisons on operands inferred to be numbers use the
+// unchecked _NUMBER opcodes.
+CompilerState compileProgram(Tree* ast, const Resolution* resolution,
+                             const TypeInference* types, Chunk* chunk);
+
+const char* compilerStateToString(CompilerState state);
+
+#endif
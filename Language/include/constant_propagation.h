@@ -0,0 +1,17 @@
+#ifndef CONSTANT_PROPAGATION_H
+#define CONSTANT_PROPAGATION_H
+
+#include "tree.h"
+#include "ast_optimizer.h"
+
+// Sparse conditional constant propagation (Wegman and Zadeck) over the SSA
+// form of the program. A value is constant when it is the same on every
+// edge that can run, and an edge only runs when the branch before it can
+// take it, so a variable assigned in a branch that never runs does not
+// spoil the value at the merge. Reads of variables that hold a number or
+// bool constant become literals; run foldConstants and eliminateDeadCode
+// afterwards to fold them and resolve the branches they decide. Returns
+// false when out of memory, leaving a tree that is still correct.
+bool propagateConstants(Tree* ast, OptimizerStatistics* statistics);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef HARDWARE_COUNTERS_H
+#define HARDWARE_COUNTERS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef enum HardwareEvent
+{
+    HardwareEvent_CYCLES          = 0,
+    HardwareEvent_INSTRUCTIONS    = 1,
+    HardwareEvent_BRANCH_MISSES   = 2,
+    HardwareEvent_L1D_READ_MISSES = 3,
+    HardwareEvent_LLC_READ_MISSES = 4,
+} HardwareEvent;
+
+const size_t HARDWARE_EVENTS_NUMBER = 5;
+
+// One perf_event_open descriptor per event, counting this process in user
+// space. Events are opened one by one, so a CPU or a virtual machine that
+// lacks one of them still reports the others.
+typedef struct HardwareCounters
+{
+    int descriptors[HARDWARE_EVENTS_NUMBER];    // -1 when not available
+    int error;                                  // errno of the first event that failed
+} HardwareCounters;
+
+// False when no event could be opened: outside Linux, without a PMU, or
+// when perf_event_paranoid forbids it; error then tells why.
+bool hardwareCountersCtor(HardwareCounters* counters);
+void hardwareCountersDtor(HardwareCounters* counters);
+
+bool hardwareCounterAvailable(const HardwareCounters* counters, HardwareEvent event);
+
+// Totals since the counters were opened, scaled up when the kernel had to
+// share the PMU with other events; unavailable events read as 0.
+void hardwareCountersRead(const HardwareCounters* counters,
+                          uint64_t values[HARDWARE_EVENTS_NUMBER]);
+
+const char* hardwareEventToString(HardwareEvent event);
+
+#endif
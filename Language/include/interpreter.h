@@ -0,0 +1,40 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <stdio.h>
+
+#include "tree.h"
+#include "value.h"
+#include "arena.h"
+#include "resolver.h"
+#include "profiler.h"
+
+typedef enum InterpreterState
+{
+    InterpreterState_OK            = 0,
+    InterpreterState_RESOLVE_ERROR = 1,
+    InterpreterState_RUNTIME_ERROR = 2,
+    InterpreterState_MEMORY_ERROR  = 3,
+} InterpreterState;
+
+// Walks the AST directly. Variables live in a flat frame indexed by the
+// slots the resolver assigned, so no name is looked up while running.
+typedef struct Interpreter
+{
+    Tree*            ast;
+    Resolution       resolution;
+    Value*           frame;
+    Arena            arena;
+    FILE*            output;
+    Profile*         profile;       // NULL unless the run is profiled
+    InterpreterState state;
+    char             error_message[RUNTIME_ERROR_BUFFER_SIZE];
+} Interpreter;
+
+InterpreterState interpreterCtor(Interpreter* interpreter, Tree* ast, FILE* output);
+InterpreterState interpretProgram(Interpreter* interpreter);
+// Counts and times every statement and operator the run executes.
+void interpreterEnableProfile(Interpreter* interpreter, Profile* profile);
+void interpreterDtor(Interpreter* interpreter);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "bytecode.h"
+#include "value.h"
+#include "arena.h"
+
+// The JIT writes x86-64 machine code for the System V calling convention
+// and relies on the NaN-boxed Value, so it is only built there; elsewhere
+// jitCompileLoop rejects every loop and the VM keeps interpreting.
+#if defined(__x86_64__) && defined(__linux__) && !defined(VALUE_TAGGED_UNION)
+    #define JIT_X86_64
+#endif
+
+// What compiled code needs from the VM for the instructions it hands back
+// to C: the arena for boxed integers and concatenations, the output, and
+// the VM's frame and stack, which hold every value the arena sweep keeps.
+typedef struct JitRuntime
+{
+    Arena*  arena;
+    FILE*   output;
+    Value*  frame;
+    size_t  frame_size;
+    Value*  stack;
+} JitRuntime;
+
+// Runs a loop from its first instruction with the operand stack empty,
+// until control leaves the loop or an instruction fails. Returns the
+// offset the VM continues at in the low 32 bits and the operand stack
+// depth there in the high 32 bits.
+typedef uint64_t (*JitCode)(Value* frame, Value* stack, JitRuntime* runtime);
+
+typedef struct JitStatistics
+{
+    size_t compiled_loops;
+    size_t rejected_loops;
+    size_t code_bytes;
+    size_t entries;         // times the VM ran compiled code
+} JitStatistics;
+
+typedef struct JitMapping
+{
+    void*  address;
+    size_t size;
+} JitMapping;
+
+typedef struct Jit
+{
+    const Chunk*  chunk;
+    JitRuntime    runtime;
+    uint32_t      threshold;
+
+    uint32_t*     iterations;   // loop start offset -> back edges taken while interpreted
+    JitCode*      loops;        // loop start offset -> compiled code or NULL
+
+    JitMapping*   mappings;     // executable pages, one mapping per loop
+    size_t        mappings_number;
+    size_t        mappings_capacity;
+
+    JitStatistics statistics;
+} Jit;
+
+// A loop is compiled after threshold iterations in the interpreter.
+bool jitCtor(Jit* jit, const Chunk* chunk, Arena* arena, Value* frame, Value* stack,
+             FILE* output, uint32_t threshold);
+void jitDtor(Jit* jit);
+
+// Compiles the loop whose back edge at end jumps to start. The code keeps
+// values NaN-boxed in the VM's frame and stack, computes on unboxed doubles
+// and small integers inline and calls into C for everything else, so it
+// runs any loop the VM does; NULL when the loop is rejected.
+JitCode jitCompileLoop(Jit* jit, uint32_t start, uint32_t end);
+
+// Called on every back edge the VM takes: counts the iteration and compiles
+// the loop once it is hot. NULL means keep interpreting.
+JitCode jitBackEdge(Jit* jit, uint32_t start, uint32_t end);
+
+#endif
@@ -36,6 +36,14 @@ typedef enum TokenType
     TOKEN_RBRACE        = 27,
     TOKEN_SEMICOLON     = 28,
     TOKEN_ERROR         = 29,
+    TOKEN_KEYWORD_TRUE  = 30,
+    TOKEN_KEYWORD_FALSE = 31,
+    TOKEN_INTEGER       = 32,   // a NUMBER without a fractional part
+    TOKEN_LBRACKET      = 33,
+    TOKEN_RBRACKET      = 34,
+    TOKEN_COMMA         = 35,
+    TOKEN_KEYWORD_LEN   = 36,
+    TOKEN_KEYWORD_ARRAY = 37,
 } TokenType;
 
 typedef struct Token
@@ -65,6 +73,10 @@ const Keyword KEYWORD_ARRAY[] = {
     {.keyword = "else" , .type = TOKEN_KEYWORD_ELSE },
     {.keyword = "while", .type = TOKEN_KEYWORD_WHILE},
     {.keyword = "print", .type = TOKEN_PRINT        },
+    {.keyword = "true" , .type = TOKEN_KEYWORD_TRUE },
+    {.keyword = "false", .type = TOKEN_KEYWORD_FALSE},
+    {.keyword = "len"  , .type = TOKEN_KEYWORD_LEN  },
+    {.keyword = "array", .type = TOKEN_KEYWORD_ARRAY},
 };
 
 const size_t KEYWORD_ARRAY_LENGTH = sizeof(KEYWORD_ARRAY) / sizeof(Keyword);
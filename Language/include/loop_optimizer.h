@@ -0,0 +1,40 @@
+#ifndef LOOP_OPTIMIZER_H
+#define LOOP_OPTIMIZER_H
+
+#include "tree.h"
+#include "ast_optimizer.h"
+
+// Loop-invariant code motion for while loops. An expression in the
+// condition or body whose variables are never assigned anywhere in the loop
+// is computed once into a "$tN" temporary before it. Only expressions that
+// cannot fail at run time move: their operands are provably numbers (every
+// assignment of those variables stores a number) or the operator accepts
+// any value (==, !=, !, &&, ||), so hoisting one out of a branch that never
+// runs changes nothing. The loop becomes
+//     if (condition) { $t0 = invariant; while (condition') { ... } }
+// so a loop that runs zero times computes nothing. Inner loops are handled
+// first, so an expression moved out of an inner loop can move again out of
+// the loop around it.
+// Returns false when out of memory, leaving a tree that is still correct.
+bool hoistLoopInvariants(Tree* ast, OptimizerStatistics* statistics);
+
+// Both passes below work on loops over an induction variable:
+//     i = start; ... while (i < limit) { ... i = i + step; ... }
+// where start, limit and step are integer literals, the comparison goes in
+// the direction of the step, and the body assigns i only in that one
+// top-level statement. Only loops whose i stays an exact integer are
+// touched, so the results match the loop as written bit for bit.
+
+// Strength reduction: products i * k with a positive integer literal k that
+// occur at least twice in the loop share a "$tN" temporary that starts at
+// start * k and grows by step * k after each increment of i.
+bool reduceInductionStrength(Tree* ast, OptimizerStatistics* statistics);
+
+// Unrolls small loops without inner loops by factor: a copy
+//     while (i + (factor - 1) * step < limit) { body ... body }
+// runs first while factor iterations are left, and the original loop does
+// the rest. Returns false when out of memory, leaving a tree that is still
+// correct.
+bool unrollLoops(Tree* ast, int factor, OptimizerStatistics* statistics);
+
+#endif
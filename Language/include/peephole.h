@@ -0,0 +1,30 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "bytecode.h"
+
+typedef struct PeepholeStatistics
+{
+    size_t threaded_jumps;          // jumps sent straight to where a jump chain ends
+    size_t removed_instructions;    // unreachable code, LOAD x STORE x, TRUTHY before a branch
+    size_t fused_branches;          // comparisons merged into the jump they feed
+    size_t superinstructions;       // pairs merged into one fused instruction
+} PeepholeStatistics;
+
+// Rewrites the instruction stream of a compiled chunk in place so that the
+// VM dispatches fewer instructions for the same work:
+//   - a jump to a JUMP, or to TRUE/FALSE followed by a conditional jump,
+//     goes directly where that leads (the else-if ladders), without ever
+//     turning a forward jump into a backward one, and code no path reaches
+//     any more is removed;
+//   - STORE x LOAD x becomes STORE_KEEP x, LOAD x STORE x disappears, and
+//     TRUTHY or NOT before a conditional jump is folded into the jump;
+//   - a comparison followed by a conditional jump becomes one JUMP_IF_*;
+//   - CONSTANT or LOAD followed by a binary operator, LOAD CONSTANT and
+//     STORE LOAD become superinstructions.
+// Two instructions are only merged when no jump lands on the second one.
+// statistics may be NULL. Returns false when out of memory, leaving a
+// chunk that is still correct.
+bool optimizeBytecode(Chunk* chunk, PeepholeStatistics* statistics);
+
+#endif
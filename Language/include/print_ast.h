@@ -4,6 +4,9 @@
 #include "tree.h"
 #include "syntactic_analysis.h"
 
+const char* syntaxNodeTypeToString(SyntaxNodeType type);
+const char* tokenTypeToString(int type);
+
 void printAST(Tree* tree, int node_index, int indent_level);
 void printASTFromRoot(Tree* tree);
 
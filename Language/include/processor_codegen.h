@@ -0,0 +1,25 @@
+#ifndef PROCESSOR_CODEGEN_H
+#define PROCESSOR_CODEGEN_H
+
+#include <stdio.h>
+
+#include "tree.h"
+#include "resolver.h"
+
+typedef enum ProcessorCodegenState
+{
+    ProcessorCodegenState_OK          = 0,
+    ProcessorCodegenState_UNSUPPORTED = 1,
+    ProcessorCodegenState_BAD_TREE    = 2,
+    ProcessorCodegenState_WRITE_ERROR = 3,
+} ProcessorCodegenState;
+
+// Emits assembly for the Processor stack machine (see processor_emulator.h
+// for the instruction set). Every variable lives in the RAM cell with the
+// number of its slot and the cell right after them is a scratch cell. The
+// machine only knows numbers: booleans become 1 and 0 (so print shows 1/0
+// instead of true/false), and string values are rejected.
+ProcessorCodegenState generateProcessorAssembly(Tree* ast, const Resolution* resolution,
+                                                FILE* output);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef PROCESSOR_EMULATOR_H
+#define PROCESSOR_EMULATOR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Stand-in for the Processor submodule: assembles and runs its text
+// assembly so programs can be checked end to end without the submodule.
+//
+// The machine has a stack of doubles and a RAM of doubles.
+//   push N        push the number N
+//   push [A]      push RAM cell A
+//   pop [A]       pop into RAM cell A
+//   pop           pop and drop
+//   add sub mul div mod
+//                 pop b, pop a, push a op b (mod truncates like fmod)
+//   out           pop and print the number on its own line
+//   jmp L         jump to label L
+//   ja jae jb jbe je jne L
+//                 pop b, pop a, jump if a > b, >=, <, <=, ==, != (IEEE)
+//   hlt           stop
+// Labels are written as "name:" on their own line, ';' starts a comment.
+
+typedef enum ProcessorOpcode
+{
+    ProcessorOpcode_PUSH_NUMBER = 0,
+    ProcessorOpcode_PUSH_MEMORY = 1,
+    ProcessorOpcode_POP_MEMORY  = 2,
+    ProcessorOpcode_POP         = 3,
+    ProcessorOpcode_ADD         = 4,
+    ProcessorOpcode_SUB         = 5,
+    ProcessorOpcode_MUL         = 6,
+    ProcessorOpcode_DIV         = 7,
+    ProcessorOpcode_MOD         = 8,
+    ProcessorOpcode_OUT         = 9,
+    ProcessorOpcode_JMP         = 10,
+    ProcessorOpcode_JA          = 11,
+    ProcessorOpcode_JAE         = 12,
+    ProcessorOpcode_JB          = 13,
+    ProcessorOpcode_JBE         = 14,
+    ProcessorOpcode_JE          = 15,
+    ProcessorOpcode_JNE         = 16,
+    ProcessorOpcode_HLT         = 17,
+} ProcessorOpcode;
+
+typedef struct ProcessorInstruction
+{
+    ProcessorOpcode opcode;
+    size_t          argument;   // RAM address or jump target
+    double          number;
+} ProcessorInstruction;
+
+typedef struct ProcessorProgram
+{
+    ProcessorInstruction* code;
+    size_t                code_size;
+    size_t                ram_size;
+} ProcessorProgram;
+
+typedef enum ProcessorState
+{
+    ProcessorState_OK              = 0,
+    ProcessorState_SYNTAX_ERROR    = 1,
+    ProcessorState_UNKNOWN_LABEL   = 2,
+    ProcessorState_STACK_UNDERFLOW = 3,
+    ProcessorState_MEMORY_ERROR    = 4,
+} ProcessorState;
+
+ProcessorState processorAssemble(const char* source, ProcessorProgram* program);
+ProcessorState processorRun(const ProcessorProgram* program, FILE* output);
+void processorProgramDtor(ProcessorProgram* program);
+
+const char* processorStateToString(ProcessorState state);
+
+#endif
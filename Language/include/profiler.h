@@ -0,0 +1,68 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "tree.h"
+
+// The time stamp counter costs a few cycles to read; elsewhere the
+// monotonic clock stands in for it, in nanoseconds.
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define PROFILER_RDTSC
+#endif
+
+typedef struct NodeProfile
+{
+    uint64_t count;         // times the node ran
+    uint64_t ticks;         // including the nodes it ran
+} NodeProfile;
+
+// Per-node execution counts and times of one run of the tree interpreter,
+// indexed like Tree::nodes_array. The interpreter only looks at it when it
+// is given one, so a run without --profile pays nothing for it.
+typedef struct Profile
+{
+    const Tree*  ast;
+    NodeProfile* nodes;
+    size_t       nodes_number;
+
+    uint64_t     start_ticks;
+    uint64_t     total_ticks;
+    double       start_seconds;
+    double       seconds;
+} Profile;
+
+bool profileCtor(Profile* profile, const Tree* ast);
+void profileDtor(Profile* profile);
+
+// Brackets the run, so ticks can be converted to time.
+void profileStart(Profile* profile);
+void profileStop(Profile* profile);
+
+static inline uint64_t profileTicks(void)
+{
+#ifdef PROFILER_RDTSC
+    return __rdtsc();
+#else
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// Counts one run of node that began at start_ticks.
+void profileRecord(Profile* profile, int node, uint64_t start_ticks);
+
+// Self time is a node's time minus that of the profiled nodes under it.
+// Prints the top nodes by self time with their source lines.
+bool profilePrintHotspots(const Profile* profile, FILE* output, size_t top);
+
+// One line per profiled node, "while@3;if@5;+@6 <self nanoseconds>", the
+// folded-stack input of flamegraph.pl and compatible tools. The language
+// has no functions, so a node's stack is its chain of profiled ancestors.
+bool profileWriteFolded(const Profile* profile, FILE* output);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef REGISTER_ALLOCATOR_H
+#define REGISTER_ALLOCATOR_H
+
+#include <stdio.h>
+
+#include "ssa.h"
+
+// A location is a register from 0 up or a spill slot, encoded below -1.
+const int NO_LOCATION = -1;
+
+// The last two registers are never allocated: spilled operands are
+// reloaded into them and parallel moves break their cycles with them.
+const int SCRATCH_REGISTERS  = 2;
+const int MIN_REGISTERS      = SCRATCH_REGISTERS + 1;
+const int DEFAULT_REGISTERS  = 16;      // the general-purpose registers of x86-64
+
+static inline int  spillLocation(int slot)     { return -2 - slot;      }
+static inline int  locationSlot(int location)  { return -2 - location;  }
+static inline bool locationIsRegister(int location) { return location >= 0; }
+
+// Positions count two per instruction of the linear order: operands are
+// read at the even one and the result is written at the odd one, so an
+// operand's last use can hand its register to the result.
+typedef struct LiveInterval
+{
+    int value;
+    int start;
+    int end;
+} LiveInterval;
+
+typedef struct RegisterAllocation
+{
+    int*          locations;        // value -> location, NO_LOCATION if it defines nothing
+    LiveInterval* intervals;        // by start
+    size_t        intervals_number;
+
+    int*          order;            // reachable blocks in the order they are laid out
+    size_t        order_number;
+
+    int           registers_number; // including the scratch registers
+    size_t        spill_slots;
+    size_t        spilled_values;
+    size_t        max_live;         // most values live at one position
+} RegisterAllocation;
+
+typedef enum RegisterAllocatorState
+{
+    RegisterAllocatorState_OK            = 0,
+    RegisterAllocatorState_BAD_REGISTERS = 1,
+    RegisterAllocatorState_BAD_FUNCTION  = 2,
+    RegisterAllocatorState_MEMORY_ERROR  = 3,
+} RegisterAllocatorState;
+
+// Lays the reachable blocks out in reverse postorder and computes which
+// values are live at each block boundary, iterating over bit sets until
+// nothing changes; a phi's arguments are live at the end of the
+// predecessor they come from. Every value gets the single interval from
+// its first to its last live position. Linear scan (Poletto and Sarkar)
+// then visits the intervals by start and keeps them in the
+// registers_number - SCRATCH_REGISTERS registers it may allocate; when all
+// are taken the interval that ends last goes to a spill slot.
+RegisterAllocatorState allocateRegisters(const SsaFunction* function, int registers_number,
+                                         RegisterAllocation* allocation);
+void registerAllocationDtor(RegisterAllocation* allocation);
+
+const char* registerAllocatorStateToString(RegisterAllocatorState state);
+void registerAllocationDump(const RegisterAllocation* allocation, FILE* output);
+
+#endif
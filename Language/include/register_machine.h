@@ -0,0 +1,90 @@
+#ifndef REGISTER_MACHINE_H
+#define REGISTER_MACHINE_H
+
+#include <stdio.h>
+
+#include "ssa.h"
+#include "register_allocator.h"
+#include "value.h"
+#include "arena.h"
+
+typedef enum RegisterOpcode
+{
+    RegisterOpcode_LOAD_CONSTANT = 0,   // destination = constants[argument]
+    RegisterOpcode_MOVE          = 1,   // destination = operands[0]
+    RegisterOpcode_UNARY         = 2,   // destination = operation operands[0]
+    RegisterOpcode_BINARY        = 3,   // destination = operands[0] operation operands[1]
+    RegisterOpcode_TRUTHY        = 4,   // destination = operands[0] converted to bool
+    RegisterOpcode_PRINT         = 5,   // prints operands[0]
+    RegisterOpcode_JUMP          = 6,   // to targets[0]
+    RegisterOpcode_BRANCH        = 7,   // to targets[0] if operands[0] is truthy, else targets[1]
+    RegisterOpcode_RETURN        = 8,
+    RegisterOpcode_SPILL         = 9,   // slots[argument] = operands[0]
+    RegisterOpcode_RELOAD        = 10,  // destination = slots[argument]
+} RegisterOpcode;
+
+typedef struct RegisterInstruction
+{
+    RegisterOpcode opcode;
+    int            operation;           // TokenType of UNARY and BINARY
+    int            destination;
+    int            operands[2];
+    int            argument;
+    int            targets[2];
+    int            line;
+} RegisterInstruction;
+
+// Code for a machine with registers_number registers and a frame of spill
+// slots. Constants stay in the SsaFunction it was lowered from, which has
+// to outlive it.
+typedef struct RegisterProgram
+{
+    RegisterInstruction* code;
+    size_t               code_size;
+    size_t               code_capacity;
+
+    const Value*         constants;
+    int                  registers_number;
+    size_t               slots_number;
+
+    size_t               moves;         // copies the phis turned into
+    size_t               spills;
+    size_t               reloads;
+} RegisterProgram;
+
+typedef enum RegisterMachineState
+{
+    RegisterMachineState_OK            = 0,
+    RegisterMachineState_RUNTIME_ERROR = 1,
+    RegisterMachineState_MEMORY_ERROR  = 2,
+} RegisterMachineState;
+
+// Lays the blocks out in the allocator's order. A spilled operand is
+// reloaded into a scratch register right before it is read and a spilled
+// result is stored right after it is written. Phis become parallel copies
+// on the edges into their block: inline before a JUMP and in a stub after
+// a BRANCH, sequentialized so that no source is overwritten before it is
+// read, with cycles broken through a scratch register.
+RegisterMachineState lowerToRegisters(const SsaFunction* function,
+                                      const RegisterAllocation* allocation,
+                                      RegisterProgram* program);
+void registerProgramDtor(RegisterProgram* program);
+void registerProgramDump(const RegisterProgram* program, FILE* output);
+
+typedef struct RegisterMachine
+{
+    const RegisterProgram* program;
+    Value*                 registers;
+    Value*                 slots;
+    Arena                  arena;
+    FILE*                  output;
+    RegisterMachineState   state;
+    char                   error_message[RUNTIME_ERROR_BUFFER_SIZE];
+} RegisterMachine;
+
+RegisterMachineState registerMachineCtor(RegisterMachine* machine,
+                                         const RegisterProgram* program, FILE* output);
+RegisterMachineState registerMachineRun(RegisterMachine* machine);
+void registerMachineDtor(RegisterMachine* machine);
+
+#endif
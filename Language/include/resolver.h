@@ -0,0 +1,39 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <stdlib.h>
+
+#include "tree.h"
+
+const int NO_SLOT = -1;
+
+// Maps every IDENTIFIER node of a program onto a slot of one flat frame.
+// The language has a single global scope, so a name always resolves to the
+// same slot no matter which block declares or assigns it.
+typedef struct Resolution
+{
+    int*         node_slots;    // indexed by node, NO_SLOT for non-identifiers
+    const char** slot_names;    // borrowed from the tree
+    size_t       nodes_number;
+    size_t       slots_number;
+} Resolution;
+
+typedef enum ResolverState
+{
+    ResolverState_OK                 = 0,
+    ResolverState_UNDEFINED_VARIABLE = 1,
+    ResolverState_MEMORY_ERROR       = 2,
+} ResolverState;
+
+// Optimization passes name the variables they introduce "$t0", "$t1", ...;
+// the lexer never produces '$', so they cannot clash with user names.
+const char* const TEMPORARY_PREFIX = "$t";
+
+ResolverState resolveProgram(Tree* ast, Resolution* resolution);
+int resolutionFindSlot(const Resolution* resolution, const char* name);
+// Smallest N such that no "$tM" with M >= N is in use, so passes that run
+// one after another never reuse a temporary.
+size_t resolutionFirstFreeTemporary(const Resolution* resolution);
+void resolutionDtor(Resolution* resolution);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef RUN_STATISTICS_H
+#define RUN_STATISTICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "tree.h"
+#include "hardware_counters.h"
+
+const size_t RUN_STATISTICS_MAX_PHASES = 32;
+
+typedef struct PhaseStatistics
+{
+    const char* name;
+    double      wall_seconds;
+    double      cpu_seconds;
+    uint64_t    allocations;        // malloc, calloc and realloc calls
+    uint64_t    allocated_bytes;    // as requested, a realloc counts its new size
+    int64_t     heap_bytes;         // change of the bytes in use on the heap
+    uint64_t    events[HARDWARE_EVENTS_NUMBER];
+} PhaseStatistics;
+
+// What --stats reports about one run of the driver: the time and memory
+// of every phase, in the order they ran, and the size of the program.
+// Phases do not nest; a phase that runs twice is listed twice.
+typedef struct RunStatistics
+{
+    PhaseStatistics phases[RUN_STATISTICS_MAX_PHASES];
+    size_t          phases_number;
+    bool            measuring;
+    PhaseStatistics started;        // counters when the current phase began
+    const HardwareCounters* counters;   // NULL unless they were asked for and opened
+    int             counters_error; // errno when they were asked for and not opened
+
+    const char*     source_path;
+    size_t          source_bytes;
+    size_t          tokens_number;
+    size_t          parsed_nodes_number;
+    size_t          nodes_number;
+    size_t          nodes_capacity;
+} RunStatistics;
+
+void runStatisticsBeginPhase(RunStatistics* statistics, const char* name);
+void runStatisticsEndPhase(RunStatistics* statistics);
+
+// Records the size of the tree and of the array that holds it; the first
+// call, after parsing, also counts the nodes as parsed.
+void runStatisticsCountTree(RunStatistics* statistics, const Tree* ast);
+
+// False when allocations are not counted: unless the build defines
+// RUN_STATISTICS_COUNT_ALLOCATIONS, in sanitizer builds, whose allocator
+// must see every call, and outside glibc.
+bool runStatisticsCountsAllocations(void);
+
+// False when the bytes in use on the heap cannot be read: outside glibc
+// and without a sanitizer.
+bool runStatisticsMeasuresHeap(void);
+
+// One JSON object with the phases, the tree, the totals and the peak
+// resident set size. With hardware counters every phase also gets its
+// IPC and its events per token (lex, parse) or per parsed node (the rest).
+bool runStatisticsWriteJson(const RunStatistics* statistics, FILE* output, int exit_code);
+
+#endif
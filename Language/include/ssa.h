@@ -0,0 +1,124 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tree.h"
+#include "value.h"
+#include "arena.h"
+#include "resolver.h"
+
+const int NO_BLOCK = -1;
+const int NO_VALUE = -1;
+
+// Every instruction defines at most one value, named by its index.
+typedef enum SsaOpcode
+{
+    SsaOpcode_CONSTANT = 0,   // constants[argument]
+    SsaOpcode_PHI      = 1,   // phi_arguments[argument ...], one per predecessor
+    SsaOpcode_UNARY    = 2,   // operation operands[0]
+    SsaOpcode_BINARY   = 3,   // operands[0] operation operands[1]
+    SsaOpcode_TRUTHY   = 4,   // operands[0] converted to bool
+    SsaOpcode_PRINT    = 5,   // prints operands[0]
+    SsaOpcode_JUMP     = 6,   // to successors[0]
+    SsaOpcode_BRANCH   = 7,   // to successors[0] if operands[0] is truthy, else successors[1]
+    SsaOpcode_RETURN   = 8,
+    SsaOpcode_NOP      = 9,   // removed, e.g. a phi that turned out trivial
+} SsaOpcode;
+
+const int SSA_OPCODES_NUMBER = 10;
+
+typedef struct SsaInstruction
+{
+    SsaOpcode opcode;
+    int       operation;        // TokenType of UNARY and BINARY
+    int       operands[2];
+    int       argument;
+    int       arguments_number; // phi arguments
+    int       block;
+    int       line;
+    int       node;             // AST node that computes the value, or EMPTY_NODE
+    int       variable;         // slot a phi merges, or NO_SLOT
+} SsaInstruction;
+
+typedef struct SsaBlock
+{
+    int first;                  // into SsaFunction::schedule: phis, body, terminator
+    int size;
+    int phis_number;
+    int successors[2];          // NO_BLOCK when absent
+    int first_predecessor;      // into SsaFunction::predecessors, in phi argument order
+    int predecessors_number;
+
+    int immediate_dominator;    // NO_BLOCK for the entry block
+    int first_child;            // dominator tree
+    int next_sibling;
+    int preorder;               // dominator tree numbering: a dominates b iff
+    int postorder;              // a.preorder <= b.preorder && b.postorder <= a.postorder
+} SsaBlock;
+
+// A whole program in SSA form. All storage is flat: instructions are
+// listed per block through the schedule array, and predecessors and phi
+// arguments live in shared arrays addressed by (first, number) pairs.
+// Block 0 is the entry; every variable starts as the constant 0 there.
+typedef struct SsaFunction
+{
+    SsaInstruction* instructions;
+    size_t          instructions_number;
+    size_t          instructions_capacity;
+    int*            schedule;
+
+    SsaBlock*       blocks;
+    size_t          blocks_number;
+    size_t          blocks_capacity;
+    int*            predecessors;
+    int*            reverse_postorder;
+
+    int*            phi_arguments;
+    size_t          phi_arguments_number;
+    size_t          phi_arguments_capacity;
+
+    Value*          constants;
+    size_t          constants_number;
+    size_t          constants_capacity;
+
+    int*            node_values;        // AST node -> value it computes, or NO_VALUE
+    size_t          nodes_number;
+
+    const char**    slot_names;
+    size_t          slots_number;
+    Arena           arena;              // strings and boxed integers of constants, slot names
+} SsaFunction;
+
+typedef enum SsaState
+{
+    SsaState_OK            = 0,
+    SsaState_RESOLVE_ERROR = 1,
+    SsaState_BAD_TREE      = 2,
+    SsaState_MEMORY_ERROR  = 3,
+} SsaState;
+
+// Lowers the AST to a control-flow graph in SSA form (Braun et al.: phis
+// are placed while lowering, blocks are sealed as soon as all their
+// predecessors are known and trivial phis are removed afterwards), then
+// builds the dominator tree.
+SsaState ssaBuild(Tree* ast, SsaFunction* function);
+void ssaDtor(SsaFunction* function);
+
+// Cooper-Harvey-Kennedy over reverse postorder. ssaBuild already calls it;
+// passes that change the graph call it again.
+SsaState ssaBuildDominators(SsaFunction* function);
+bool ssaDominates(const SsaFunction* function, int dominator, int block);
+
+static inline const SsaInstruction* ssaBlockInstruction(const SsaFunction* function,
+                                                        const SsaBlock* block, int index)
+{
+    return &function->instructions[function->schedule[block->first + index]];
+}
+
+const char* ssaOpcodeToString(SsaOpcode opcode);
+const char* ssaStateToString(SsaState state);
+void ssaDump(const SsaFunction* function, FILE* output);
+
+#endif
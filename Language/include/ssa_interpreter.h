@@ -0,0 +1,35 @@
+#ifndef SSA_INTERPRETER_H
+#define SSA_INTERPRETER_H
+
+#include <stdio.h>
+
+#include "ssa.h"
+#include "value.h"
+#include "arena.h"
+
+typedef enum SsaInterpreterState
+{
+    SsaInterpreterState_OK            = 0,
+    SsaInterpreterState_RUNTIME_ERROR = 1,
+    SsaInterpreterState_MEMORY_ERROR  = 2,
+} SsaInterpreterState;
+
+// Runs the SSA graph block by block. It is slower than the VM and exists
+// to check the lowering and the passes over it against the other backends.
+typedef struct SsaInterpreter
+{
+    const SsaFunction*  function;
+    Value*              values;         // one per instruction
+    Value*              phi_values;     // phis of a block are assigned in parallel
+    Arena               arena;
+    FILE*               output;
+    SsaInterpreterState state;
+    char                error_message[RUNTIME_ERROR_BUFFER_SIZE];
+} SsaInterpreter;
+
+SsaInterpreterState ssaInterpreterCtor(SsaInterpreter* interpreter,
+                                       const SsaFunction* function, FILE* output);
+SsaInterpreterState ssaInterpreterRun(SsaInterpreter* interpreter);
+void ssaInterpreterDtor(SsaInterpreter* interpreter);
+
+#endif
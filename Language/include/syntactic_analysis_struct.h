@@ -1,6 +1,20 @@
 #ifndef SYNTATIC_ANALYSIS_STRUCT_H
 #define SYNTATIC_ANALYSIS_STRUCT_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+// Shape of the nodes in the binary tree:
+//   PROGRAM, BLOCK     left  - first STATEMENT cell (or none)
+//   STATEMENT          left  - the statement, right - next STATEMENT cell
+//   VAR_DECLARATION,
+//   ASSIGNMENT         left  - IDENTIFIER, right - expression
+//   IF                 left  - condition, right - then BLOCK or ELSE
+//   ELSE               left  - then BLOCK, right - else BLOCK or IF
+//   WHILE              left  - condition, right - body BLOCK
+//   PRINT              left  - expression
+//   BINARY_OPERATION   left  - left operand, right - right operand
+//   UNARY_OPERATION    left  - operand
 typedef enum SyntaxNodeType
 {
     SyntaxNodeType_PROGRAM          = 0,
@@ -16,19 +30,26 @@ typedef enum SyntaxNodeType
     SyntaxNodeType_STRING           = 10,
     SyntaxNodeType_IDENTIFIER       = 11,
     SyntaxNodeType_BOOL             = 12,
+    SyntaxNodeType_STATEMENT        = 13,
+    SyntaxNodeType_PRINT            = 14,
+    SyntaxNodeType_INTEGER          = 15,
 } SyntaxNodeType;
 
+const int SYNTAX_NODE_TYPES_NUMBER = 16;
+
 typedef struct SyntaxNode
 {
     SyntaxNodeType type;
+    int            line;
     union
     {
-        double number;
+        double  number;
+        int64_t integer;
+        bool   boolean;
         char*  string;
         char*  identifier;
-        int    operation; 
+        int    operation;
     } data;
 } SyntaxNode;
 
 #endif
-
@@ -0,0 +1,78 @@
+#ifndef TYPE_INFERENCE_H
+#define TYPE_INFERENCE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "tree.h"
+#include "value.h"
+#include "arena.h"
+
+// The set of run-time types a value may have: one bit per ValueType. A set
+// with a single bit is a static type, a set with several is dynamic and
+// NONE belongs to code that never computes a value.
+typedef uint8_t StaticType;
+
+const StaticType StaticType_NONE    = 0;
+const StaticType StaticType_NUMBER  = 1 << ValueType_NUMBER;
+const StaticType StaticType_BOOL    = 1 << ValueType_BOOL;
+const StaticType StaticType_STRING  = 1 << ValueType_STRING;
+const StaticType StaticType_ARRAY   = 1 << ValueType_ARRAY;
+const StaticType StaticType_DYNAMIC = StaticType_NUMBER | StaticType_BOOL | StaticType_STRING
+                                    | StaticType_ARRAY;
+
+// Which representations a number may have: integers (small or boxed) and
+// doubles. Any operation with a double operand gives a double, so a
+// double-only value stays one through arithmetic.
+typedef uint8_t NumberKind;
+
+const NumberKind NumberKind_NONE    = 0;
+const NumberKind NumberKind_INTEGER = 1;
+const NumberKind NumberKind_DOUBLE  = 2;
+const NumberKind NumberKind_ANY     = NumberKind_INTEGER | NumberKind_DOUBLE;
+
+typedef struct TypeInference
+{
+    StaticType*  node_types;    // AST expression node -> types of its value
+    NumberKind*  node_kinds;    // AST expression node -> kinds of its numbers
+    size_t       nodes_number;
+    StaticType*  slot_types;    // every type a variable is assigned or read as
+    const char** slot_names;    // owned by names_arena
+    size_t       slots_number;
+    Arena        names_arena;
+
+    size_t       errors_number;
+    char         error_message[RUNTIME_ERROR_BUFFER_SIZE];   // the first error
+} TypeInference;
+
+typedef enum TypeInferenceState
+{
+    TypeInferenceState_OK            = 0,
+    TypeInferenceState_RESOLVE_ERROR = 1,
+    TypeInferenceState_BAD_TREE      = 2,
+    TypeInferenceState_MEMORY_ERROR  = 3,
+} TypeInferenceState;
+
+// Flow-sensitive inference over the SSA form: literals have their type,
+// variables start as the number 0, phis join the types of their arguments
+// and operators keep only the results of operand types they accept, so
+// "x - 1" is a number whatever x is, or the program stops. An operator none
+// of whose possible operand types it accepts is a type error that any run
+// reaching it would hit; such errors are counted, not printed.
+TypeInferenceState inferTypes(Tree* ast, TypeInference* types);
+void typeInferenceDtor(TypeInference* types);
+
+static inline bool staticTypeIsNumber(const TypeInference* types, int node_index)
+{
+    return types != NULL && types->node_types[node_index] == StaticType_NUMBER;
+}
+
+// Every value the node can have is a double, so its tag need not be checked.
+bool staticTypeIsDouble(const TypeInference* types, int node_index);
+
+// "number", "bool" or "string" for one type, "dynamic" for several and
+// "none" for the empty set.
+const char* staticTypeToString(StaticType type);
+void typeInferenceDump(const TypeInference* types, FILE* output);
+
+#endif
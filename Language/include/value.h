@@ -0,0 +1,263 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "arena.h"
+
+typedef enum ValueType
+{
+    ValueType_NUMBER = 0,
+    ValueType_BOOL   = 1,
+    ValueType_STRING = 2,
+    ValueType_ARRAY  = 3,
+} ValueType;
+
+// Numbers side by side as doubles; see value.cpp.
+typedef struct ArrayObject ArrayObject;
+
+#ifndef VALUE_TAGGED_UNION
+
+// NaN boxing: a Value is 8 bytes. Doubles are stored as themselves.
+// Everything else is a quiet NaN with bit 50 set, which no arithmetic
+// result has: the default NaN of x86 and ARM leaves the payload empty.
+// Bools are QNAN | 2 and QNAN | 3, strings set the sign bit as well and
+// keep the pointer in the low 48 bits, which covers the user address space
+// of x86-64 and AArch64. Integers set bit 48: those in [-2^47, 2^47) keep
+// their two's complement in the low 48 bits, larger ones set the sign bit
+// too and point to an int64_t in an arena. Arrays set bit 49 instead of
+// the sign bit and point to their ArrayObject; strings built at run time
+// set it next to the sign bit, as they are arena objects a sweep may free
+// and constants are not. Define VALUE_TAGGED_UNION to get
+// the 16-byte struct with a type field instead, e.g. to compare the two.
+typedef struct Value
+{
+    uint64_t bits;
+} Value;
+
+const uint64_t VALUE_QNAN          = 0x7FFC000000000000;
+const uint64_t VALUE_SIGN          = 0x8000000000000000;
+const uint64_t VALUE_INTEGER_BIT   = 0x0001000000000000;
+const uint64_t VALUE_ARRAY_BIT     = 0x0002000000000000;
+const uint64_t VALUE_PAYLOAD_MASK  = 0x0000FFFFFFFFFFFF;
+const uint64_t VALUE_FALSE_BITS    = VALUE_QNAN | 2;
+const uint64_t VALUE_TRUE_BITS     = VALUE_QNAN | 3;
+const uint64_t VALUE_STRING_TAG    = VALUE_QNAN | VALUE_SIGN;
+const uint64_t VALUE_STRING_OBJECT_TAG = VALUE_STRING_TAG | VALUE_ARRAY_BIT;
+const uint64_t VALUE_INTEGER_TAG   = VALUE_QNAN | VALUE_INTEGER_BIT;
+const uint64_t VALUE_BOXED_TAG     = VALUE_QNAN | VALUE_SIGN | VALUE_INTEGER_BIT;
+const uint64_t VALUE_ARRAY_TAG     = VALUE_QNAN | VALUE_ARRAY_BIT;
+const uint64_t VALUE_ARRAY_MASK    = VALUE_BOXED_TAG | VALUE_ARRAY_BIT;
+const int64_t  VALUE_SMALL_INTEGER_MAX = ((int64_t)1 << 47) - 1;
+const int64_t  VALUE_SMALL_INTEGER_MIN = -((int64_t)1 << 47);
+
+static inline Value valueNumber(double number)
+{
+    Value value = {};
+    memcpy(&value.bits, &number, sizeof(value.bits));
+    return value;
+}
+
+static inline bool valueIntegerIsSmall(int64_t integer)
+{
+    return integer >= VALUE_SMALL_INTEGER_MIN && integer <= VALUE_SMALL_INTEGER_MAX;
+}
+
+// integer must be small, see valueMakeInteger for the others.
+static inline Value valueSmallInteger(int64_t integer)
+{
+    Value value = {.bits = VALUE_INTEGER_TAG | ((uint64_t)integer & VALUE_PAYLOAD_MASK)};
+    return value;
+}
+
+static inline Value valueBool(bool boolean)
+{
+    Value value = {.bits = boolean ? VALUE_TRUE_BITS : VALUE_FALSE_BITS};
+    return value;
+}
+
+// Check that the pointer fits into the payload, so they live in value.cpp.
+// valueStringObject takes a string from arenaAllocObject.
+Value valueString(const char* string);
+Value valueStringObject(const char* string);
+Value valueArray(const ArrayObject* array);
+
+static inline bool valueIsDouble(Value value)       { return (value.bits & VALUE_QNAN) != VALUE_QNAN;                   }
+static inline bool valueIsInteger(Value value)      { return (value.bits & VALUE_INTEGER_TAG) == VALUE_INTEGER_TAG;     }
+static inline bool valueIsSmallInteger(Value value) { return (value.bits & VALUE_BOXED_TAG) == VALUE_INTEGER_TAG;       }
+static inline bool valueIsNumber(Value value)       { return (value.bits & VALUE_QNAN) != VALUE_QNAN
+                                                          || (value.bits & VALUE_INTEGER_TAG) == VALUE_INTEGER_TAG; }
+static inline bool valueIsBool(Value value)         { return (value.bits | 1) == VALUE_TRUE_BITS;                       }
+static inline bool valueIsString(Value value)       { return (value.bits & VALUE_BOXED_TAG) == VALUE_STRING_TAG;        }
+static inline bool valueIsArray(Value value)        { return (value.bits & VALUE_ARRAY_MASK) == VALUE_ARRAY_TAG;        }
+
+ValueType valueType(Value value);
+
+static inline double valueAsDouble(Value value)
+{
+    double number = 0;
+    memcpy(&number, &value.bits, sizeof(number));
+    return number;
+}
+
+// Sign-extends the 48-bit payload.
+static inline int64_t valueAsSmallInteger(Value value) { return (int64_t)(value.bits << 16) >> 16; }
+
+// Small or boxed, so it lives in value.cpp.
+int64_t valueAsInteger(Value value);
+
+static inline bool valueAsBool(Value value)          { return value.bits == VALUE_TRUE_BITS; }
+static inline const char* valueAsString(Value value) { return (const char*)(uintptr_t)(value.bits & VALUE_PAYLOAD_MASK); }
+static inline const ArrayObject* valueAsArray(Value value)
+{
+    return (const ArrayObject*)(uintptr_t)(value.bits & VALUE_PAYLOAD_MASK);
+}
+
+#else
+
+typedef struct Value
+{
+    ValueType type;
+    bool      is_integer;
+    bool      is_object;        // a string from arenaAllocObject
+    union
+    {
+        double      number;
+        int64_t     integer;
+        bool        boolean;
+        const char*        string;
+        const ArrayObject* array;
+    } as;
+} Value;
+
+static inline Value valueNumber(double number)
+{
+    Value value = {.type = ValueType_NUMBER, .is_integer = false, .as = {.number = number}};
+    return value;
+}
+
+// Every integer fits into the union.
+const int64_t VALUE_SMALL_INTEGER_MAX = INT64_MAX;
+const int64_t VALUE_SMALL_INTEGER_MIN = INT64_MIN;
+
+static inline bool valueIntegerIsSmall(int64_t)    { return true; }
+
+static inline Value valueSmallInteger(int64_t integer)
+{
+    Value value = {.type = ValueType_NUMBER, .is_integer = true, .as = {.integer = integer}};
+    return value;
+}
+
+static inline Value valueBool(bool boolean)
+{
+    Value value = {.type = ValueType_BOOL, .is_integer = false, .as = {.boolean = boolean}};
+    return value;
+}
+
+static inline Value valueString(const char* string)
+{
+    Value value = {.type = ValueType_STRING, .is_integer = false, .as = {.string = string}};
+    return value;
+}
+
+static inline Value valueStringObject(const char* string)
+{
+    Value value = {.type = ValueType_STRING, .is_integer = false, .is_object = true,
+                   .as = {.string = string}};
+    return value;
+}
+
+static inline Value valueArray(const ArrayObject* array)
+{
+    Value value = {.type = ValueType_ARRAY, .is_integer = false, .as = {.array = array}};
+    return value;
+}
+
+static inline ValueType valueType(Value value)     { return value.type;                    }
+static inline bool valueIsDouble(Value value)      { return value.type == ValueType_NUMBER && !value.is_integer; }
+static inline bool valueIsInteger(Value value)     { return value.is_integer;              }
+static inline bool valueIsSmallInteger(Value value) { return value.is_integer;             }
+static inline bool valueIsNumber(Value value)      { return value.type == ValueType_NUMBER; }
+static inline bool valueIsBool(Value value)        { return value.type == ValueType_BOOL;   }
+static inline bool valueIsString(Value value)      { return value.type == ValueType_STRING; }
+static inline bool valueIsArray(Value value)       { return value.type == ValueType_ARRAY;  }
+static inline double valueAsDouble(Value value)    { return value.as.number;               }
+static inline int64_t valueAsSmallInteger(Value value) { return value.as.integer;          }
+static inline int64_t valueAsInteger(Value value)  { return value.as.integer;              }
+static inline bool valueAsBool(Value value)        { return value.as.boolean;              }
+static inline const char* valueAsString(Value value) { return value.as.string;             }
+static inline const ArrayObject* valueAsArray(Value value) { return value.as.array;        }
+
+#endif
+
+typedef enum RuntimeState
+{
+    RuntimeState_OK           = 0,
+    RuntimeState_TYPE_ERROR   = 1,
+    RuntimeState_MEMORY_ERROR = 2,
+    RuntimeState_INDEX_ERROR  = 3,     // not an integer, or outside the array
+    RuntimeState_LENGTH_ERROR = 4,     // element-wise operands of different lengths
+    RuntimeState_SIZE_ERROR   = 5,     // array(n, x) with n not a whole number >= 0
+} RuntimeState;
+
+const size_t NUMBER_TEXT_BUFFER_SIZE   = 32;
+const size_t RUNTIME_ERROR_BUFFER_SIZE = 128;
+
+// A number is a double or an integer; the language does not tell them
+// apart except in how they print and how far they stay exact. Integer
+// results that are not representable, overflow or would be -0 as doubles
+// are computed in doubles instead, so integers behave like the doubles
+// they stand for wherever those are exact.
+double valueAsNumber(Value value);
+
+// Small integers are stored in the value, others in an arena object;
+// without an arena that is a memory error.
+RuntimeState valueMakeInteger(int64_t integer, Arena* arena, Value* result);
+
+// Marks the arena objects the values point to, so the next arenaSweep
+// keeps them. A backend sweeps its arena only where every value it can
+// still read is in memory it marks: its variables, stack or registers.
+void valueMarkAll(const Value* values, size_t values_number);
+
+// false, 0, NaN and "" are falsy, an array is truthy when all of its
+// elements are, everything else is truthy.
+bool valueIsTruthy(Value value);
+
+// Arrays are equal when their elements are, in order.
+bool valueEquals(Value left, Value right);
+
+// operation is a TokenType from TOKEN_PLUS to TOKEN_OR. && and || are
+// evaluated eagerly here; short-circuiting is up to the caller.
+// Arithmetic and <, >, <=, >= apply element-wise when an operand is an
+// array, to a number on the other side or to an array of the same length;
+// comparisons give 1 or 0 per element. TOKEN_LBRACKET indexes an array,
+// TOKEN_COMMA appends a number to one and TOKEN_KEYWORD_ARRAY makes an
+// array of left elements that all equal right. Arrays are built in the
+// arena, like concatenated strings.
+RuntimeState valueBinaryOperation(int operation, Value left, Value right,
+                                  Arena* arena, Value* result);
+
+// TOKEN_BANG, TOKEN_MINUS (element-wise on arrays), TOKEN_LBRACKET, which
+// makes a one-element array of a number, and TOKEN_KEYWORD_LEN, the length
+// of an array or a string.
+RuntimeState valueUnaryOperation(int operation, Value operand, Arena* arena, Value* result);
+
+// The arithmetic on two integers, false when the result has to be a double.
+bool integerBinaryOperation(int operation, int64_t left, int64_t right, int64_t* result);
+
+// IEEE division: x / 0 is an infinity or NaN, not an error. Kept out of
+// line so the float-divide-by-zero sanitizer can be switched off for it.
+double numberDivide(double left, double right);
+
+const char* valueTypeToString(ValueType type);
+
+// The message of an error that is not about the operand types.
+const char* runtimeStateToString(RuntimeState state);
+void valueFormatNumber(char* buffer, size_t buffer_size, double number);
+void valueFormatInteger(char* buffer, size_t buffer_size, int64_t integer);
+void valuePrint(FILE* output, Value value);
+
+#endif
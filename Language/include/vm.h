@@ -0,0 +1,53 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stdio.h>
+
+#include "bytecode.h"
+#include "value.h"
+#include "arena.h"
+#include "jit.h"
+
+// The dispatch loop uses computed goto where the compiler supports labels
+// as values; define VM_SWITCH_DISPATCH to force the portable switch loop.
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+    #define VM_COMPUTED_GOTO
+#endif
+
+// Built with VM_PROFILE_PAIRS the VM counts how often each opcode runs
+// right after each other one; make profile-pairs reports the counts the
+// superinstructions were chosen from. Counting slows every dispatch, so
+// regular builds leave it out.
+
+typedef enum VMState
+{
+    VMState_OK            = 0,
+    VMState_RUNTIME_ERROR = 1,
+    VMState_MEMORY_ERROR  = 2,
+} VMState;
+
+typedef struct VM
+{
+    const Chunk* chunk;
+    Value*       frame;
+    Value*       stack;
+    Arena        arena;
+    FILE*        output;
+    Jit*         jit;           // NULL while every loop is interpreted
+    uint64_t*    pair_counts;   // [previous * OPCODES_NUMBER + next], VM_PROFILE_PAIRS only
+    VMState      state;
+    char         error_message[RUNTIME_ERROR_BUFFER_SIZE];
+} VM;
+
+VMState vmCtor(VM* vm, const Chunk* chunk, FILE* output);
+VMState vmRun(VM* vm);
+
+// Compiles loops to machine code once they have run threshold iterations.
+// Without JIT support for the platform every loop keeps being interpreted.
+VMState vmEnableJit(VM* vm, uint32_t threshold);
+// Prints the top most frequent opcode pairs; without VM_PROFILE_PAIRS it
+// only says that nothing was counted.
+void vmPrintPairProfile(const VM* vm, FILE* output, size_t top);
+void vmDtor(VM* vm);
+
+#endif
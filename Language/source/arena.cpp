@@ -0,0 +1,265 @@
+#include "arena.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct ArenaChunk
+{
+    ArenaChunk* next;
+    size_t      used;
+    size_t      capacity;
+    alignas(16) char data[];
+} ArenaChunk;
+
+// size is a multiple of ARENA_ALIGNMENT, so its low bit holds the mark.
+typedef struct ArenaObject
+{
+    ArenaObject* next;
+    size_t       size;
+    alignas(16) char data[];
+} ArenaObject;
+
+static ArenaChunk* newChunk(size_t capacity);
+static void freeObjects(ArenaObject* object);
+
+static const size_t ARENA_CHUNK_SIZE        = 64 * 1024;
+static const size_t ARENA_ALIGNMENT         = 16;
+static const size_t ARENA_SMALL_OBJECT_SIZE = 16;
+static const size_t ARENA_OBJECT_MARK       = 1;
+static const size_t ARENA_MIN_SWEEP_BYTES   = 1024 * 1024;
+
+
+// public ---------------------------------------------------------------------
+
+
+void arenaCtor(Arena* arena)
+{
+    assert(arena != NULL);
+
+    arena->head            = NULL;
+    arena->allocated_bytes = 0;
+    arena->reserved_bytes  = 0;
+    arena->objects         = NULL;
+    arena->free_objects    = NULL;
+    arena->object_bytes    = 0;
+    arena->sweep_threshold = ARENA_MIN_SWEEP_BYTES;
+}
+
+
+void* arenaAlloc(Arena* arena, size_t size)
+{
+    assert(arena != NULL);
+
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+    ArenaChunk* chunk = arena->head;
+    if (chunk == NULL || chunk->capacity - chunk->used < size)
+    {
+        chunk = newChunk(size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE);
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+
+        chunk->next = arena->head;
+        arena->head = chunk;
+
+        arena->reserved_bytes += chunk->capacity;
+    }
+
+    void* memory = chunk->data + chunk->used;
+    chunk->used            += size;
+    arena->allocated_bytes += size;
+
+    return memory;
+}
+
+
+char* arenaStrndup(Arena* arena, const char* text, size_t length)
+{
+    assert(arena != NULL);
+    assert(text  != NULL);
+
+    char* copy = (char*)arenaAlloc(arena, length + 1);
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+
+void arenaReset(Arena* arena)
+{
+    assert(arena != NULL);
+
+    freeObjects(arena->objects);
+    freeObjects(arena->free_objects);
+    arena->objects         = NULL;
+    arena->free_objects    = NULL;
+    arena->object_bytes    = 0;
+    arena->sweep_threshold = ARENA_MIN_SWEEP_BYTES;
+
+    ArenaChunk* chunk = arena->head;
+    if (chunk == NULL)
+    {
+        return;
+    }
+
+    // Keep the newest chunk so a reused arena does not go back to malloc.
+    ArenaChunk* rest = chunk->next;
+    while (rest != NULL)
+    {
+        ArenaChunk* next = rest->next;
+        arena->reserved_bytes -= rest->capacity;
+        free(rest);
+        rest = next;
+    }
+
+    chunk->next = NULL;
+    chunk->used = 0;
+    arena->allocated_bytes = 0;
+}
+
+
+void arenaDtor(Arena* arena)
+{
+    assert(arena != NULL);
+
+    ArenaChunk* chunk = arena->head;
+    while (chunk != NULL)
+    {
+        ArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    freeObjects(arena->objects);
+    freeObjects(arena->free_objects);
+
+    arena->head            = NULL;
+    arena->allocated_bytes = 0;
+    arena->reserved_bytes  = 0;
+    arena->objects         = NULL;
+    arena->free_objects    = NULL;
+    arena->object_bytes    = 0;
+    arena->sweep_threshold = ARENA_MIN_SWEEP_BYTES;
+}
+
+
+void* arenaAllocObject(Arena* arena, size_t size)
+{
+    assert(arena != NULL);
+
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    if (size < ARENA_SMALL_OBJECT_SIZE)
+    {
+        size = ARENA_SMALL_OBJECT_SIZE;
+    }
+
+    ArenaObject* object = NULL;
+    if (size == ARENA_SMALL_OBJECT_SIZE && arena->free_objects != NULL)
+    {
+        object = arena->free_objects;
+        arena->free_objects = object->next;
+    }
+    else
+    {
+        object = (ArenaObject*)malloc(sizeof(ArenaObject) + size);
+        if (object == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    object->next   = arena->objects;
+    object->size   = size;
+    arena->objects = object;
+    arena->object_bytes += sizeof(ArenaObject) + size;
+
+    return object->data;
+}
+
+
+void arenaMarkObject(void* object)
+{
+    assert(object != NULL);
+
+    ArenaObject* header = (ArenaObject*)((char*)object - offsetof(ArenaObject, data));
+    header->size |= ARENA_OBJECT_MARK;
+}
+
+
+void arenaSweep(Arena* arena)
+{
+    assert(arena != NULL);
+
+    size_t kept_bytes = 0;
+    ArenaObject** link = &arena->objects;
+    while (*link != NULL)
+    {
+        ArenaObject* object = *link;
+        if ((object->size & ARENA_OBJECT_MARK) != 0)
+        {
+            object->size &= ~ARENA_OBJECT_MARK;
+            kept_bytes += sizeof(ArenaObject) + object->size;
+            link = &object->next;
+            continue;
+        }
+
+        *link = object->next;
+        if (object->size == ARENA_SMALL_OBJECT_SIZE)
+        {
+            object->next = arena->free_objects;
+            arena->free_objects = object;
+        }
+        else
+        {
+            free(object);
+        }
+    }
+
+    arena->object_bytes    = kept_bytes;
+    arena->sweep_threshold = 2 * kept_bytes > ARENA_MIN_SWEEP_BYTES ? 2 * kept_bytes
+                                                                   : ARENA_MIN_SWEEP_BYTES;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static ArenaChunk* newChunk(size_t capacity)
+{
+    ArenaChunk* chunk = (ArenaChunk*)malloc(sizeof(ArenaChunk) + capacity);
+    if (chunk == NULL)
+    {
+        return NULL;
+    }
+
+    chunk->next     = NULL;
+    chunk->used     = 0;
+    chunk->capacity = capacity;
+
+    return chunk;
+}
+
+
+
+static void freeObjects(ArenaObject* object)
+{
+    while (object != NULL)
+    {
+        ArenaObject* next = object->next;
+        free(object);
+        object = next;
+    }
+}
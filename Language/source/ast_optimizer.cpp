@@ -0,0 +1,927 @@
+#include "ast_optimizer.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "tree_node_structure.h"
+#include "lexical_analysis.h"
+#include "value.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct Folder
+{
+    Tree*               ast;
+    OptimizerStatistics statistics;
+    Arena               arena;          // boxed integers while folding
+} Folder;
+
+static void foldSubtree(Folder* folder, int node_index);
+static void foldUnary(Folder* folder, int node_index);
+static void foldBinary(Folder* folder, int node_index);
+static bool foldLogical(Folder* folder, int node_index);
+static bool simplifyArithmetic(Folder* folder, int node_index);
+
+static void replaceWithValue(Folder* folder, int node_index, int constant_index, Value value);
+static void replaceWithSubtree(Folder* folder, int node_index, int replacement_index);
+static size_t subtreeSize(const Tree* ast, int node_index);
+
+typedef struct Eliminator
+{
+    Tree*               ast;
+    OptimizerStatistics statistics;
+    bool                removed_assignments;
+} Eliminator;
+
+typedef struct NameSet
+{
+    const char** names;
+    size_t       size;
+    size_t       capacity;
+} NameSet;
+
+static void eliminateInList(Eliminator* eliminator, int owner_index);
+static int eliminateInStatement(Eliminator* eliminator, int node_index);
+static int removeCell(Eliminator* eliminator, int cell_index);
+static int spliceBlock(Eliminator* eliminator, int cell_index);
+static bool neverCompletes(const Tree* ast, int node_index);
+static bool isTruthyConstant(const TreeNode* node);
+static bool containsAssignment(const Tree* ast, int node_index);
+
+static bool zeroUnassignedReads(Tree* ast);
+static bool collectAssignedNames(const Tree* ast, int node_index, NameSet* names);
+static void replaceUnassignedReads(Tree* ast, int node_index, const NameSet* names);
+static int compareNames(const void* first, const void* second);
+
+static size_t reachableSize(const Tree* ast, int node_index);
+static void addStatistics(OptimizerStatistics* total, const OptimizerStatistics* pass);
+
+static bool isConstant(const TreeNode* node);
+static bool constantValue(const TreeNode* node, Arena* arena, Value* value);
+static bool isIntegerLiteral(const TreeNode* node, int64_t integer);
+static bool producesNumber(const Tree* ast, int node_index);
+static bool producesBool(const Tree* ast, int node_index);
+
+
+// public ---------------------------------------------------------------------
+
+
+void foldConstants(Tree* ast, OptimizerStatistics* statistics)
+{
+    assert(ast != NULL);
+
+    Folder folder = {
+        .ast        = ast,
+        .statistics = {},
+        .arena      = {},
+    };
+    arenaCtor(&folder.arena);
+
+    if (ast->nodes_number > 0)
+    {
+        foldSubtree(&folder, 0);
+    }
+
+    arenaDtor(&folder.arena);
+
+    if (statistics != NULL)
+    {
+        addStatistics(statistics, &folder.statistics);
+    }
+}
+
+
+void eliminateDeadCode(Tree* ast, OptimizerStatistics* statistics)
+{
+    assert(ast != NULL);
+
+    if (ast->nodes_number == 0)
+    {
+        return;
+    }
+
+    Eliminator eliminator = {
+        .ast                 = ast,
+        .statistics          = {},
+        .removed_assignments = false,
+    };
+
+    size_t nodes_before = reachableSize(ast, 0);
+    eliminateInList(&eliminator, 0);
+
+    // A name that is only assigned in removed code still has to read as 0
+    // instead of becoming an undefined variable.
+    if (eliminator.removed_assignments && !zeroUnassignedReads(ast))
+    {
+        fprintf(stderr, "Warning: not enough memory to finish dead code elimination\n");
+    }
+
+    eliminator.statistics.nodes_removed = nodes_before - reachableSize(ast, 0);
+
+    if (statistics != NULL)
+    {
+        addStatistics(statistics, &eliminator.statistics);
+    }
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+// Children are folded before their parent, so a parent only ever sees
+// operands that are already as small as they get. Statement chains are
+// walked in a loop to keep the recursion as deep as the nesting.
+static void foldSubtree(Folder* folder, int node_index)
+{
+    assert(folder != NULL);
+
+    TreeNode* nodes = folder->ast->nodes_array;
+
+    if (nodes[node_index].data.type == SyntaxNodeType_STATEMENT)
+    {
+        for (int cell = node_index; cell != EMPTY_NODE; cell = nodes[cell].right_index)
+        {
+            foldSubtree(folder, nodes[cell].left_index);
+        }
+        return;
+    }
+
+    if (nodes[node_index].left_index != EMPTY_NODE)
+    {
+        foldSubtree(folder, nodes[node_index].left_index);
+    }
+    if (nodes[node_index].right_index != EMPTY_NODE)
+    {
+        foldSubtree(folder, nodes[node_index].right_index);
+    }
+
+    switch (nodes[node_index].data.type)
+    {
+        case SyntaxNodeType_UNARY_OPERATION:  foldUnary(folder, node_index);  break;
+        case SyntaxNodeType_BINARY_OPERATION: foldBinary(folder, node_index); break;
+        default:                                                              break;
+    }
+}
+
+
+static void foldUnary(Folder* folder, int node_index)
+{
+    assert(folder != NULL);
+
+    const TreeNode* nodes   = folder->ast->nodes_array;
+    int operation           = nodes[node_index].data.data.operation;
+    int operand_index       = nodes[node_index].left_index;
+    const TreeNode* operand = &nodes[operand_index];
+
+    Value value  = {};
+    Value result = {};
+    if (isConstant(operand))
+    {
+        // [n] is an array, which has no literal to fold into.
+        if (constantValue(operand, &folder->arena, &value)
+         && valueUnaryOperation(operation, value, &folder->arena, &result) == RuntimeState_OK
+         && !valueIsArray(result))
+        {
+            replaceWithValue(folder, node_index, operand_index, result);
+        }
+        return;
+    }
+
+    // !!x is x as long as x is already a bool. - -x is not x when x is the
+    // integer 0 or INT64_MIN, which negate to doubles.
+    bool same_operation = operand->data.type == SyntaxNodeType_UNARY_OPERATION
+                       && operand->data.data.operation == operation;
+    if (!same_operation)
+    {
+        return;
+    }
+
+    int inner_index = operand->left_index;
+    if (operation == TOKEN_BANG && producesBool(folder->ast, inner_index))
+    {
+        replaceWithSubtree(folder, node_index, inner_index);
+        folder->statistics.simplified_identities++;
+    }
+}
+
+
+static void foldBinary(Folder* folder, int node_index)
+{
+    assert(folder != NULL);
+
+    if (foldLogical(folder, node_index) || simplifyArithmetic(folder, node_index))
+    {
+        return;
+    }
+
+    const TreeNode* nodes = folder->ast->nodes_array;
+    int left_index        = nodes[node_index].left_index;
+    int right_index       = nodes[node_index].right_index;
+
+    // array(n, x) has no literal to fold into either, and building it here
+    // would only cost memory.
+    if (!isConstant(&nodes[left_index]) || !isConstant(&nodes[right_index])
+     || nodes[node_index].data.data.operation == TOKEN_KEYWORD_ARRAY)
+    {
+        return;
+    }
+
+    Value left   = {};
+    Value right  = {};
+    Value result = {};
+    if (constantValue(&nodes[left_index], &folder->arena, &left)
+     && constantValue(&nodes[right_index], &folder->arena, &right)
+     && valueBinaryOperation(nodes[node_index].data.data.operation, left, right,
+                             &folder->arena, &result) == RuntimeState_OK)
+    {
+        replaceWithValue(folder, node_index, left_index, result);
+    }
+}
+
+
+// && and || with a constant left operand either decide the result on their
+// own or reduce to the truthiness of the right operand. A constant right
+// operand only helps when the left one is already a bool.
+static bool foldLogical(Folder* folder, int node_index)
+{
+    assert(folder != NULL);
+
+    const TreeNode* nodes = folder->ast->nodes_array;
+    int operation         = nodes[node_index].data.data.operation;
+    if (operation != TOKEN_AND && operation != TOKEN_OR)
+    {
+        return false;
+    }
+
+    int left_index  = nodes[node_index].left_index;
+    int right_index = nodes[node_index].right_index;
+    bool deciding   = operation == TOKEN_OR;
+
+    if (isConstant(&nodes[left_index]))
+    {
+        bool left = isTruthyConstant(&nodes[left_index]);
+        if (left == deciding)
+        {
+            replaceWithValue(folder, node_index, left_index, valueBool(left));
+        }
+        else if (isConstant(&nodes[right_index]))
+        {
+            bool right = isTruthyConstant(&nodes[right_index]);
+            replaceWithValue(folder, node_index, right_index, valueBool(right));
+        }
+        else if (producesBool(folder->ast, right_index))
+        {
+            replaceWithSubtree(folder, node_index, right_index);
+            folder->statistics.simplified_identities++;
+        }
+        return true;
+    }
+
+    if (isConstant(&nodes[right_index])
+     && isTruthyConstant(&nodes[right_index]) != deciding
+     && producesBool(folder->ast, left_index))
+    {
+        replaceWithSubtree(folder, node_index, left_index);
+        folder->statistics.simplified_identities++;
+        return true;
+    }
+
+    return false;
+}
+
+
+static bool simplifyArithmetic(Folder* folder, int node_index)
+{
+    assert(folder != NULL);
+
+    const TreeNode* nodes = folder->ast->nodes_array;
+    int left_index        = nodes[node_index].left_index;
+    int right_index       = nodes[node_index].right_index;
+    const TreeNode* left  = &nodes[left_index];
+    const TreeNode* right = &nodes[right_index];
+
+    int kept_index = EMPTY_NODE;
+    switch (nodes[node_index].data.data.operation)
+    {
+        case TOKEN_STAR:
+            if (isIntegerLiteral(right, 1))
+            {
+                kept_index = left_index;
+            }
+            else if (isIntegerLiteral(left, 1))
+            {
+                kept_index = right_index;
+            }
+            break;
+
+        case TOKEN_SLASH:
+            kept_index = isIntegerLiteral(right, 1) ? left_index : EMPTY_NODE;
+            break;
+
+        case TOKEN_MINUS:
+            kept_index = isIntegerLiteral(right, 0) ? left_index : EMPTY_NODE;
+            break;
+
+        default:
+            break;
+    }
+
+    if (kept_index == EMPTY_NODE || isConstant(&nodes[kept_index])
+     || !producesNumber(folder->ast, kept_index))
+    {
+        return false;
+    }
+
+    replaceWithSubtree(folder, node_index, kept_index);
+    folder->statistics.simplified_identities++;
+    return true;
+}
+
+
+// The folded value is written into one of the constant children, which then
+// takes the place of the operator node; nothing is allocated.
+static void replaceWithValue(Folder* folder, int node_index, int constant_index, Value value)
+{
+    assert(folder != NULL);
+    assert(!valueIsString(value) && !valueIsArray(value));
+
+    SyntaxNode data = folder->ast->nodes_array[constant_index].data;
+    if (valueIsInteger(value))
+    {
+        data.type         = SyntaxNodeType_INTEGER;
+        data.data.integer = valueAsInteger(value);
+    }
+    else if (valueIsNumber(value))
+    {
+        data.type        = SyntaxNodeType_NUMBER;
+        data.data.number = valueAsDouble(value);
+    }
+    else
+    {
+        data.type         = SyntaxNodeType_BOOL;
+        data.data.boolean = valueAsBool(value);
+    }
+
+    treeSetNodeData(folder->ast, constant_index, data);
+    replaceWithSubtree(folder, node_index, constant_index);
+    folder->statistics.folded_expressions++;
+}
+
+
+static void replaceWithSubtree(Folder* folder, int node_index, int replacement_index)
+{
+    assert(folder != NULL);
+
+    folder->statistics.nodes_removed += subtreeSize(folder->ast, node_index)
+                                      - subtreeSize(folder->ast, replacement_index);
+    treeReplaceNode(folder->ast, node_index, replacement_index);
+}
+
+
+static size_t subtreeSize(const Tree* ast, int node_index)
+{
+    assert(ast != NULL);
+
+    if (node_index == EMPTY_NODE)
+    {
+        return 0;
+    }
+
+    const TreeNode* node = &ast->nodes_array[node_index];
+    return 1 + subtreeSize(ast, node->left_index) + subtreeSize(ast, node->right_index);
+}
+
+
+// Walks the statement list hanging off a PROGRAM or BLOCK node.
+static void eliminateInList(Eliminator* eliminator, int owner_index)
+{
+    assert(eliminator != NULL);
+
+    Tree* ast = eliminator->ast;
+    int cell  = ast->nodes_array[owner_index].left_index;
+
+    while (cell != EMPTY_NODE)
+    {
+        int statement   = ast->nodes_array[cell].left_index;
+        int replacement = eliminateInStatement(eliminator, statement);
+
+        if (replacement == EMPTY_NODE)
+        {
+            cell = removeCell(eliminator, cell);
+            continue;
+        }
+
+        if (replacement != statement)
+        {
+            treeReplaceNode(ast, statement, replacement);
+        }
+
+        if (ast->nodes_array[replacement].data.type == SyntaxNodeType_BLOCK)
+        {
+            int last_cell = spliceBlock(eliminator, cell);
+            if (last_cell == EMPTY_NODE)
+            {
+                cell = removeCell(eliminator, cell);
+                continue;
+            }
+            cell = last_cell;
+        }
+
+        int next = ast->nodes_array[cell].right_index;
+        if (next != EMPTY_NODE && neverCompletes(ast, ast->nodes_array[cell].left_index))
+        {
+            for (int dead = next; dead != EMPTY_NODE; dead = ast->nodes_array[dead].right_index)
+            {
+                eliminator->statistics.unreachable_statements++;
+                eliminator->removed_assignments |= containsAssignment(ast, ast->nodes_array[dead].left_index);
+            }
+            treeDetachNode(ast, next);
+            next = EMPTY_NODE;
+        }
+
+        cell = next;
+    }
+}
+
+
+// Simplifies the statement and the blocks inside it. Returns the node that
+// should stand in its place, or EMPTY_NODE when nothing is left.
+static int eliminateInStatement(Eliminator* eliminator, int node_index)
+{
+    assert(eliminator != NULL);
+
+    Tree* ast = eliminator->ast;
+
+    switch (ast->nodes_array[node_index].data.type)
+    {
+        case SyntaxNodeType_BLOCK:
+            eliminateInList(eliminator, node_index);
+            return node_index;
+
+        case SyntaxNodeType_WHILE:
+        {
+            const TreeNode* condition = &ast->nodes_array[ast->nodes_array[node_index].left_index];
+            if (isConstant(condition) && !isTruthyConstant(condition))
+            {
+                eliminator->statistics.removed_loops++;
+                eliminator->removed_assignments |= containsAssignment(ast, node_index);
+                return EMPTY_NODE;
+            }
+
+            eliminateInList(eliminator, ast->nodes_array[node_index].right_index);
+            return node_index;
+        }
+
+        case SyntaxNodeType_IF:
+        {
+            int branches   = ast->nodes_array[node_index].right_index;
+            int then_block = branches;
+            int else_part  = EMPTY_NODE;
+
+            if (ast->nodes_array[branches].data.type == SyntaxNodeType_ELSE)
+            {
+                then_block = ast->nodes_array[branches].left_index;
+                else_part  = ast->nodes_array[branches].right_index;
+            }
+
+            eliminateInList(eliminator, then_block);
+            if (else_part != EMPTY_NODE)
+            {
+                int replacement = eliminateInStatement(eliminator, else_part);
+                if (replacement == EMPTY_NODE)
+                {
+                    treeReplaceNode(ast, branches, then_block);
+                    else_part = EMPTY_NODE;
+                }
+                else if (replacement != else_part)
+                {
+                    treeReplaceNode(ast, else_part, replacement);
+                    else_part = replacement;
+                }
+            }
+
+            const TreeNode* condition = &ast->nodes_array[ast->nodes_array[node_index].left_index];
+            if (!isConstant(condition))
+            {
+                return node_index;
+            }
+
+            eliminator->statistics.resolved_branches++;
+            int taken   = isTruthyConstant(condition) ? then_block : else_part;
+            int dropped = isTruthyConstant(condition) ? else_part  : then_block;
+            if (dropped != EMPTY_NODE)
+            {
+                eliminator->removed_assignments |= containsAssignment(ast, dropped);
+            }
+
+            return taken;
+        }
+
+        default:
+            return node_index;
+    }
+}
+
+
+// Unlinks a STATEMENT cell and returns the cell that now follows its
+// predecessor.
+static int removeCell(Eliminator* eliminator, int cell_index)
+{
+    assert(eliminator != NULL);
+
+    Tree* ast = eliminator->ast;
+    int next  = ast->nodes_array[cell_index].right_index;
+
+    if (next == EMPTY_NODE)
+    {
+        treeDetachNode(ast, cell_index);
+    }
+    else
+    {
+        treeReplaceNode(ast, cell_index, next);
+    }
+
+    return next;
+}
+
+
+// Replaces a cell holding a BLOCK with the block's own cells; there is only
+// one scope, so a nested block means nothing by itself. Returns the last
+// spliced cell, or EMPTY_NODE for an empty block (the cell is left as is).
+static int spliceBlock(Eliminator* eliminator, int cell_index)
+{
+    assert(eliminator != NULL);
+
+    Tree* ast  = eliminator->ast;
+    int block  = ast->nodes_array[cell_index].left_index;
+    int first  = ast->nodes_array[block].left_index;
+    if (first == EMPTY_NODE)
+    {
+        return EMPTY_NODE;
+    }
+
+    int last = first;
+    while (ast->nodes_array[last].right_index != EMPTY_NODE)
+    {
+        last = ast->nodes_array[last].right_index;
+    }
+
+    int next = ast->nodes_array[cell_index].right_index;
+    treeReplaceNode(ast, cell_index, first);
+    if (next != EMPTY_NODE)
+    {
+        treeInsertOnRight(ast, last, next);
+    }
+
+    return last;
+}
+
+
+static bool neverCompletes(const Tree* ast, int node_index)
+{
+    assert(ast != NULL);
+
+    const TreeNode* node = &ast->nodes_array[node_index];
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_WHILE:
+            return isTruthyConstant(&ast->nodes_array[node->left_index]);
+
+        case SyntaxNodeType_BLOCK:
+        {
+            int cell = node->left_index;
+            if (cell == EMPTY_NODE)
+            {
+                return false;
+            }
+            while (ast->nodes_array[cell].right_index != EMPTY_NODE)
+            {
+                cell = ast->nodes_array[cell].right_index;
+            }
+            return neverCompletes(ast, ast->nodes_array[cell].left_index);
+        }
+
+        case SyntaxNodeType_IF:
+        {
+            const TreeNode* branches = &ast->nodes_array[node->right_index];
+            return branches->data.type == SyntaxNodeType_ELSE
+                && neverCompletes(ast, branches->left_index)
+                && neverCompletes(ast, branches->right_index);
+        }
+
+        default:
+            return false;
+    }
+}
+
+
+static bool isTruthyConstant(const TreeNode* node)
+{
+    assert(node != NULL);
+
+    if (node->data.type == SyntaxNodeType_INTEGER)
+    {
+        return node->data.data.integer != 0;
+    }
+
+    Value value = {};
+    return isConstant(node) && constantValue(node, NULL, &value) && valueIsTruthy(value);
+}
+
+
+static bool containsAssignment(const Tree* ast, int node_index)
+{
+    assert(ast != NULL);
+
+    if (node_index == EMPTY_NODE)
+    {
+        return false;
+    }
+
+    const TreeNode* node = &ast->nodes_array[node_index];
+    if (node->data.type == SyntaxNodeType_VAR_DECLARATION
+     || node->data.type == SyntaxNodeType_ASSIGNMENT)
+    {
+        return true;
+    }
+
+    if (node->data.type == SyntaxNodeType_STATEMENT)
+    {
+        for (int cell = node_index; cell != EMPTY_NODE; cell = ast->nodes_array[cell].right_index)
+        {
+            if (containsAssignment(ast, ast->nodes_array[cell].left_index))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    return containsAssignment(ast, node->left_index)
+        || containsAssignment(ast, node->right_index);
+}
+
+
+static bool zeroUnassignedReads(Tree* ast)
+{
+    assert(ast != NULL);
+
+    NameSet names = {};
+    if (!collectAssignedNames(ast, 0, &names))
+    {
+        free(names.names);
+        return false;
+    }
+
+    if (names.size > 0)
+    {
+        qsort(names.names, names.size, sizeof(const char*), compareNames);
+    }
+
+    replaceUnassignedReads(ast, 0, &names);
+    free(names.names);
+
+    return true;
+}
+
+
+static bool collectAssignedNames(const Tree* ast, int node_index, NameSet* names)
+{
+    assert(ast   != NULL);
+    assert(names != NULL);
+
+    for (; node_index != EMPTY_NODE; node_index = ast->nodes_array[node_index].right_index)
+    {
+        const TreeNode* node = &ast->nodes_array[node_index];
+
+        if (node->data.type == SyntaxNodeType_VAR_DECLARATION
+         || node->data.type == SyntaxNodeType_ASSIGNMENT)
+        {
+            if (names->size == names->capacity)
+            {
+                size_t new_capacity = names->capacity == 0 ? 16 : names->capacity * 2;
+                const char** new_names = (const char**)realloc(names->names,
+                                                               new_capacity * sizeof(const char*));
+                if (new_names == NULL)
+                {
+                    return false;
+                }
+                names->names    = new_names;
+                names->capacity = new_capacity;
+            }
+
+            names->names[names->size++] = ast->nodes_array[node->left_index].data.data.identifier;
+            continue;
+        }
+
+        if (node->left_index != EMPTY_NODE
+         && !collectAssignedNames(ast, node->left_index, names))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static void replaceUnassignedReads(Tree* ast, int node_index, const NameSet* names)
+{
+    assert(ast   != NULL);
+    assert(names != NULL);
+
+    for (; node_index != EMPTY_NODE; node_index = ast->nodes_array[node_index].right_index)
+    {
+        TreeNode* node = &ast->nodes_array[node_index];
+
+        if (node->data.type == SyntaxNodeType_IDENTIFIER)
+        {
+            const char* name = node->data.data.identifier;
+            bool assigned    = names->size > 0
+                            && bsearch(&name, names->names, names->size,
+                                       sizeof(const char*), compareNames) != NULL;
+            if (!assigned)
+            {
+                SyntaxNode zero   = node->data;
+                zero.type         = SyntaxNodeType_INTEGER;
+                zero.data.integer = 0;
+                free(node->data.data.identifier);
+                treeSetNodeData(ast, node_index, zero);
+            }
+            return;
+        }
+
+        // Assignment targets are always assigned; only their values can read.
+        if (node->data.type == SyntaxNodeType_VAR_DECLARATION
+         || node->data.type == SyntaxNodeType_ASSIGNMENT)
+        {
+            replaceUnassignedReads(ast, node->right_index, names);
+            return;
+        }
+
+        if (node->left_index != EMPTY_NODE)
+        {
+            replaceUnassignedReads(ast, node->left_index, names);
+        }
+    }
+}
+
+
+static int compareNames(const void* first, const void* second)
+{
+    assert(first  != NULL);
+    assert(second != NULL);
+
+    return strcmp(*(const char* const*)first, *(const char* const*)second);
+}
+
+
+static size_t reachableSize(const Tree* ast, int node_index)
+{
+    assert(ast != NULL);
+
+    size_t size = 0;
+    for (; node_index != EMPTY_NODE; node_index = ast->nodes_array[node_index].right_index)
+    {
+        size++;
+        if (ast->nodes_array[node_index].left_index != EMPTY_NODE)
+        {
+            size += reachableSize(ast, ast->nodes_array[node_index].left_index);
+        }
+    }
+
+    return size;
+}
+
+
+static void addStatistics(OptimizerStatistics* total, const OptimizerStatistics* pass)
+{
+    assert(total != NULL);
+    assert(pass  != NULL);
+
+    total->folded_expressions     += pass->folded_expressions;
+    total->simplified_identities  += pass->simplified_identities;
+    total->propagated_constants   += pass->propagated_constants;
+    total->resolved_branches      += pass->resolved_branches;
+    total->removed_loops          += pass->removed_loops;
+    total->unreachable_statements += pass->unreachable_statements;
+    total->reused_expressions     += pass->reused_expressions;
+    total->hoisted_expressions    += pass->hoisted_expressions;
+    total->reduced_multiplications += pass->reduced_multiplications;
+    total->unrolled_loops         += pass->unrolled_loops;
+    total->temporaries            += pass->temporaries;
+    total->nodes_removed          += pass->nodes_removed;
+}
+
+
+static bool isConstant(const TreeNode* node)
+{
+    assert(node != NULL);
+
+    return node->data.type == SyntaxNodeType_NUMBER
+        || node->data.type == SyntaxNodeType_INTEGER
+        || node->data.type == SyntaxNodeType_BOOL;
+}
+
+
+// Integers outside the small range need the arena, false when that fails.
+static bool constantValue(const TreeNode* node, Arena* arena, Value* value)
+{
+    assert(node  != NULL);
+    assert(value != NULL);
+    assert(isConstant(node));
+
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_NUMBER:
+            *value = valueNumber(node->data.data.number);
+            return true;
+        case SyntaxNodeType_INTEGER:
+            return valueMakeInteger(node->data.data.integer, arena, value) == RuntimeState_OK;
+        case SyntaxNodeType_BOOL:
+        default:
+            *value = valueBool(node->data.data.boolean);
+            return true;
+    }
+}
+
+
+static bool isIntegerLiteral(const TreeNode* node, int64_t integer)
+{
+    assert(node != NULL);
+
+    return node->data.type == SyntaxNodeType_INTEGER && node->data.data.integer == integer;
+}
+
+
+// True when the expression either fails at run time or yields a number or
+// an array, so dropping a "* 1" around it cannot change what the program
+// does: arrays multiply element by element.
+static bool producesNumber(const Tree* ast, int node_index)
+{
+    assert(ast != NULL);
+
+    const TreeNode* node = &ast->nodes_array[node_index];
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_NUMBER:
+        case SyntaxNodeType_INTEGER:
+            return true;
+
+        case SyntaxNodeType_UNARY_OPERATION:
+            return node->data.data.operation == TOKEN_MINUS;
+
+        case SyntaxNodeType_BINARY_OPERATION:
+            switch (node->data.data.operation)
+            {
+                case TOKEN_MINUS:
+                case TOKEN_STAR:
+                case TOKEN_SLASH:
+                case TOKEN_PERCENT:
+                    return true;
+                case TOKEN_PLUS:
+                    return producesNumber(ast, node->left_index)
+                        || producesNumber(ast, node->right_index);
+                default:
+                    return false;
+            }
+
+        default:
+            return false;
+    }
+}
+
+
+static bool producesBool(const Tree* ast, int node_index)
+{
+    assert(ast != NULL);
+
+    const TreeNode* node = &ast->nodes_array[node_index];
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_BOOL:
+            return true;
+
+        case SyntaxNodeType_UNARY_OPERATION:
+            return node->data.data.operation == TOKEN_BANG;
+
+        case SyntaxNodeType_BINARY_OPERATION:
+            switch (node->data.data.operation)
+            {
+                // <, >, <= and >= compare arrays element by element.
+                case TOKEN_EQEQ:
+                case TOKEN_BANGEQ:
+                case TOKEN_AND:
+                case TOKEN_OR:
+                    return true;
+                default:
+                    return false;
+            }
+
+        default:
+            return false;
+    }
+}
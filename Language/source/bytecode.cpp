@@ -0,0 +1,506 @@
+#include "bytecode.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "lexical_analysis.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct OpcodeInfo
+{
+    const char* name;
+    int         stack_effect;
+    bool        has_operand;
+    bool        is_jump;
+} OpcodeInfo;
+
+static const OpcodeInfo OPCODE_INFO[] = {
+    [OP_CONSTANT]      = {.name = "CONSTANT",      .stack_effect =  1, .has_operand = true,  .is_jump = false},
+    [OP_TRUE]          = {.name = "TRUE",          .stack_effect =  1, .has_operand = false, .is_jump = false},
+    [OP_FALSE]         = {.name = "FALSE",         .stack_effect =  1, .has_operand = false, .is_jump = false},
+    [OP_LOAD]          = {.name = "LOAD",          .stack_effect =  1, .has_operand = true,  .is_jump = false},
+    [OP_STORE]         = {.name = "STORE",         .stack_effect = -1, .has_operand = true,  .is_jump = false},
+    [OP_POP]           = {.name = "POP",           .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_ADD]           = {.name = "ADD",           .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_SUBTRACT]      = {.name = "SUBTRACT",      .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_MULTIPLY]      = {.name = "MULTIPLY",      .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_DIVIDE]        = {.name = "DIVIDE",        .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_MODULO]        = {.name = "MODULO",        .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_EQUAL]         = {.name = "EQUAL",         .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_NOT_EQUAL]     = {.name = "NOT_EQUAL",     .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_LESS]          = {.name = "LESS",          .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_GREATER]       = {.name = "GREATER",       .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_LESS_EQUAL]    = {.name = "LESS_EQUAL",    .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_GREATER_EQUAL] = {.name = "GREATER_EQUAL", .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_NOT]           = {.name = "NOT",           .stack_effect =  0, .has_operand = false, .is_jump = false},
+    [OP_NEGATE]        = {.name = "NEGATE",        .stack_effect =  0, .has_operand = false, .is_jump = false},
+    [OP_TRUTHY]        = {.name = "TRUTHY",        .stack_effect =  0, .has_operand = false, .is_jump = false},
+    [OP_JUMP]          = {.name = "JUMP",          .stack_effect =  0, .has_operand = true,  .is_jump = true },
+    [OP_JUMP_IF_FALSE] = {.name = "JUMP_IF_FALSE", .stack_effect = -1, .has_operand = true,  .is_jump = true },
+    [OP_JUMP_IF_TRUE]  = {.name = "JUMP_IF_TRUE",  .stack_effect = -1, .has_operand = true,  .is_jump = true },
+    [OP_PRINT]         = {.name = "PRINT",         .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_HALT]          = {.name = "HALT",          .stack_effect =  0, .has_operand = false, .is_jump = false},
+
+    [OP_ADD_DOUBLE]           = {.name = "ADD_DOUBLE",           .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_SUBTRACT_DOUBLE]      = {.name = "SUBTRACT_DOUBLE",      .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_MULTIPLY_DOUBLE]      = {.name = "MULTIPLY_DOUBLE",      .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_DIVIDE_DOUBLE]        = {.name = "DIVIDE_DOUBLE",        .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_MODULO_DOUBLE]        = {.name = "MODULO_DOUBLE",        .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_LESS_DOUBLE]          = {.name = "LESS_DOUBLE",          .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_GREATER_DOUBLE]       = {.name = "GREATER_DOUBLE",       .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_LESS_EQUAL_DOUBLE]    = {.name = "LESS_EQUAL_DOUBLE",    .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_GREATER_EQUAL_DOUBLE] = {.name = "GREATER_EQUAL_DOUBLE", .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_NEGATE_DOUBLE]        = {.name = "NEGATE_DOUBLE",        .stack_effect =  0, .has_operand = false, .is_jump = false},
+
+    [OP_STORE_KEEP]                = {.name = "STORE_KEEP",                .stack_effect =  0, .has_operand = true, .is_jump = false},
+    [OP_JUMP_IF_LESS]              = {.name = "JUMP_IF_LESS",              .stack_effect = -2, .has_operand = true, .is_jump = true },
+    [OP_JUMP_IF_NOT_LESS]          = {.name = "JUMP_IF_NOT_LESS",          .stack_effect = -2, .has_operand = true, .is_jump = true },
+    [OP_JUMP_IF_GREATER]           = {.name = "JUMP_IF_GREATER",           .stack_effect = -2, .has_operand = true, .is_jump = true },
+    [OP_JUMP_IF_NOT_GREATER]       = {.name = "JUMP_IF_NOT_GREATER",       .stack_effect = -2, .has_operand = true, .is_jump = true },
+    [OP_JUMP_IF_LESS_EQUAL]        = {.name = "JUMP_IF_LESS_EQUAL",        .stack_effect = -2, .has_operand = true, .is_jump = true },
+    [OP_JUMP_IF_NOT_LESS_EQUAL]    = {.name = "JUMP_IF_NOT_LESS_EQUAL",    .stack_effect = -2, .has_operand = true, .is_jump = true },
+    [OP_JUMP_IF_GREATER_EQUAL]     = {.name = "JUMP_IF_GREATER_EQUAL",     .stack_effect = -2, .has_operand = true, .is_jump = true },
+    [OP_JUMP_IF_NOT_GREATER_EQUAL] = {.name = "JUMP_IF_NOT_GREATER_EQUAL", .stack_effect = -2, .has_operand = true, .is_jump = true },
+    [OP_JUMP_IF_EQUAL]             = {.name = "JUMP_IF_EQUAL",             .stack_effect = -2, .has_operand = true, .is_jump = true },
+    [OP_JUMP_IF_NOT_EQUAL]         = {.name = "JUMP_IF_NOT_EQUAL",         .stack_effect = -2, .has_operand = true, .is_jump = true },
+
+    [OP_LOAD_CONSTANT]   = {.name = "LOAD_CONSTANT",   .stack_effect =  2, .has_operand = true, .is_jump = false},
+    [OP_STORE_LOAD]      = {.name = "STORE_LOAD",      .stack_effect =  0, .has_operand = true, .is_jump = false},
+    [OP_CONSTANT_BINARY] = {.name = "CONSTANT_BINARY", .stack_effect =  0, .has_operand = true, .is_jump = false},
+    [OP_LOAD_BINARY]     = {.name = "LOAD_BINARY",     .stack_effect =  0, .has_operand = true, .is_jump = false},
+
+    // The targets are in the switch table, not in the operand.
+    [OP_SWITCH]          = {.name = "SWITCH",          .stack_effect = -1, .has_operand = true, .is_jump = false},
+
+    [OP_INDEX]           = {.name = "INDEX",           .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_APPEND]          = {.name = "APPEND",          .stack_effect = -1, .has_operand = false, .is_jump = false},
+    [OP_ARRAY]           = {.name = "ARRAY",           .stack_effect =  0, .has_operand = false, .is_jump = false},
+    [OP_LENGTH]          = {.name = "LENGTH",          .stack_effect =  0, .has_operand = false, .is_jump = false},
+    [OP_FILL]            = {.name = "FILL",            .stack_effect = -1, .has_operand = false, .is_jump = false},
+};
+
+static_assert(sizeof(OPCODE_INFO) / sizeof(OPCODE_INFO[0]) == (size_t)OPCODES_NUMBER,
+              "every opcode needs an OPCODE_INFO entry");
+
+static bool growArray(void** array, size_t* capacity, size_t element_size);
+static bool switchKey(Value value, int64_t* key);
+static void disassemblePart(const Chunk* chunk, Instruction part, FILE* output);
+static void disassembleSwitch(const Chunk* chunk, const SwitchTable* table, FILE* output);
+
+static const size_t CHUNK_START_SIZE = 64;
+static const double INT64_LIMIT      = 9223372036854775808.0;     // 2^63
+
+
+// public ---------------------------------------------------------------------
+
+
+void chunkCtor(Chunk* chunk)
+{
+    assert(chunk != NULL);
+
+    *chunk = (Chunk){};
+    arenaCtor(&chunk->names_arena);
+}
+
+
+bool chunkWrite(Chunk* chunk, Instruction instruction, int line)
+{
+    assert(chunk != NULL);
+
+    if (chunk->code_size == chunk->code_capacity)
+    {
+        size_t lines_capacity = chunk->code_capacity;
+        if (!growArray((void**)&chunk->code,  &chunk->code_capacity, sizeof(Instruction))
+         || !growArray((void**)&chunk->lines, &lines_capacity,       sizeof(int)))
+        {
+            return false;
+        }
+    }
+
+    chunk->code [chunk->code_size] = instruction;
+    chunk->lines[chunk->code_size] = line;
+    chunk->code_size++;
+
+    return true;
+}
+
+
+bool chunkAddConstant(Chunk* chunk, Value value, uint32_t* index)
+{
+    assert(chunk != NULL);
+    assert(index != NULL);
+
+    if (chunk->constants_number > MAX_OPERAND)
+    {
+        return false;
+    }
+
+    if (chunk->constants_number == chunk->constants_capacity
+     && !growArray((void**)&chunk->constants, &chunk->constants_capacity, sizeof(Value)))
+    {
+        return false;
+    }
+
+    *index = (uint32_t)chunk->constants_number;
+    chunk->constants[chunk->constants_number++] = value;
+
+    return true;
+}
+
+
+bool chunkAddSwitch(Chunk* chunk, SwitchTable table, uint32_t* index)
+{
+    assert(chunk != NULL);
+    assert(index != NULL);
+
+    if (chunk->switches_number > MAX_OPERAND
+     || (chunk->switches_number == chunk->switches_capacity
+      && !growArray((void**)&chunk->switches, &chunk->switches_capacity, sizeof(SwitchTable))))
+    {
+        free(table.keys);
+        free(table.targets);
+        return false;
+    }
+
+    *index = (uint32_t)chunk->switches_number;
+    chunk->switches[chunk->switches_number++] = table;
+
+    return true;
+}
+
+
+uint32_t switchTableFind(const SwitchTable* table, Value value)
+{
+    assert(table != NULL);
+
+    int64_t key = 0;
+    if (!switchKey(value, &key))
+    {
+        return table->entries_number;
+    }
+
+    // Unsigned, so a key below minimum wraps past the end.
+    if (table->keys == NULL)
+    {
+        uint64_t entry = (uint64_t)key - (uint64_t)table->minimum;
+        return entry < table->entries_number ? (uint32_t)entry : table->entries_number;
+    }
+
+    uint32_t low  = 0;
+    uint32_t high = table->entries_number;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (table->keys[middle] < key)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low < table->entries_number && table->keys[low] == key ? low : table->entries_number;
+}
+
+
+void chunkDtor(Chunk* chunk)
+{
+    if (chunk == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < chunk->switches_number; i++)
+    {
+        free(chunk->switches[i].keys);
+        free(chunk->switches[i].targets);
+    }
+
+    free(chunk->code);
+    free(chunk->lines);
+    free(chunk->constants);
+    free(chunk->slot_names);
+    free(chunk->switches);
+    arenaDtor(&chunk->names_arena);
+
+    *chunk = (Chunk){};
+}
+
+
+const char* opcodeToString(Opcode opcode)
+{
+    if ((int)opcode >= OPCODES_NUMBER)
+    {
+        return "UNKNOWN";
+    }
+
+    return OPCODE_INFO[opcode].name;
+}
+
+
+int opcodeStackEffect(Opcode opcode)
+{
+    assert((int)opcode < OPCODES_NUMBER);
+
+    return OPCODE_INFO[opcode].stack_effect;
+}
+
+
+bool opcodeHasJumpTarget(Opcode opcode)
+{
+    assert((int)opcode < OPCODES_NUMBER);
+
+    return OPCODE_INFO[opcode].is_jump;
+}
+
+
+int opcodeOperation(Opcode opcode)
+{
+    switch (opcode)
+    {
+        case OP_ADD:
+        case OP_ADD_DOUBLE:           return TOKEN_PLUS;
+        case OP_SUBTRACT:
+        case OP_SUBTRACT_DOUBLE:      return TOKEN_MINUS;
+        case OP_MULTIPLY:
+        case OP_MULTIPLY_DOUBLE:      return TOKEN_STAR;
+        case OP_DIVIDE:
+        case OP_DIVIDE_DOUBLE:        return TOKEN_SLASH;
+        case OP_MODULO:
+        case OP_MODULO_DOUBLE:        return TOKEN_PERCENT;
+        case OP_EQUAL:                return TOKEN_EQEQ;
+        case OP_NOT_EQUAL:            return TOKEN_BANGEQ;
+        case OP_LESS:
+        case OP_LESS_DOUBLE:          return TOKEN_LT;
+        case OP_GREATER:
+        case OP_GREATER_DOUBLE:       return TOKEN_GT;
+        case OP_LESS_EQUAL:
+        case OP_LESS_EQUAL_DOUBLE:    return TOKEN_LTEQ;
+        case OP_GREATER_EQUAL:
+        case OP_GREATER_EQUAL_DOUBLE: return TOKEN_GTEQ;
+        case OP_NOT:                  return TOKEN_BANG;
+        case OP_NEGATE:
+        case OP_NEGATE_DOUBLE:        return TOKEN_MINUS;
+        case OP_INDEX:
+        case OP_ARRAY:                return TOKEN_LBRACKET;
+        case OP_APPEND:               return TOKEN_COMMA;
+        case OP_LENGTH:               return TOKEN_KEYWORD_LEN;
+        case OP_FILL:                 return TOKEN_KEYWORD_ARRAY;
+        default:                      return TOKEN_ERROR;
+    }
+}
+
+
+size_t instructionUnfuse(Instruction instruction, Instruction parts[2])
+{
+    assert(parts != NULL);
+
+    Opcode   opcode  = instructionOpcode(instruction);
+    uint32_t operand = instructionOperand(instruction);
+    Opcode   comparison = OP_HALT;
+
+    switch (opcode)
+    {
+        case OP_STORE_KEEP:
+            parts[0] = makeInstruction(OP_STORE, operand);
+            parts[1] = makeInstruction(OP_LOAD,  operand);
+            return 2;
+
+        case OP_LOAD_CONSTANT:
+            parts[0] = makeInstruction(OP_LOAD,     operandFirst(operand));
+            parts[1] = makeInstruction(OP_CONSTANT, operandSecond(operand));
+            return 2;
+
+        case OP_STORE_LOAD:
+            parts[0] = makeInstruction(OP_STORE, operandFirst(operand));
+            parts[1] = makeInstruction(OP_LOAD,  operandSecond(operand));
+            return 2;
+
+        case OP_CONSTANT_BINARY:
+        case OP_LOAD_BINARY:
+            parts[0] = makeInstruction(opcode == OP_LOAD_BINARY ? OP_LOAD : OP_CONSTANT,
+                                       operandFirst(operand));
+            parts[1] = makeInstruction((Opcode)operandSecond(operand), 0);
+            return 2;
+
+        case OP_JUMP_IF_LESS:
+        case OP_JUMP_IF_NOT_LESS:          comparison = OP_LESS;          break;
+        case OP_JUMP_IF_GREATER:
+        case OP_JUMP_IF_NOT_GREATER:       comparison = OP_GREATER;       break;
+        case OP_JUMP_IF_LESS_EQUAL:
+        case OP_JUMP_IF_NOT_LESS_EQUAL:    comparison = OP_LESS_EQUAL;    break;
+        case OP_JUMP_IF_GREATER_EQUAL:
+        case OP_JUMP_IF_NOT_GREATER_EQUAL: comparison = OP_GREATER_EQUAL; break;
+        case OP_JUMP_IF_EQUAL:
+        case OP_JUMP_IF_NOT_EQUAL:         comparison = OP_EQUAL;         break;
+
+        default:
+            parts[0] = instruction;
+            return 1;
+    }
+
+    // The fused branches come in pairs, the jump on true first.
+    bool on_true = (opcode - OP_JUMP_IF_LESS) % 2 == 0;
+    parts[0] = makeInstruction(comparison, 0);
+    parts[1] = makeInstruction(on_true ? OP_JUMP_IF_TRUE : OP_JUMP_IF_FALSE, operand);
+    return 2;
+}
+
+
+void chunkDisassemble(const Chunk* chunk, FILE* output)
+{
+    assert(chunk  != NULL);
+    assert(output != NULL);
+
+    fprintf(output, "; %lu instructions, %lu constants, %lu slots, stack %lu\n",
+            chunk->code_size, chunk->constants_number,
+            chunk->slots_number, chunk->max_stack);
+
+    for (size_t offset = 0; offset < chunk->code_size; offset++)
+    {
+        Instruction instruction = chunk->code[offset];
+        Opcode opcode = instructionOpcode(instruction);
+        uint32_t operand = instructionOperand(instruction);
+
+        fprintf(output, "%05lu %4d  %-14s", offset, chunk->lines[offset], opcodeToString(opcode));
+
+        Instruction parts[2] = {};
+        if ((int)opcode < OPCODES_NUMBER && instructionUnfuse(instruction, parts) == 2
+         && opcode != OP_STORE_KEEP && !OPCODE_INFO[opcode].is_jump)
+        {
+            disassemblePart(chunk, parts[0], output);
+            disassemblePart(chunk, parts[1], output);
+            fputc('\n', output);
+            continue;
+        }
+
+        if ((int)opcode < OPCODES_NUMBER && OPCODE_INFO[opcode].has_operand)
+        {
+            fprintf(output, " %u", operand);
+        }
+
+        switch (opcode)
+        {
+            case OP_CONSTANT:
+                fputs("  ; ", output);
+                valuePrint(output, chunk->constants[operand]);
+                break;
+            case OP_LOAD:
+            case OP_STORE:
+            case OP_STORE_KEEP:
+                fprintf(output, "  ; %s", chunk->slot_names[operand]);
+                break;
+            case OP_SWITCH:
+                disassembleSwitch(chunk, &chunk->switches[operand], output);
+                break;
+            default:
+                break;
+        }
+
+        fputc('\n', output);
+    }
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static bool growArray(void** array, size_t* capacity, size_t element_size)
+{
+    assert(array    != NULL);
+    assert(capacity != NULL);
+
+    size_t new_capacity = *capacity == 0 ? CHUNK_START_SIZE : *capacity * 2;
+    void* new_array = realloc(*array, new_capacity * element_size);
+    if (new_array == NULL)
+    {
+        return false;
+    }
+
+    *array    = new_array;
+    *capacity = new_capacity;
+
+    return true;
+}
+
+
+// Integers, and doubles that hold an integer exactly, are the values that
+// can equal a case.
+static bool switchKey(Value value, int64_t* key)
+{
+    assert(key != NULL);
+
+    if (valueIsInteger(value))
+    {
+        *key = valueAsInteger(value);
+        return true;
+    }
+
+    if (!valueIsDouble(value))
+    {
+        return false;
+    }
+
+    // Within the int64_t range the integral part converts exactly.
+    double number = valueAsDouble(value);
+    if (!isgreaterequal(number, -INT64_LIMIT) || !isless(number, INT64_LIMIT)
+     || islessgreater(trunc(number), number))
+    {
+        return false;
+    }
+
+    *key = (int64_t)number;
+    return true;
+}
+
+
+// One half of a superinstruction, as " [LOAD i]".
+static void disassemblePart(const Chunk* chunk, Instruction part, FILE* output)
+{
+    assert(chunk  != NULL);
+    assert(output != NULL);
+
+    Opcode   opcode  = instructionOpcode(part);
+    uint32_t operand = instructionOperand(part);
+
+    fprintf(output, " [%s", opcodeToString(opcode));
+    switch (opcode)
+    {
+        case OP_CONSTANT:
+            fputc(' ', output);
+            valuePrint(output, chunk->constants[operand]);
+            break;
+        case OP_LOAD:
+        case OP_STORE:
+            fprintf(output, " %s", chunk->slot_names[operand]);
+            break;
+        default:
+            break;
+    }
+    fputc(']', output);
+}
+
+
+// The cases as "  ; sparse, 3 -> 00012, 5 -> 00020". The entries of a
+// dense table that are no case show where the SWITCH falls through.
+static void disassembleSwitch(const Chunk* chunk, const SwitchTable* table, FILE* output)
+{
+    assert(chunk  != NULL);
+    assert(table  != NULL);
+    assert(output != NULL);
+
+    fprintf(output, "  ; %s", table->keys == NULL ? "dense" : "sparse");
+    for (uint32_t entry = 0; entry < table->entries_number; entry++)
+    {
+        int64_t key = table->keys == NULL ? table->minimum + (int64_t)entry : table->keys[entry];
+        fprintf(output, ", %" PRId64 " -> %05u", key, table->targets[entry]);
+    }
+}
@@ -0,0 +1,802 @@
+#include "c_codegen.h"
+
+#include <math.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include "tree_node_structure.h"
+#include "lexical_analysis.h"
+#include "value.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct CCodegen
+{
+    Tree*               ast;
+    const Resolution*   resolution;
+    const TypeInference* types;
+    FILE*               output;
+    size_t              temporaries_number;
+    int                 depth;
+    CCodegenState       state;
+} CCodegen;
+
+static void generateStatements(CCodegen* codegen, int cell_index);
+static void generateStatement(CCodegen* codegen, int node_index);
+static void generateBranches(CCodegen* codegen, int node_index);
+static size_t generateValue(CCodegen* codegen, int node_index);
+static size_t generateBinary(CCodegen* codegen, int node_index);
+static size_t generateShortCircuit(CCodegen* codegen, int node_index);
+
+static void unsupported(CCodegen* codegen, int line);
+
+static size_t newTemporary(CCodegen* codegen);
+static void emitIndent(CCodegen* codegen);
+static void emitOpen(CCodegen* codegen);
+static void emitClose(CCodegen* codegen);
+static void emitDouble(CCodegen* codegen, double number);
+static void emitInteger(CCodegen* codegen, int64_t integer);
+static void emitString(CCodegen* codegen, const char* string);
+
+static const char* operationFunction(int operation);
+
+// Everything the generated code calls. It mirrors value.cpp, with plain
+// int64_t instead of boxed integers and malloc'ed strings that live until
+// the program exits, as they would in the arena.
+static const char* const RUNTIME_SOURCE = R"RUNTIME(#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__GNUC__)
+    #define INLINE      static inline __attribute__((always_inline))
+    #define NORETURN    __attribute__((noreturn))
+    #define UNLIKELY(x) __builtin_expect(!!(x), 0)
+    #define RUNTIME     static __attribute__((unused))
+#else
+    #define INLINE      static inline
+    #define NORETURN
+    #define UNLIKELY(x) (x)
+    #define RUNTIME     static
+#endif
+
+typedef enum Type { TYPE_DOUBLE, TYPE_INTEGER, TYPE_BOOL, TYPE_STRING } Type;
+
+typedef struct Value
+{
+    Type type;
+    union
+    {
+        double      number;
+        int64_t     integer;
+        int         boolean;
+        const char* string;
+    } as;
+} Value;
+
+enum { ADD, SUBTRACT, MULTIPLY, DIVIDE, MODULO };
+enum { LESS, EQUAL, GREATER, UNORDERED };
+
+INLINE Value number(double x)        { Value value; value.type = TYPE_DOUBLE;  value.as.number  = x; return value; }
+INLINE Value integer(int64_t x)      { Value value; value.type = TYPE_INTEGER; value.as.integer = x; return value; }
+INLINE Value boolean(int x)          { Value value; value.type = TYPE_BOOL;    value.as.boolean = x; return value; }
+INLINE Value string(const char* x)   { Value value; value.type = TYPE_STRING;  value.as.string  = x; return value; }
+
+INLINE int isNumber(Value value)     { return value.type == TYPE_DOUBLE || value.type == TYPE_INTEGER; }
+INLINE double asNumber(Value value)  { return value.type == TYPE_INTEGER ? (double)value.as.integer : value.as.number; }
+
+RUNTIME const char* typeName(Value value)
+{
+    return value.type == TYPE_BOOL ? "bool" : value.type == TYPE_STRING ? "string" : "number";
+}
+
+RUNTIME NORETURN void failBinary(const char* operation, Value left, Value right, int line)
+{
+    fflush(stdout);
+    fprintf(stderr, "Runtime error: cannot apply '%s' to %s and %s (line %d)\n",
+            operation, typeName(left), typeName(right), line);
+    exit(EXIT_FAILURE);
+}
+
+RUNTIME NORETURN void failUnary(const char* operation, Value operand, int line)
+{
+    fflush(stdout);
+    fprintf(stderr, "Runtime error: cannot apply '%s' to %s (line %d)\n",
+            operation, typeName(operand), line);
+    exit(EXIT_FAILURE);
+}
+
+RUNTIME NORETURN void failMemory(int line)
+{
+    fflush(stdout);
+    fprintf(stderr, "Runtime error: out of memory (line %d)\n", line);
+    exit(EXIT_FAILURE);
+}
+
+INLINE int truthy(Value value)
+{
+    switch (value.type)
+    {
+        case TYPE_BOOL:    return value.as.boolean;
+        case TYPE_INTEGER: return value.as.integer != 0;
+        case TYPE_DOUBLE:  return isless(0.0, fabs(value.as.number));
+        default:           return value.as.string[0] != '\0';
+    }
+}
+
+#if defined(__GNUC__)
+    #define ADD_OVERFLOW(a, b, r)      __builtin_add_overflow(a, b, r)
+    #define SUBTRACT_OVERFLOW(a, b, r) __builtin_sub_overflow(a, b, r)
+    #define MULTIPLY_OVERFLOW(a, b, r) __builtin_mul_overflow(a, b, r)
+#else
+RUNTIME int ADD_OVERFLOW(int64_t a, int64_t b, int64_t* r)
+{
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) return 1;
+    *r = a + b;
+    return 0;
+}
+
+RUNTIME int SUBTRACT_OVERFLOW(int64_t a, int64_t b, int64_t* r)
+{
+    if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b)) return 1;
+    *r = a - b;
+    return 0;
+}
+
+RUNTIME int MULTIPLY_OVERFLOW(int64_t a, int64_t b, int64_t* r)
+{
+    if (a != 0 && b != 0
+     && ((a == -1 && b == INT64_MIN) || (b == -1 && a == INT64_MIN)
+      || (a != -1 && b != -1 && (a * b) / b != a))) return 1;
+    *r = a * b;
+    return 0;
+}
+#endif
+
+// Integer results that are inexact, overflow or would be -0 are computed
+// in doubles instead.
+INLINE int integerOperation(int operation, int64_t left, int64_t right, int64_t* result)
+{
+    switch (operation)
+    {
+        case ADD:      return !ADD_OVERFLOW(left, right, result);
+        case SUBTRACT: return !SUBTRACT_OVERFLOW(left, right, result);
+        case MULTIPLY: return !MULTIPLY_OVERFLOW(left, right, result) && (*result != 0 || (left >= 0 && right >= 0));
+        case DIVIDE:
+            if (right == 0 || (left == INT64_MIN && right == -1) || left % right != 0
+             || (left == 0 && right < 0)) return 0;
+            *result = left / right;
+            return 1;
+        default:
+            if (right == 0) return 0;
+            *result = right == -1 ? 0 : left % right;
+            return *result != 0 || left >= 0;
+    }
+}
+
+RUNTIME Value concatenate(const char* left, const char* right, int line)
+{
+    size_t left_length  = strlen(left);
+    size_t right_length = strlen(right);
+    char*  result       = (char*)malloc(left_length + right_length + 1);
+    if (result == NULL) failMemory(line);
+
+    memcpy(result, left, left_length);
+    memcpy(result + left_length, right, right_length + 1);
+    return string(result);
+}
+
+INLINE Value numberOperation(int operation, Value left, Value right)
+{
+    if (left.type == TYPE_INTEGER && right.type == TYPE_INTEGER)
+    {
+        int64_t result = 0;
+        if (integerOperation(operation, left.as.integer, right.as.integer, &result)) return integer(result);
+    }
+
+    double x = asNumber(left);
+    double y = asNumber(right);
+    switch (operation)
+    {
+        case ADD:      return number(x + y);
+        case SUBTRACT: return number(x - y);
+        case MULTIPLY: return number(x * y);
+        case DIVIDE:   return number(x / y);
+        default:       return number(fmod(x, y));
+    }
+}
+
+INLINE Value arithmetic(int operation, const char* name, Value left, Value right, int line)
+{
+    if (UNLIKELY(!isNumber(left) || !isNumber(right)))
+    {
+        if (operation == ADD && left.type == TYPE_STRING && right.type == TYPE_STRING)
+        {
+            return concatenate(left.as.string, right.as.string, line);
+        }
+        failBinary(name, left, right, line);
+    }
+
+    return numberOperation(operation, left, right);
+}
+
+INLINE Value add(Value left, Value right, int line)      { return arithmetic(ADD,      "+", left, right, line); }
+INLINE Value subtract(Value left, Value right, int line) { return arithmetic(SUBTRACT, "-", left, right, line); }
+INLINE Value multiply(Value left, Value right, int line) { return arithmetic(MULTIPLY, "*", left, right, line); }
+INLINE Value divide(Value left, Value right, int line)   { return arithmetic(DIVIDE,   "/", left, right, line); }
+INLINE Value modulo(Value left, Value right, int line)   { return arithmetic(MODULO,   "%", left, right, line); }
+
+INLINE Value addNumbers(Value left, Value right)      { return numberOperation(ADD,      left, right); }
+INLINE Value subtractNumbers(Value left, Value right) { return numberOperation(SUBTRACT, left, right); }
+INLINE Value multiplyNumbers(Value left, Value right) { return numberOperation(MULTIPLY, left, right); }
+INLINE Value divideNumbers(Value left, Value right)   { return numberOperation(DIVIDE,   left, right); }
+INLINE Value moduloNumbers(Value left, Value right)   { return numberOperation(MODULO,   left, right); }
+
+INLINE Value negate(Value operand, int line)
+{
+    if (UNLIKELY(!isNumber(operand))) failUnary("-", operand, line);
+
+    // -0 and -INT64_MIN are not integers.
+    if (operand.type == TYPE_INTEGER && operand.as.integer != 0 && operand.as.integer != INT64_MIN)
+    {
+        return integer(-operand.as.integer);
+    }
+    return number(-asNumber(operand));
+}
+
+INLINE int compareDoubles(double left, double right)
+{
+    return isless(left, right) ? LESS : isgreater(left, right) ? GREATER : left == right ? EQUAL : UNORDERED;
+}
+
+// Exact: 2^53 + 1 is greater than the double 2^53.
+INLINE int compareIntegerToDouble(int64_t left, double right)
+{
+    if (isnan(right))                                return UNORDERED;
+    if (isgreaterequal(right, 9223372036854775808.0)) return LESS;
+    if (isless(right, -9223372036854775808.0))        return GREATER;
+
+    double  whole         = trunc(right);
+    int64_t right_integer = (int64_t)whole;
+    if (left != right_integer) return left < right_integer ? LESS : GREATER;
+    return compareDoubles(0, right - whole);
+}
+
+INLINE int compareNumbers(Value left, Value right)
+{
+    if (left.type == TYPE_INTEGER && right.type == TYPE_INTEGER)
+    {
+        return left.as.integer < right.as.integer ? LESS : left.as.integer > right.as.integer ? GREATER : EQUAL;
+    }
+    if (left.type == TYPE_INTEGER) return compareIntegerToDouble(left.as.integer, right.as.number);
+    if (right.type == TYPE_INTEGER)
+    {
+        int order = compareIntegerToDouble(right.as.integer, left.as.number);
+        return order == LESS ? GREATER : order == GREATER ? LESS : order;
+    }
+    return compareDoubles(left.as.number, right.as.number);
+}
+
+INLINE int compare(const char* name, Value left, Value right, int line)
+{
+    if (isNumber(left) && isNumber(right)) return compareNumbers(left, right);
+    if (UNLIKELY(left.type != TYPE_STRING || right.type != TYPE_STRING)) failBinary(name, left, right, line);
+
+    int order = strcmp(left.as.string, right.as.string);
+    return order < 0 ? LESS : order > 0 ? GREATER : EQUAL;
+}
+
+INLINE int less(Value left, Value right, int line)         { return compare("<",  left, right, line) == LESS;    }
+INLINE int greater(Value left, Value right, int line)      { return compare(">",  left, right, line) == GREATER; }
+INLINE int lessEqual(Value left, Value right, int line)    { int order = compare("<=", left, right, line); return order == LESS    || order == EQUAL; }
+INLINE int greaterEqual(Value left, Value right, int line) { int order = compare(">=", left, right, line); return order == GREATER || order == EQUAL; }
+
+INLINE int lessNumbers(Value left, Value right, int line)         { (void)line; return compareNumbers(left, right) == LESS;    }
+INLINE int greaterNumbers(Value left, Value right, int line)      { (void)line; return compareNumbers(left, right) == GREATER; }
+INLINE int lessEqualNumbers(Value left, Value right, int line)    { (void)line; int order = compareNumbers(left, right); return order == LESS    || order == EQUAL; }
+INLINE int greaterEqualNumbers(Value left, Value right, int line) { (void)line; int order = compareNumbers(left, right); return order == GREATER || order == EQUAL; }
+
+INLINE int equal(Value left, Value right, int line)
+{
+    (void)line;
+    if (isNumber(left) && isNumber(right)) return compareNumbers(left, right) == EQUAL;
+    if (left.type != right.type)           return 0;
+    if (left.type == TYPE_BOOL)            return left.as.boolean == right.as.boolean;
+    return strcmp(left.as.string, right.as.string) == 0;
+}
+
+INLINE int notEqual(Value left, Value right, int line) { return !equal(left, right, line); }
+
+// The shortest of %.15g and %.17g that reads back as the same double;
+// every NaN prints as nan, whatever its sign.
+RUNTIME void print(Value value)
+{
+    char buffer[32];
+    switch (value.type)
+    {
+        case TYPE_INTEGER:
+            printf("%" PRId64 "\n", value.as.integer);
+            break;
+        case TYPE_DOUBLE:
+            if (isnan(value.as.number))
+            {
+                puts("nan");
+                break;
+            }
+            snprintf(buffer, sizeof(buffer), "%.15g", value.as.number);
+            if (strtod(buffer, NULL) != value.as.number)
+            {
+                snprintf(buffer, sizeof(buffer), "%.17g", value.as.number);
+            }
+            puts(buffer);
+            break;
+        case TYPE_BOOL:
+            puts(value.as.boolean ? "true" : "false");
+            break;
+        default:
+            puts(value.as.string);
+            break;
+    }
+}
+)RUNTIME";
+
+
+// public ---------------------------------------------------------------------
+
+
+CCodegenState generateCSource(Tree* ast, const Resolution* resolution,
+                              const TypeInference* types, FILE* output)
+{
+    assert(ast        != NULL);
+    assert(resolution != NULL);
+    assert(output     != NULL);
+
+    CCodegen codegen = {
+        .ast                = ast,
+        .resolution         = resolution,
+        .types              = types,
+        .output             = output,
+        .temporaries_number = 0,
+        .depth              = 1,
+        .state              = CCodegenState_OK,
+    };
+
+    fprintf(output, "// Generated by the Language compiler; build with cc -O2 FILE.c -lm\n");
+    fputs(RUNTIME_SOURCE, output);
+    fprintf(output, "\nint main(void)\n{\n");
+
+    // Variables read before any assignment has run hold 0.
+    for (size_t slot = 0; slot < resolution->slots_number; slot++)
+    {
+        fprintf(output, "    Value v%lu = integer(0);   // %s\n", slot, resolution->slot_names[slot]);
+    }
+
+    if (ast->nodes_number > 0)
+    {
+        generateStatements(&codegen, ast->nodes_array[0].left_index);
+    }
+
+    fprintf(output, "    return EXIT_SUCCESS;\n}\n");
+
+    if (codegen.state == CCodegenState_OK && ferror(output))
+    {
+        codegen.state = CCodegenState_WRITE_ERROR;
+    }
+
+    return codegen.state;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static void generateStatements(CCodegen* codegen, int cell_index)
+{
+    assert(codegen != NULL);
+
+    TreeNode* nodes = codegen->ast->nodes_array;
+    while (cell_index != EMPTY_NODE && codegen->state == CCodegenState_OK)
+    {
+        generateStatement(codegen, nodes[cell_index].left_index);
+        cell_index = nodes[cell_index].right_index;
+    }
+}
+
+
+// Every statement gets its own C block, so the temporaries of one are
+// dead at the next and the C compiler keeps them in registers.
+static void generateStatement(CCodegen* codegen, int node_index)
+{
+    assert(codegen != NULL);
+
+    const TreeNode* node = &codegen->ast->nodes_array[node_index];
+
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_VAR_DECLARATION:
+        case SyntaxNodeType_ASSIGNMENT:
+        {
+            emitOpen(codegen);
+            size_t value = generateValue(codegen, node->right_index);
+            emitIndent(codegen);
+            fprintf(codegen->output, "v%d = t%lu;\n",
+                    codegen->resolution->node_slots[node->left_index], value);
+            emitClose(codegen);
+            break;
+        }
+
+        case SyntaxNodeType_PRINT:
+        {
+            emitOpen(codegen);
+            size_t value = generateValue(codegen, node->left_index);
+            emitIndent(codegen);
+            fprintf(codegen->output, "print(t%lu);\n", value);
+            emitClose(codegen);
+            break;
+        }
+
+        case SyntaxNodeType_IF:
+            emitOpen(codegen);
+            generateBranches(codegen, node_index);
+            emitClose(codegen);
+            break;
+
+        case SyntaxNodeType_WHILE:
+        {
+            emitIndent(codegen);
+            fprintf(codegen->output, "for (;;)\n");
+            emitOpen(codegen);
+            size_t condition = generateValue(codegen, node->left_index);
+            emitIndent(codegen);
+            fprintf(codegen->output, "if (!truthy(t%lu)) break;\n", condition);
+            generateStatement(codegen, node->right_index);
+            emitClose(codegen);
+            break;
+        }
+
+        case SyntaxNodeType_BLOCK:
+        case SyntaxNodeType_PROGRAM:
+        case SyntaxNodeType_STATEMENT:
+            generateStatements(codegen, node->left_index);
+            break;
+
+        // An expression statement is computed for its errors only.
+        case SyntaxNodeType_BINARY_OPERATION:
+        case SyntaxNodeType_UNARY_OPERATION:
+        case SyntaxNodeType_NUMBER:
+        case SyntaxNodeType_INTEGER:
+        case SyntaxNodeType_STRING:
+        case SyntaxNodeType_IDENTIFIER:
+        case SyntaxNodeType_BOOL:
+        {
+            emitOpen(codegen);
+            size_t value = generateValue(codegen, node_index);
+            emitIndent(codegen);
+            fprintf(codegen->output, "(void)t%lu;\n", value);
+            emitClose(codegen);
+            break;
+        }
+
+        case SyntaxNodeType_ELSE:
+        default:
+            codegen->state = CCodegenState_BAD_TREE;
+            break;
+    }
+}
+
+
+// The condition of an IF and its branches, inside the statement's block.
+static void generateBranches(CCodegen* codegen, int node_index)
+{
+    assert(codegen != NULL);
+
+    const TreeNode* node     = &codegen->ast->nodes_array[node_index];
+    const TreeNode* branches = &codegen->ast->nodes_array[node->right_index];
+    bool has_else = branches->data.type == SyntaxNodeType_ELSE;
+
+    size_t condition = generateValue(codegen, node->left_index);
+    emitIndent(codegen);
+    fprintf(codegen->output, "if (truthy(t%lu))\n", condition);
+    emitOpen(codegen);
+    generateStatement(codegen, has_else ? branches->left_index : node->right_index);
+    emitClose(codegen);
+
+    if (has_else)
+    {
+        emitIndent(codegen);
+        fprintf(codegen->output, "else\n");
+        emitOpen(codegen);
+        generateStatement(codegen, branches->right_index);
+        emitClose(codegen);
+    }
+}
+
+
+// Declares a temporary holding the value of the expression and returns its
+// number. Operands are computed first, left to right, so errors come in
+// the order the tree walker reports them.
+static size_t generateValue(CCodegen* codegen, int node_index)
+{
+    assert(codegen != NULL);
+
+    const TreeNode* node = &codegen->ast->nodes_array[node_index];
+    size_t result = 0;
+
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_BINARY_OPERATION:
+            return generateBinary(codegen, node_index);
+
+        case SyntaxNodeType_UNARY_OPERATION:
+        {
+            size_t operand = generateValue(codegen, node->left_index);
+            result = newTemporary(codegen);
+            if (node->data.data.operation == TOKEN_LBRACKET
+             || node->data.data.operation == TOKEN_KEYWORD_LEN)
+            {
+                unsupported(codegen, node->data.line);
+                fprintf(codegen->output, "integer(0);\n");
+            }
+            else if (node->data.data.operation == TOKEN_BANG)
+            {
+                fprintf(codegen->output, "boolean(!truthy(t%lu));\n", operand);
+            }
+            else
+            {
+                fprintf(codegen->output, "negate(t%lu, %d);\n", operand, node->data.line);
+            }
+            return result;
+        }
+
+        case SyntaxNodeType_NUMBER:
+            result = newTemporary(codegen);
+            emitDouble(codegen, node->data.data.number);
+            return result;
+
+        case SyntaxNodeType_INTEGER:
+            result = newTemporary(codegen);
+            emitInteger(codegen, node->data.data.integer);
+            return result;
+
+        case SyntaxNodeType_BOOL:
+            result = newTemporary(codegen);
+            fprintf(codegen->output, "boolean(%d);\n", node->data.data.boolean ? 1 : 0);
+            return result;
+
+        case SyntaxNodeType_STRING:
+            result = newTemporary(codegen);
+            emitString(codegen, node->data.data.string);
+            return result;
+
+        case SyntaxNodeType_IDENTIFIER:
+            result = newTemporary(codegen);
+            fprintf(codegen->output, "v%d;\n", codegen->resolution->node_slots[node_index]);
+            return result;
+
+        default:
+            codegen->state = CCodegenState_BAD_TREE;
+            result = newTemporary(codegen);
+            fprintf(codegen->output, "integer(0);\n");
+            return result;
+    }
+}
+
+
+static size_t generateBinary(CCodegen* codegen, int node_index)
+{
+    assert(codegen != NULL);
+
+    const TreeNode* node = &codegen->ast->nodes_array[node_index];
+    int operation = node->data.data.operation;
+
+    if (operation == TOKEN_AND || operation == TOKEN_OR)
+    {
+        return generateShortCircuit(codegen, node_index);
+    }
+
+    const char* function = operationFunction(operation);
+    if (operation == TOKEN_LBRACKET || operation == TOKEN_COMMA
+     || operation == TOKEN_KEYWORD_ARRAY)
+    {
+        unsupported(codegen, node->data.line);
+        function = "add";
+    }
+    else if (function == NULL)
+    {
+        codegen->state = CCodegenState_BAD_TREE;
+        function = "add";
+    }
+
+    size_t left  = generateValue(codegen, node->left_index);
+    size_t right = generateValue(codegen, node->right_index);
+    size_t result = newTemporary(codegen);
+
+    bool numbers = operation != TOKEN_EQEQ && operation != TOKEN_BANGEQ
+                && staticTypeIsNumber(codegen->types, node->left_index)
+                && staticTypeIsNumber(codegen->types, node->right_index);
+    bool arithmetic = operation == TOKEN_PLUS || operation == TOKEN_MINUS || operation == TOKEN_STAR
+                   || operation == TOKEN_SLASH || operation == TOKEN_PERCENT;
+
+    if (arithmetic && numbers)
+    {
+        fprintf(codegen->output, "%sNumbers(t%lu, t%lu);\n", function, left, right);
+    }
+    else if (arithmetic)
+    {
+        fprintf(codegen->output, "%s(t%lu, t%lu, %d);\n", function, left, right, node->data.line);
+    }
+    else
+    {
+        fprintf(codegen->output, "boolean(%s%s(t%lu, t%lu, %d));\n",
+                function, numbers ? "Numbers" : "", left, right, node->data.line);
+    }
+
+    return result;
+}
+
+
+// "a && b" and "a || b" are bools and never compute b when a decides.
+static size_t generateShortCircuit(CCodegen* codegen, int node_index)
+{
+    assert(codegen != NULL);
+
+    const TreeNode* node = &codegen->ast->nodes_array[node_index];
+    bool is_and = node->data.data.operation == TOKEN_AND;
+
+    size_t left   = generateValue(codegen, node->left_index);
+    size_t result = codegen->temporaries_number++;
+    emitIndent(codegen);
+    fprintf(codegen->output, "Value t%lu = boolean(%d);\n", result, is_and ? 0 : 1);
+    emitIndent(codegen);
+    fprintf(codegen->output, "if (%struthy(t%lu))\n", is_and ? "" : "!", left);
+    emitOpen(codegen);
+    size_t right = generateValue(codegen, node->right_index);
+    emitIndent(codegen);
+    fprintf(codegen->output, "t%lu = boolean(truthy(t%lu));\n", result, right);
+    emitClose(codegen);
+
+    return result;
+}
+
+
+// Only the first one is reported; generation goes on so that the output
+// stays well-formed.
+static void unsupported(CCodegen* codegen, int line)
+{
+    assert(codegen != NULL);
+
+    if (codegen->state == CCodegenState_OK)
+    {
+        fprintf(stderr, "Error: arrays are not supported by the C backend (line %d)\n", line);
+        codegen->state = CCodegenState_UNSUPPORTED;
+    }
+}
+
+
+// Starts "Value tN = " for the caller to finish.
+static size_t newTemporary(CCodegen* codegen)
+{
+    assert(codegen != NULL);
+
+    size_t temporary = codegen->temporaries_number++;
+    emitIndent(codegen);
+    fprintf(codegen->output, "Value t%lu = ", temporary);
+
+    return temporary;
+}
+
+
+static void emitIndent(CCodegen* codegen)
+{
+    assert(codegen != NULL);
+
+    fprintf(codegen->output, "%*s", codegen->depth * 4, "");
+}
+
+
+static void emitOpen(CCodegen* codegen)
+{
+    assert(codegen != NULL);
+
+    emitIndent(codegen);
+    fprintf(codegen->output, "{\n");
+    codegen->depth++;
+}
+
+
+static void emitClose(CCodegen* codegen)
+{
+    assert(codegen != NULL);
+
+    codegen->depth--;
+    emitIndent(codegen);
+    fprintf(codegen->output, "}\n");
+}
+
+
+// Hexadecimal floats are exact; folding may leave infinities and NaNs,
+// which have no literal.
+static void emitDouble(CCodegen* codegen, double number)
+{
+    assert(codegen != NULL);
+
+    if (isnan(number))
+    {
+        fprintf(codegen->output, "number(%sNAN);\n", signbit(number) ? "-" : "");
+    }
+    else if (isinf(number))
+    {
+        fprintf(codegen->output, "number(%sHUGE_VAL);\n", number < 0 ? "-" : "");
+    }
+    else
+    {
+        char buffer[NUMBER_TEXT_BUFFER_SIZE] = {};
+        valueFormatNumber(buffer, sizeof(buffer), number);
+        fprintf(codegen->output, "number(%a);   // %s\n", number, buffer);
+    }
+}
+
+
+static void emitInteger(CCodegen* codegen, int64_t integer)
+{
+    assert(codegen != NULL);
+
+    if (integer == INT64_MIN)
+    {
+        fprintf(codegen->output, "integer(INT64_MIN);\n");
+        return;
+    }
+
+    fprintf(codegen->output, "integer(INT64_C(%" PRId64 "));\n", integer);
+}
+
+
+// Octal escapes for everything but printable ASCII, so any byte survives.
+static void emitString(CCodegen* codegen, const char* string)
+{
+    assert(codegen != NULL);
+    assert(string  != NULL);
+
+    fprintf(codegen->output, "string(\"");
+    for (const unsigned char* c = (const unsigned char*)string; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fprintf(codegen->output, "\\%c", *c);
+        }
+        else if (*c >= ' ' && *c < 0x7F && *c != '?')
+        {
+            fputc(*c, codegen->output);
+        }
+        else
+        {
+            fprintf(codegen->output, "\\%03o", *c);
+        }
+    }
+    fprintf(codegen->output, "\");\n");
+}
+
+
+// The runtime function for a binary operator other than && and ||.
+static const char* operationFunction(int operation)
+{
+    switch (operation)
+    {
+        case TOKEN_PLUS:    return "add";
+        case TOKEN_MINUS:   return "subtract";
+        case TOKEN_STAR:    return "multiply";
+        case TOKEN_SLASH:   return "divide";
+        case TOKEN_PERCENT: return "modulo";
+        case TOKEN_LT:      return "less";
+        case TOKEN_GT:      return "greater";
+        case TOKEN_LTEQ:    return "lessEqual";
+        case TOKEN_GTEQ:    return "greaterEqual";
+        case TOKEN_EQEQ:    return "equal";
+        case TOKEN_BANGEQ:  return "notEqual";
+        default:            return NULL;
+    }
+}
@@ -0,0 +1,698 @@
+#include "common_subexpressions.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tree_node_structure.h"
+#include "lexical_analysis.h"
+#include "resolver.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+static const int NO_VALUE = -1;
+
+typedef struct ExpressionKey
+{
+    int         type;
+    int         operation;
+    int         left;
+    int         right;
+    uint64_t    bits;   // NUMBER payload or BOOL value
+    const char* string; // STRING contents, borrowed from the tree
+} ExpressionKey;
+
+typedef struct ExpressionEntry
+{
+    ExpressionKey key;
+    int           value;
+    unsigned      generation;   // entries of older generations are empty
+} ExpressionEntry;
+
+typedef struct ValueInfo
+{
+    int         node;           // occurrence that can still be saved, or EMPTY_NODE
+    const char* holder;         // variable holding the value, or NULL
+    int         holder_slot;    // NO_SLOT for temporaries, which never change
+} ValueInfo;
+
+typedef struct SlotValue
+{
+    int      value;
+    unsigned generation;
+} SlotValue;
+
+typedef struct Numbering
+{
+    Tree*               ast;
+    Resolution          resolution;
+
+    ExpressionEntry*    entries;
+    size_t              entries_capacity;
+    size_t              entries_used;
+
+    SlotValue*          slot_values;
+    ValueInfo*          values;
+    size_t              values_number;
+    size_t              values_capacity;
+
+    int*                node_values;
+    size_t              node_values_capacity;
+
+    unsigned            generation;
+    size_t              next_temporary;
+    bool                failed;
+    OptimizerStatistics statistics;
+} Numbering;
+
+static void numberList(Numbering* numbering, int owner_index);
+static void numberControl(Numbering* numbering, int node_index);
+static void numberExpression(Numbering* numbering, int node_index, bool record);
+static int computeValue(Numbering* numbering, int node_index);
+static void rewrite(Numbering* numbering, int node_index, bool record);
+static void assignSlot(Numbering* numbering, int slot, int value);
+
+static bool holderIsValid(const Numbering* numbering, int value);
+static void reuseValue(Numbering* numbering, int value, int node_index);
+static void saveInTemporary(Numbering* numbering, int value);
+static int createRead(Numbering* numbering, const char* name, int line);
+static int containingCell(const Tree* ast, int node_index);
+
+static void startGeneration(Numbering* numbering);
+static int newValue(Numbering* numbering);
+static int lookupExpression(Numbering* numbering, const ExpressionKey* key);
+static ExpressionEntry* findEntry(ExpressionEntry* entries, size_t capacity, unsigned generation,
+                                  const ExpressionKey* key);
+static bool growEntries(Numbering* numbering);
+static uint64_t hashKey(const ExpressionKey* key);
+static bool keysEqual(const ExpressionKey* first, const ExpressionKey* second);
+static bool isCommutative(int operation);
+
+static const size_t EXPRESSION_TABLE_START_SIZE = 256;
+
+
+// public ---------------------------------------------------------------------
+
+
+bool eliminateCommonSubexpressions(Tree* ast, OptimizerStatistics* statistics)
+{
+    assert(ast != NULL);
+
+    if (ast->nodes_number == 0)
+    {
+        return true;
+    }
+
+    Numbering numbering = {};
+    numbering.ast = ast;
+
+    if (resolveProgram(ast, &numbering.resolution) != ResolverState_OK)
+    {
+        return false;
+    }
+
+    numbering.slot_values = (SlotValue*)calloc(numbering.resolution.slots_number + 1,
+                                               sizeof(SlotValue));
+    numbering.next_temporary = resolutionFirstFreeTemporary(&numbering.resolution);
+    numbering.failed = numbering.slot_values == NULL || !growEntries(&numbering);
+
+    if (!numbering.failed)
+    {
+        numberList(&numbering, 0);
+    }
+
+    if (statistics != NULL)
+    {
+        statistics->reused_expressions += numbering.statistics.reused_expressions;
+        statistics->temporaries        += numbering.statistics.temporaries;
+    }
+
+    free(numbering.entries);
+    free(numbering.slot_values);
+    free(numbering.values);
+    free(numbering.node_values);
+    resolutionDtor(&numbering.resolution);
+
+    return !numbering.failed;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static void numberList(Numbering* numbering, int owner_index)
+{
+    assert(numbering != NULL);
+
+    startGeneration(numbering);
+
+    for (int cell = numbering->ast->nodes_array[owner_index].left_index;
+         cell != EMPTY_NODE && !numbering->failed;
+         cell = numbering->ast->nodes_array[cell].right_index)
+    {
+        int statement = numbering->ast->nodes_array[cell].left_index;
+        const TreeNode* node = &numbering->ast->nodes_array[statement];
+
+        switch (node->data.type)
+        {
+            case SyntaxNodeType_VAR_DECLARATION:
+            case SyntaxNodeType_ASSIGNMENT:
+            {
+                int slot  = numbering->resolution.node_slots[node->left_index];
+                int value = computeValue(numbering, node->right_index);
+                numberExpression(numbering, node->right_index, true);
+                if (!numbering->failed)
+                {
+                    assignSlot(numbering, slot, value);
+                }
+                break;
+            }
+
+            case SyntaxNodeType_PRINT:
+                computeValue(numbering, node->left_index);
+                numberExpression(numbering, node->left_index, true);
+                break;
+
+            case SyntaxNodeType_IF:
+                // The condition runs once, before anything in the branches.
+                computeValue(numbering, node->left_index);
+                numberExpression(numbering, node->left_index, false);
+                numberControl(numbering, statement);
+                startGeneration(numbering);
+                break;
+
+            default:
+                numberControl(numbering, statement);
+                startGeneration(numbering);
+                break;
+        }
+    }
+}
+
+
+// Numbers the statement lists nested in a control statement; each of them
+// is a run of its own.
+static void numberControl(Numbering* numbering, int node_index)
+{
+    assert(numbering != NULL);
+
+    const TreeNode* node = &numbering->ast->nodes_array[node_index];
+
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_BLOCK:
+            numberList(numbering, node_index);
+            break;
+
+        case SyntaxNodeType_WHILE:
+            numberList(numbering, node->right_index);
+            break;
+
+        case SyntaxNodeType_IF:
+            numberControl(numbering, node->right_index);
+            break;
+
+        case SyntaxNodeType_ELSE:
+        {
+            int else_part = node->right_index;
+            numberList(numbering, node->left_index);
+            numberControl(numbering, else_part);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+
+static void numberExpression(Numbering* numbering, int node_index, bool record)
+{
+    assert(numbering != NULL);
+
+    if (!numbering->failed)
+    {
+        rewrite(numbering, node_index, record);
+    }
+}
+
+
+static int computeValue(Numbering* numbering, int node_index)
+{
+    assert(numbering != NULL);
+
+    if (numbering->failed)
+    {
+        return NO_VALUE;
+    }
+
+    if ((size_t)node_index >= numbering->node_values_capacity)
+    {
+        size_t new_capacity = numbering->ast->nodes_capacity;
+        int* new_values = (int*)realloc(numbering->node_values, new_capacity * sizeof(int));
+        if (new_values == NULL)
+        {
+            numbering->failed = true;
+            return NO_VALUE;
+        }
+        numbering->node_values          = new_values;
+        numbering->node_values_capacity = new_capacity;
+    }
+
+    const TreeNode* node = &numbering->ast->nodes_array[node_index];
+    ExpressionKey key = {
+        .type      = node->data.type,
+        .operation = 0,
+        .left      = NO_VALUE,
+        .right     = NO_VALUE,
+        .bits      = 0,
+        .string    = NULL,
+    };
+
+    int value = NO_VALUE;
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_NUMBER:
+            memcpy(&key.bits, &node->data.data.number, sizeof(key.bits));
+            value = lookupExpression(numbering, &key);
+            break;
+
+        case SyntaxNodeType_INTEGER:
+            key.bits = (uint64_t)node->data.data.integer;
+            value = lookupExpression(numbering, &key);
+            break;
+
+        case SyntaxNodeType_BOOL:
+            key.bits = node->data.data.boolean;
+            value = lookupExpression(numbering, &key);
+            break;
+
+        case SyntaxNodeType_STRING:
+            key.string = node->data.data.string;
+            value = lookupExpression(numbering, &key);
+            break;
+
+        case SyntaxNodeType_IDENTIFIER:
+        {
+            SlotValue* slot = &numbering->slot_values[numbering->resolution.node_slots[node_index]];
+            if (slot->generation != numbering->generation)
+            {
+                slot->value      = newValue(numbering);
+                slot->generation = numbering->generation;
+            }
+            value = slot->value;
+            break;
+        }
+
+        case SyntaxNodeType_UNARY_OPERATION:
+            key.operation = node->data.data.operation;
+            key.left      = computeValue(numbering, node->left_index);
+            value = lookupExpression(numbering, &key);
+            break;
+
+        case SyntaxNodeType_BINARY_OPERATION:
+        {
+            key.operation = node->data.data.operation;
+            key.left      = computeValue(numbering, node->left_index);
+            key.right     = computeValue(numbering, node->right_index);
+            if (isCommutative(key.operation) && key.left > key.right)
+            {
+                int swap  = key.left;
+                key.left  = key.right;
+                key.right = swap;
+            }
+            value = lookupExpression(numbering, &key);
+            break;
+        }
+
+        default:
+            value = newValue(numbering);
+            break;
+    }
+
+    if (!numbering->failed)
+    {
+        numbering->node_values[node_index] = value;
+    }
+
+    return value;
+}
+
+
+// Operators are checked before their operands so the largest repeated
+// expression is reused; an occurrence is recorded after its operands, in
+// the order the program evaluates them. The right operand of && and || may
+// not run, so nothing inside it is recorded.
+static void rewrite(Numbering* numbering, int node_index, bool record)
+{
+    assert(numbering != NULL);
+
+    const TreeNode* node = &numbering->ast->nodes_array[node_index];
+    if (numbering->failed
+     || (node->data.type != SyntaxNodeType_UNARY_OPERATION
+      && node->data.type != SyntaxNodeType_BINARY_OPERATION))
+    {
+        return;
+    }
+
+    int value = numbering->node_values[node_index];
+    if (holderIsValid(numbering, value) || numbering->values[value].node != EMPTY_NODE)
+    {
+        reuseValue(numbering, value, node_index);
+        return;
+    }
+
+    int operation   = node->data.data.operation;
+    int right_index = node->right_index;
+
+    rewrite(numbering, node->left_index, record);
+    if (right_index != EMPTY_NODE)
+    {
+        rewrite(numbering, right_index,
+                record && operation != TOKEN_AND && operation != TOKEN_OR);
+    }
+
+    if (record && !numbering->failed)
+    {
+        numbering->values[value].node = node_index;
+    }
+}
+
+
+static void assignSlot(Numbering* numbering, int slot, int value)
+{
+    assert(numbering != NULL);
+
+    numbering->slot_values[slot].value      = value;
+    numbering->slot_values[slot].generation = numbering->generation;
+
+    if (!holderIsValid(numbering, value))
+    {
+        numbering->values[value].holder      = numbering->resolution.slot_names[slot];
+        numbering->values[value].holder_slot = slot;
+    }
+}
+
+
+static bool holderIsValid(const Numbering* numbering, int value)
+{
+    assert(numbering != NULL);
+
+    const ValueInfo* info = &numbering->values[value];
+    if (info->holder == NULL)
+    {
+        return false;
+    }
+
+    if (info->holder_slot == NO_SLOT)
+    {
+        return true;
+    }
+
+    const SlotValue* slot = &numbering->slot_values[info->holder_slot];
+    return slot->generation == numbering->generation && slot->value == value;
+}
+
+
+static void reuseValue(Numbering* numbering, int value, int node_index)
+{
+    assert(numbering != NULL);
+
+    if (!holderIsValid(numbering, value))
+    {
+        saveInTemporary(numbering, value);
+    }
+
+    int line = numbering->ast->nodes_array[node_index].data.line;
+    int read = createRead(numbering, numbering->values[value].holder, line);
+    if (read == EMPTY_NODE)
+    {
+        return;
+    }
+
+    treeReplaceNode(numbering->ast, node_index, read);
+    numbering->statistics.reused_expressions++;
+}
+
+
+// Moves the first occurrence into "$tN = expression;" right before the
+// statement that contains it and reads $tN in its place. The operands are
+// the same there: expressions cannot assign.
+static void saveInTemporary(Numbering* numbering, int value)
+{
+    assert(numbering != NULL);
+
+    Tree* ast        = numbering->ast;
+    int   expression = numbering->values[value].node;
+    int   line       = ast->nodes_array[expression].data.line;
+
+    char name[32] = {};
+    snprintf(name, sizeof(name), "%s%lu", TEMPORARY_PREFIX, numbering->next_temporary++);
+
+    SyntaxNode cell_data   = { .type = SyntaxNodeType_STATEMENT,  .line = line, .data = {} };
+    SyntaxNode assign_data = { .type = SyntaxNodeType_ASSIGNMENT, .line = line, .data = {} };
+
+    int cell   = treeCreateNewNode(ast, cell_data);
+    int assign = cell   == EMPTY_NODE ? EMPTY_NODE : treeCreateNewNode(ast, assign_data);
+    int target = assign == EMPTY_NODE ? EMPTY_NODE : createRead(numbering, name, line);
+    int read   = target == EMPTY_NODE ? EMPTY_NODE : createRead(numbering, name, line);
+    if (read == EMPTY_NODE)
+    {
+        numbering->failed = true;
+        return;
+    }
+
+    int statement_cell = containingCell(ast, expression);
+
+    treeReplaceNode(ast, expression, read);
+    treeInsertOnLeft(ast, assign, target);
+    treeInsertOnRight(ast, assign, expression);
+    treeInsertOnLeft(ast, cell, assign);
+
+    treeReplaceNode(ast, statement_cell, cell);
+    treeInsertOnRight(ast, cell, statement_cell);
+
+    numbering->values[value].node        = EMPTY_NODE;
+    numbering->values[value].holder      = ast->nodes_array[target].data.data.identifier;
+    numbering->values[value].holder_slot = NO_SLOT;
+    numbering->statistics.temporaries++;
+}
+
+
+static int createRead(Numbering* numbering, const char* name, int line)
+{
+    assert(numbering != NULL);
+    assert(name      != NULL);
+
+    SyntaxNode data = {
+        .type = SyntaxNodeType_IDENTIFIER,
+        .line = line,
+        .data = { .identifier = strdup(name) },
+    };
+    if (data.data.identifier == NULL)
+    {
+        numbering->failed = true;
+        return EMPTY_NODE;
+    }
+
+    int node_index = treeCreateNewNode(numbering->ast, data);
+    if (node_index == EMPTY_NODE)
+    {
+        free(data.data.identifier);
+        numbering->failed = true;
+    }
+
+    return node_index;
+}
+
+
+// An occurrence may have moved into a temporary's assignment since it was
+// recorded, so its statement is found through the parent links.
+static int containingCell(const Tree* ast, int node_index)
+{
+    assert(ast != NULL);
+
+    while (ast->nodes_array[node_index].data.type != SyntaxNodeType_STATEMENT)
+    {
+        node_index = ast->nodes_array[node_index].parent_index;
+        assert(node_index != EMPTY_NODE);
+    }
+
+    return node_index;
+}
+
+
+static void startGeneration(Numbering* numbering)
+{
+    assert(numbering != NULL);
+
+    numbering->generation++;
+    numbering->entries_used  = 0;
+    numbering->values_number = 0;
+}
+
+
+static int newValue(Numbering* numbering)
+{
+    assert(numbering != NULL);
+
+    if (numbering->values_number == numbering->values_capacity)
+    {
+        size_t new_capacity = numbering->values_capacity == 0 ? EXPRESSION_TABLE_START_SIZE
+                                                              : numbering->values_capacity * 2;
+        ValueInfo* new_values = (ValueInfo*)realloc(numbering->values,
+                                                    new_capacity * sizeof(ValueInfo));
+        if (new_values == NULL)
+        {
+            numbering->failed = true;
+            return NO_VALUE;
+        }
+        numbering->values          = new_values;
+        numbering->values_capacity = new_capacity;
+    }
+
+    int value = (int)numbering->values_number++;
+    numbering->values[value] = (ValueInfo){
+        .node        = EMPTY_NODE,
+        .holder      = NULL,
+        .holder_slot = NO_SLOT,
+    };
+
+    return value;
+}
+
+
+static int lookupExpression(Numbering* numbering, const ExpressionKey* key)
+{
+    assert(numbering != NULL);
+    assert(key       != NULL);
+
+    if (numbering->failed)
+    {
+        return NO_VALUE;
+    }
+
+    ExpressionEntry* entry = findEntry(numbering->entries, numbering->entries_capacity,
+                                       numbering->generation, key);
+    if (entry->generation == numbering->generation)
+    {
+        return entry->value;
+    }
+
+    int value = newValue(numbering);
+    if (value == NO_VALUE)
+    {
+        return NO_VALUE;
+    }
+
+    *entry = (ExpressionEntry){
+        .key        = *key,
+        .value      = value,
+        .generation = numbering->generation,
+    };
+    numbering->entries_used++;
+
+    if (numbering->entries_used * 2 > numbering->entries_capacity && !growEntries(numbering))
+    {
+        numbering->failed = true;
+        return NO_VALUE;
+    }
+
+    return value;
+}
+
+
+static ExpressionEntry* findEntry(ExpressionEntry* entries, size_t capacity, unsigned generation,
+                                  const ExpressionKey* key)
+{
+    assert(entries != NULL);
+    assert(key     != NULL);
+
+    size_t mask  = capacity - 1;
+    size_t index = (size_t)hashKey(key) & mask;
+
+    while (entries[index].generation == generation && !keysEqual(&entries[index].key, key))
+    {
+        index = (index + 1) & mask;
+    }
+
+    return &entries[index];
+}
+
+
+static bool growEntries(Numbering* numbering)
+{
+    assert(numbering != NULL);
+
+    size_t new_capacity = numbering->entries_capacity == 0 ? EXPRESSION_TABLE_START_SIZE
+                                                           : numbering->entries_capacity * 2;
+    ExpressionEntry* new_entries = (ExpressionEntry*)calloc(new_capacity, sizeof(ExpressionEntry));
+    if (new_entries == NULL)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < numbering->entries_capacity; i++)
+    {
+        const ExpressionEntry* entry = &numbering->entries[i];
+        if (entry->generation == numbering->generation)
+        {
+            *findEntry(new_entries, new_capacity, numbering->generation, &entry->key) = *entry;
+        }
+    }
+
+    free(numbering->entries);
+    numbering->entries          = new_entries;
+    numbering->entries_capacity = new_capacity;
+
+    return true;
+}
+
+
+static uint64_t hashKey(const ExpressionKey* key)
+{
+    assert(key != NULL);
+
+    uint64_t hash = key->bits;
+    for (const char* symbol = key->string; symbol != NULL && *symbol != '\0'; symbol++)
+    {
+        hash = hash * 31 + (unsigned char)*symbol;
+    }
+    hash = hash * 31 + (uint64_t)key->type;
+    hash = hash * 31 + (uint64_t)key->operation;
+    hash = hash * 31 + (uint64_t)(uint32_t)key->left;
+    hash = hash * 31 + (uint64_t)(uint32_t)key->right;
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+
+static bool keysEqual(const ExpressionKey* first, const ExpressionKey* second)
+{
+    assert(first  != NULL);
+    assert(second != NULL);
+
+    return first->type      == second->type
+        && first->operation == second->operation
+        && first->left      == second->left
+        && first->right     == second->right
+        && first->bits      == second->bits
+        && (first->string == second->string
+         || (first->string != NULL && second->string != NULL
+          && strcmp(first->string, second->string) == 0));
+}
+
+
+static bool isCommutative(int operation)
+{
+    return operation == TOKEN_STAR
+        || operation == TOKEN_EQEQ
+        || operation == TOKEN_BANGEQ;
+}
@@ -0,0 +1,1052 @@
+#include "compile_server.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "arena.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef enum RequestKind
+{
+    RequestKind_RUN      = 0,
+    RequestKind_SHUTDOWN = 1,
+} RequestKind;
+
+// Both ends run on the same machine, so the fields are in its byte order.
+// A request header is followed by the client's working directory, the
+// arguments and, with has_source, the source, each as a 32-bit length and
+// the bytes without a terminating zero. A response header is followed by
+// what the run wrote to stdout and then to stderr.
+typedef struct RequestHeader
+{
+    uint32_t magic;
+    uint32_t kind;
+    uint32_t arguments_number;
+    uint32_t has_source;
+} RequestHeader;
+
+typedef struct ResponseHeader
+{
+    uint32_t magic;
+    int32_t  exit_code;
+    uint32_t output_length;
+    uint32_t errors_length;
+} ResponseHeader;
+
+// The key is kept whole and compared on every hit; its hash only picks
+// the entry.
+typedef struct CachedResult
+{
+    uint64_t hash;
+    char*    key;
+    size_t   key_length;
+    bool     used;
+    int      exit_code;
+    char*    output;
+    size_t   output_length;
+    char*    errors;
+    size_t   errors_length;
+} CachedResult;
+
+// stdout and stderr are pointed at two unlinked temporary files while a
+// request runs; saved_output and saved_errors hold the server's own.
+typedef struct Capture
+{
+    FILE* output;
+    FILE* errors;
+    int   saved_output;
+    int   saved_errors;
+} Capture;
+
+typedef struct Server
+{
+    const CompileServerHandler* handler;
+    CompileServerStatistics*    statistics;
+    Arena           arena;          // the strings of the current request
+    CachedResult*   cache;          // direct-mapped by key
+    Capture         capture;
+    char*           buffer;         // TRANSFER_BUFFER_SIZE bytes
+    int             home;           // the server's working directory
+} Server;
+
+static int openListener(const char* socket_path);
+static int connectTo(const char* socket_path);
+static bool fillAddress(const char* socket_path, struct sockaddr_un* address);
+static bool isOwnSocket(const char* socket_path);
+static bool isOwnPrivateDirectory(const char* directory);
+static bool peerIsSameUser(int connection);
+static bool limitWaiting(int connection);
+
+static bool serveConnection(Server* server, int connection);
+static bool readRequest(Server* server, int connection, const RequestHeader* header,
+                        CompileRequest* request, char** directory);
+static bool runRequest(Server* server, int connection, const CompileRequest* request);
+static int runIsolated(const CompileServerHandler* handler, const CompileRequest* request);
+static void refuseRequest(int connection, const char* message, const char* detail);
+
+static bool captureCtor(Capture* capture);
+static void captureDtor(Capture* capture);
+static void beginCapture(Capture* capture);
+static void clearCapture(Capture* capture);
+static void endCapture(Capture* capture);
+static size_t capturedLength(FILE* file);
+static char* readCaptured(FILE* file, size_t length);
+static bool sendCaptured(Server* server, int connection, FILE* file, size_t length);
+
+static uint64_t hashKey(const char* key, size_t key_length);
+static bool storeResult(CachedResult* entry, const char* key, size_t key_length,
+                        uint64_t hash, int exit_code, FILE* output,
+                        size_t output_length, FILE* errors, size_t errors_length);
+static bool sendResult(int connection, const CachedResult* entry);
+static void cacheDtor(CachedResult* cache);
+
+static bool sendRequest(int connection, RequestKind kind, int argc, char** argv,
+                        const char* directory, const char* source);
+static bool copyToStream(int connection, size_t length, FILE* stream, char* buffer);
+
+static char* readString(int connection, Arena* arena);
+static bool writeString(int connection, const char* text);
+static bool readAll(int connection, void* data, size_t size);
+static bool writeAll(int connection, const void* data, size_t size);
+
+static const uint32_t PROTOCOL_MAGIC        = 0x474E414C;     // "LANG"
+static const uint32_t MAX_ARGUMENTS         = 4096;
+static const uint32_t MAX_STRING_LENGTH     = 256 * 1024 * 1024;
+static const size_t   RESULT_CACHE_CAPACITY = 256;
+static const size_t   MAX_CACHED_OUTPUT     = 1024 * 1024;     // per stream
+static const size_t   MAX_CACHED_KEY        = 1024 * 1024;
+static const size_t   TRANSFER_BUFFER_SIZE  = 64 * 1024;
+static const int      LISTEN_BACKLOG        = 64;
+static const time_t   CLIENT_TIMEOUT        = 10;              // seconds
+
+
+// public ---------------------------------------------------------------------
+
+
+bool compileServerServe(const char* socket_path, const CompileServerHandler* handler,
+                        CompileServerStatistics* statistics)
+{
+    assert(socket_path != NULL);
+    assert(handler     != NULL);
+    assert(statistics  != NULL);
+
+    int listener = openListener(socket_path);
+    if (listener < 0)
+    {
+        return false;
+    }
+
+    Server server = {
+        .handler    = handler,
+        .statistics = statistics,
+        .arena      = {},
+        .cache      = (CachedResult*)calloc(RESULT_CACHE_CAPACITY, sizeof(CachedResult)),
+        .capture    = {},
+        .buffer     = (char*)malloc(TRANSFER_BUFFER_SIZE),
+        .home       = open(".", O_RDONLY | O_DIRECTORY),
+    };
+    arenaCtor(&server.arena);
+
+    bool started = server.cache != NULL && server.buffer != NULL && server.home >= 0
+                && captureCtor(&server.capture);
+    if (!started)
+    {
+        fprintf(stderr, "Cannot start the server: %s\n", strerror(errno));
+    }
+    else
+    {
+        fprintf(stderr, "Serving on %s\n", socket_path);
+    }
+
+    bool running = started;
+    while (running)
+    {
+        int connection = accept(listener, NULL, NULL);
+        if (connection < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            fprintf(stderr, "Cannot accept a client: %s\n", strerror(errno));
+            break;
+        }
+
+        // The socket file may be reachable by others, e.g. at a path given
+        // with --serve, and a run reads and writes files as this user.
+        if (!peerIsSameUser(connection))
+        {
+            fprintf(stderr, "Refusing a client of another user\n");
+            server.statistics->failed_requests++;
+            close(connection);
+            continue;
+        }
+        if (!limitWaiting(connection))
+        {
+            fprintf(stderr, "Cannot set a timeout for a client: %s\n", strerror(errno));
+            server.statistics->failed_requests++;
+            close(connection);
+            continue;
+        }
+
+        running = serveConnection(&server, connection);
+        close(connection);
+
+        // Not arenaReset: it keeps the newest chunk, which may hold a
+        // large source text.
+        arenaDtor(&server.arena);
+        arenaCtor(&server.arena);
+    }
+
+    close(listener);
+    unlink(socket_path);
+
+    arenaDtor(&server.arena);
+    if (server.cache != NULL)
+    {
+        cacheDtor(server.cache);
+    }
+    captureDtor(&server.capture);
+    free(server.buffer);
+    if (server.home >= 0)
+    {
+        close(server.home);
+    }
+
+    return started;
+}
+
+
+int compileClientRun(const char* socket_path, int argc, char** argv, const char* source)
+{
+    assert(socket_path != NULL);
+    assert(argv        != NULL);
+
+    int connection = connectTo(socket_path);
+    if (connection < 0)
+    {
+        fprintf(stderr, "Cannot connect to %s: %s\n", socket_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    char* directory = getcwd(NULL, 0);
+    char* buffer    = (char*)malloc(TRANSFER_BUFFER_SIZE);
+    ResponseHeader response = {};
+
+    bool answered = directory != NULL && buffer != NULL
+                 && sendRequest(connection, RequestKind_RUN, argc, argv, directory, source)
+                 && readAll(connection, &response, sizeof(response))
+                 && response.magic == PROTOCOL_MAGIC
+                 && copyToStream(connection, response.output_length, stdout, buffer)
+                 && copyToStream(connection, response.errors_length, stderr, buffer);
+
+    close(connection);
+    free(directory);
+    free(buffer);
+
+    if (!answered)
+    {
+        fprintf(stderr, "The server at %s did not answer\n", socket_path);
+        return EXIT_FAILURE;
+    }
+
+    return response.exit_code;
+}
+
+
+bool compileClientShutdown(const char* socket_path)
+{
+    assert(socket_path != NULL);
+
+    int connection = connectTo(socket_path);
+    if (connection < 0)
+    {
+        fprintf(stderr, "Cannot connect to %s: %s\n", socket_path, strerror(errno));
+        return false;
+    }
+
+    ResponseHeader response = {};
+    bool answered = sendRequest(connection, RequestKind_SHUTDOWN, 0, NULL, "", NULL)
+                 && readAll(connection, &response, sizeof(response))
+                 && response.magic == PROTOCOL_MAGIC;
+    close(connection);
+
+    return answered;
+}
+
+
+bool compileServerDefaultPath(char* buffer, size_t buffer_size)
+{
+    assert(buffer != NULL);
+
+    const char* runtime_directory = getenv("XDG_RUNTIME_DIR");
+    if (runtime_directory != NULL && runtime_directory[0] == '/')
+    {
+        if (!isOwnPrivateDirectory(runtime_directory))
+        {
+            fprintf(stderr, "%s is not a directory only you can use\n", runtime_directory);
+            return false;
+        }
+        return snprintf(buffer, buffer_size, "%s/language.sock", runtime_directory)
+               < (int)buffer_size;
+    }
+
+    char directory[sizeof(((struct sockaddr_un*)NULL)->sun_path)] = {};
+    snprintf(directory, sizeof(directory), "/tmp/language-%u", (unsigned)getuid());
+    if (mkdir(directory, 0700) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Cannot create %s: %s\n", directory, strerror(errno));
+        return false;
+    }
+    if (!isOwnPrivateDirectory(directory))
+    {
+        fprintf(stderr, "%s is not a directory only you can use\n", directory);
+        return false;
+    }
+
+    return snprintf(buffer, buffer_size, "%s/language.sock", directory) < (int)buffer_size;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+// A socket file nobody listens on is what a killed server leaves behind;
+// one that still answers belongs to a running server and is left alone,
+// and so is any file that is not a socket of this user's.
+static int openListener(const char* socket_path)
+{
+    struct sockaddr_un address = {};
+    if (!fillAddress(socket_path, &address))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return -1;
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        fprintf(stderr, "Cannot create a socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    bool bound = bind(listener, (const struct sockaddr*)&address, sizeof(address)) == 0;
+    if (!bound && errno == EADDRINUSE && isOwnSocket(socket_path))
+    {
+        int probe = connectTo(socket_path);
+        if (probe >= 0)
+        {
+            close(probe);
+            errno = EADDRINUSE;
+        }
+        else if (unlink(socket_path) == 0)
+        {
+            bound = bind(listener, (const struct sockaddr*)&address, sizeof(address)) == 0;
+        }
+    }
+
+    if (!bound || listen(listener, LISTEN_BACKLOG) != 0)
+    {
+        fprintf(stderr, "Cannot listen on %s: %s\n", socket_path, strerror(errno));
+        close(listener);
+        return -1;
+    }
+
+    return listener;
+}
+
+
+// Only to a socket this user created and a server this user runs, so
+// nobody else can stand in for the server and see the requests.
+static int connectTo(const char* socket_path)
+{
+    struct sockaddr_un address = {};
+    if (!fillAddress(socket_path, &address))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (!isOwnSocket(socket_path))
+    {
+        return -1;
+    }
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0)
+    {
+        return -1;
+    }
+
+    if (connect(connection, (const struct sockaddr*)&address, sizeof(address)) != 0
+     || !peerIsSameUser(connection))
+    {
+        int error = errno;
+        close(connection);
+        errno = error;
+        return -1;
+    }
+
+    return connection;
+}
+
+
+static bool fillAddress(const char* socket_path, struct sockaddr_un* address)
+{
+    assert(socket_path != NULL);
+    assert(address     != NULL);
+
+    size_t length = strlen(socket_path);
+    if (length >= sizeof(address->sun_path))
+    {
+        return false;
+    }
+
+    address->sun_family = AF_UNIX;
+    memcpy(address->sun_path, socket_path, length + 1);
+    return true;
+}
+
+
+// lstat, so a symbolic link planted at the path is not followed.
+static bool isOwnSocket(const char* socket_path)
+{
+    assert(socket_path != NULL);
+
+    struct stat status = {};
+    if (lstat(socket_path, &status) != 0)
+    {
+        return false;
+    }
+    if (!S_ISSOCK(status.st_mode) || status.st_uid != getuid())
+    {
+        errno = EPERM;
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool isOwnPrivateDirectory(const char* directory)
+{
+    assert(directory != NULL);
+
+    struct stat status = {};
+    return lstat(directory, &status) == 0 && S_ISDIR(status.st_mode)
+        && status.st_uid == getuid() && (status.st_mode & (S_IRWXG | S_IRWXO)) == 0;
+}
+
+
+// False with errno set to EPERM when the other end runs as someone else.
+static bool peerIsSameUser(int connection)
+{
+    struct ucred credentials = {};
+    socklen_t size = sizeof(credentials);
+    if (getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials, &size) != 0)
+    {
+        return false;
+    }
+    if (credentials.uid != getuid())
+    {
+        errno = EPERM;
+        return false;
+    }
+
+    return true;
+}
+
+
+// Requests are served one at a time, so a client that stops sending its
+// request or reading its result would hold up everyone else. With these
+// timeouts a recv or send that makes no progress for CLIENT_TIMEOUT fails,
+// and the server drops the client and counts the request as failed.
+static bool limitWaiting(int connection)
+{
+    struct timeval timeout = {.tv_sec = CLIENT_TIMEOUT, .tv_usec = 0};
+
+    return setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0
+        && setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == 0;
+}
+
+
+// False once a client has asked the server to stop.
+static bool serveConnection(Server* server, int connection)
+{
+    assert(server != NULL);
+
+    RequestHeader header = {};
+    if (!readAll(connection, &header, sizeof(header)) || header.magic != PROTOCOL_MAGIC)
+    {
+        server->statistics->failed_requests++;
+        return true;
+    }
+
+    if (header.kind == RequestKind_SHUTDOWN)
+    {
+        ResponseHeader response = {.magic = PROTOCOL_MAGIC, .exit_code = EXIT_SUCCESS};
+        writeAll(connection, &response, sizeof(response));
+        return false;
+    }
+
+    CompileRequest request = {};
+    char* directory = NULL;
+    if (header.kind != RequestKind_RUN || !readRequest(server, connection, &header, &request, &directory))
+    {
+        server->statistics->failed_requests++;
+        return true;
+    }
+
+    server->statistics->requests++;
+    if (chdir(directory) != 0)
+    {
+        refuseRequest(connection, "Cannot change to directory", directory);
+        return true;
+    }
+
+    if (!runRequest(server, connection, &request))
+    {
+        server->statistics->failed_requests++;
+    }
+
+    if (fchdir(server->home) != 0)
+    {
+        fprintf(stderr, "Cannot return to the server's directory: %s\n", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool readRequest(Server* server, int connection, const RequestHeader* header,
+                        CompileRequest* request, char** directory)
+{
+    assert(server    != NULL);
+    assert(header    != NULL);
+    assert(request   != NULL);
+    assert(directory != NULL);
+
+    if (header->arguments_number == 0 || header->arguments_number > MAX_ARGUMENTS)
+    {
+        return false;
+    }
+
+    *directory = readString(connection, &server->arena);
+    request->argc = (int)header->arguments_number;
+    request->argv = (char**)arenaAlloc(&server->arena,
+                                       (header->arguments_number + 1) * sizeof(char*));
+    if (*directory == NULL || request->argv == NULL)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < request->argc; i++)
+    {
+        request->argv[i] = readString(connection, &server->arena);
+        if (request->argv[i] == NULL)
+        {
+            return false;
+        }
+    }
+    request->argv[request->argc] = NULL;
+
+    request->source = header->has_source ? readString(connection, &server->arena) : NULL;
+    return !header->has_source || request->source != NULL;
+}
+
+
+// What the key step prints (a bad option, an unreadable file) is dropped:
+// the run that follows prints it again. False when the client did not
+// take the whole result.
+static bool runRequest(Server* server, int connection, const CompileRequest* request)
+{
+    assert(server  != NULL);
+    assert(request != NULL);
+
+    const CompileServerHandler* handler = server->handler;
+    Capture* capture = &server->capture;
+
+    beginCapture(capture);
+    const char* key = NULL;
+    size_t key_length = 0;
+    bool cacheable = handler->key(request, &server->arena, &key, &key_length, handler->context)
+                  && key_length <= MAX_CACHED_KEY;
+    clearCapture(capture);
+
+    uint64_t hash = cacheable ? hashKey(key, key_length) : 0;
+    CachedResult* entry = &server->cache[hash % RESULT_CACHE_CAPACITY];
+    if (cacheable && entry->used && entry->hash == hash && entry->key_length == key_length
+     && memcmp(entry->key, key, key_length) == 0)
+    {
+        endCapture(capture);
+        server->statistics->cache_hits++;
+        return sendResult(connection, entry);
+    }
+
+    int exit_code = runIsolated(handler, request);
+    endCapture(capture);
+
+    size_t output_length = capturedLength(capture->output);
+    size_t errors_length = capturedLength(capture->errors);
+    if (cacheable && output_length <= MAX_CACHED_OUTPUT && errors_length <= MAX_CACHED_OUTPUT
+     && storeResult(entry, key, key_length, hash, exit_code, capture->output, output_length,
+                    capture->errors, errors_length))
+    {
+        return sendResult(connection, entry);
+    }
+
+    ResponseHeader response = {
+        .magic         = PROTOCOL_MAGIC,
+        .exit_code     = exit_code,
+        .output_length = (uint32_t)(output_length < UINT32_MAX ? output_length : UINT32_MAX),
+        .errors_length = (uint32_t)(errors_length < UINT32_MAX ? errors_length : UINT32_MAX),
+    };
+    return writeAll(connection, &response, sizeof(response))
+        && sendCaptured(server, connection, capture->output, response.output_length)
+        && sendCaptured(server, connection, capture->errors, response.errors_length);
+}
+
+
+// The parser and the C runtime end the process on an error, so the run
+// happens in a child forked from the server. It starts with the code
+// already loaded and linked and with what the key step read, but builds
+// its arenas, tables and tree afresh, and they go away with it. Its stdout
+// and stderr are the capture files.
+static int runIsolated(const CompileServerHandler* handler, const CompileRequest* request)
+{
+    assert(handler != NULL);
+    assert(request != NULL);
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t child = fork();
+    if (child < 0)
+    {
+        fprintf(stderr, "Cannot start the run: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (child == 0)
+    {
+        exit(handler->run(request, handler->context));
+    }
+
+    int status = 0;
+    while (waitpid(child, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            fprintf(stderr, "Cannot wait for the run: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (WIFSIGNALED(status))
+    {
+        fprintf(stderr, "The run was killed by signal %d\n", WTERMSIG(status));
+        return EXIT_FAILURE;
+    }
+
+    return WEXITSTATUS(status);
+}
+
+
+static void refuseRequest(int connection, const char* message, const char* detail)
+{
+    assert(message != NULL);
+    assert(detail  != NULL);
+
+    char text[256] = {};
+    int length = snprintf(text, sizeof(text), "%s %s: %s\n", message, detail, strerror(errno));
+    size_t size = length < 0 ? 0 : (size_t)length < sizeof(text) ? (size_t)length : sizeof(text) - 1;
+
+    ResponseHeader response = {
+        .magic         = PROTOCOL_MAGIC,
+        .exit_code     = EXIT_FAILURE,
+        .output_length = 0,
+        .errors_length = (uint32_t)size,
+    };
+    if (writeAll(connection, &response, sizeof(response)))
+    {
+        writeAll(connection, text, size);
+    }
+}
+
+
+static bool captureCtor(Capture* capture)
+{
+    assert(capture != NULL);
+
+    capture->output       = tmpfile();
+    capture->errors       = tmpfile();
+    capture->saved_output = dup(STDOUT_FILENO);
+    capture->saved_errors = dup(STDERR_FILENO);
+
+    return capture->output != NULL && capture->errors != NULL
+        && capture->saved_output >= 0 && capture->saved_errors >= 0;
+}
+
+
+static void captureDtor(Capture* capture)
+{
+    assert(capture != NULL);
+
+    if (capture->output != NULL)
+    {
+        fclose(capture->output);
+    }
+    if (capture->errors != NULL)
+    {
+        fclose(capture->errors);
+    }
+    if (capture->saved_output >= 0)
+    {
+        close(capture->saved_output);
+    }
+    if (capture->saved_errors >= 0)
+    {
+        close(capture->saved_errors);
+    }
+
+    capture->output       = NULL;
+    capture->errors       = NULL;
+    capture->saved_output = -1;
+    capture->saved_errors = -1;
+}
+
+
+static void beginCapture(Capture* capture)
+{
+    assert(capture != NULL);
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(fileno(capture->output), STDOUT_FILENO);
+    dup2(fileno(capture->errors), STDERR_FILENO);
+    clearCapture(capture);
+}
+
+
+// The descriptors share their offset with stdout and stderr, so both
+// start over at the beginning of the emptied files.
+static void clearCapture(Capture* capture)
+{
+    assert(capture != NULL);
+
+    fflush(stdout);
+    fflush(stderr);
+    if (ftruncate(fileno(capture->output), 0) != 0 || ftruncate(fileno(capture->errors), 0) != 0)
+    {
+        return;
+    }
+    lseek(fileno(capture->output), 0, SEEK_SET);
+    lseek(fileno(capture->errors), 0, SEEK_SET);
+}
+
+
+static void endCapture(Capture* capture)
+{
+    assert(capture != NULL);
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(capture->saved_output, STDOUT_FILENO);
+    dup2(capture->saved_errors, STDERR_FILENO);
+}
+
+
+static size_t capturedLength(FILE* file)
+{
+    assert(file != NULL);
+
+    struct stat status = {};
+    if (fstat(fileno(file), &status) != 0 || status.st_size < 0)
+    {
+        return 0;
+    }
+
+    return (size_t)status.st_size;
+}
+
+
+static char* readCaptured(FILE* file, size_t length)
+{
+    assert(file != NULL);
+
+    char* text = (char*)malloc(length + 1);
+    if (text == NULL)
+    {
+        return NULL;
+    }
+
+    size_t done = 0;
+    while (done < length)
+    {
+        ssize_t read_now = pread(fileno(file), text + done, length - done, (off_t)done);
+        if (read_now <= 0)
+        {
+            free(text);
+            return NULL;
+        }
+        done += (size_t)read_now;
+    }
+
+    text[length] = '\0';
+    return text;
+}
+
+
+static bool sendCaptured(Server* server, int connection, FILE* file, size_t length)
+{
+    assert(server != NULL);
+    assert(file   != NULL);
+
+    size_t done = 0;
+    while (done < length)
+    {
+        size_t chunk = length - done < TRANSFER_BUFFER_SIZE ? length - done : TRANSFER_BUFFER_SIZE;
+        ssize_t read_now = pread(fileno(file), server->buffer, chunk, (off_t)done);
+        if (read_now <= 0 || !writeAll(connection, server->buffer, (size_t)read_now))
+        {
+            return false;
+        }
+        done += (size_t)read_now;
+    }
+
+    return true;
+}
+
+
+// FNV-1a: it only spreads keys over the entries, so it need not resist
+// collisions.
+static uint64_t hashKey(const char* key, size_t key_length)
+{
+    assert(key != NULL || key_length == 0);
+
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < key_length; i++)
+    {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+
+static bool storeResult(CachedResult* entry, const char* key, size_t key_length,
+                        uint64_t hash, int exit_code, FILE* output,
+                        size_t output_length, FILE* errors, size_t errors_length)
+{
+    assert(entry  != NULL);
+    assert(key    != NULL || key_length == 0);
+    assert(output != NULL);
+    assert(errors != NULL);
+
+    char* key_copy    = (char*)malloc(key_length + 1);
+    char* output_text = readCaptured(output, output_length);
+    char* errors_text = readCaptured(errors, errors_length);
+    if (key_copy == NULL || output_text == NULL || errors_text == NULL)
+    {
+        free(key_copy);
+        free(output_text);
+        free(errors_text);
+        return false;
+    }
+    if (key_length != 0)
+    {
+        memcpy(key_copy, key, key_length);
+    }
+
+    free(entry->key);
+    free(entry->output);
+    free(entry->errors);
+    entry->hash          = hash;
+    entry->key           = key_copy;
+    entry->key_length    = key_length;
+    entry->used          = true;
+    entry->exit_code     = exit_code;
+    entry->output        = output_text;
+    entry->output_length = output_length;
+    entry->errors        = errors_text;
+    entry->errors_length = errors_length;
+
+    return true;
+}
+
+
+static bool sendResult(int connection, const CachedResult* entry)
+{
+    assert(entry != NULL);
+
+    ResponseHeader response = {
+        .magic         = PROTOCOL_MAGIC,
+        .exit_code     = entry->exit_code,
+        .output_length = (uint32_t)entry->output_length,
+        .errors_length = (uint32_t)entry->errors_length,
+    };
+
+    return writeAll(connection, &response, sizeof(response))
+        && writeAll(connection, entry->output, entry->output_length)
+        && writeAll(connection, entry->errors, entry->errors_length);
+}
+
+
+static void cacheDtor(CachedResult* cache)
+{
+    assert(cache != NULL);
+
+    for (size_t i = 0; i < RESULT_CACHE_CAPACITY; i++)
+    {
+        free(cache[i].key);
+        free(cache[i].output);
+        free(cache[i].errors);
+    }
+    free(cache);
+}
+
+
+static bool sendRequest(int connection, RequestKind kind, int argc, char** argv,
+                        const char* directory, const char* source)
+{
+    assert(argc == 0 || argv != NULL);
+    assert(directory != NULL);
+
+    RequestHeader header = {
+        .magic            = PROTOCOL_MAGIC,
+        .kind             = (uint32_t)kind,
+        .arguments_number = (uint32_t)argc,
+        .has_source       = source != NULL,
+    };
+    if (!writeAll(connection, &header, sizeof(header)))
+    {
+        return false;
+    }
+
+    if (kind == RequestKind_SHUTDOWN)
+    {
+        return true;
+    }
+
+    bool sent = writeString(connection, directory);
+    for (int i = 0; sent && i < argc; i++)
+    {
+        sent = writeString(connection, argv[i]);
+    }
+
+    return sent && (source == NULL || writeString(connection, source));
+}
+
+
+static bool copyToStream(int connection, size_t length, FILE* stream, char* buffer)
+{
+    assert(stream != NULL);
+    assert(buffer != NULL);
+
+    while (length > 0)
+    {
+        size_t chunk = length < TRANSFER_BUFFER_SIZE ? length : TRANSFER_BUFFER_SIZE;
+        if (!readAll(connection, buffer, chunk))
+        {
+            return false;
+        }
+        fwrite(buffer, 1, chunk, stream);
+        length -= chunk;
+    }
+
+    return fflush(stream) == 0;
+}
+
+
+static char* readString(int connection, Arena* arena)
+{
+    assert(arena != NULL);
+
+    uint32_t length = 0;
+    if (!readAll(connection, &length, sizeof(length)) || length > MAX_STRING_LENGTH)
+    {
+        return NULL;
+    }
+
+    char* text = (char*)arenaAlloc(arena, (size_t)length + 1);
+    if (text == NULL || !readAll(connection, text, length))
+    {
+        return NULL;
+    }
+
+    text[length] = '\0';
+    return text;
+}
+
+
+static bool writeString(int connection, const char* text)
+{
+    assert(text != NULL);
+
+    size_t length = strlen(text);
+    if (length > MAX_STRING_LENGTH)
+    {
+        return false;
+    }
+
+    uint32_t length32 = (uint32_t)length;
+    return writeAll(connection, &length32, sizeof(length32)) && writeAll(connection, text, length);
+}
+
+
+static bool readAll(int connection, void* data, size_t size)
+{
+    char* bytes = (char*)data;
+    while (size > 0)
+    {
+        ssize_t received = recv(connection, bytes, size, 0);
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            return false;
+        }
+        bytes += received;
+        size  -= (size_t)received;
+    }
+
+    return true;
+}
+
+
+// MSG_NOSIGNAL: a client that went away must not take the server down
+// with SIGPIPE.
+static bool writeAll(int connection, const void* data, size_t size)
+{
+    const char* bytes = (const char*)data;
+    while (size > 0)
+    {
+        ssize_t sent = send(connection, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (sent <= 0)
+        {
+            return false;
+        }
+        bytes += sent;
+        size  -= (size_t)sent;
+    }
+
+    return true;
+}
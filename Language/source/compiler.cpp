@@ -0,0 +1,797 @@
+#include "compiler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tree_node_structure.h"
+#include "lexical_analysis.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct Compiler
+{
+    Tree*                ast;
+    const Resolution*    resolution;
+    const TypeInference* types;
+    Chunk*               chunk;
+    CompilerState        state;
+    int                  stack_depth;
+} Compiler;
+
+typedef struct SwitchCase
+{
+    int64_t key;
+    int     body;       // node index
+    size_t  order;      // position in the ladder
+} SwitchCase;
+
+static void compileStatements(Compiler* compiler, int cell_index);
+static void compileStatement(Compiler* compiler, int node_index);
+static void compileIf(Compiler* compiler, const TreeNode* node);
+static bool compileSwitch(Compiler* compiler, const TreeNode* node);
+static bool switchCase(const Compiler* compiler, const TreeNode* node, int* slot, int64_t* key);
+static size_t uniqueCases(SwitchCase* cases, size_t cases_number);
+static bool buildSwitchTable(const SwitchCase* cases, const uint32_t* arms, size_t cases_number,
+                             uint32_t fallthrough, SwitchTable* table);
+static int compareCases(const void* first, const void* second);
+static void compileWhile(Compiler* compiler, const TreeNode* node);
+static void compileExpression(Compiler* compiler, int node_index);
+static void compileLogical(Compiler* compiler, const TreeNode* node);
+static void compileConstant(Compiler* compiler, Value value, int line);
+
+static size_t emit(Compiler* compiler, Opcode opcode, uint32_t operand, int line);
+static size_t emitJump(Compiler* compiler, Opcode opcode, int line);
+static void patchJump(Compiler* compiler, size_t jump_offset);
+static void copySlotNames(Compiler* compiler);
+
+static Opcode binaryOpcode(int operation);
+static Opcode doubleOpcode(Opcode opcode);
+static bool isDoubleOperand(const Compiler* compiler, int node_index, int other_index);
+static void compileDoubleOperand(Compiler* compiler, int node_index);
+static const uint32_t UNPATCHED_JUMP = 0;
+
+// Shorter ladders are as fast as compare-and-branch instructions.
+static const size_t SWITCH_MIN_CASES = 4;
+
+static const int64_t EXACT_DOUBLE_INTEGER = (int64_t)1 << 53;
+
+
+// public ---------------------------------------------------------------------
+
+
+CompilerState compileProgram(Tree* ast, const Resolution* resolution,
+                             const TypeInference* types, Chunk* chunk)
+{
+    assert(ast        != NULL);
+    assert(resolution != NULL);
+    assert(chunk      != NULL);
+
+    Compiler compiler = {
+        .ast         = ast,
+        .resolution  = resolution,
+        .types       = types,
+        .chunk       = chunk,
+        .state       = CompilerState_OK,
+        .stack_depth = 0,
+    };
+
+    copySlotNames(&compiler);
+
+    if (ast->nodes_number > 0)
+    {
+        compileStatements(&compiler, ast->nodes_array[0].left_index);
+    }
+
+    emit(&compiler, OP_HALT, 0, 0);
+
+    return compiler.state;
+}
+
+
+const char* compilerStateToString(CompilerState state)
+{
+    switch (state)
+    {
+        case CompilerState_OK:           return "ok";
+        case CompilerState_TOO_LARGE:    return "program is too large for the bytecode format";
+        case CompilerState_BAD_TREE:     return "malformed syntax tree";
+        case CompilerState_MEMORY_ERROR: return "out of memory";
+        default:                         return "unknown error";
+    }
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static void compileStatements(Compiler* compiler, int cell_index)
+{
+    assert(compiler != NULL);
+
+    TreeNode* nodes = compiler->ast->nodes_array;
+    while (cell_index != EMPTY_NODE && compiler->state == CompilerState_OK)
+    {
+        compileStatement(compiler, nodes[cell_index].left_index);
+        cell_index = nodes[cell_index].right_index;
+    }
+}
+
+
+static void compileStatement(Compiler* compiler, int node_index)
+{
+    assert(compiler != NULL);
+
+    const TreeNode* node = &compiler->ast->nodes_array[node_index];
+    int line = node->data.line;
+
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_VAR_DECLARATION:
+        case SyntaxNodeType_ASSIGNMENT:
+        {
+            compileExpression(compiler, node->right_index);
+            int slot = compiler->resolution->node_slots[node->left_index];
+            emit(compiler, OP_STORE, (uint32_t)slot, line);
+            break;
+        }
+
+        case SyntaxNodeType_IF:
+            compileIf(compiler, node);
+            break;
+
+        case SyntaxNodeType_WHILE:
+            compileWhile(compiler, node);
+            break;
+
+        case SyntaxNodeType_BLOCK:
+        case SyntaxNodeType_PROGRAM:
+        case SyntaxNodeType_STATEMENT:
+            compileStatements(compiler, node->left_index);
+            break;
+
+        case SyntaxNodeType_PRINT:
+            compileExpression(compiler, node->left_index);
+            emit(compiler, OP_PRINT, 0, line);
+            break;
+
+        case SyntaxNodeType_ELSE:
+        case SyntaxNodeType_BINARY_OPERATION:
+        case SyntaxNodeType_UNARY_OPERATION:
+        case SyntaxNodeType_NUMBER:
+        case SyntaxNodeType_INTEGER:
+        case SyntaxNodeType_STRING:
+        case SyntaxNodeType_IDENTIFIER:
+        case SyntaxNodeType_BOOL:
+        default:
+            compiler->state = CompilerState_BAD_TREE;
+            break;
+    }
+}
+
+
+static void compileIf(Compiler* compiler, const TreeNode* node)
+{
+    assert(compiler != NULL);
+    assert(node     != NULL);
+
+    if (compileSwitch(compiler, node))
+    {
+        return;
+    }
+
+    const TreeNode* branches = &compiler->ast->nodes_array[node->right_index];
+    bool has_else = branches->data.type == SyntaxNodeType_ELSE;
+    int line = node->data.line;
+
+    compileExpression(compiler, node->left_index);
+    size_t else_jump = emitJump(compiler, OP_JUMP_IF_FALSE, line);
+
+    compileStatement(compiler, has_else ? branches->left_index : node->right_index);
+    if (!has_else)
+    {
+        patchJump(compiler, else_jump);
+        return;
+    }
+
+    size_t end_jump = emitJump(compiler, OP_JUMP, line);
+    patchJump(compiler, else_jump);
+    compileStatement(compiler, branches->right_index);
+    patchJump(compiler, end_jump);
+}
+
+
+// An else-if ladder that compares one variable with integer literals
+// dispatches through a switch table instead of testing the cases in turn:
+//         LOAD x
+//         SWITCH table
+//         the final else branch, if any
+//         JUMP end
+//   case: body              one per case, by value; all but the last
+//         JUMP end          end with a jump
+//   end:
+// Reading a variable and comparing it for equality cannot fail, so the
+// order the cases are tested in does not matter. A repeated case can never
+// run and is left out. Returns false, having emitted nothing, when node
+// does not start a long enough ladder.
+static bool compileSwitch(Compiler* compiler, const TreeNode* node)
+{
+    assert(compiler != NULL);
+    assert(node     != NULL);
+
+    const TreeNode* nodes = compiler->ast->nodes_array;
+    SwitchCase* cases = NULL;
+    size_t cases_number   = 0;
+    size_t cases_capacity = 0;
+
+    int slot = -1;
+    int link_index = (int)(node - nodes);
+    while (link_index != EMPTY_NODE)
+    {
+        const TreeNode* link = &nodes[link_index];
+        int case_slot = -1;
+        int64_t key = 0;
+        if (!switchCase(compiler, link, &case_slot, &key) || (slot != -1 && case_slot != slot))
+        {
+            break;
+        }
+        slot = case_slot;
+
+        if (cases_number == cases_capacity)
+        {
+            size_t capacity = cases_capacity == 0 ? 16 : cases_capacity * 2;
+            SwitchCase* grown = (SwitchCase*)realloc(cases, capacity * sizeof(SwitchCase));
+            if (grown == NULL)
+            {
+                free(cases);
+                compiler->state = CompilerState_MEMORY_ERROR;
+                return true;
+            }
+            cases          = grown;
+            cases_capacity = capacity;
+        }
+
+        const TreeNode* branches = &nodes[link->right_index];
+        bool has_else = branches->data.type == SyntaxNodeType_ELSE;
+        cases[cases_number] = (SwitchCase){
+            .key   = key,
+            .body  = has_else ? branches->left_index : link->right_index,
+            .order = cases_number,
+        };
+        cases_number++;
+
+        link_index = has_else ? branches->right_index : EMPTY_NODE;
+    }
+
+    if (cases_number < SWITCH_MIN_CASES)
+    {
+        free(cases);
+        return false;
+    }
+
+    qsort(cases, cases_number, sizeof(SwitchCase), compareCases);
+    cases_number = uniqueCases(cases, cases_number);
+
+    size_t*   end_jumps = (size_t*)  calloc(cases_number, sizeof(size_t));
+    uint32_t* arms      = (uint32_t*)calloc(cases_number, sizeof(uint32_t));
+    if (end_jumps == NULL || arms == NULL)
+    {
+        free(cases);
+        free(end_jumps);
+        free(arms);
+        compiler->state = CompilerState_MEMORY_ERROR;
+        return true;
+    }
+
+    int line = node->data.line;
+    emit(compiler, OP_LOAD, (uint32_t)slot, line);
+    size_t switch_offset = emit(compiler, OP_SWITCH, 0, line);
+
+    if (link_index != EMPTY_NODE)
+    {
+        compileStatement(compiler, link_index);
+    }
+
+    for (size_t i = 0; i < cases_number && compiler->state == CompilerState_OK; i++)
+    {
+        end_jumps[i] = emitJump(compiler, OP_JUMP, line);
+        arms[i] = (uint32_t)compiler->chunk->code_size;
+        compileStatement(compiler, cases[i].body);
+    }
+
+    for (size_t i = 0; i < cases_number; i++)
+    {
+        patchJump(compiler, end_jumps[i]);
+    }
+
+    SwitchTable table = {};
+    uint32_t index = 0;
+    if (compiler->state == CompilerState_OK)
+    {
+        if (!buildSwitchTable(cases, arms, cases_number, (uint32_t)switch_offset + 1, &table)
+         || !chunkAddSwitch(compiler->chunk, table, &index))
+        {
+            compiler->state = CompilerState_MEMORY_ERROR;
+        }
+        else
+        {
+            compiler->chunk->code[switch_offset] = makeInstruction(OP_SWITCH, index);
+        }
+    }
+
+    free(cases);
+    free(end_jumps);
+    free(arms);
+
+    return true;
+}
+
+
+// node is "if (x == k)" or "if (k == x)" with an integer literal k.
+static bool switchCase(const Compiler* compiler, const TreeNode* node, int* slot, int64_t* key)
+{
+    assert(compiler != NULL);
+    assert(node     != NULL);
+    assert(slot     != NULL);
+    assert(key      != NULL);
+
+    const TreeNode* nodes = compiler->ast->nodes_array;
+    if (node->data.type != SyntaxNodeType_IF || node->left_index == EMPTY_NODE)
+    {
+        return false;
+    }
+
+    const TreeNode* condition = &nodes[node->left_index];
+    if (condition->data.type != SyntaxNodeType_BINARY_OPERATION
+     || condition->data.data.operation != TOKEN_EQEQ)
+    {
+        return false;
+    }
+
+    int variable = condition->left_index;
+    int literal  = condition->right_index;
+    if (nodes[variable].data.type == SyntaxNodeType_INTEGER)
+    {
+        variable = condition->right_index;
+        literal  = condition->left_index;
+    }
+
+    if (nodes[variable].data.type != SyntaxNodeType_IDENTIFIER
+     || nodes[literal].data.type  != SyntaxNodeType_INTEGER)
+    {
+        return false;
+    }
+
+    *slot = compiler->resolution->node_slots[variable];
+    *key  = nodes[literal].data.data.integer;
+
+    return true;
+}
+
+
+// cases is sorted by key and then by order; only the first of each key
+// stays. Returns how many are left.
+static size_t uniqueCases(SwitchCase* cases, size_t cases_number)
+{
+    assert(cases != NULL);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < cases_number; i++)
+    {
+        if (kept == 0 || cases[kept - 1].key != cases[i].key)
+        {
+            cases[kept++] = cases[i];
+        }
+    }
+
+    return kept;
+}
+
+
+// Dense when at least half of the values from the smallest case to the
+// largest are cases, sparse otherwise.
+static bool buildSwitchTable(const SwitchCase* cases, const uint32_t* arms, size_t cases_number,
+                             uint32_t fallthrough, SwitchTable* table)
+{
+    assert(cases != NULL);
+    assert(arms  != NULL);
+    assert(table != NULL);
+    assert(cases_number > 0);
+
+    uint64_t span = (uint64_t)cases[cases_number - 1].key - (uint64_t)cases[0].key;
+    bool dense = span < 2 * (uint64_t)cases_number;
+    size_t entries_number = dense ? (size_t)span + 1 : cases_number;
+
+    *table = (SwitchTable){
+        .keys           = dense ? NULL : (int64_t*)calloc(entries_number, sizeof(int64_t)),
+        .minimum        = cases[0].key,
+        .targets        = (uint32_t*)calloc(entries_number, sizeof(uint32_t)),
+        .entries_number = (uint32_t)entries_number,
+    };
+
+    if (table->targets == NULL || (!dense && table->keys == NULL))
+    {
+        free(table->keys);
+        free(table->targets);
+        return false;
+    }
+
+    for (size_t entry = 0; dense && entry < entries_number; entry++)
+    {
+        table->targets[entry] = fallthrough;
+    }
+
+    for (size_t i = 0; i < cases_number; i++)
+    {
+        size_t entry = dense ? (size_t)((uint64_t)cases[i].key - (uint64_t)cases[0].key) : i;
+        table->targets[entry] = arms[i];
+        if (!dense)
+        {
+            table->keys[entry] = cases[i].key;
+        }
+    }
+
+    return true;
+}
+
+
+static int compareCases(const void* first, const void* second)
+{
+    const SwitchCase* left  = (const SwitchCase*)first;
+    const SwitchCase* right = (const SwitchCase*)second;
+
+    if (left->key != right->key)
+    {
+        return left->key < right->key ? -1 : 1;
+    }
+    return left->order < right->order ? -1 : (left->order > right->order ? 1 : 0);
+}
+
+
+// The condition is placed after the body so that each iteration costs a
+// single conditional backward jump:
+//         JUMP condition
+//   body: ...
+//   condition: ...
+//         JUMP_IF_TRUE body
+static void compileWhile(Compiler* compiler, const TreeNode* node)
+{
+    assert(compiler != NULL);
+    assert(node     != NULL);
+
+    int line = node->data.line;
+    size_t entry_jump = emitJump(compiler, OP_JUMP, line);
+
+    size_t body_start = compiler->chunk->code_size;
+    compileStatement(compiler, node->right_index);
+
+    patchJump(compiler, entry_jump);
+    compileExpression(compiler, node->left_index);
+    emit(compiler, OP_JUMP_IF_TRUE, (uint32_t)body_start, line);
+}
+
+
+static void compileExpression(Compiler* compiler, int node_index)
+{
+    assert(compiler != NULL);
+
+    if (node_index == EMPTY_NODE)
+    {
+        compiler->state = CompilerState_BAD_TREE;
+        return;
+    }
+
+    const TreeNode* node = &compiler->ast->nodes_array[node_index];
+    int line = node->data.line;
+
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_NUMBER:
+            compileConstant(compiler, valueNumber(node->data.data.number), line);
+            break;
+
+        case SyntaxNodeType_INTEGER:
+        {
+            Value integer = {};
+            if (valueMakeInteger(node->data.data.integer, &compiler->chunk->names_arena, &integer)
+                != RuntimeState_OK)
+            {
+                compiler->state = CompilerState_MEMORY_ERROR;
+                return;
+            }
+            compileConstant(compiler, integer, line);
+            break;
+        }
+
+        case SyntaxNodeType_BOOL:
+            emit(compiler, node->data.data.boolean ? OP_TRUE : OP_FALSE, 0, line);
+            break;
+
+        case SyntaxNodeType_STRING:
+        {
+            const char* text = node->data.data.string;
+            char* copy = arenaStrndup(&compiler->chunk->names_arena, text, strlen(text));
+            if (copy == NULL)
+            {
+                compiler->state = CompilerState_MEMORY_ERROR;
+                return;
+            }
+            compileConstant(compiler, valueString(copy), line);
+            break;
+        }
+
+        case SyntaxNodeType_IDENTIFIER:
+            emit(compiler, OP_LOAD, (uint32_t)compiler->resolution->node_slots[node_index], line);
+            break;
+
+        case SyntaxNodeType_BINARY_OPERATION:
+            if (node->data.data.operation == TOKEN_AND
+             || node->data.data.operation == TOKEN_OR)
+            {
+                compileLogical(compiler, node);
+                break;
+            }
+
+        {
+            Opcode opcode = binaryOpcode(node->data.data.operation);
+            if (opcode == OP_HALT)
+            {
+                compiler->state = CompilerState_BAD_TREE;
+                return;
+            }
+
+            if (doubleOpcode(opcode) != opcode
+             && isDoubleOperand(compiler, node->left_index, node->right_index)
+             && isDoubleOperand(compiler, node->right_index, node->left_index))
+            {
+                opcode = doubleOpcode(opcode);
+                compileDoubleOperand(compiler, node->left_index);
+                compileDoubleOperand(compiler, node->right_index);
+                emit(compiler, opcode, 0, line);
+                break;
+            }
+
+            compileExpression(compiler, node->left_index);
+            compileExpression(compiler, node->right_index);
+            emit(compiler, opcode, 0, line);
+            break;
+        }
+
+        case SyntaxNodeType_UNARY_OPERATION:
+        {
+            Opcode opcode = OP_HALT;
+            switch (node->data.data.operation)
+            {
+                case TOKEN_BANG:        opcode = OP_NOT;    break;
+                case TOKEN_MINUS:       opcode = OP_NEGATE; break;
+                case TOKEN_LBRACKET:    opcode = OP_ARRAY;  break;
+                case TOKEN_KEYWORD_LEN: opcode = OP_LENGTH; break;
+                default:
+                    compiler->state = CompilerState_BAD_TREE;
+                    return;
+            }
+            if (opcode == OP_NEGATE && staticTypeIsDouble(compiler->types, node->left_index))
+            {
+                opcode = OP_NEGATE_DOUBLE;
+            }
+
+            compileExpression(compiler, node->left_index);
+            emit(compiler, opcode, 0, line);
+            break;
+        }
+
+        default:
+            compiler->state = CompilerState_BAD_TREE;
+            break;
+    }
+}
+
+
+//   left                          left
+//   JUMP_IF_FALSE short           JUMP_IF_TRUE short
+//   right                         right
+//   TRUTHY                        TRUTHY
+//   JUMP end                      JUMP end
+//   short: FALSE                  short: TRUE
+//   end:                          end:
+static void compileLogical(Compiler* compiler, const TreeNode* node)
+{
+    assert(compiler != NULL);
+    assert(node     != NULL);
+
+    bool is_and = node->data.data.operation == TOKEN_AND;
+    int line = node->data.line;
+
+    compileExpression(compiler, node->left_index);
+    size_t short_jump = emitJump(compiler, is_and ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE, line);
+
+    compileExpression(compiler, node->right_index);
+    emit(compiler, OP_TRUTHY, 0, line);
+    size_t end_jump = emitJump(compiler, OP_JUMP, line);
+
+    // Only one of the two paths runs, the value pushed below replaces the
+    // one produced by the right operand.
+    compiler->stack_depth--;
+    patchJump(compiler, short_jump);
+    emit(compiler, is_and ? OP_FALSE : OP_TRUE, 0, line);
+    patchJump(compiler, end_jump);
+}
+
+
+static void compileConstant(Compiler* compiler, Value value, int line)
+{
+    assert(compiler != NULL);
+
+    uint32_t index = 0;
+    if (!chunkAddConstant(compiler->chunk, value, &index))
+    {
+        compiler->state = compiler->chunk->constants_number > MAX_OPERAND
+                        ? CompilerState_TOO_LARGE
+                        : CompilerState_MEMORY_ERROR;
+        return;
+    }
+
+    emit(compiler, OP_CONSTANT, index, line);
+}
+
+
+static size_t emit(Compiler* compiler, Opcode opcode, uint32_t operand, int line)
+{
+    assert(compiler != NULL);
+
+    if (compiler->state != CompilerState_OK)
+    {
+        return 0;
+    }
+
+    if (operand > MAX_OPERAND || compiler->chunk->code_size > MAX_OPERAND)
+    {
+        compiler->state = CompilerState_TOO_LARGE;
+        return 0;
+    }
+
+    if (!chunkWrite(compiler->chunk, makeInstruction(opcode, operand), line))
+    {
+        compiler->state = CompilerState_MEMORY_ERROR;
+        return 0;
+    }
+
+    compiler->stack_depth += opcodeStackEffect(opcode);
+    if (compiler->stack_depth > (int)compiler->chunk->max_stack)
+    {
+        compiler->chunk->max_stack = (size_t)compiler->stack_depth;
+    }
+
+    return compiler->chunk->code_size - 1;
+}
+
+
+static size_t emitJump(Compiler* compiler, Opcode opcode, int line)
+{
+    assert(compiler != NULL);
+
+    return emit(compiler, opcode, UNPATCHED_JUMP, line);
+}
+
+
+static void patchJump(Compiler* compiler, size_t jump_offset)
+{
+    assert(compiler != NULL);
+
+    if (compiler->state != CompilerState_OK)
+    {
+        return;
+    }
+
+    Instruction* jump = &compiler->chunk->code[jump_offset];
+    *jump = makeInstruction(instructionOpcode(*jump), (uint32_t)compiler->chunk->code_size);
+}
+
+
+static void copySlotNames(Compiler* compiler)
+{
+    assert(compiler != NULL);
+
+    Chunk* chunk = compiler->chunk;
+    size_t slots_number = compiler->resolution->slots_number;
+
+    chunk->slots_number = slots_number;
+    chunk->slot_names   = (const char**)calloc(slots_number + 1, sizeof(const char*));
+    if (chunk->slot_names == NULL)
+    {
+        compiler->state = CompilerState_MEMORY_ERROR;
+        return;
+    }
+
+    for (size_t slot = 0; slot < slots_number; slot++)
+    {
+        const char* name = compiler->resolution->slot_names[slot];
+        chunk->slot_names[slot] = arenaStrndup(&chunk->names_arena, name, strlen(name));
+        if (chunk->slot_names[slot] == NULL)
+        {
+            compiler->state = CompilerState_MEMORY_ERROR;
+            return;
+        }
+    }
+}
+
+
+static Opcode binaryOpcode(int operation)
+{
+    switch (operation)
+    {
+        case TOKEN_PLUS:           return OP_ADD;
+        case TOKEN_MINUS:          return OP_SUBTRACT;
+        case TOKEN_STAR:           return OP_MULTIPLY;
+        case TOKEN_SLASH:          return OP_DIVIDE;
+        case TOKEN_PERCENT:        return OP_MODULO;
+        case TOKEN_EQEQ:           return OP_EQUAL;
+        case TOKEN_BANGEQ:         return OP_NOT_EQUAL;
+        case TOKEN_LT:             return OP_LESS;
+        case TOKEN_GT:             return OP_GREATER;
+        case TOKEN_LTEQ:           return OP_LESS_EQUAL;
+        case TOKEN_GTEQ:           return OP_GREATER_EQUAL;
+        case TOKEN_LBRACKET:       return OP_INDEX;
+        case TOKEN_COMMA:          return OP_APPEND;
+        case TOKEN_KEYWORD_ARRAY:  return OP_FILL;
+        default:                   return OP_HALT;
+    }
+}
+
+
+// Both operands are doubles. EQUAL and NOT_EQUAL have no tag check to
+// skip worth an opcode.
+static Opcode doubleOpcode(Opcode opcode)
+{
+    switch (opcode)
+    {
+        case OP_ADD:           return OP_ADD_DOUBLE;
+        case OP_SUBTRACT:      return OP_SUBTRACT_DOUBLE;
+        case OP_MULTIPLY:      return OP_MULTIPLY_DOUBLE;
+        case OP_DIVIDE:        return OP_DIVIDE_DOUBLE;
+        case OP_MODULO:        return OP_MODULO_DOUBLE;
+        case OP_LESS:          return OP_LESS_DOUBLE;
+        case OP_GREATER:       return OP_GREATER_DOUBLE;
+        case OP_LESS_EQUAL:    return OP_LESS_EQUAL_DOUBLE;
+        case OP_GREATER_EQUAL: return OP_GREATER_EQUAL_DOUBLE;
+        default:               return opcode;
+    }
+}
+
+
+// An integer literal next to a double operand is converted by the
+// operation anyway, so it can be compiled as a double constant instead.
+// Only literals up to 2^53 qualify: above it the conversion rounds, and
+// comparisons with a double are exact.
+static bool isDoubleOperand(const Compiler* compiler, int node_index, int other_index)
+{
+    assert(compiler != NULL);
+
+    if (staticTypeIsDouble(compiler->types, node_index))
+    {
+        return true;
+    }
+
+    const TreeNode* node = &compiler->ast->nodes_array[node_index];
+    return node->data.type == SyntaxNodeType_INTEGER
+        && node->data.data.integer >= -EXACT_DOUBLE_INTEGER
+        && node->data.data.integer <=  EXACT_DOUBLE_INTEGER
+        && staticTypeIsDouble(compiler->types, other_index);
+}
+
+
+static void compileDoubleOperand(Compiler* compiler, int node_index)
+{
+    assert(compiler != NULL);
+
+    const TreeNode* node = &compiler->ast->nodes_array[node_index];
+    if (node->data.type == SyntaxNodeType_INTEGER)
+    {
+        compileConstant(compiler, valueNumber((double)node->data.data.integer), node->data.line);
+        return;
+    }
+
+    compileExpression(compiler, node_index);
+}
@@ -0,0 +1,616 @@
+#include "constant_propagation.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tree_node_structure.h"
+#include "lexical_analysis.h"
+#include "value.h"
+#include "arena.h"
+#include "ssa.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef enum LatticeLevel
+{
+    LatticeLevel_UNDEFINED   = 0,   // not reached yet
+    LatticeLevel_CONSTANT    = 1,
+    LatticeLevel_OVERDEFINED = 2,   // differs between runs or paths
+} LatticeLevel;
+
+typedef struct LatticeValue
+{
+    LatticeLevel level;
+    Value        value;
+} LatticeValue;
+
+typedef struct Propagator
+{
+    const SsaFunction* function;
+    LatticeValue*      values;
+    Arena              arena;           // strings built while evaluating
+
+    bool*              executable_edges;// indexed like SsaFunction::predecessors
+    int*               edge_targets;
+    bool*              visited_blocks;
+
+    int*               users;           // users[first_user[v] .. first_user[v + 1])
+    int*               first_user;
+
+    int*               edge_worklist;
+    size_t             edge_worklist_size;
+    int*               value_worklist;
+    size_t             value_worklist_size;
+    bool*              queued_values;
+} Propagator;
+
+static bool propagatorCtor(Propagator* propagator, const SsaFunction* function);
+static void propagatorDtor(Propagator* propagator);
+static bool buildUsers(Propagator* propagator);
+static void runPropagation(Propagator* propagator);
+
+static void visitBlock(Propagator* propagator, int block);
+static void visitInstruction(Propagator* propagator, int value);
+static void visitPhi(Propagator* propagator, int value);
+static void visitBranch(Propagator* propagator, const SsaInstruction* instruction);
+static void markEdge(Propagator* propagator, int from, int to);
+static void setValue(Propagator* propagator, int value, LatticeValue lattice);
+
+static LatticeValue evaluate(Propagator* propagator, const SsaInstruction* instruction);
+static LatticeValue meet(LatticeValue first, LatticeValue second);
+static bool sameConstant(Value first, Value second);
+
+static size_t substituteReads(Tree* ast, const SsaFunction* function,
+                              const LatticeValue* values);
+
+static const LatticeValue UNDEFINED   = { .level = LatticeLevel_UNDEFINED,   .value = {} };
+static const LatticeValue OVERDEFINED = { .level = LatticeLevel_OVERDEFINED, .value = {} };
+
+
+// public ---------------------------------------------------------------------
+
+
+bool propagateConstants(Tree* ast, OptimizerStatistics* statistics)
+{
+    assert(ast != NULL);
+
+    if (ast->nodes_number == 0)
+    {
+        return true;
+    }
+
+    SsaFunction function = {};
+    SsaState state = ssaBuild(ast, &function);
+    if (state != SsaState_OK)
+    {
+        return state != SsaState_MEMORY_ERROR;
+    }
+
+    Propagator propagator = {};
+    bool built = propagatorCtor(&propagator, &function);
+    if (built)
+    {
+        runPropagation(&propagator);
+
+        size_t replaced = substituteReads(ast, &function, propagator.values);
+        if (statistics != NULL)
+        {
+            statistics->propagated_constants += replaced;
+        }
+    }
+
+    propagatorDtor(&propagator);
+    ssaDtor(&function);
+
+    return built;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static bool propagatorCtor(Propagator* propagator, const SsaFunction* function)
+{
+    assert(propagator != NULL);
+    assert(function   != NULL);
+
+    *propagator = (Propagator){};
+    propagator->function = function;
+    arenaCtor(&propagator->arena);
+
+    size_t values_number = function->instructions_number + 1;
+    size_t edges_number  = 1;
+    for (size_t block = 0; block < function->blocks_number; block++)
+    {
+        edges_number += (size_t)function->blocks[block].predecessors_number;
+    }
+
+    propagator->values           = (LatticeValue*)calloc(values_number, sizeof(LatticeValue));
+    propagator->queued_values    = (bool*)calloc(values_number, sizeof(bool));
+    propagator->value_worklist   = (int*)malloc(values_number * sizeof(int));
+    propagator->executable_edges = (bool*)calloc(edges_number, sizeof(bool));
+    propagator->edge_targets     = (int*)malloc(edges_number * sizeof(int));
+    propagator->edge_worklist    = (int*)malloc(edges_number * sizeof(int));
+    propagator->visited_blocks   = (bool*)calloc(function->blocks_number + 1, sizeof(bool));
+
+    if (propagator->values         == NULL || propagator->queued_values    == NULL
+     || propagator->value_worklist == NULL || propagator->executable_edges == NULL
+     || propagator->edge_targets   == NULL || propagator->edge_worklist    == NULL
+     || propagator->visited_blocks == NULL)
+    {
+        return false;
+    }
+
+    for (size_t block = 0; block < function->blocks_number; block++)
+    {
+        const SsaBlock* data = &function->blocks[block];
+        for (int p = 0; p < data->predecessors_number; p++)
+        {
+            propagator->edge_targets[data->first_predecessor + p] = (int)block;
+        }
+    }
+
+    return buildUsers(propagator);
+}
+
+
+static void propagatorDtor(Propagator* propagator)
+{
+    assert(propagator != NULL);
+
+    free(propagator->values);
+    free(propagator->queued_values);
+    free(propagator->value_worklist);
+    free(propagator->executable_edges);
+    free(propagator->edge_targets);
+    free(propagator->edge_worklist);
+    free(propagator->visited_blocks);
+    free(propagator->users);
+    free(propagator->first_user);
+    arenaDtor(&propagator->arena);
+
+    *propagator = (Propagator){};
+}
+
+
+// Def-use chains as one flat array: count the uses of every value, turn
+// the counts into offsets, then fill each value's range.
+static bool buildUsers(Propagator* propagator)
+{
+    assert(propagator != NULL);
+
+    const SsaFunction* function = propagator->function;
+    size_t values_number = function->instructions_number;
+
+    propagator->first_user = (int*)calloc(values_number + 2, sizeof(int));
+    if (propagator->first_user == NULL)
+    {
+        return false;
+    }
+
+    int* first_user = propagator->first_user;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (size_t user = 0; user < values_number; user++)
+        {
+            const SsaInstruction* instruction = &function->instructions[user];
+            int operands_number = instruction->opcode == SsaOpcode_PHI ? instruction->arguments_number
+                                : instruction->opcode == SsaOpcode_NOP ? 0
+                                                                       : 2;
+            for (int i = 0; i < operands_number; i++)
+            {
+                int used = instruction->opcode == SsaOpcode_PHI
+                         ? function->phi_arguments[instruction->argument + i]
+                         : instruction->operands[i];
+                if (used == NO_VALUE)
+                {
+                    continue;
+                }
+
+                if (pass == 0)
+                {
+                    first_user[used + 2]++;
+                }
+                else
+                {
+                    propagator->users[first_user[used + 1]++] = (int)user;
+                }
+            }
+        }
+
+        if (pass == 0)
+        {
+            for (size_t value = 0; value < values_number; value++)
+            {
+                first_user[value + 2] += first_user[value + 1];
+            }
+
+            propagator->users = (int*)malloc(((size_t)first_user[values_number + 1] + 1) * sizeof(int));
+            if (propagator->users == NULL)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+static void runPropagation(Propagator* propagator)
+{
+    assert(propagator != NULL);
+
+    const SsaFunction* function = propagator->function;
+
+    propagator->visited_blocks[0] = true;
+    visitBlock(propagator, 0);
+
+    while (propagator->edge_worklist_size > 0 || propagator->value_worklist_size > 0)
+    {
+        while (propagator->edge_worklist_size > 0)
+        {
+            int edge  = propagator->edge_worklist[--propagator->edge_worklist_size];
+            int block = propagator->edge_targets[edge];
+
+            if (!propagator->visited_blocks[block])
+            {
+                propagator->visited_blocks[block] = true;
+                visitBlock(propagator, block);
+                continue;
+            }
+
+            const SsaBlock* data = &function->blocks[block];
+            for (int i = 0; i < data->phis_number; i++)
+            {
+                visitPhi(propagator, function->schedule[data->first + i]);
+            }
+        }
+
+        while (propagator->value_worklist_size > 0)
+        {
+            int value = propagator->value_worklist[--propagator->value_worklist_size];
+            propagator->queued_values[value] = false;
+
+            for (int u = propagator->first_user[value]; u < propagator->first_user[value + 1]; u++)
+            {
+                int user = propagator->users[u];
+                if (propagator->visited_blocks[function->instructions[user].block])
+                {
+                    visitInstruction(propagator, user);
+                }
+            }
+        }
+    }
+}
+
+
+static void visitBlock(Propagator* propagator, int block)
+{
+    assert(propagator != NULL);
+
+    const SsaFunction* function = propagator->function;
+    const SsaBlock*    data     = &function->blocks[block];
+
+    for (int i = 0; i < data->size; i++)
+    {
+        visitInstruction(propagator, function->schedule[data->first + i]);
+    }
+}
+
+
+static void visitInstruction(Propagator* propagator, int value)
+{
+    assert(propagator != NULL);
+
+    const SsaInstruction* instruction = &propagator->function->instructions[value];
+
+    switch (instruction->opcode)
+    {
+        case SsaOpcode_PHI:
+            visitPhi(propagator, value);
+            break;
+
+        case SsaOpcode_JUMP:
+            markEdge(propagator, instruction->block,
+                     propagator->function->blocks[instruction->block].successors[0]);
+            break;
+
+        case SsaOpcode_BRANCH:
+            visitBranch(propagator, instruction);
+            break;
+
+        case SsaOpcode_CONSTANT:
+        case SsaOpcode_UNARY:
+        case SsaOpcode_BINARY:
+        case SsaOpcode_TRUTHY:
+            setValue(propagator, value, evaluate(propagator, instruction));
+            break;
+
+        case SsaOpcode_PRINT:
+        case SsaOpcode_RETURN:
+        case SsaOpcode_NOP:
+        default:
+            break;
+    }
+}
+
+
+// Only arguments that arrive over an edge known to run take part.
+static void visitPhi(Propagator* propagator, int value)
+{
+    assert(propagator != NULL);
+
+    const SsaFunction*    function    = propagator->function;
+    const SsaInstruction* instruction = &function->instructions[value];
+    const SsaBlock*       block       = &function->blocks[instruction->block];
+
+    LatticeValue result = UNDEFINED;
+    for (int a = 0; a < instruction->arguments_number; a++)
+    {
+        if (!propagator->executable_edges[block->first_predecessor + a])
+        {
+            continue;
+        }
+
+        int argument = function->phi_arguments[instruction->argument + a];
+        result = meet(result, propagator->values[argument]);
+        if (result.level == LatticeLevel_OVERDEFINED)
+        {
+            break;
+        }
+    }
+
+    setValue(propagator, value, result);
+}
+
+
+static void visitBranch(Propagator* propagator, const SsaInstruction* instruction)
+{
+    assert(propagator  != NULL);
+    assert(instruction != NULL);
+
+    const SsaBlock*     block     = &propagator->function->blocks[instruction->block];
+    const LatticeValue* condition = &propagator->values[instruction->operands[0]];
+
+    switch (condition->level)
+    {
+        case LatticeLevel_CONSTANT:
+            markEdge(propagator, instruction->block,
+                     block->successors[valueIsTruthy(condition->value) ? 0 : 1]);
+            break;
+
+        case LatticeLevel_OVERDEFINED:
+            markEdge(propagator, instruction->block, block->successors[0]);
+            markEdge(propagator, instruction->block, block->successors[1]);
+            break;
+
+        case LatticeLevel_UNDEFINED:
+        default:
+            break;
+    }
+}
+
+
+static void markEdge(Propagator* propagator, int from, int to)
+{
+    assert(propagator != NULL);
+
+    if (to == NO_BLOCK)
+    {
+        return;
+    }
+
+    const SsaFunction* function = propagator->function;
+    const SsaBlock*    block    = &function->blocks[to];
+    for (int p = 0; p < block->predecessors_number; p++)
+    {
+        int edge = block->first_predecessor + p;
+        if (function->predecessors[edge] == from && !propagator->executable_edges[edge])
+        {
+            propagator->executable_edges[edge] = true;
+            propagator->edge_worklist[propagator->edge_worklist_size++] = edge;
+            return;
+        }
+    }
+}
+
+
+// Values only ever move down the lattice, so every value is queued at
+// most twice and the propagation ends.
+static void setValue(Propagator* propagator, int value, LatticeValue lattice)
+{
+    assert(propagator != NULL);
+
+    LatticeValue* current = &propagator->values[value];
+    if (lattice.level < current->level
+     || (lattice.level == current->level
+      && (lattice.level != LatticeLevel_CONSTANT || sameConstant(lattice.value, current->value))))
+    {
+        return;
+    }
+
+    *current = lattice;
+
+    if (!propagator->queued_values[value])
+    {
+        propagator->queued_values[value] = true;
+        propagator->value_worklist[propagator->value_worklist_size++] = value;
+    }
+}
+
+
+// Uses the same operations as the backends, so a folded value is exactly
+// what the program would compute. Operations that fail at run time stay
+// overdefined and are reported by the backend.
+__attribute__((no_sanitize("float-divide-by-zero")))
+static LatticeValue evaluate(Propagator* propagator, const SsaInstruction* instruction)
+{
+    assert(propagator  != NULL);
+    assert(instruction != NULL);
+
+    if (instruction->opcode == SsaOpcode_CONSTANT)
+    {
+        return (LatticeValue){
+            .level = LatticeLevel_CONSTANT,
+            .value = propagator->function->constants[instruction->argument],
+        };
+    }
+
+    // Arrays are never written back, and building array(n, x) here would
+    // only cost memory.
+    if (instruction->opcode == SsaOpcode_BINARY && instruction->operation == TOKEN_KEYWORD_ARRAY)
+    {
+        return OVERDEFINED;
+    }
+
+    const LatticeValue* left  = &propagator->values[instruction->operands[0]];
+    const LatticeValue* right = instruction->opcode == SsaOpcode_BINARY
+                              ? &propagator->values[instruction->operands[1]]
+                              : left;
+
+    if (left->level == LatticeLevel_OVERDEFINED || right->level == LatticeLevel_OVERDEFINED)
+    {
+        return OVERDEFINED;
+    }
+    if (left->level == LatticeLevel_UNDEFINED || right->level == LatticeLevel_UNDEFINED)
+    {
+        return UNDEFINED;
+    }
+
+    Value result = {};
+    RuntimeState state = RuntimeState_OK;
+    switch (instruction->opcode)
+    {
+        case SsaOpcode_TRUTHY:
+            result = valueBool(valueIsTruthy(left->value));
+            break;
+
+        case SsaOpcode_UNARY:
+            state = valueUnaryOperation(instruction->operation, left->value,
+                                        &propagator->arena, &result);
+            break;
+
+        case SsaOpcode_BINARY:
+            state = valueBinaryOperation(instruction->operation, left->value, right->value,
+                                         &propagator->arena, &result);
+            break;
+
+        default:
+            return OVERDEFINED;
+    }
+
+    if (state != RuntimeState_OK)
+    {
+        return OVERDEFINED;
+    }
+
+    return (LatticeValue){
+        .level = LatticeLevel_CONSTANT,
+        .value = result,
+    };
+}
+
+
+static LatticeValue meet(LatticeValue first, LatticeValue second)
+{
+    if (first.level == LatticeLevel_UNDEFINED)
+    {
+        return second;
+    }
+    if (second.level == LatticeLevel_UNDEFINED)
+    {
+        return first;
+    }
+    if (first.level == LatticeLevel_CONSTANT && second.level == LatticeLevel_CONSTANT
+     && sameConstant(first.value, second.value))
+    {
+        return first;
+    }
+
+    return OVERDEFINED;
+}
+
+
+// Doubles compare by bits: 0 and -0 print differently, and a NaN has to
+// match itself for a loop that keeps it to stay constant. An integer is
+// never the same constant as the equal double.
+static bool sameConstant(Value first, Value second)
+{
+    if (valueType(first) != valueType(second) || valueIsInteger(first) != valueIsInteger(second))
+    {
+        return false;
+    }
+
+    if (valueIsInteger(first))
+    {
+        return valueAsInteger(first) == valueAsInteger(second);
+    }
+
+    if (valueIsNumber(first))
+    {
+        double first_number  = valueAsDouble(first);
+        double second_number = valueAsDouble(second);
+        uint64_t first_bits  = 0;
+        uint64_t second_bits = 0;
+        memcpy(&first_bits,  &first_number,  sizeof(first_bits));
+        memcpy(&second_bits, &second_number, sizeof(second_bits));
+        return first_bits == second_bits;
+    }
+
+    return valueEquals(first, second);
+}
+
+
+// Only number, integer and bool constants are written back, like foldConstants;
+// nothing in the tree has to be allocated.
+static size_t substituteReads(Tree* ast, const SsaFunction* function,
+                              const LatticeValue* values)
+{
+    assert(ast      != NULL);
+    assert(function != NULL);
+    assert(values   != NULL);
+
+    size_t replaced = 0;
+    for (size_t node_index = 0; node_index < function->nodes_number; node_index++)
+    {
+        TreeNode* node = &ast->nodes_array[node_index];
+        int value = function->node_values[node_index];
+        if (node->data.type != SyntaxNodeType_IDENTIFIER || value == NO_VALUE
+         || values[value].level != LatticeLevel_CONSTANT)
+        {
+            continue;
+        }
+
+        Value constant  = values[value].value;
+        SyntaxNode data = node->data;
+        if (valueIsInteger(constant))
+        {
+            data.type         = SyntaxNodeType_INTEGER;
+            data.data.integer = valueAsInteger(constant);
+        }
+        else if (valueIsNumber(constant))
+        {
+            data.type        = SyntaxNodeType_NUMBER;
+            data.data.number = valueAsDouble(constant);
+        }
+        else if (valueIsBool(constant))
+        {
+            data.type         = SyntaxNodeType_BOOL;
+            data.data.boolean = valueAsBool(constant);
+        }
+        else
+        {
+            continue;
+        }
+
+        free(node->data.data.identifier);
+        treeSetNodeData(ast, (int)node_index, data);
+        replaced++;
+    }
+
+    return replaced;
+}
@@ -0,0 +1,156 @@
+#include "hardware_counters.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+
+// static ---------------------------------------------------------------------
+
+
+#ifdef __linux__
+
+static int openEvent(uint32_t type, uint64_t config);
+
+static const uint64_t CACHE_READ_MISS = (uint64_t)PERF_COUNT_HW_CACHE_OP_READ << 8
+                                      | (uint64_t)PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+
+typedef struct EventConfig
+{
+    uint32_t type;
+    uint64_t config;
+} EventConfig;
+
+// Indexed by HardwareEvent.
+static const EventConfig EVENTS[HARDWARE_EVENTS_NUMBER] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | CACHE_READ_MISS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL  | CACHE_READ_MISS},
+};
+
+#endif
+
+
+// public ---------------------------------------------------------------------
+
+
+bool hardwareCountersCtor(HardwareCounters* counters)
+{
+    assert(counters != NULL);
+
+    bool opened = false;
+    counters->error = 0;
+    for (size_t event = 0; event < HARDWARE_EVENTS_NUMBER; event++)
+    {
+#ifdef __linux__
+        counters->descriptors[event] = openEvent(EVENTS[event].type, EVENTS[event].config);
+        if (counters->descriptors[event] < 0 && counters->error == 0)
+        {
+            counters->error = errno;
+        }
+#else
+        counters->descriptors[event] = -1;
+        counters->error = ENOSYS;
+#endif
+        opened = opened || counters->descriptors[event] >= 0;
+    }
+
+    return opened;
+}
+
+
+void hardwareCountersDtor(HardwareCounters* counters)
+{
+    assert(counters != NULL);
+
+    for (size_t event = 0; event < HARDWARE_EVENTS_NUMBER; event++)
+    {
+#ifdef __linux__
+        if (counters->descriptors[event] >= 0)
+        {
+            close(counters->descriptors[event]);
+        }
+#endif
+        counters->descriptors[event] = -1;
+    }
+}
+
+
+bool hardwareCounterAvailable(const HardwareCounters* counters, HardwareEvent event)
+{
+    assert(counters != NULL);
+    assert((size_t)event < HARDWARE_EVENTS_NUMBER);
+
+    return counters->descriptors[event] >= 0;
+}
+
+
+void hardwareCountersRead(const HardwareCounters* counters,
+                          uint64_t values[HARDWARE_EVENTS_NUMBER])
+{
+    assert(counters != NULL);
+    assert(values   != NULL);
+
+    for (size_t event = 0; event < HARDWARE_EVENTS_NUMBER; event++)
+    {
+        values[event] = 0;
+#ifdef __linux__
+        // value, time enabled, time running
+        uint64_t reading[3] = {};
+        if (counters->descriptors[event] < 0
+         || read(counters->descriptors[event], reading, sizeof(reading)) != sizeof(reading))
+        {
+            continue;
+        }
+
+        values[event] = reading[0];
+        if (reading[2] > 0 && reading[2] < reading[1])
+        {
+            values[event] = (uint64_t)((double)reading[0] * (double)reading[1] / (double)reading[2]);
+        }
+#endif
+    }
+}
+
+
+const char* hardwareEventToString(HardwareEvent event)
+{
+    switch (event)
+    {
+        case HardwareEvent_CYCLES:          return "cycles";
+        case HardwareEvent_INSTRUCTIONS:    return "instructions";
+        case HardwareEvent_BRANCH_MISSES:   return "branch_misses";
+        case HardwareEvent_L1D_READ_MISSES: return "l1d_read_misses";
+        case HardwareEvent_LLC_READ_MISSES: return "llc_read_misses";
+        default:                            return "unknown";
+    }
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+#ifdef __linux__
+
+static int openEvent(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attributes = {};
+    attributes.size           = sizeof(attributes);
+    attributes.type           = type;
+    attributes.config         = config;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv     = 1;
+    attributes.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+}
+
+#endif
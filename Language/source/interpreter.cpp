@@ -0,0 +1,400 @@
+#include "interpreter.h"
+
+#include <string.h>
+#include <assert.h>
+
+#include "tree_node_structure.h"
+#include "lexical_analysis.h"
+#include "print_ast.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+static void executeStatements(Interpreter* interpreter, int cell_index);
+static void executeStatement(Interpreter* interpreter, int node_index);
+static void runStatement(Interpreter* interpreter, int node_index);
+static Value evaluate(Interpreter* interpreter, int node_index);
+static Value evaluateBinary(Interpreter* interpreter, const TreeNode* node);
+static Value evaluateUnary(Interpreter* interpreter, const TreeNode* node);
+static void runtimeError(Interpreter* interpreter, RuntimeState state, int line,
+                         int operation, Value left, Value right, bool is_unary);
+static void sweepArena(Interpreter* interpreter);
+
+
+// public ---------------------------------------------------------------------
+
+
+InterpreterState interpreterCtor(Interpreter* interpreter, Tree* ast, FILE* output)
+{
+    assert(interpreter != NULL);
+    assert(ast         != NULL);
+    assert(output      != NULL);
+
+    *interpreter = (Interpreter){};
+    interpreter->ast    = ast;
+    interpreter->output = output;
+    arenaCtor(&interpreter->arena);
+
+    ResolverState resolver_state = resolveProgram(ast, &interpreter->resolution);
+    if (resolver_state != ResolverState_OK)
+    {
+        interpreter->state = resolver_state == ResolverState_MEMORY_ERROR
+                           ? InterpreterState_MEMORY_ERROR
+                           : InterpreterState_RESOLVE_ERROR;
+        return interpreter->state;
+    }
+
+    size_t slots_number = interpreter->resolution.slots_number;
+    interpreter->frame = (Value*)malloc((slots_number + 1) * sizeof(Value));
+    if (interpreter->frame == NULL)
+    {
+        interpreter->state = InterpreterState_MEMORY_ERROR;
+        return interpreter->state;
+    }
+
+    for (size_t slot = 0; slot < slots_number; slot++)
+    {
+        interpreter->frame[slot] = valueSmallInteger(0);
+    }
+
+    return InterpreterState_OK;
+}
+
+
+InterpreterState interpretProgram(Interpreter* interpreter)
+{
+    assert(interpreter != NULL);
+
+    if (interpreter->state != InterpreterState_OK)
+    {
+        return interpreter->state;
+    }
+
+    if (interpreter->ast->nodes_number > 0)
+    {
+        executeStatements(interpreter, interpreter->ast->nodes_array[0].left_index);
+    }
+
+    return interpreter->state;
+}
+
+
+void interpreterEnableProfile(Interpreter* interpreter, Profile* profile)
+{
+    assert(interpreter != NULL);
+    assert(profile     != NULL);
+    assert(profile->nodes_number == interpreter->ast->nodes_number);
+
+    interpreter->profile = profile;
+}
+
+
+void interpreterDtor(Interpreter* interpreter)
+{
+    if (interpreter == NULL)
+    {
+        return;
+    }
+
+    resolutionDtor(&interpreter->resolution);
+    arenaDtor(&interpreter->arena);
+    free(interpreter->frame);
+
+    interpreter->frame = NULL;
+    interpreter->ast   = NULL;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static void executeStatements(Interpreter* interpreter, int cell_index)
+{
+    assert(interpreter != NULL);
+
+    TreeNode* nodes = interpreter->ast->nodes_array;
+    while (cell_index != EMPTY_NODE && interpreter->state == InterpreterState_OK)
+    {
+        executeStatement(interpreter, nodes[cell_index].left_index);
+        cell_index = nodes[cell_index].right_index;
+    }
+}
+
+
+// Without a profile the only cost is the test of the pointer.
+static void executeStatement(Interpreter* interpreter, int node_index)
+{
+    assert(interpreter != NULL);
+
+    if (interpreter->profile == NULL)
+    {
+        runStatement(interpreter, node_index);
+        return;
+    }
+
+    uint64_t start = profileTicks();
+    runStatement(interpreter, node_index);
+    profileRecord(interpreter->profile, node_index, start);
+}
+
+
+static void runStatement(Interpreter* interpreter, int node_index)
+{
+    assert(interpreter != NULL);
+
+    TreeNode* nodes = interpreter->ast->nodes_array;
+    const TreeNode* node = &nodes[node_index];
+
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_VAR_DECLARATION:
+        case SyntaxNodeType_ASSIGNMENT:
+        {
+            Value value = evaluate(interpreter, node->right_index);
+            int slot = interpreter->resolution.node_slots[node->left_index];
+            interpreter->frame[slot] = value;
+            break;
+        }
+
+        case SyntaxNodeType_IF:
+        {
+            Value condition = evaluate(interpreter, node->left_index);
+            if (interpreter->state != InterpreterState_OK)
+            {
+                break;
+            }
+
+            const TreeNode* branches = &nodes[node->right_index];
+            bool has_else = branches->data.type == SyntaxNodeType_ELSE;
+            if (valueIsTruthy(condition))
+            {
+                executeStatement(interpreter, has_else ? branches->left_index : node->right_index);
+            }
+            else if (has_else)
+            {
+                executeStatement(interpreter, branches->right_index);
+            }
+            break;
+        }
+
+        case SyntaxNodeType_WHILE:
+            while (interpreter->state == InterpreterState_OK)
+            {
+                if (arenaShouldSweep(&interpreter->arena))
+                {
+                    sweepArena(interpreter);
+                }
+
+                Value condition = evaluate(interpreter, node->left_index);
+                if (interpreter->state != InterpreterState_OK || !valueIsTruthy(condition))
+                {
+                    break;
+                }
+
+                executeStatement(interpreter, node->right_index);
+            }
+            break;
+
+        case SyntaxNodeType_BLOCK:
+            executeStatements(interpreter, node->left_index);
+            break;
+
+        case SyntaxNodeType_PRINT:
+        {
+            Value value = evaluate(interpreter, node->left_index);
+            if (interpreter->state == InterpreterState_OK)
+            {
+                valuePrint(interpreter->output, value);
+                fputc('\n', interpreter->output);
+            }
+            break;
+        }
+
+        case SyntaxNodeType_PROGRAM:
+        case SyntaxNodeType_STATEMENT:
+            executeStatements(interpreter, node->left_index);
+            break;
+
+        case SyntaxNodeType_ELSE:
+        case SyntaxNodeType_BINARY_OPERATION:
+        case SyntaxNodeType_UNARY_OPERATION:
+        case SyntaxNodeType_NUMBER:
+        case SyntaxNodeType_INTEGER:
+        case SyntaxNodeType_STRING:
+        case SyntaxNodeType_IDENTIFIER:
+        case SyntaxNodeType_BOOL:
+        default:
+            evaluate(interpreter, node_index);
+            break;
+    }
+}
+
+
+static Value evaluate(Interpreter* interpreter, int node_index)
+{
+    assert(interpreter != NULL);
+
+    const TreeNode* node = &interpreter->ast->nodes_array[node_index];
+
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_NUMBER:
+            return valueNumber(node->data.data.number);
+        case SyntaxNodeType_INTEGER:
+        {
+            Value integer = {};
+            RuntimeState state = valueMakeInteger(node->data.data.integer, &interpreter->arena, &integer);
+            if (state != RuntimeState_OK)
+            {
+                runtimeError(interpreter, state, node->data.line, 0, integer, integer, false);
+            }
+            return integer;
+        }
+        case SyntaxNodeType_BOOL:
+            return valueBool(node->data.data.boolean);
+        case SyntaxNodeType_STRING:
+            return valueString(node->data.data.string);
+        case SyntaxNodeType_IDENTIFIER:
+            return interpreter->frame[interpreter->resolution.node_slots[node_index]];
+        case SyntaxNodeType_BINARY_OPERATION:
+        case SyntaxNodeType_UNARY_OPERATION:
+        {
+            if (interpreter->profile == NULL)
+            {
+                return node->data.type == SyntaxNodeType_BINARY_OPERATION
+                     ? evaluateBinary(interpreter, node)
+                     : evaluateUnary(interpreter, node);
+            }
+
+            uint64_t start = profileTicks();
+            Value result = node->data.type == SyntaxNodeType_BINARY_OPERATION
+                         ? evaluateBinary(interpreter, node)
+                         : evaluateUnary(interpreter, node);
+            profileRecord(interpreter->profile, node_index, start);
+            return result;
+        }
+        default:
+            break;
+    }
+
+    snprintf(interpreter->error_message, sizeof(interpreter->error_message),
+             "Runtime error: %s is not an expression (line %d)",
+             syntaxNodeTypeToString(node->data.type), node->data.line);
+    interpreter->state = InterpreterState_RUNTIME_ERROR;
+
+    return valueBool(false);
+}
+
+
+static Value evaluateBinary(Interpreter* interpreter, const TreeNode* node)
+{
+    assert(interpreter != NULL);
+    assert(node        != NULL);
+
+    int operation = node->data.data.operation;
+    Value left = evaluate(interpreter, node->left_index);
+    if (interpreter->state != InterpreterState_OK)
+    {
+        return left;
+    }
+
+    if (operation == TOKEN_AND && !valueIsTruthy(left))
+    {
+        return valueBool(false);
+    }
+    if (operation == TOKEN_OR && valueIsTruthy(left))
+    {
+        return valueBool(true);
+    }
+
+    Value right = evaluate(interpreter, node->right_index);
+    if (interpreter->state != InterpreterState_OK)
+    {
+        return right;
+    }
+
+    Value result = {};
+    RuntimeState state = valueBinaryOperation(operation, left, right, &interpreter->arena, &result);
+    if (state != RuntimeState_OK)
+    {
+        runtimeError(interpreter, state, node->data.line, operation, left, right, false);
+    }
+
+    return result;
+}
+
+
+static Value evaluateUnary(Interpreter* interpreter, const TreeNode* node)
+{
+    assert(interpreter != NULL);
+    assert(node        != NULL);
+
+    int operation = node->data.data.operation;
+    Value operand = evaluate(interpreter, node->left_index);
+    if (interpreter->state != InterpreterState_OK)
+    {
+        return operand;
+    }
+
+    Value result = {};
+    RuntimeState state = valueUnaryOperation(operation, operand, &interpreter->arena, &result);
+    if (state != RuntimeState_OK)
+    {
+        runtimeError(interpreter, state, node->data.line, operation, operand, operand, true);
+    }
+
+    return result;
+}
+
+
+static void runtimeError(Interpreter* interpreter, RuntimeState state, int line,
+                         int operation, Value left, Value right, bool is_unary)
+{
+    assert(interpreter != NULL);
+
+    if (state == RuntimeState_MEMORY_ERROR)
+    {
+        snprintf(interpreter->error_message, sizeof(interpreter->error_message),
+                 "Runtime error: out of memory (line %d)", line);
+        interpreter->state = InterpreterState_MEMORY_ERROR;
+        return;
+    }
+
+    if (state == RuntimeState_INDEX_ERROR || state == RuntimeState_LENGTH_ERROR
+     || state == RuntimeState_SIZE_ERROR)
+    {
+        snprintf(interpreter->error_message, sizeof(interpreter->error_message),
+                 "Runtime error: %s (line %d)", runtimeStateToString(state), line);
+    }
+    else if (is_unary)
+    {
+        snprintf(interpreter->error_message, sizeof(interpreter->error_message),
+                 "Runtime error: cannot apply '%s' to %s (line %d)",
+                 tokenTypeToString(operation),
+                 valueTypeToString(valueType(left)),
+                 line);
+    }
+    else
+    {
+        snprintf(interpreter->error_message, sizeof(interpreter->error_message),
+                 "Runtime error: cannot apply '%s' to %s and %s (line %d)",
+                 tokenTypeToString(operation),
+                 valueTypeToString(valueType(left)),
+                 valueTypeToString(valueType(right)),
+                 line);
+    }
+
+    interpreter->state = InterpreterState_RUNTIME_ERROR;
+}
+
+
+// Between statements every value the run can read is in the frame; the
+// intermediate results of expressions are only held while one runs.
+static void sweepArena(Interpreter* interpreter)
+{
+    assert(interpreter != NULL);
+
+    valueMarkAll(interpreter->frame, interpreter->resolution.slots_number);
+    arenaSweep(&interpreter->arena);
+}
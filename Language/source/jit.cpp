@@ -0,0 +1,1847 @@
+#include "jit.h"
+
+#include <string.h>
+#include <assert.h>
+
+#ifdef JIT_X86_64
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+#include "lexical_analysis.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+static bool runInstruction(JitRuntime* runtime, Value* operands, uint32_t opcode);
+static void sweepArena(JitRuntime* runtime, const Value* stack_top);
+
+#ifdef JIT_X86_64
+
+typedef enum Register
+{
+    Register_RAX = 0,
+    Register_RCX = 1,
+    Register_RDX = 2,
+    Register_RBX = 3,
+    Register_RSP = 4,
+    Register_RBP = 5,
+    Register_RSI = 6,
+    Register_RDI = 7,
+    Register_R8  = 8,
+    Register_R12 = 12,
+    Register_R13 = 13,
+    Register_R14 = 14,
+    Register_R15 = 15,
+} Register;
+
+// Register roles in compiled code. The frame, stack and runtime pointers
+// and the two tag masks live in callee-saved registers, so calls into C
+// keep them; everything else is scratch.
+const Register FRAME_REGISTER   = Register_RBX;
+const Register STACK_REGISTER   = Register_R14;
+const Register RUNTIME_REGISTER = Register_R15;
+const Register QNAN_REGISTER    = Register_R12;     // VALUE_QNAN
+const Register INTEGER_REGISTER = Register_R13;     // VALUE_INTEGER_TAG
+
+typedef enum Condition
+{
+    Condition_O  = 0x0,
+    Condition_B  = 0x2,
+    Condition_AE = 0x3,
+    Condition_E  = 0x4,
+    Condition_NE = 0x5,
+    Condition_BE = 0x6,
+    Condition_A  = 0x7,
+    Condition_S  = 0x8,
+    Condition_P  = 0xA,
+    Condition_NP = 0xB,
+    Condition_L  = 0xC,
+    Condition_GE = 0xD,
+    Condition_LE = 0xE,
+    Condition_G  = 0xF,
+} Condition;
+
+typedef struct Fixup
+{
+    size_t position;    // of the rel32 field
+    size_t label;
+} Fixup;
+
+typedef struct Exit
+{
+    size_t   label;
+    uint32_t offset;
+    int      depth;
+} Exit;
+
+typedef struct Assembler
+{
+    uint8_t* code;
+    size_t   size;
+    size_t   capacity;
+
+    size_t*  labels;            // label -> code position, NO_POSITION until bound
+    size_t   labels_number;
+    size_t   labels_capacity;
+
+    Fixup*   fixups;
+    size_t   fixups_number;
+    size_t   fixups_capacity;
+
+    bool     failed;            // out of memory; later output is dropped
+} Assembler;
+
+typedef struct LoopCompiler
+{
+    const Chunk* chunk;
+    uint32_t     start;
+    uint32_t     end;
+    size_t       size;          // instructions in the loop
+
+    int*         depths;        // operand stack depth before each instruction, -1 if unreachable
+    bool*        is_target;     // reached by a jump, so it cannot be fused into a comparison
+
+    Exit*        exits;
+    size_t       exits_number;
+    size_t       exits_capacity;
+
+    Assembler    assembler;
+    size_t       epilogue;      // label
+} LoopCompiler;
+
+static bool analyzeLoop(LoopCompiler* compiler);
+static bool reachInstruction(LoopCompiler* compiler, uint32_t offset, int depth,
+                             uint32_t* worklist, size_t* worklist_size);
+static int instructionInputs(Instruction instruction);
+static int opcodeInputs(Opcode opcode);
+static void compileLoop(LoopCompiler* compiler);
+static uint32_t compileInstruction(LoopCompiler* compiler, uint32_t offset);
+static bool compileOperation(LoopCompiler* compiler, uint32_t offset, Instruction instruction,
+                             int depth);
+static void compileArithmetic(LoopCompiler* compiler, uint32_t offset, Opcode opcode, int depth);
+static void compileDoubleArithmetic(LoopCompiler* compiler, uint32_t offset, Opcode opcode, int depth);
+static uint8_t sseArithmeticOpcode(Opcode opcode);
+static bool isDoubleOpcode(Opcode opcode);
+static void compileIntegerArithmetic(LoopCompiler* compiler, Opcode opcode, int32_t left,
+                                     size_t slow, size_t done);
+static void compileComparison(LoopCompiler* compiler, uint32_t offset, Opcode opcode, int depth,
+                              const Instruction* jump, uint32_t fallthrough);
+static void compileConditionalJump(LoopCompiler* compiler, uint32_t offset, Instruction jump, int depth);
+static void compileUnary(LoopCompiler* compiler, uint32_t offset, Opcode opcode, int depth);
+static void compileSwitch(LoopCompiler* compiler, uint32_t table_index, int depth,
+                          uint32_t fallthrough);
+static void compileBoolBranch(LoopCompiler* compiler, Opcode jump, uint32_t target,
+                              int depth, uint32_t fallthrough);
+static void compileToDouble(LoopCompiler* compiler, Register value, int xmm, size_t slow);
+static void compileSmallIntegerCheck(LoopCompiler* compiler, Register value, size_t otherwise);
+static void compileCall(LoopCompiler* compiler, uint32_t offset, Opcode opcode, int first_operand);
+static void compileStoreBool(LoopCompiler* compiler, int32_t displacement);
+static size_t branchLabel(LoopCompiler* compiler, uint32_t target, int depth);
+static size_t exitLabel(LoopCompiler* compiler, uint32_t offset, int depth);
+static bool installCode(Jit* jit, const Assembler* assembler, JitCode* code);
+
+static int32_t stackSlot(int depth);
+static int32_t frameSlot(uint32_t slot);
+
+static void assemblerDtor(Assembler* assembler);
+static size_t newLabel(Assembler* assembler);
+static void bindLabel(Assembler* assembler, size_t label);
+static bool resolveFixups(Assembler* assembler);
+static void emitByte(Assembler* assembler, uint8_t byte);
+static void emitBytes(Assembler* assembler, const uint8_t* bytes, size_t size);
+static void emitU32(Assembler* assembler, uint32_t value);
+static void emitU64(Assembler* assembler, uint64_t value);
+static void emitRex(Assembler* assembler, bool wide, int reg, int rm);
+static void emitModRmRegister(Assembler* assembler, int reg, int rm);
+static void emitModRmMemory(Assembler* assembler, int reg, Register base, int32_t displacement);
+static void emitLoad(Assembler* assembler, Register destination, Register base, int32_t displacement);
+static void emitStore(Assembler* assembler, Register base, int32_t displacement, Register source);
+static void emitMove(Assembler* assembler, Register destination, Register source);
+static void emitMoveImmediate(Assembler* assembler, Register destination, uint64_t value);
+static void emitAlu(Assembler* assembler, uint8_t opcode, Register destination, Register source);
+static void emitAluImmediate8(Assembler* assembler, int extension, Register destination, int8_t value);
+static void emitCompare32(Assembler* assembler, Register value, uint32_t immediate);
+static void emitShift(Assembler* assembler, int extension, Register value, uint8_t count);
+static void emitMultiply(Assembler* assembler, Register destination, Register source);
+static void emitLea(Assembler* assembler, Register destination, Register base, int32_t displacement);
+static void emitSetCondition(Assembler* assembler, Condition condition, Register byte_register);
+static void emitJump(Assembler* assembler, size_t label);
+static void emitJumpIf(Assembler* assembler, Condition condition, size_t label);
+static void emitRelative(Assembler* assembler, size_t label);
+static void emitSse(Assembler* assembler, uint8_t prefix, bool wide, uint8_t opcode, int reg, int rm);
+static void emitSseMemory(Assembler* assembler, uint8_t prefix, uint8_t opcode, int xmm,
+                          Register base, int32_t displacement);
+static void emitPush(Assembler* assembler, Register value);
+static void emitPop(Assembler* assembler, Register value);
+
+const size_t NO_POSITION = SIZE_MAX;
+
+const uint8_t ALU_ADD  = 0x01;
+const uint8_t ALU_OR   = 0x09;
+const uint8_t ALU_AND  = 0x21;
+const uint8_t ALU_SUB  = 0x29;
+const uint8_t ALU_CMP  = 0x39;
+const uint8_t ALU_TEST = 0x85;
+
+const int EXTENSION_OR  = 1;
+const int EXTENSION_XOR = 6;
+const int SHIFT_LEFT    = 4;
+const int SHIFT_RIGHT   = 5;
+const int SHIFT_ARITHMETIC_RIGHT = 7;
+
+const uint8_t SSE_MOVQ_TO_XMM   = 0x6E;    // 66 REX.W 0F 6E: movq xmm, r64
+const uint8_t SSE_MOVQ_STORE    = 0xD6;    // 66 0F D6: movq m64, xmm
+const uint8_t SSE_CVTSI2SD      = 0x2A;    // F2 REX.W 0F 2A
+const uint8_t SSE_CVTTSD2SI     = 0x2C;    // F2 REX.W 0F 2C
+const uint8_t SSE_UCOMISD       = 0x2E;    // 66 0F 2E
+const uint8_t SSE_ADDSD         = 0x58;    // F2 0F xx
+const uint8_t SSE_MULSD         = 0x59;
+const uint8_t SSE_SUBSD         = 0x5C;
+const uint8_t SSE_DIVSD         = 0x5E;
+
+// The top 16 bits of a small integer: no sign, the quiet NaN and bit 48.
+const uint32_t SMALL_INTEGER_TOP = (uint32_t)(VALUE_INTEGER_TAG >> 48);
+const uint8_t  PAYLOAD_SHIFT     = 16;
+
+#endif
+
+
+// public ---------------------------------------------------------------------
+
+
+bool jitCtor(Jit* jit, const Chunk* chunk, Arena* arena, Value* frame, Value* stack,
+             FILE* output, uint32_t threshold)
+{
+    assert(jit    != NULL);
+    assert(chunk  != NULL);
+    assert(arena  != NULL);
+    assert(frame  != NULL);
+    assert(stack  != NULL);
+    assert(output != NULL);
+    assert(threshold > 0);
+
+    *jit = (Jit){};
+    jit->chunk     = chunk;
+    jit->runtime   = (JitRuntime){
+        .arena      = arena,
+        .output     = output,
+        .frame      = frame,
+        .frame_size = chunk->slots_number,
+        .stack      = stack,
+    };
+    jit->threshold = threshold;
+
+    jit->iterations = (uint32_t*)calloc(chunk->code_size + 1, sizeof(uint32_t));
+    jit->loops      = (JitCode*) calloc(chunk->code_size + 1, sizeof(JitCode));
+    if (jit->iterations == NULL || jit->loops == NULL)
+    {
+        jitDtor(jit);
+        return false;
+    }
+
+    return true;
+}
+
+
+void jitDtor(Jit* jit)
+{
+    if (jit == NULL)
+    {
+        return;
+    }
+
+#ifdef JIT_X86_64
+    for (size_t i = 0; i < jit->mappings_number; i++)
+    {
+        munmap(jit->mappings[i].address, jit->mappings[i].size);
+    }
+#endif
+
+    free(jit->mappings);
+    free(jit->iterations);
+    free(jit->loops);
+
+    jit->mappings   = NULL;
+    jit->iterations = NULL;
+    jit->loops      = NULL;
+    jit->mappings_number = 0;
+}
+
+
+JitCode jitBackEdge(Jit* jit, uint32_t start, uint32_t end)
+{
+    assert(jit != NULL);
+    assert(start < jit->chunk->code_size);
+
+    if (jit->loops[start] != NULL)
+    {
+        return jit->loops[start];
+    }
+
+    // A rejected loop stays at the threshold and is not tried again.
+    if (jit->iterations[start] >= jit->threshold || ++jit->iterations[start] < jit->threshold)
+    {
+        return NULL;
+    }
+
+    return jitCompileLoop(jit, start, end);
+}
+
+
+JitCode jitCompileLoop(Jit* jit, uint32_t start, uint32_t end)
+{
+    assert(jit != NULL);
+    assert(start <= end && end < jit->chunk->code_size);
+
+    JitCode code = NULL;
+
+#ifdef JIT_X86_64
+    LoopCompiler compiler = {
+        .chunk     = jit->chunk,
+        .start     = start,
+        .end       = end,
+        .size      = end - start + 1,
+        .depths    = (int*) malloc((end - start + 1) * sizeof(int)),
+        .is_target = (bool*)calloc(end - start + 1,  sizeof(bool)),
+    };
+
+    if (compiler.depths != NULL && compiler.is_target != NULL && analyzeLoop(&compiler))
+    {
+        compileLoop(&compiler);
+        if (resolveFixups(&compiler.assembler) && installCode(jit, &compiler.assembler, &code))
+        {
+            jit->statistics.code_bytes += compiler.assembler.size;
+        }
+    }
+
+    free(compiler.depths);
+    free(compiler.is_target);
+    free(compiler.exits);
+    assemblerDtor(&compiler.assembler);
+#else
+    (void)runInstruction;
+#endif
+
+    if (code == NULL)
+    {
+        jit->statistics.rejected_loops++;
+        return NULL;
+    }
+
+    jit->loops[start] = code;
+    jit->statistics.compiled_loops++;
+
+    return code;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+// Runs one instruction that compiled code leaves to C, on the operands at
+// the top of the VM's stack, as the VM would. On failure the operands are
+// left alone and the VM runs the instruction again to report the error.
+static bool runInstruction(JitRuntime* runtime, Value* operands, uint32_t opcode)
+{
+    assert(runtime  != NULL);
+    assert(operands != NULL);
+
+    Value result = {};
+    switch ((Opcode)opcode)
+    {
+        case OP_NOT:
+            operands[0] = valueBool(!valueIsTruthy(operands[0]));
+            return true;
+
+        case OP_TRUTHY:
+            operands[0] = valueBool(valueIsTruthy(operands[0]));
+            return true;
+
+        case OP_EQUAL:
+        case OP_NOT_EQUAL:
+            operands[0] = valueBool(valueEquals(operands[0], operands[1]) == (opcode == OP_EQUAL));
+            return true;
+
+        case OP_PRINT:
+            valuePrint(runtime->output, operands[0]);
+            fputc('\n', runtime->output);
+            return true;
+
+        case OP_NEGATE:
+        case OP_NEGATE_DOUBLE:
+        case OP_ARRAY:
+        case OP_LENGTH:
+            if (arenaShouldSweep(runtime->arena))
+            {
+                sweepArena(runtime, operands + 1);
+            }
+            if (valueUnaryOperation(opcodeOperation((Opcode)opcode), operands[0], runtime->arena,
+                                    &result) != RuntimeState_OK)
+            {
+                return false;
+            }
+            operands[0] = result;
+            return true;
+
+        default:
+            if (arenaShouldSweep(runtime->arena))
+            {
+                sweepArena(runtime, operands + 2);
+            }
+            if (valueBinaryOperation(opcodeOperation((Opcode)opcode), operands[0], operands[1],
+                                     runtime->arena, &result) != RuntimeState_OK)
+            {
+                return false;
+            }
+            // Compiled comparisons branch on a bool; the VM takes the
+            // element-wise comparisons of arrays.
+            if (opcodeOperation((Opcode)opcode) >= TOKEN_LT && opcodeOperation((Opcode)opcode) <= TOKEN_GTEQ
+             && !valueIsBool(result))
+            {
+                return false;
+            }
+            operands[0] = result;
+            return true;
+    }
+}
+
+
+// Compiled code keeps every value in the VM's frame and on its stack, up
+// to the operands of the instruction it hands back.
+static void sweepArena(JitRuntime* runtime, const Value* stack_top)
+{
+    assert(runtime   != NULL);
+    assert(stack_top != NULL);
+
+    valueMarkAll(runtime->frame, runtime->frame_size);
+    valueMarkAll(runtime->stack, (size_t)(stack_top - runtime->stack));
+    arenaSweep(runtime->arena);
+}
+
+
+#ifdef JIT_X86_64
+
+// Gives every reachable instruction of the loop its operand stack depth,
+// which the bytecode fixes statically; a loop whose depths disagree or
+// overflow the VM's stack is rejected.
+static bool analyzeLoop(LoopCompiler* compiler)
+{
+    assert(compiler != NULL);
+
+    uint32_t* worklist = (uint32_t*)malloc(compiler->size * sizeof(uint32_t));
+    if (worklist == NULL)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < compiler->size; i++)
+    {
+        compiler->depths[i] = -1;
+    }
+
+    size_t worklist_size = 0;
+    compiler->is_target[0] = true;
+    bool consistent = reachInstruction(compiler, compiler->start, 0, worklist, &worklist_size);
+
+    while (consistent && worklist_size > 0)
+    {
+        uint32_t offset = worklist[--worklist_size];
+        Instruction instruction = compiler->chunk->code[offset];
+        Opcode opcode = instructionOpcode(instruction);
+        if ((int)opcode >= OPCODES_NUMBER)
+        {
+            consistent = false;
+            break;
+        }
+
+        int depth = compiler->depths[offset - compiler->start];
+        int after = depth + opcodeStackEffect(opcode);
+        if (depth < instructionInputs(instruction) || after > (int)compiler->chunk->max_stack)
+        {
+            consistent = false;
+            break;
+        }
+
+        if (opcodeHasJumpTarget(opcode))
+        {
+            uint32_t target = instructionOperand(instruction);
+            if (target >= compiler->start && target <= compiler->end)
+            {
+                compiler->is_target[target - compiler->start] = true;
+            }
+            consistent = reachInstruction(compiler, target, after, worklist, &worklist_size);
+        }
+
+        if (opcode == OP_SWITCH)
+        {
+            const SwitchTable* table = &compiler->chunk->switches[instructionOperand(instruction)];
+            for (uint32_t entry = 0; consistent && entry < table->entries_number; entry++)
+            {
+                uint32_t target = table->targets[entry];
+                if (target >= compiler->start && target <= compiler->end)
+                {
+                    compiler->is_target[target - compiler->start] = true;
+                }
+                consistent = reachInstruction(compiler, target, after, worklist, &worklist_size);
+            }
+        }
+
+        if (consistent && opcode != OP_JUMP && opcode != OP_HALT)
+        {
+            consistent = reachInstruction(compiler, offset + 1, after, worklist, &worklist_size);
+        }
+    }
+
+    free(worklist);
+
+    return consistent;
+}
+
+
+static bool reachInstruction(LoopCompiler* compiler, uint32_t offset, int depth,
+                             uint32_t* worklist, size_t* worklist_size)
+{
+    assert(compiler      != NULL);
+    assert(worklist      != NULL);
+    assert(worklist_size != NULL);
+
+    if (offset < compiler->start || offset > compiler->end)
+    {
+        return true;
+    }
+
+    int* known = &compiler->depths[offset - compiler->start];
+    if (*known == -1)
+    {
+        *known = depth;
+        worklist[(*worklist_size)++] = offset;
+        return true;
+    }
+
+    return *known == depth;
+}
+
+
+// A superinstruction needs what its first part needs and what its second
+// part needs beyond the values the first one pushed.
+static int instructionInputs(Instruction instruction)
+{
+    Instruction parts[2] = {};
+    if (instructionUnfuse(instruction, parts) == 1)
+    {
+        return opcodeInputs(instructionOpcode(instruction));
+    }
+
+    Opcode first  = instructionOpcode(parts[0]);
+    Opcode second = instructionOpcode(parts[1]);
+    int inputs = opcodeInputs(second) - opcodeStackEffect(first);
+
+    return inputs > opcodeInputs(first) ? inputs : opcodeInputs(first);
+}
+
+
+static int opcodeInputs(Opcode opcode)
+{
+    switch (opcode)
+    {
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_MODULO:
+        case OP_EQUAL:
+        case OP_NOT_EQUAL:
+        case OP_LESS:
+        case OP_GREATER:
+        case OP_LESS_EQUAL:
+        case OP_GREATER_EQUAL:
+        case OP_ADD_DOUBLE:
+        case OP_SUBTRACT_DOUBLE:
+        case OP_MULTIPLY_DOUBLE:
+        case OP_DIVIDE_DOUBLE:
+        case OP_MODULO_DOUBLE:
+        case OP_LESS_DOUBLE:
+        case OP_GREATER_DOUBLE:
+        case OP_LESS_EQUAL_DOUBLE:
+        case OP_GREATER_EQUAL_DOUBLE:
+        case OP_INDEX:
+        case OP_APPEND:
+        case OP_FILL:
+            return 2;
+
+        case OP_STORE:
+        case OP_POP:
+        case OP_NOT:
+        case OP_NEGATE:
+        case OP_NEGATE_DOUBLE:
+        case OP_TRUTHY:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+        case OP_PRINT:
+        case OP_SWITCH:
+        case OP_ARRAY:
+        case OP_LENGTH:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+
+static void compileLoop(LoopCompiler* compiler)
+{
+    assert(compiler != NULL);
+
+    Assembler* assembler = &compiler->assembler;
+    for (size_t i = 0; i < compiler->size; i++)
+    {
+        newLabel(assembler);
+    }
+    compiler->epilogue = newLabel(assembler);
+
+    static const Register SAVED[] = {
+        Register_RBX, Register_R12, Register_R13, Register_R14, Register_R15,
+    };
+    const size_t SAVED_NUMBER = sizeof(SAVED) / sizeof(SAVED[0]);
+
+    // Five pushes after the return address leave rsp 16-byte aligned for
+    // the calls into C.
+    for (size_t i = 0; i < SAVED_NUMBER; i++)
+    {
+        emitPush(assembler, SAVED[i]);
+    }
+    emitMove(assembler, FRAME_REGISTER,   Register_RDI);
+    emitMove(assembler, STACK_REGISTER,   Register_RSI);
+    emitMove(assembler, RUNTIME_REGISTER, Register_RDX);
+    emitMoveImmediate(assembler, QNAN_REGISTER,    VALUE_QNAN);
+    emitMoveImmediate(assembler, INTEGER_REGISTER, VALUE_INTEGER_TAG);
+
+    uint32_t offset = compiler->start;
+    while (offset <= compiler->end)
+    {
+        if (compiler->depths[offset - compiler->start] < 0)
+        {
+            offset++;
+            continue;
+        }
+
+        bindLabel(assembler, offset - compiler->start);
+        offset = compileInstruction(compiler, offset);
+    }
+
+    for (size_t i = 0; i < compiler->exits_number; i++)
+    {
+        const Exit* exit = &compiler->exits[i];
+        bindLabel(assembler, exit->label);
+        emitMoveImmediate(assembler, Register_RAX, (uint64_t)exit->depth << 32 | exit->offset);
+        emitJump(assembler, compiler->epilogue);
+    }
+
+    bindLabel(assembler, compiler->epilogue);
+    for (size_t i = SAVED_NUMBER; i > 0; i--)
+    {
+        emitPop(assembler, SAVED[i - 1]);
+    }
+    emitByte(assembler, 0xC3);     // ret
+}
+
+
+// Returns the offset of the next instruction to compile.
+// A superinstruction is compiled as its two parts. When the second part
+// fails the exit goes back to the whole instruction at its first depth,
+// and the VM runs it again: first parts only store or push values, so
+// repeating them changes nothing.
+static uint32_t compileInstruction(LoopCompiler* compiler, uint32_t offset)
+{
+    assert(compiler != NULL);
+
+    Assembler* assembler = &compiler->assembler;
+    int depth = compiler->depths[offset - compiler->start];
+    uint32_t next = offset + 1;
+
+    Instruction parts[2] = {};
+    Instruction instruction = compiler->chunk->code[offset];
+    if (instructionUnfuse(instruction, parts) == 2)
+    {
+        Opcode first = instructionOpcode(parts[0]);
+        if (opcodeHasJumpTarget(instructionOpcode(parts[1])))
+        {
+            compileComparison(compiler, offset, first, depth, &parts[1], next);
+            return next;
+        }
+
+        compileOperation(compiler, offset, parts[0], depth);
+        depth += opcodeStackEffect(first);
+        instruction = parts[1];
+    }
+
+    Opcode opcode = instructionOpcode(instruction);
+    uint32_t operand = instructionOperand(instruction);
+
+    switch (opcode)
+    {
+        case OP_EQUAL:
+        case OP_NOT_EQUAL:
+        case OP_LESS:
+        case OP_GREATER:
+        case OP_LESS_EQUAL:
+        case OP_GREATER_EQUAL:
+        case OP_LESS_DOUBLE:
+        case OP_GREATER_DOUBLE:
+        case OP_LESS_EQUAL_DOUBLE:
+        case OP_GREATER_EQUAL_DOUBLE:
+        {
+            // A comparison that only feeds a conditional jump branches on
+            // the flags instead of building a bool.
+            Opcode following = next <= compiler->end ? instructionOpcode(compiler->chunk->code[next])
+                                                     : OP_HALT;
+            bool fused = (following == OP_JUMP_IF_FALSE || following == OP_JUMP_IF_TRUE)
+                      && !compiler->is_target[next - compiler->start];
+            compileComparison(compiler, offset, opcode, depth,
+                              fused ? &compiler->chunk->code[next] : NULL, next + 1);
+            if (fused)
+            {
+                return next + 1;
+            }
+            break;
+        }
+
+        case OP_JUMP:
+            emitJump(assembler, branchLabel(compiler, operand, depth));
+            return next;
+
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+            compileConditionalJump(compiler, offset, instruction, depth);
+            return next;
+
+        case OP_SWITCH:
+            compileSwitch(compiler, operand, depth, next);
+            return next;
+
+        case OP_HALT:
+            emitJump(assembler, exitLabel(compiler, offset, depth));
+            return next;
+
+        default:
+            if (!compileOperation(compiler, offset, instruction, depth))
+            {
+                emitJump(assembler, exitLabel(compiler, offset, depth));
+                return next;
+            }
+            break;
+    }
+
+    // Falling out of the loop returns to the VM.
+    if (next > compiler->end)
+    {
+        emitJump(assembler, branchLabel(compiler, next, depth + opcodeStackEffect(opcode)));
+    }
+
+    return next;
+}
+
+
+// Compiles an instruction that neither jumps nor ends the program, on the
+// operand stack at depth; false for the others.
+static bool compileOperation(LoopCompiler* compiler, uint32_t offset, Instruction instruction,
+                             int depth)
+{
+    assert(compiler != NULL);
+
+    Assembler* assembler = &compiler->assembler;
+    Opcode opcode = instructionOpcode(instruction);
+    uint32_t operand = instructionOperand(instruction);
+
+    switch (opcode)
+    {
+        case OP_CONSTANT:
+        case OP_TRUE:
+        case OP_FALSE:
+        {
+            Value value = opcode == OP_CONSTANT ? compiler->chunk->constants[operand]
+                                                : valueBool(opcode == OP_TRUE);
+            emitMoveImmediate(assembler, Register_RAX, value.bits);
+            emitStore(assembler, STACK_REGISTER, stackSlot(depth), Register_RAX);
+            return true;
+        }
+
+        case OP_LOAD:
+            emitLoad(assembler, Register_RAX, FRAME_REGISTER, frameSlot(operand));
+            emitStore(assembler, STACK_REGISTER, stackSlot(depth), Register_RAX);
+            return true;
+
+        case OP_STORE:
+            emitLoad(assembler, Register_RAX, STACK_REGISTER, stackSlot(depth - 1));
+            emitStore(assembler, FRAME_REGISTER, frameSlot(operand), Register_RAX);
+            return true;
+
+        case OP_POP:
+            return true;
+
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_MODULO:
+            compileArithmetic(compiler, offset, opcode, depth);
+            return true;
+
+        case OP_ADD_DOUBLE:
+        case OP_SUBTRACT_DOUBLE:
+        case OP_MULTIPLY_DOUBLE:
+        case OP_DIVIDE_DOUBLE:
+        case OP_MODULO_DOUBLE:
+            compileDoubleArithmetic(compiler, offset, opcode, depth);
+            return true;
+
+        case OP_EQUAL:
+        case OP_NOT_EQUAL:
+        case OP_LESS:
+        case OP_GREATER:
+        case OP_LESS_EQUAL:
+        case OP_GREATER_EQUAL:
+        case OP_LESS_DOUBLE:
+        case OP_GREATER_DOUBLE:
+        case OP_LESS_EQUAL_DOUBLE:
+        case OP_GREATER_EQUAL_DOUBLE:
+            compileComparison(compiler, offset, opcode, depth, NULL, 0);
+            return true;
+
+        case OP_NOT:
+        case OP_NEGATE:
+        case OP_NEGATE_DOUBLE:
+        case OP_TRUTHY:
+            compileUnary(compiler, offset, opcode, depth);
+            return true;
+
+        case OP_PRINT:
+        case OP_ARRAY:
+        case OP_LENGTH:
+            compileCall(compiler, offset, opcode, depth - 1);
+            return true;
+
+        case OP_INDEX:
+        case OP_APPEND:
+        case OP_FILL:
+            compileCall(compiler, offset, opcode, depth - 2);
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+
+// Two small integers are computed as integers as long as the result is
+// one, any mix of doubles and small integers as doubles; the rest, and the
+// integer results that need boxing or a -0, go to runInstruction.
+static void compileArithmetic(LoopCompiler* compiler, uint32_t offset, Opcode opcode, int depth)
+{
+    assert(compiler != NULL);
+
+    Assembler* assembler = &compiler->assembler;
+    int32_t left  = stackSlot(depth - 2);
+    int32_t right = stackSlot(depth - 1);
+
+    size_t not_integers = newLabel(assembler);
+    size_t slow         = newLabel(assembler);
+    size_t done         = newLabel(assembler);
+
+    emitLoad(assembler, Register_RAX, STACK_REGISTER, left);
+    emitLoad(assembler, Register_RCX, STACK_REGISTER, right);
+    compileSmallIntegerCheck(compiler, Register_RAX, not_integers);
+    compileSmallIntegerCheck(compiler, Register_RCX, not_integers);
+    compileIntegerArithmetic(compiler, opcode, left, slow, done);
+
+    bindLabel(assembler, not_integers);
+    if (opcode == OP_MODULO)
+    {
+        emitJump(assembler, slow);
+    }
+    else
+    {
+        compileToDouble(compiler, Register_RAX, 0, slow);
+        compileToDouble(compiler, Register_RCX, 1, slow);
+        emitSse(assembler, 0xF2, false, sseArithmeticOpcode(opcode), 0, 1);
+        emitSseMemory(assembler, 0x66, SSE_MOVQ_STORE, 0, STACK_REGISTER, left);
+        emitJump(assembler, done);
+    }
+
+    bindLabel(assembler, slow);
+    compileCall(compiler, offset, opcode, depth - 2);
+    bindLabel(assembler, done);
+}
+
+
+// Type inference proved both operands doubles, so their bits go straight
+// into xmm registers. % has no SSE instruction and calls out for fmod.
+static void compileDoubleArithmetic(LoopCompiler* compiler, uint32_t offset, Opcode opcode, int depth)
+{
+    assert(compiler != NULL);
+
+    if (opcode == OP_MODULO_DOUBLE)
+    {
+        compileCall(compiler, offset, opcode, depth - 2);
+        return;
+    }
+
+    Assembler* assembler = &compiler->assembler;
+    int32_t left  = stackSlot(depth - 2);
+    int32_t right = stackSlot(depth - 1);
+
+    emitLoad(assembler, Register_RAX, STACK_REGISTER, left);
+    emitLoad(assembler, Register_RCX, STACK_REGISTER, right);
+    emitSse(assembler, 0x66, true, SSE_MOVQ_TO_XMM, 0, Register_RAX);
+    emitSse(assembler, 0x66, true, SSE_MOVQ_TO_XMM, 1, Register_RCX);
+    emitSse(assembler, 0xF2, false, sseArithmeticOpcode(opcode), 0, 1);
+    emitSseMemory(assembler, 0x66, SSE_MOVQ_STORE, 0, STACK_REGISTER, left);
+}
+
+
+static uint8_t sseArithmeticOpcode(Opcode opcode)
+{
+    switch (opcode)
+    {
+        case OP_SUBTRACT:
+        case OP_SUBTRACT_DOUBLE: return SSE_SUBSD;
+        case OP_MULTIPLY:
+        case OP_MULTIPLY_DOUBLE: return SSE_MULSD;
+        case OP_DIVIDE:
+        case OP_DIVIDE_DOUBLE:   return SSE_DIVSD;
+        default:                 return SSE_ADDSD;
+    }
+}
+
+
+static bool isDoubleOpcode(Opcode opcode)
+{
+    switch (opcode)
+    {
+        case OP_ADD_DOUBLE:
+        case OP_SUBTRACT_DOUBLE:
+        case OP_MULTIPLY_DOUBLE:
+        case OP_DIVIDE_DOUBLE:
+        case OP_MODULO_DOUBLE:
+        case OP_LESS_DOUBLE:
+        case OP_GREATER_DOUBLE:
+        case OP_LESS_EQUAL_DOUBLE:
+        case OP_GREATER_EQUAL_DOUBLE:
+        case OP_NEGATE_DOUBLE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+
+
+// The operands are in rax and rcx. Shifted left by 16 the 48-bit payloads
+// become int64 multiples of 2^16, so the overflow flag of add, sub and imul
+// tells whether the result still fits; quotients and remainders are never
+// larger than the operands.
+static void compileIntegerArithmetic(LoopCompiler* compiler, Opcode opcode, int32_t left,
+                                     size_t slow, size_t done)
+{
+    assert(compiler != NULL);
+
+    Assembler* assembler = &compiler->assembler;
+    Register result  = Register_RAX;
+    bool     shifted = true;
+    size_t   inexact = NO_POSITION;
+
+    switch (opcode)
+    {
+        case OP_ADD:
+        case OP_ADD_DOUBLE:
+        case OP_SUBTRACT:
+        case OP_SUBTRACT_DOUBLE:
+        {
+            bool add = opcode == OP_ADD || opcode == OP_ADD_DOUBLE;
+            emitShift(assembler, SHIFT_LEFT, Register_RAX, PAYLOAD_SHIFT);
+            emitShift(assembler, SHIFT_LEFT, Register_RCX, PAYLOAD_SHIFT);
+            emitAlu(assembler, add ? ALU_ADD : ALU_SUB, Register_RAX, Register_RCX);
+            emitJumpIf(assembler, Condition_O, slow);
+            break;
+        }
+
+        case OP_MULTIPLY:
+        case OP_MULTIPLY_DOUBLE:
+        {
+            // A zero product with a negative factor is -0.
+            size_t nonzero = newLabel(assembler);
+            emitShift(assembler, SHIFT_LEFT, Register_RAX, PAYLOAD_SHIFT);
+            emitShift(assembler, SHIFT_LEFT, Register_RCX, PAYLOAD_SHIFT);
+            emitShift(assembler, SHIFT_ARITHMETIC_RIGHT, Register_RCX, PAYLOAD_SHIFT);
+            emitMove(assembler, Register_RDX, Register_RAX);
+            emitMultiply(assembler, Register_RAX, Register_RCX);
+            emitJumpIf(assembler, Condition_O, slow);
+            emitAlu(assembler, ALU_TEST, Register_RAX, Register_RAX);
+            emitJumpIf(assembler, Condition_NE, nonzero);
+            emitAlu(assembler, ALU_OR, Register_RDX, Register_RCX);
+            emitJumpIf(assembler, Condition_S, slow);
+            bindLabel(assembler, nonzero);
+            break;
+        }
+
+        case OP_DIVIDE:
+        case OP_DIVIDE_DOUBLE:
+        {
+            // As in the VM, the double quotient of two small integers is an
+            // integer exactly when the division is exact. 0 / -k is -0.
+            size_t exact = newLabel(assembler);
+            inexact = newLabel(assembler);
+            emitShift(assembler, SHIFT_LEFT, Register_RAX, PAYLOAD_SHIFT);
+            emitShift(assembler, SHIFT_ARITHMETIC_RIGHT, Register_RAX, PAYLOAD_SHIFT);
+            emitShift(assembler, SHIFT_LEFT, Register_RCX, PAYLOAD_SHIFT);
+            emitShift(assembler, SHIFT_ARITHMETIC_RIGHT, Register_RCX, PAYLOAD_SHIFT);
+            emitAlu(assembler, ALU_TEST, Register_RCX, Register_RCX);
+            emitJumpIf(assembler, Condition_E, slow);
+            emitSse(assembler, 0xF2, true,  SSE_CVTSI2SD,  0, Register_RAX);
+            emitSse(assembler, 0xF2, true,  SSE_CVTSI2SD,  1, Register_RCX);
+            emitSse(assembler, 0xF2, false, SSE_DIVSD,     0, 1);
+            emitSse(assembler, 0xF2, true,  SSE_CVTTSD2SI, Register_RDX, 0);
+            emitSse(assembler, 0xF2, true,  SSE_CVTSI2SD,  1, Register_RDX);
+            emitSse(assembler, 0x66, false, SSE_UCOMISD,   0, 1);
+            emitJumpIf(assembler, Condition_NE, inexact);
+            emitAlu(assembler, ALU_TEST, Register_RDX, Register_RDX);
+            emitJumpIf(assembler, Condition_NE, exact);
+            emitAlu(assembler, ALU_TEST, Register_RCX, Register_RCX);
+            emitJumpIf(assembler, Condition_S, inexact);
+            bindLabel(assembler, exact);
+            result  = Register_RDX;
+            shifted = false;
+            break;
+        }
+
+        case OP_MODULO:
+        case OP_MODULO_DOUBLE:
+        default:
+        {
+            // The remainder has the sign of the dividend; a zero one with a
+            // negative dividend is -0.
+            static const uint8_t CQO[]      = {0x48, 0x99};
+            static const uint8_t IDIV_RCX[] = {0x48, 0xF7, 0xF9};
+            size_t nonzero = newLabel(assembler);
+            emitShift(assembler, SHIFT_LEFT, Register_RAX, PAYLOAD_SHIFT);
+            emitShift(assembler, SHIFT_ARITHMETIC_RIGHT, Register_RAX, PAYLOAD_SHIFT);
+            emitShift(assembler, SHIFT_LEFT, Register_RCX, PAYLOAD_SHIFT);
+            emitShift(assembler, SHIFT_ARITHMETIC_RIGHT, Register_RCX, PAYLOAD_SHIFT);
+            emitAlu(assembler, ALU_TEST, Register_RCX, Register_RCX);
+            emitJumpIf(assembler, Condition_E, slow);
+            emitMove(assembler, Register_R8, Register_RAX);
+            emitBytes(assembler, CQO, sizeof(CQO));
+            emitBytes(assembler, IDIV_RCX, sizeof(IDIV_RCX));
+            emitAlu(assembler, ALU_TEST, Register_RDX, Register_RDX);
+            emitJumpIf(assembler, Condition_NE, nonzero);
+            emitAlu(assembler, ALU_TEST, Register_R8, Register_R8);
+            emitJumpIf(assembler, Condition_S, slow);
+            bindLabel(assembler, nonzero);
+            result  = Register_RDX;
+            shifted = false;
+            break;
+        }
+    }
+
+    // Keep the low 48 bits and tag them.
+    if (!shifted)
+    {
+        emitShift(assembler, SHIFT_LEFT, result, PAYLOAD_SHIFT);
+    }
+    emitShift(assembler, SHIFT_RIGHT, result, PAYLOAD_SHIFT);
+    emitAlu(assembler, ALU_OR, result, INTEGER_REGISTER);
+    emitStore(assembler, STACK_REGISTER, left, result);
+    emitJump(assembler, done);
+
+    if (inexact != NO_POSITION)
+    {
+        bindLabel(assembler, inexact);
+        emitSseMemory(assembler, 0x66, SSE_MOVQ_STORE, 0, STACK_REGISTER, left);
+        emitJump(assembler, done);
+    }
+}
+
+
+// The fast paths leave the outcome in al; the slow one reads it back from
+// the bool runInstruction stored. With a conditional jump the outcome
+// decides it, and fallthrough is where the code goes on otherwise.
+static void compileComparison(LoopCompiler* compiler, uint32_t offset, Opcode opcode, int depth,
+                              const Instruction* jump, uint32_t fallthrough)
+{
+    assert(compiler != NULL);
+
+    Assembler* assembler = &compiler->assembler;
+    int32_t left  = stackSlot(depth - 2);
+    int32_t right = stackSlot(depth - 1);
+
+    size_t not_integers = newLabel(assembler);
+    size_t slow         = newLabel(assembler);
+    size_t have_outcome = newLabel(assembler);
+
+    Condition integer_condition = Condition_E;
+    Condition double_condition  = Condition_E;
+    bool      swap              = false;
+    switch (opcode)
+    {
+        case OP_LESS:
+        case OP_LESS_DOUBLE:
+            integer_condition = Condition_L;  double_condition = Condition_A;  swap = true;
+            break;
+        case OP_LESS_EQUAL:
+        case OP_LESS_EQUAL_DOUBLE:
+            integer_condition = Condition_LE; double_condition = Condition_AE; swap = true;
+            break;
+        case OP_GREATER:
+        case OP_GREATER_DOUBLE:
+            integer_condition = Condition_G;  double_condition = Condition_A;
+            break;
+        case OP_GREATER_EQUAL:
+        case OP_GREATER_EQUAL_DOUBLE:
+            integer_condition = Condition_GE; double_condition = Condition_AE;
+            break;
+        case OP_NOT_EQUAL:
+            integer_condition = Condition_NE;
+            break;
+        case OP_EQUAL:
+        default:
+            integer_condition = Condition_E;
+            break;
+    }
+
+    emitLoad(assembler, Register_RAX, STACK_REGISTER, left);
+    emitLoad(assembler, Register_RCX, STACK_REGISTER, right);
+    if (isDoubleOpcode(opcode))
+    {
+        // Proven doubles: no tag checks and no slow path.
+        emitSse(assembler, 0x66, true, SSE_MOVQ_TO_XMM, 0, Register_RAX);
+        emitSse(assembler, 0x66, true, SSE_MOVQ_TO_XMM, 1, Register_RCX);
+        emitJump(assembler, not_integers);
+    }
+    else
+    {
+        compileSmallIntegerCheck(compiler, Register_RAX, not_integers);
+        compileSmallIntegerCheck(compiler, Register_RCX, not_integers);
+        emitShift(assembler, SHIFT_LEFT, Register_RAX, PAYLOAD_SHIFT);
+        emitShift(assembler, SHIFT_LEFT, Register_RCX, PAYLOAD_SHIFT);
+        emitAlu(assembler, ALU_CMP, Register_RAX, Register_RCX);
+        emitSetCondition(assembler, integer_condition, Register_RAX);
+        emitJump(assembler, have_outcome);
+    }
+
+    // Unordered operands set CF and ZF, so "above" and "above or equal" on
+    // the swapped operands are false for NaN, as isless and friends are.
+    bindLabel(assembler, not_integers);
+    if (!isDoubleOpcode(opcode))
+    {
+        compileToDouble(compiler, Register_RAX, 0, slow);
+        compileToDouble(compiler, Register_RCX, 1, slow);
+    }
+    if (opcode == OP_EQUAL || opcode == OP_NOT_EQUAL)
+    {
+        static const uint8_t AND_AL_CL[] = {0x20, 0xC8};
+        static const uint8_t XOR_AL_1[]  = {0x34, 0x01};
+        emitSse(assembler, 0x66, false, SSE_UCOMISD, 0, 1);
+        emitSetCondition(assembler, Condition_E,  Register_RAX);
+        emitSetCondition(assembler, Condition_NP, Register_RCX);
+        emitBytes(assembler, AND_AL_CL, sizeof(AND_AL_CL));
+        if (opcode == OP_NOT_EQUAL)
+        {
+            emitBytes(assembler, XOR_AL_1, sizeof(XOR_AL_1));
+        }
+    }
+    else
+    {
+        emitSse(assembler, 0x66, false, SSE_UCOMISD, swap ? 1 : 0, swap ? 0 : 1);
+        emitSetCondition(assembler, double_condition, Register_RAX);
+    }
+    emitJump(assembler, have_outcome);
+
+    bindLabel(assembler, slow);
+    compileCall(compiler, offset, opcode, depth - 2);
+    emitLoad(assembler, Register_RAX, STACK_REGISTER, left);
+
+    bindLabel(assembler, have_outcome);
+    if (jump != NULL)
+    {
+        compileBoolBranch(compiler, instructionOpcode(*jump), instructionOperand(*jump),
+                          depth - 2, fallthrough);
+    }
+    else
+    {
+        compileStoreBool(compiler, left);
+    }
+}
+
+
+static void compileConditionalJump(LoopCompiler* compiler, uint32_t offset, Instruction jump, int depth)
+{
+    assert(compiler != NULL);
+
+    Assembler* assembler = &compiler->assembler;
+    int32_t condition = stackSlot(depth - 1);
+    size_t is_bool = newLabel(assembler);
+
+    emitLoad(assembler, Register_RAX, STACK_REGISTER, condition);
+    emitMove(assembler, Register_RCX, Register_RAX);
+    emitAluImmediate8(assembler, EXTENSION_OR, Register_RCX, 1);
+    emitMove(assembler, Register_RDX, QNAN_REGISTER);
+    emitAluImmediate8(assembler, EXTENSION_OR, Register_RDX, 3);
+    emitAlu(assembler, ALU_CMP, Register_RCX, Register_RDX);
+    emitJumpIf(assembler, Condition_E, is_bool);
+    compileCall(compiler, offset, OP_TRUTHY, depth - 1);
+    emitLoad(assembler, Register_RAX, STACK_REGISTER, condition);
+
+    bindLabel(assembler, is_bool);
+    compileBoolBranch(compiler, instructionOpcode(jump), instructionOperand(jump),
+                      depth - 1, offset + 1);
+}
+
+
+static void compileUnary(LoopCompiler* compiler, uint32_t offset, Opcode opcode, int depth)
+{
+    assert(compiler != NULL);
+
+    Assembler* assembler = &compiler->assembler;
+    int32_t operand = stackSlot(depth - 1);
+    size_t slow = newLabel(assembler);
+    size_t done = newLabel(assembler);
+
+    emitLoad(assembler, Register_RAX, STACK_REGISTER, operand);
+    if (opcode == OP_NEGATE || opcode == OP_NEGATE_DOUBLE)
+    {
+        // Doubles flip their sign bit; integers need the -0 and range rules,
+        // and NEGATE_DOUBLE has only doubles.
+        static const uint8_t BTC_RAX_63[] = {0x48, 0x0F, 0xBA, 0xF8, 0x3F};
+        if (opcode == OP_NEGATE)
+        {
+            emitMove(assembler, Register_RDX, Register_RAX);
+            emitAlu(assembler, ALU_AND, Register_RDX, QNAN_REGISTER);
+            emitAlu(assembler, ALU_CMP, Register_RDX, QNAN_REGISTER);
+            emitJumpIf(assembler, Condition_E, slow);
+        }
+        emitBytes(assembler, BTC_RAX_63, sizeof(BTC_RAX_63));
+        emitStore(assembler, STACK_REGISTER, operand, Register_RAX);
+    }
+    else
+    {
+        emitMove(assembler, Register_RCX, Register_RAX);
+        emitAluImmediate8(assembler, EXTENSION_OR, Register_RCX, 1);
+        emitMove(assembler, Register_RDX, QNAN_REGISTER);
+        emitAluImmediate8(assembler, EXTENSION_OR, Register_RDX, 3);
+        emitAlu(assembler, ALU_CMP, Register_RCX, Register_RDX);
+        emitJumpIf(assembler, Condition_NE, slow);
+        if (opcode == OP_NOT)
+        {
+            emitAluImmediate8(assembler, EXTENSION_XOR, Register_RAX, 1);
+            emitStore(assembler, STACK_REGISTER, operand, Register_RAX);
+        }
+    }
+    emitJump(assembler, done);
+
+    bindLabel(assembler, slow);
+    compileCall(compiler, offset, opcode, depth - 1);
+    bindLabel(assembler, done);
+}
+
+
+// switchTableFind gives the entry, which indexes a table of rel32 offsets
+// placed right after the indirect jump; one more entry past the cases
+// holds the fallthrough. Each offset is relative to the end of its entry,
+// as resolveFixups writes them.
+static void compileSwitch(LoopCompiler* compiler, uint32_t table_index, int depth,
+                          uint32_t fallthrough)
+{
+    assert(compiler != NULL);
+
+    static const uint8_t CALL_RAX[]          = {0xFF, 0xD0};
+    static const uint8_t MOV_EAX_EAX[]       = {0x89, 0xC0};
+    static const uint8_t LEA_RCX_RIP[]       = {0x48, 0x8D, 0x0D};          // + rel32
+    static const uint8_t LEA_RCX_RCX_RAX_4[] = {0x48, 0x8D, 0x0C, 0x81};    // lea rcx, [rcx + rax*4]
+    static const uint8_t MOVSXD_RAX_RCX[]    = {0x48, 0x63, 0x01};          // movsxd rax, [rcx]
+    static const uint8_t LEA_RAX_RAX_RCX_4[] = {0x48, 0x8D, 0x44, 0x08, 0x04};
+    static const uint8_t JMP_RAX[]           = {0xFF, 0xE0};
+    Assembler* assembler = &compiler->assembler;
+    const SwitchTable* table = &compiler->chunk->switches[table_index];
+    int after = depth - 1;
+
+    emitMoveImmediate(assembler, Register_RDI, (uint64_t)(uintptr_t)table);
+    emitLoad(assembler, Register_RSI, STACK_REGISTER, stackSlot(after));
+    emitMoveImmediate(assembler, Register_RAX, (uint64_t)(uintptr_t)&switchTableFind);
+    emitBytes(assembler, CALL_RAX, sizeof(CALL_RAX));
+    emitBytes(assembler, MOV_EAX_EAX, sizeof(MOV_EAX_EAX));     // the upper half is undefined
+
+    size_t offsets = newLabel(assembler);
+    emitBytes(assembler, LEA_RCX_RIP, sizeof(LEA_RCX_RIP));
+    emitRelative(assembler, offsets);
+    emitBytes(assembler, LEA_RCX_RCX_RAX_4, sizeof(LEA_RCX_RCX_RAX_4));
+    emitBytes(assembler, MOVSXD_RAX_RCX, sizeof(MOVSXD_RAX_RCX));
+    emitBytes(assembler, LEA_RAX_RAX_RCX_4, sizeof(LEA_RAX_RAX_RCX_4));  // lea rax, [rax + rcx + 4]
+    emitBytes(assembler, JMP_RAX, sizeof(JMP_RAX));
+
+    bindLabel(assembler, offsets);
+    for (uint32_t entry = 0; entry < table->entries_number; entry++)
+    {
+        emitRelative(assembler, branchLabel(compiler, table->targets[entry], after));
+    }
+    emitRelative(assembler, branchLabel(compiler, fallthrough, after));
+}
+
+
+// Branches on the low bit of al, which is the outcome or a bool's bits.
+// The jump has popped its operand, so depth is the depth after it.
+static void compileBoolBranch(LoopCompiler* compiler, Opcode jump, uint32_t target,
+                              int depth, uint32_t fallthrough)
+{
+    assert(compiler != NULL);
+
+    static const uint8_t TEST_AL_1[] = {0xA8, 0x01};
+    Assembler* assembler = &compiler->assembler;
+
+    emitBytes(assembler, TEST_AL_1, sizeof(TEST_AL_1));
+    emitJumpIf(assembler, jump == OP_JUMP_IF_TRUE ? Condition_NE : Condition_E,
+               branchLabel(compiler, target, depth));
+    if (fallthrough > compiler->end)
+    {
+        emitJump(assembler, branchLabel(compiler, fallthrough, depth));
+    }
+}
+
+
+// Loads a double or a small integer in value into the xmm register; other
+// values go to slow. Clobbers rdx and value.
+static void compileToDouble(LoopCompiler* compiler, Register value, int xmm, size_t slow)
+{
+    assert(compiler != NULL);
+
+    Assembler* assembler = &compiler->assembler;
+    size_t is_double = newLabel(assembler);
+    size_t converted = newLabel(assembler);
+
+    emitMove(assembler, Register_RDX, value);
+    emitAlu(assembler, ALU_AND, Register_RDX, QNAN_REGISTER);
+    emitAlu(assembler, ALU_CMP, Register_RDX, QNAN_REGISTER);
+    emitJumpIf(assembler, Condition_NE, is_double);
+    compileSmallIntegerCheck(compiler, value, slow);
+    emitShift(assembler, SHIFT_LEFT, value, PAYLOAD_SHIFT);
+    emitShift(assembler, SHIFT_ARITHMETIC_RIGHT, value, PAYLOAD_SHIFT);
+    emitSse(assembler, 0xF2, true, SSE_CVTSI2SD, xmm, value);
+    emitJump(assembler, converted);
+
+    bindLabel(assembler, is_double);
+    emitSse(assembler, 0x66, true, SSE_MOVQ_TO_XMM, xmm, value);
+    bindLabel(assembler, converted);
+}
+
+
+// Small integers are the values whose top 16 bits are 0x7FFD. Clobbers rdx.
+static void compileSmallIntegerCheck(LoopCompiler* compiler, Register value, size_t otherwise)
+{
+    assert(compiler != NULL);
+
+    Assembler* assembler = &compiler->assembler;
+    emitMove(assembler, Register_RDX, value);
+    emitShift(assembler, SHIFT_RIGHT, Register_RDX, 48);
+    emitCompare32(assembler, Register_RDX, SMALL_INTEGER_TOP);
+    emitJumpIf(assembler, Condition_NE, otherwise);
+}
+
+
+// Calls runInstruction on the operands from first_operand up; if it fails
+// the VM takes over at the instruction with the operands still in place.
+static void compileCall(LoopCompiler* compiler, uint32_t offset, Opcode opcode, int first_operand)
+{
+    assert(compiler != NULL);
+
+    static const uint8_t CALL_RAX[]   = {0xFF, 0xD0};
+    static const uint8_t TEST_AL_AL[] = {0x84, 0xC0};
+    Assembler* assembler = &compiler->assembler;
+
+    emitMove(assembler, Register_RDI, RUNTIME_REGISTER);
+    emitLea(assembler, Register_RSI, STACK_REGISTER, stackSlot(first_operand));
+    emitMoveImmediate(assembler, Register_RDX, (uint64_t)opcode);
+    emitMoveImmediate(assembler, Register_RAX, (uint64_t)(uintptr_t)&runInstruction);
+    emitBytes(assembler, CALL_RAX, sizeof(CALL_RAX));
+    emitBytes(assembler, TEST_AL_AL, sizeof(TEST_AL_AL));
+    emitJumpIf(assembler, Condition_E,
+               exitLabel(compiler, offset, compiler->depths[offset - compiler->start]));
+}
+
+
+static void compileStoreBool(LoopCompiler* compiler, int32_t displacement)
+{
+    assert(compiler != NULL);
+
+    static const uint8_t MOVZX_EAX_AL[] = {0x0F, 0xB6, 0xC0};
+    Assembler* assembler = &compiler->assembler;
+
+    emitBytes(assembler, MOVZX_EAX_AL, sizeof(MOVZX_EAX_AL));
+    emitAlu(assembler, ALU_OR, Register_RAX, QNAN_REGISTER);
+    emitAluImmediate8(assembler, EXTENSION_OR, Register_RAX, 2);
+    emitStore(assembler, STACK_REGISTER, displacement, Register_RAX);
+}
+
+
+// Jumps inside the loop go to the target's code, the others return to the
+// VM with the offset and depth.
+static size_t branchLabel(LoopCompiler* compiler, uint32_t target, int depth)
+{
+    assert(compiler != NULL);
+
+    if (target >= compiler->start && target <= compiler->end
+     && !(target == compiler->start && depth != 0))
+    {
+        return target - compiler->start;
+    }
+
+    return exitLabel(compiler, target, depth);
+}
+
+
+// A stub that returns to the VM at offset with depth values on the stack;
+// failed instructions leave through one so that the VM runs them again.
+static size_t exitLabel(LoopCompiler* compiler, uint32_t offset, int depth)
+{
+    assert(compiler != NULL);
+
+    if (compiler->exits_number == compiler->exits_capacity)
+    {
+        size_t capacity = compiler->exits_capacity == 0 ? 8 : compiler->exits_capacity * 2;
+        Exit* exits = (Exit*)realloc(compiler->exits, capacity * sizeof(Exit));
+        if (exits == NULL)
+        {
+            compiler->assembler.failed = true;
+            return compiler->epilogue;
+        }
+        compiler->exits          = exits;
+        compiler->exits_capacity = capacity;
+    }
+
+    size_t label = newLabel(&compiler->assembler);
+    compiler->exits[compiler->exits_number++] = (Exit){
+        .label  = label,
+        .offset = offset,
+        .depth  = depth,
+    };
+
+    return label;
+}
+
+
+// Copies the code into fresh pages and makes them executable but no longer
+// writable.
+static bool installCode(Jit* jit, const Assembler* assembler, JitCode* code)
+{
+    assert(jit       != NULL);
+    assert(assembler != NULL);
+    assert(code      != NULL);
+
+    if (jit->mappings_number == jit->mappings_capacity)
+    {
+        size_t capacity = jit->mappings_capacity == 0 ? 8 : jit->mappings_capacity * 2;
+        JitMapping* mappings = (JitMapping*)realloc(jit->mappings, capacity * sizeof(JitMapping));
+        if (mappings == NULL)
+        {
+            return false;
+        }
+        jit->mappings          = mappings;
+        jit->mappings_capacity = capacity;
+    }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (assembler->size + page - 1) / page * page;
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        return false;
+    }
+
+    memcpy(memory, assembler->code, assembler->size);
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, size);
+        return false;
+    }
+
+    jit->mappings[jit->mappings_number++] = (JitMapping){.address = memory, .size = size};
+    *code = (JitCode)memory;
+
+    return true;
+}
+
+
+static int32_t stackSlot(int depth)
+{
+    assert(depth >= 0);
+
+    return (int32_t)((size_t)depth * sizeof(Value));
+}
+
+
+static int32_t frameSlot(uint32_t slot)
+{
+    return (int32_t)(slot * sizeof(Value));
+}
+
+
+// assembler ------------------------------------------------------------------
+
+
+static void assemblerDtor(Assembler* assembler)
+{
+    assert(assembler != NULL);
+
+    free(assembler->code);
+    free(assembler->labels);
+    free(assembler->fixups);
+
+    *assembler = (Assembler){};
+}
+
+
+static size_t newLabel(Assembler* assembler)
+{
+    assert(assembler != NULL);
+
+    if (assembler->labels_number == assembler->labels_capacity)
+    {
+        size_t capacity = assembler->labels_capacity == 0 ? 64 : assembler->labels_capacity * 2;
+        size_t* labels = (size_t*)realloc(assembler->labels, capacity * sizeof(size_t));
+        if (labels == NULL)
+        {
+            assembler->failed = true;
+            return 0;
+        }
+        assembler->labels          = labels;
+        assembler->labels_capacity = capacity;
+    }
+
+    assembler->labels[assembler->labels_number] = NO_POSITION;
+    return assembler->labels_number++;
+}
+
+
+static void bindLabel(Assembler* assembler, size_t label)
+{
+    assert(assembler != NULL);
+
+    if (!assembler->failed)
+    {
+        assert(label < assembler->labels_number && assembler->labels[label] == NO_POSITION);
+        assembler->labels[label] = assembler->size;
+    }
+}
+
+
+static bool resolveFixups(Assembler* assembler)
+{
+    assert(assembler != NULL);
+
+    if (assembler->failed)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < assembler->fixups_number; i++)
+    {
+        const Fixup* fixup = &assembler->fixups[i];
+        size_t target = assembler->labels[fixup->label];
+        if (target == NO_POSITION)
+        {
+            return false;
+        }
+
+        int32_t relative = (int32_t)((int64_t)target - (int64_t)(fixup->position + sizeof(int32_t)));
+        memcpy(assembler->code + fixup->position, &relative, sizeof(relative));
+    }
+
+    return true;
+}
+
+
+static void emitByte(Assembler* assembler, uint8_t byte)
+{
+    emitBytes(assembler, &byte, 1);
+}
+
+
+static void emitBytes(Assembler* assembler, const uint8_t* bytes, size_t size)
+{
+    assert(assembler != NULL);
+    assert(bytes     != NULL);
+
+    if (assembler->failed)
+    {
+        return;
+    }
+
+    if (assembler->size + size > assembler->capacity)
+    {
+        size_t capacity = assembler->capacity == 0 ? 1024 : assembler->capacity * 2;
+        uint8_t* code = (uint8_t*)realloc(assembler->code, capacity);
+        if (code == NULL)
+        {
+            assembler->failed = true;
+            return;
+        }
+        assembler->code     = code;
+        assembler->capacity = capacity;
+    }
+
+    memcpy(assembler->code + assembler->size, bytes, size);
+    assembler->size += size;
+}
+
+
+static void emitU32(Assembler* assembler, uint32_t value)
+{
+    uint8_t bytes[sizeof(value)] = {};
+    memcpy(bytes, &value, sizeof(value));     // x86 is little-endian
+    emitBytes(assembler, bytes, sizeof(bytes));
+}
+
+
+static void emitU64(Assembler* assembler, uint64_t value)
+{
+    uint8_t bytes[sizeof(value)] = {};
+    memcpy(bytes, &value, sizeof(value));
+    emitBytes(assembler, bytes, sizeof(bytes));
+}
+
+
+// REX.W selects 64-bit operands, REX.R and REX.B extend the ModRM reg and
+// rm fields to r8-r15. Left out when none is needed.
+static void emitRex(Assembler* assembler, bool wide, int reg, int rm)
+{
+    uint8_t rex = (uint8_t)(0x40 | (wide ? 0x08 : 0) | ((reg & 8) >> 1) | ((rm & 8) >> 3));
+    if (rex != 0x40)
+    {
+        emitByte(assembler, rex);
+    }
+}
+
+
+static void emitModRmRegister(Assembler* assembler, int reg, int rm)
+{
+    emitByte(assembler, (uint8_t)(0xC0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+
+// [base + displacement]. rsp and r12 would need a SIB byte and are never
+// used as bases here.
+static void emitModRmMemory(Assembler* assembler, int reg, Register base, int32_t displacement)
+{
+    assert((base & 7) != Register_RSP);
+
+    uint8_t fields = (uint8_t)((reg & 7) << 3 | (base & 7));
+    if (displacement == 0 && (base & 7) != Register_RBP)
+    {
+        emitByte(assembler, fields);
+    }
+    else if (displacement >= INT8_MIN && displacement <= INT8_MAX)
+    {
+        emitByte(assembler, (uint8_t)(0x40 | fields));
+        emitByte(assembler, (uint8_t)(int8_t)displacement);
+    }
+    else
+    {
+        emitByte(assembler, (uint8_t)(0x80 | fields));
+        emitU32(assembler, (uint32_t)displacement);
+    }
+}
+
+
+// mov destination, [base + displacement]
+static void emitLoad(Assembler* assembler, Register destination, Register base, int32_t displacement)
+{
+    emitRex(assembler, true, destination, base);
+    emitByte(assembler, 0x8B);
+    emitModRmMemory(assembler, destination, base, displacement);
+}
+
+
+// mov [base + displacement], source
+static void emitStore(Assembler* assembler, Register base, int32_t displacement, Register source)
+{
+    emitRex(assembler, true, source, base);
+    emitByte(assembler, 0x89);
+    emitModRmMemory(assembler, source, base, displacement);
+}
+
+
+static void emitMove(Assembler* assembler, Register destination, Register source)
+{
+    emitRex(assembler, true, source, destination);
+    emitByte(assembler, 0x89);
+    emitModRmRegister(assembler, source, destination);
+}
+
+
+// Values that fit in 32 bits use the shorter form, which zero-extends.
+static void emitMoveImmediate(Assembler* assembler, Register destination, uint64_t value)
+{
+    bool wide = value > UINT32_MAX;
+    emitRex(assembler, wide, 0, destination);
+    emitByte(assembler, (uint8_t)(0xB8 + (destination & 7)));
+    if (wide)
+    {
+        emitU64(assembler, value);
+    }
+    else
+    {
+        emitU32(assembler, (uint32_t)value);
+    }
+}
+
+
+// add, or, and, sub, cmp or test destination, source
+static void emitAlu(Assembler* assembler, uint8_t opcode, Register destination, Register source)
+{
+    emitRex(assembler, true, source, destination);
+    emitByte(assembler, opcode);
+    emitModRmRegister(assembler, source, destination);
+}
+
+
+static void emitAluImmediate8(Assembler* assembler, int extension, Register destination, int8_t value)
+{
+    emitRex(assembler, true, 0, destination);
+    emitByte(assembler, 0x83);
+    emitModRmRegister(assembler, extension, destination);
+    emitByte(assembler, (uint8_t)value);
+}
+
+
+// cmp on the low 32 bits
+static void emitCompare32(Assembler* assembler, Register value, uint32_t immediate)
+{
+    emitRex(assembler, false, 0, value);
+    emitByte(assembler, 0x81);
+    emitModRmRegister(assembler, 7, value);
+    emitU32(assembler, immediate);
+}
+
+
+static void emitShift(Assembler* assembler, int extension, Register value, uint8_t count)
+{
+    emitRex(assembler, true, 0, value);
+    emitByte(assembler, 0xC1);
+    emitModRmRegister(assembler, extension, value);
+    emitByte(assembler, count);
+}
+
+
+// imul destination, source
+static void emitMultiply(Assembler* assembler, Register destination, Register source)
+{
+    emitRex(assembler, true, destination, source);
+    emitByte(assembler, 0x0F);
+    emitByte(assembler, 0xAF);
+    emitModRmRegister(assembler, destination, source);
+}
+
+
+static void emitLea(Assembler* assembler, Register destination, Register base, int32_t displacement)
+{
+    emitRex(assembler, true, destination, base);
+    emitByte(assembler, 0x8D);
+    emitModRmMemory(assembler, destination, base, displacement);
+}
+
+
+// setcc on al, cl, dl or bl
+static void emitSetCondition(Assembler* assembler, Condition condition, Register byte_register)
+{
+    assert(byte_register < Register_RSP);
+
+    emitByte(assembler, 0x0F);
+    emitByte(assembler, (uint8_t)(0x90 + condition));
+    emitModRmRegister(assembler, 0, byte_register);
+}
+
+
+static void emitJump(Assembler* assembler, size_t label)
+{
+    emitByte(assembler, 0xE9);
+    emitRelative(assembler, label);
+}
+
+
+static void emitJumpIf(Assembler* assembler, Condition condition, size_t label)
+{
+    emitByte(assembler, 0x0F);
+    emitByte(assembler, (uint8_t)(0x80 + condition));
+    emitRelative(assembler, label);
+}
+
+
+// A rel32 to the label, filled in by resolveFixups.
+static void emitRelative(Assembler* assembler, size_t label)
+{
+    assert(assembler != NULL);
+
+    if (assembler->failed)
+    {
+        return;
+    }
+
+    if (assembler->fixups_number == assembler->fixups_capacity)
+    {
+        size_t capacity = assembler->fixups_capacity == 0 ? 64 : assembler->fixups_capacity * 2;
+        Fixup* fixups = (Fixup*)realloc(assembler->fixups, capacity * sizeof(Fixup));
+        if (fixups == NULL)
+        {
+            assembler->failed = true;
+            return;
+        }
+        assembler->fixups          = fixups;
+        assembler->fixups_capacity = capacity;
+    }
+
+    assembler->fixups[assembler->fixups_number++] = (Fixup){
+        .position = assembler->size,
+        .label    = label,
+    };
+    emitU32(assembler, 0);
+}
+
+
+// prefix [REX] 0F opcode ModRM, register to register
+static void emitSse(Assembler* assembler, uint8_t prefix, bool wide, uint8_t opcode, int reg, int rm)
+{
+    emitByte(assembler, prefix);
+    emitRex(assembler, wide, reg, rm);
+    emitByte(assembler, 0x0F);
+    emitByte(assembler, opcode);
+    emitModRmRegister(assembler, reg, rm);
+}
+
+
+static void emitSseMemory(Assembler* assembler, uint8_t prefix, uint8_t opcode, int xmm,
+                          Register base, int32_t displacement)
+{
+    emitByte(assembler, prefix);
+    emitRex(assembler, false, xmm, base);
+    emitByte(assembler, 0x0F);
+    emitByte(assembler, opcode);
+    emitModRmMemory(assembler, xmm, base, displacement);
+}
+
+
+static void emitPush(Assembler* assembler, Register value)
+{
+    emitRex(assembler, false, 0, value);
+    emitByte(assembler, (uint8_t)(0x50 + (value & 7)));
+}
+
+
+static void emitPop(Assembler* assembler, Register value)
+{
+    emitRex(assembler, false, 0, value);
+    emitByte(assembler, (uint8_t)(0x58 + (value & 7)));
+}
+
+#endif
@@ -0,0 +1,119 @@
+// Runs the driver through a server started with language --serve: the
+// arguments go to the server as given, a source of - is read here from
+// stdin, and the run's output and exit code come back. --socket PATH picks
+// the server, --shutdown stops it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compile_server.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+static char* readStream(FILE* stream);
+
+static const size_t SOCKET_PATH_SIZE  = 108;
+static const size_t SOURCE_CHUNK_SIZE = 4096;
+
+
+// public ---------------------------------------------------------------------
+
+
+int main(int argc, char** argv)
+{
+    char default_path[SOCKET_PATH_SIZE] = {};
+    const char* socket_path = NULL;
+    bool shutdown = false;
+    bool from_stdin = false;
+
+    // argv[0] stays, so the server's usage message names the client.
+    int forwarded_number = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc)
+        {
+            socket_path = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--shutdown") == 0)
+        {
+            shutdown = true;
+            continue;
+        }
+        if (strcmp(argv[i], "-") == 0)
+        {
+            from_stdin = true;
+        }
+        argv[forwarded_number++] = argv[i];
+    }
+    argv[forwarded_number] = NULL;
+
+    if (socket_path == NULL)
+    {
+        if (!compileServerDefaultPath(default_path, sizeof(default_path)))
+        {
+            return EXIT_FAILURE;
+        }
+        socket_path = default_path;
+    }
+
+    if (shutdown)
+    {
+        return compileClientShutdown(socket_path) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    char* source = NULL;
+    if (from_stdin)
+    {
+        source = readStream(stdin);
+        if (source == NULL)
+        {
+            fprintf(stderr, "Cannot read the program from stdin\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    int exit_code = compileClientRun(socket_path, forwarded_number, argv, source);
+    free(source);
+
+    return exit_code;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static char* readStream(FILE* stream)
+{
+    size_t capacity = SOURCE_CHUNK_SIZE;
+    size_t size     = 0;
+    char*  buffer   = (char*)malloc(capacity);
+    while (buffer != NULL)
+    {
+        size += fread(buffer + size, sizeof(char), capacity - size - 1, stream);
+        if (size + 1 < capacity)
+        {
+            break;
+        }
+
+        capacity *= 2;
+        char* grown = (char*)realloc(buffer, capacity);
+        if (grown == NULL)
+        {
+            free(buffer);
+        }
+        buffer = grown;
+    }
+
+    if (buffer == NULL || ferror(stream))
+    {
+        free(buffer);
+        return NULL;
+    }
+
+    buffer[size] = '\0';
+    return buffer;
+}
@@ -9,7 +9,7 @@
 
 
 static bool match(Lexer* lexer, char expected);
-static Token errorToken(const char* message);
+static Token errorToken(Lexer* lexer, const char* message);
 static Token readIdentifier(Lexer* lexer);
 static Token readString(Lexer* lexer);
 static Token readNumber(Lexer* lexer);
@@ -54,7 +54,10 @@ Token nextToken(Lexer* lexer)
 
         if (current_char == '/' && *lexer->current  == '/')
         {
-            lexer->current++;
+            while (*lexer->current != '\n' && *lexer->current != '\0')
+            {
+                lexer->current++;
+            }
             continue;
         }
 
@@ -65,6 +68,9 @@ Token nextToken(Lexer* lexer)
             case ')' : return makeToken(lexer, TOKEN_RPAREN);
             case '{' : return makeToken(lexer, TOKEN_LBRACE);
             case '}' : return makeToken(lexer, TOKEN_RBRACE);
+            case '[' : return makeToken(lexer, TOKEN_LBRACKET);
+            case ']' : return makeToken(lexer, TOKEN_RBRACKET);
+            case ',' : return makeToken(lexer, TOKEN_COMMA);
             case ';' : return makeToken(lexer, TOKEN_SEMICOLON);
             case '+' : return makeToken(lexer, TOKEN_PLUS);
             case '-' : return makeToken(lexer, TOKEN_MINUS);
@@ -112,6 +118,20 @@ Token nextToken(Lexer* lexer)
                     return makeToken(lexer, TOKEN_GT);
                 }  
 
+            case '&':
+                if (match(lexer, '&'))
+                {
+                    return makeToken(lexer, TOKEN_AND);
+                }
+                return errorToken(lexer, "Expected '&&'");
+
+            case '|':
+                if (match(lexer, '|'))
+                {
+                    return makeToken(lexer, TOKEN_OR);
+                }
+                return errorToken(lexer, "Expected '||'");
+
             case '"': return readString(lexer);
             
             default:
@@ -119,11 +139,11 @@ Token nextToken(Lexer* lexer)
                 {
                     return readNumber(lexer);
                 }
-                if (isalpha(current_char))
+                if (isalpha(current_char) || current_char == '_')
                 {
                     return readIdentifier(lexer); 
                 }
-                return errorToken("Unexpected character");
+                return errorToken(lexer, "Unexpected character");
         }
     }
 }
@@ -161,9 +181,11 @@ static Token readNumber(Lexer* lexer)
         {
             lexer->current++;
         }
+
+        return makeToken(lexer, TOKEN_NUMBER);
     }
 
-    return makeToken(lexer, TOKEN_NUMBER);
+    return makeToken(lexer, TOKEN_INTEGER);
 }
 
 
@@ -176,13 +198,13 @@ static Token readString(Lexer* lexer)
         if (*lexer->current == '\n')
         {
             lexer->line++;
-            lexer->current++;
         }
+        lexer->current++;
     }
 
     if (*lexer->current == '\0')
     {
-        return errorToken("Unterminated string");
+        return errorToken(lexer, "Unterminated string");
     }
 
     lexer->current++;
@@ -218,13 +240,16 @@ static Token readIdentifier(Lexer* lexer)
 }
 
 
-static Token errorToken(const char* message)
+static Token errorToken(Lexer* lexer, const char* message)
 {
+    assert(lexer   != NULL);
+    assert(message != NULL);
+
     return (Token){
         .type   = TOKEN_ERROR,
         .start  = message,
         .length = (int)strlen(message),
-        .line   = 0,
+        .line   = lexer->line,
     };
 }
 
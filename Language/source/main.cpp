@@ -1,23 +1,1552 @@
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "lexical_analysis.h"
 #include "syntactic_analysis.h"
 #include "print_ast.h"
+#include "tree_graphviz.h"
+#include "ast_optimizer.h"
+#include "constant_propagation.h"
+#include "common_subexpressions.h"
+#include "loop_optimizer.h"
+#include "interpreter.h"
+#include "profiler.h"
+#include "compiler.h"
+#include "vm.h"
+#include "peephole.h"
+#include "processor_codegen.h"
+#include "processor_emulator.h"
+#include "c_codegen.h"
+#include "ssa.h"
+#include "ssa_interpreter.h"
+#include "register_allocator.h"
+#include "register_machine.h"
+#include "type_inference.h"
+#include "run_statistics.h"
+#include "compile_server.h"
 
 
-int main()
+typedef enum Backend
 {
-    const char* source = "S = 1231 + 10 * 2; if (S > 10) {S = 5;}";
-    Lexer lexer = {}; 
+    Backend_TREE      = 0,
+    Backend_VM        = 1,
+    Backend_PROCESSOR = 2,
+    Backend_SSA       = 3,
+    Backend_C         = 4,
+    Backend_REGISTER  = 5,
+} Backend;
+
+typedef struct Options
+{
+    const char*         source_path;
+    bool                print_ast;
+    bool                run;
+    bool                disassemble;
+    bool                dump_ssa;
+    bool                dump_registers;
+    bool                dump_types;
+    bool                time;
+    bool                optimize;
+    bool                peephole;
+    bool                optimizer_statistics;
+    int                 unroll_factor;
+    bool                jit;
+    int                 jit_threshold;
+    bool                check_jit;
+    bool                profile_pairs;
+    bool                profile;
+    int                 profile_top;
+    const char*         profile_folded_path;
+    bool                statistics;
+    bool                hardware_counters;
+    const char*         statistics_path;
+    RunStatistics*      run_statistics;     // set while --stats measures
+    int                 registers_number;
+    Backend             backend;
+    const char*         processor_output_path;
+    const char*         c_output_path;
+    TreeGraphvizOptions graphviz;
+    const char*         serve_path;
+} Options;
+
+// What the server's key step loaded for the run that follows it.
+typedef struct ServerSession
+{
+    char* file_source;
+} ServerSession;
+
+static Options defaultOptions(void);
+static int runDriver(Options* options, const char* source);
+static int serve(const char* socket_path);
+static bool serverKey(const CompileRequest* request, Arena* arena, const char** key,
+                      size_t* key_length, void* context);
+static int serverRun(const CompileRequest* request, void* context);
+static bool isCacheable(const Options* options);
+static bool parseOptions(Options* options, int argc, char** argv);
+static bool parseIntArgument(const char* text, int* value);
+static char* readSourceFile(const char* path);
+static char* readStream(FILE* stream);
+static bool checkTypes(Tree* ast);
+static bool optimizeProgram(Tree* ast, const Options* options);
+static bool dumpTypes(Tree* ast);
+static int runProgram(Tree* ast, const Options* options);
+static int runInterpreter(Tree* ast, const Options* options);
+static bool reportProfile(const Profile* profile, const Options* options);
+static void beginPhase(const Options* options, const char* name);
+static void endPhase(const Options* options);
+static size_t countTokens(const char* source);
+static bool writeStatistics(const RunStatistics* statistics, const Options* options,
+                            int exit_code);
+static int runVM(Tree* ast, const Options* options);
+static VMState executeChunk(const Chunk* chunk, FILE* output, int jit_threshold,
+                            char* error_message, JitStatistics* statistics,
+                            bool profile_pairs);
+static int checkJit(const Chunk* chunk, const Options* options);
+static int runProcessor(Tree* ast, const Options* options);
+static int runSsa(Tree* ast, const Options* options);
+static int runRegisters(Tree* ast, const Options* options);
+static int emitC(Tree* ast, const Options* options);
+static char* generateProcessorSource(Tree* ast);
+static bool writeTextFile(const char* path, const char* text);
+static const char* backendToString(Backend backend);
+static double secondsNow(void);
+static void printUsage(const char* program_name);
+
+static const char* DEFAULT_SOURCE = "S = 1231 + 10 * 2; if (S > 10) {S = 5;}";
+static const int   MAX_UNROLL_FACTOR = 16;
+static const int   DEFAULT_JIT_THRESHOLD = 100;
+static const size_t PROFILED_PAIRS_NUMBER = 12;
+static const int   DEFAULT_PROFILE_TOP = 10;
+static const size_t SOURCE_CHUNK_SIZE = 4096;
+
+
+int main(int argc, char** argv)
+{
+    Options options = defaultOptions();
+    if (!parseOptions(&options, argc, argv))
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (options.serve_path != NULL)
+    {
+        return serve(options.serve_path);
+    }
+
+    char* file_source = NULL;
+    if (options.source_path != NULL)
+    {
+        file_source = readSourceFile(options.source_path);
+        if (file_source == NULL)
+        {
+            fprintf(stderr, "Cannot read %s\n", options.source_path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int exit_code = runDriver(&options, file_source != NULL ? file_source : DEFAULT_SOURCE);
+    free(file_source);
+
+    return exit_code;
+}
+
+
+static Options defaultOptions(void)
+{
+    Options options = {
+        .source_path = NULL,
+        .print_ast   = false,
+        .run         = true,
+        .disassemble = false,
+        .dump_ssa    = false,
+        .dump_registers = false,
+        .dump_types  = false,
+        .time        = false,
+        .optimize    = true,
+        .peephole    = true,
+        .optimizer_statistics = false,
+        .unroll_factor = 1,
+        .jit         = true,
+        .jit_threshold = DEFAULT_JIT_THRESHOLD,
+        .check_jit   = false,
+        .profile_pairs = false,
+        .profile     = false,
+        .profile_top = DEFAULT_PROFILE_TOP,
+        .profile_folded_path = NULL,
+        .statistics  = false,
+        .hardware_counters = false,
+        .statistics_path = NULL,
+        .run_statistics = NULL,
+        .registers_number = DEFAULT_REGISTERS,
+        .backend     = Backend_VM,
+        .processor_output_path = NULL,
+        .c_output_path = NULL,
+        .graphviz    = treeGraphvizDefaultOptions(NULL),
+        .serve_path  = NULL,
+    };
+
+    return options;
+}
+
+
+static int runDriver(Options* options, const char* source)
+{
+    // The parser pulls tokens as it goes, so lexing on its own is measured
+    // by a separate pass, and the parse phase includes lexing again.
+    RunStatistics statistics = {};
+    HardwareCounters counters = {};
+    if (options->hardware_counters)
+    {
+        if (hardwareCountersCtor(&counters))
+        {
+            statistics.counters = &counters;
+        }
+        else
+        {
+            statistics.counters_error = counters.error;
+            fprintf(stderr, "Warning: hardware counters unavailable: %s\n",
+                    strerror(counters.error));
+        }
+    }
+
+    if (options->statistics)
+    {
+        options->run_statistics = &statistics;
+        statistics.source_path  = options->source_path;
+        statistics.source_bytes = strlen(source);
+
+        beginPhase(options, "lex");
+        statistics.tokens_number = countTokens(source);
+        endPhase(options);
+    }
+
+    Lexer lexer = {};
     initLexer(&lexer, source);
 
     Parser parser = {};
     initParser(&parser, &lexer);
 
+    beginPhase(options, "parse");
     parseProgram(&parser);
-    printASTFromRoot(parser.ast);
+    endPhase(options);
+    runStatisticsCountTree(&statistics, parser.ast);
+
+    beginPhase(options, "check_types");
+    bool well_typed = checkTypes(parser.ast);
+    endPhase(options);
+
+    int exit_code = EXIT_SUCCESS;
+    if (!well_typed || (options->optimize && !optimizeProgram(parser.ast, options)))
+    {
+        exit_code = EXIT_FAILURE;
+    }
+    runStatisticsCountTree(&statistics, parser.ast);
+
+    if (options->print_ast)
+    {
+        printASTFromRoot(parser.ast);
+    }
+
+    if (options->dump_types && exit_code == EXIT_SUCCESS && !dumpTypes(parser.ast))
+    {
+        exit_code = EXIT_FAILURE;
+    }
+
+    if (options->graphviz.output_path != NULL)
+    {
+        TreeGraphvizResult result = {};
+        TreeGraphvizState state = treeExportGraphviz(parser.ast, &options->graphviz, &result);
+        if (state != TreeGraphvizState_OK)
+        {
+            fprintf(stderr, "Cannot export %s: %s\n",
+                    options->graphviz.output_path,
+                    treeGraphvizStateToString(state));
+            exit_code = EXIT_FAILURE;
+        }
+        else
+        {
+            fprintf(stderr, "Exported %lu nodes (%lu collapsed) to %s\n",
+                    result.nodes_written,
+                    result.nodes_collapsed,
+                    options->graphviz.output_path);
+        }
+    }
+
+    if (options->run && exit_code == EXIT_SUCCESS)
+    {
+        exit_code = runProgram(parser.ast, options);
+    }
+
+    if (options->statistics && !writeStatistics(&statistics, options, exit_code))
+    {
+        exit_code = EXIT_FAILURE;
+    }
 
     dtorParser(&parser);
+    if (options->hardware_counters)
+    {
+        hardwareCountersDtor(&counters);
+    }
+
+    return exit_code;
+}
+
+
+// The server prints where it listens and, when it stops, how many runs the
+// cache answered.
+static int serve(const char* socket_path)
+{
+    ServerSession session = {};
+    CompileServerHandler handler = {
+        .key     = serverKey,
+        .run     = serverRun,
+        .context = &session,
+    };
+
+    CompileServerStatistics statistics = {};
+    bool served = compileServerServe(socket_path, &handler, &statistics);
+    free(session.file_source);
+
+    if (!served)
+    {
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "Served %" PRIu64 " requests, %" PRIu64 " from the cache, %" PRIu64 " failed\n",
+            statistics.requests, statistics.cache_hits, statistics.failed_requests);
+
+    return EXIT_SUCCESS;
+}
+
+
+// The arguments, each ending in a zero, and then the source text, so an
+// edited file misses the cache while the same run on the same text hits
+// it.
+static bool serverKey(const CompileRequest* request, Arena* arena, const char** key,
+                      size_t* key_length, void* context)
+{
+    ServerSession* session = (ServerSession*)context;
+    free(session->file_source);
+    session->file_source = NULL;
+
+    Options options = defaultOptions();
+    if (!parseOptions(&options, request->argc, request->argv) || !isCacheable(&options))
+    {
+        return false;
+    }
+
+    const char* source = request->source;
+    if (source == NULL && options.source_path != NULL)
+    {
+        if (strcmp(options.source_path, "-") == 0)
+        {
+            return false;
+        }
+        session->file_source = readSourceFile(options.source_path);
+        source = session->file_source;
+        if (source == NULL)
+        {
+            return false;
+        }
+    }
+    if (source == NULL)
+    {
+        source = DEFAULT_SOURCE;
+    }
+
+    size_t source_length = strlen(source);
+    size_t length = source_length;
+    for (int i = 1; i < request->argc; i++)
+    {
+        length += strlen(request->argv[i]) + 1;
+    }
+
+    char* bytes = (char*)arenaAlloc(arena, length + 1);
+    if (bytes == NULL)
+    {
+        return false;
+    }
+
+    char* end = bytes;
+    for (int i = 1; i < request->argc; i++)
+    {
+        size_t argument_length = strlen(request->argv[i]) + 1;
+        memcpy(end, request->argv[i], argument_length);
+        end += argument_length;
+    }
+    memcpy(end, source, source_length);
+
+    *key        = bytes;
+    *key_length = length;
+    return true;
+}
+
+
+static int serverRun(const CompileRequest* request, void* context)
+{
+    ServerSession* session = (ServerSession*)context;
+
+    Options options = defaultOptions();
+    if (!parseOptions(&options, request->argc, request->argv))
+    {
+        printUsage(request->argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (options.serve_path != NULL)
+    {
+        fprintf(stderr, "Cannot start a server from a request\n");
+        return EXIT_FAILURE;
+    }
+
+    const char* source = request->source != NULL ? request->source : session->file_source;
+    if (source == NULL && options.source_path != NULL)
+    {
+        // Standard input is the server's, not the client's.
+        if (strcmp(options.source_path, "-") != 0)
+        {
+            session->file_source = readSourceFile(options.source_path);
+            source = session->file_source;
+        }
+        if (source == NULL)
+        {
+            fprintf(stderr, "Cannot read %s\n", options.source_path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return runDriver(&options, source != NULL ? source : DEFAULT_SOURCE);
+}
+
+
+// Runs that write files or report timings must happen every time.
+static bool isCacheable(const Options* options)
+{
+    return options->graphviz.output_path    == NULL
+        && options->c_output_path           == NULL
+        && options->processor_output_path   == NULL
+        && options->profile_folded_path     == NULL
+        && options->serve_path              == NULL
+        && !options->statistics
+        && !options->time
+        && !options->profile;
+}
+
 
-    return 0;
+// Like names, types are checked on the tree as written, so the verdict does
+// not depend on the passes. Only operations that fail on every run reaching
+// them are errors; a tree the SSA lowering rejects is left to the backend.
+static bool checkTypes(Tree* ast)
+{
+    TypeInference types = {};
+    TypeInferenceState state = inferTypes(ast, &types);
+    if (state == TypeInferenceState_RESOLVE_ERROR)
+    {
+        return false;
+    }
+
+    bool well_typed = state != TypeInferenceState_OK || types.errors_number == 0;
+    if (!well_typed)
+    {
+        fprintf(stderr, "%s\n", types.error_message);
+    }
+
+    typeInferenceDtor(&types);
+
+    return well_typed;
+}
+
+
+// Names are checked on the tree as written, so an undefined variable is
+// still reported when the passes remove the code that reads it.
+static bool optimizeProgram(Tree* ast, const Options* options)
+{
+    beginPhase(options, "resolve");
+    Resolution resolution = {};
+    ResolverState resolver_state = resolveProgram(ast, &resolution);
+    resolutionDtor(&resolution);
+    endPhase(options);
+    if (resolver_state != ResolverState_OK)
+    {
+        return false;
+    }
+
+    beginPhase(options, "fold_constants");
+    OptimizerStatistics fold = {};
+    foldConstants(ast, &fold);
+    endPhase(options);
+
+    // Propagated reads are folded by a second run of the folder.
+    beginPhase(options, "propagate_constants");
+    OptimizerStatistics propagation = {};
+    bool propagated = propagateConstants(ast, &propagation);
+    endPhase(options);
+    if (!propagated)
+    {
+        fprintf(stderr, "Warning: constant propagation stopped early\n");
+    }
+    if (propagation.propagated_constants > 0)
+    {
+        beginPhase(options, "fold_constants");
+        foldConstants(ast, &fold);
+        endPhase(options);
+    }
+
+    beginPhase(options, "eliminate_dead_code");
+    OptimizerStatistics dead_code = {};
+    eliminateDeadCode(ast, &dead_code);
+    endPhase(options);
+
+    // Products of the counter are counted before CSE merges them, and
+    // unrolled copies repeat the reduced updates.
+    beginPhase(options, "reduce_induction_strength");
+    OptimizerStatistics loops = {};
+    bool reduced = reduceInductionStrength(ast, &loops);
+    endPhase(options);
+    if (!reduced)
+    {
+        fprintf(stderr, "Warning: strength reduction stopped early\n");
+    }
+
+    beginPhase(options, "eliminate_common_subexpressions");
+    OptimizerStatistics subexpressions = {};
+    bool eliminated = eliminateCommonSubexpressions(ast, &subexpressions);
+    endPhase(options);
+    if (!eliminated)
+    {
+        fprintf(stderr, "Warning: common subexpression elimination stopped early\n");
+    }
+
+    beginPhase(options, "unroll_loops");
+    bool unrolled = unrollLoops(ast, options->unroll_factor, &loops);
+    endPhase(options);
+    if (!unrolled)
+    {
+        fprintf(stderr, "Warning: loop unrolling stopped early\n");
+    }
+
+    beginPhase(options, "hoist_loop_invariants");
+    bool hoisted = hoistLoopInvariants(ast, &loops);
+    endPhase(options);
+    if (!hoisted)
+    {
+        fprintf(stderr, "Warning: loop-invariant code motion stopped early\n");
+    }
+
+    if (options->optimizer_statistics)
+    {
+        fprintf(stderr, "fold: %lu constant expressions, %lu identities, %lu nodes removed\n",
+                fold.folded_expressions,
+                fold.simplified_identities,
+                fold.nodes_removed);
+        fprintf(stderr, "propagation: %lu variable reads replaced by constants\n",
+                propagation.propagated_constants);
+        fprintf(stderr, "dead code: %lu branches resolved, %lu loops removed, "
+                        "%lu unreachable statements, %lu nodes removed\n",
+                dead_code.resolved_branches,
+                dead_code.removed_loops,
+                dead_code.unreachable_statements,
+                dead_code.nodes_removed);
+        fprintf(stderr, "cse: %lu expressions reused, %lu temporaries\n",
+                subexpressions.reused_expressions,
+                subexpressions.temporaries);
+        fprintf(stderr, "loops: %lu invariant expressions hoisted, %lu multiplications reduced, "
+                        "%lu loops unrolled, %lu temporaries\n",
+                loops.hoisted_expressions,
+                loops.reduced_multiplications,
+                loops.unrolled_loops,
+                loops.temporaries);
+    }
+
+    return true;
+}
+
+
+static bool dumpTypes(Tree* ast)
+{
+    TypeInference types = {};
+    TypeInferenceState state = inferTypes(ast, &types);
+    if (state != TypeInferenceState_OK)
+    {
+        return false;
+    }
+
+    typeInferenceDump(&types, stdout);
+    typeInferenceDtor(&types);
+
+    return true;
+}
+
+
+static int runProgram(Tree* ast, const Options* options)
+{
+    // The VM splits its run into compile, peephole and execute phases.
+    if (options->backend != Backend_VM)
+    {
+        beginPhase(options, options->backend == Backend_C ? "emit_c" : "execute");
+    }
+
+    double start = secondsNow();
+    int exit_code = EXIT_SUCCESS;
+    switch (options->backend)
+    {
+        case Backend_TREE:      exit_code = runInterpreter(ast, options); break;
+        case Backend_VM:        exit_code = runVM(ast, options);        break;
+        case Backend_PROCESSOR: exit_code = runProcessor(ast, options); break;
+        case Backend_SSA:       exit_code = runSsa(ast, options);       break;
+        case Backend_REGISTER:  exit_code = runRegisters(ast, options); break;
+        case Backend_C:         exit_code = emitC(ast, options);        break;
+        default:                exit_code = EXIT_FAILURE;               break;
+    }
+
+    if (options->backend != Backend_VM)
+    {
+        endPhase(options);
+    }
+
+    if (options->time)
+    {
+        fflush(stdout);
+        fprintf(stderr, "%s: %.3f ms\n",
+                backendToString(options->backend),
+                (secondsNow() - start) * 1000);
+    }
+
+    return exit_code;
+}
+
+
+static int runInterpreter(Tree* ast, const Options* options)
+{
+    Interpreter interpreter = {};
+    InterpreterState state = interpreterCtor(&interpreter, ast, stdout);
+
+    Profile profile = {};
+    bool profiled = state == InterpreterState_OK && options->profile;
+    if (profiled)
+    {
+        if (!profileCtor(&profile, ast))
+        {
+            fprintf(stderr, "Error: out of memory\n");
+            profileDtor(&profile);
+            interpreterDtor(&interpreter);
+            return EXIT_FAILURE;
+        }
+        interpreterEnableProfile(&interpreter, &profile);
+        profileStart(&profile);
+    }
+
+    if (state == InterpreterState_OK)
+    {
+        state = interpretProgram(&interpreter);
+    }
+
+    if (state == InterpreterState_RUNTIME_ERROR
+     || state == InterpreterState_MEMORY_ERROR)
+    {
+        fflush(stdout);
+        fprintf(stderr, "%s\n", interpreter.error_message);
+    }
+
+    // A run that failed is still worth seeing up to the failure.
+    bool reported = true;
+    if (profiled)
+    {
+        profileStop(&profile);
+        fflush(stdout);
+        reported = reportProfile(&profile, options);
+        profileDtor(&profile);
+    }
+
+    interpreterDtor(&interpreter);
+
+    return state == InterpreterState_OK && reported ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+static bool reportProfile(const Profile* profile, const Options* options)
+{
+    if (!profilePrintHotspots(profile, stderr, (size_t)options->profile_top))
+    {
+        fprintf(stderr, "Error: out of memory\n");
+        return false;
+    }
+
+    if (options->profile_folded_path == NULL)
+    {
+        return true;
+    }
+
+    FILE* file = fopen(options->profile_folded_path, "w");
+    bool written = file != NULL && profileWriteFolded(profile, file);
+    if (file != NULL && fclose(file) != 0)
+    {
+        written = false;
+    }
+
+    if (!written)
+    {
+        fprintf(stderr, "Cannot write %s\n", options->profile_folded_path);
+    }
+
+    return written;
+}
+
+
+static void beginPhase(const Options* options, const char* name)
+{
+    if (options->run_statistics != NULL)
+    {
+        runStatisticsBeginPhase(options->run_statistics, name);
+    }
+}
+
+
+static void endPhase(const Options* options)
+{
+    if (options->run_statistics != NULL)
+    {
+        runStatisticsEndPhase(options->run_statistics);
+    }
+}
+
+
+// Stops at the first error token, as the parser does.
+static size_t countTokens(const char* source)
+{
+    Lexer lexer = {};
+    initLexer(&lexer, source);
+
+    size_t tokens_number = 0;
+    for (Token token = nextToken(&lexer);
+         token.type != TOKEN_EOF && token.type != TOKEN_ERROR;
+         token = nextToken(&lexer))
+    {
+        tokens_number++;
+    }
+
+    return tokens_number;
+}
+
+
+static bool writeStatistics(const RunStatistics* statistics, const Options* options,
+                            int exit_code)
+{
+    fflush(stdout);
+    if (options->statistics_path == NULL)
+    {
+        return runStatisticsWriteJson(statistics, stderr, exit_code);
+    }
+
+    FILE* file = fopen(options->statistics_path, "w");
+    bool written = file != NULL && runStatisticsWriteJson(statistics, file, exit_code);
+    if (file != NULL && fclose(file) != 0)
+    {
+        written = false;
+    }
+
+    if (!written)
+    {
+        fprintf(stderr, "Cannot write %s\n", options->statistics_path);
+    }
+
+    return written;
+}
+
+
+static int runVM(Tree* ast, const Options* options)
+{
+    beginPhase(options, "compile");
+    Resolution resolution = {};
+    if (resolveProgram(ast, &resolution) != ResolverState_OK)
+    {
+        endPhase(options);
+        return EXIT_FAILURE;
+    }
+
+    // Without types every operation keeps its run-time check.
+    TypeInference types = {};
+    bool typed = options->optimize && inferTypes(ast, &types) == TypeInferenceState_OK;
+
+    Chunk chunk = {};
+    chunkCtor(&chunk);
+
+    CompilerState compiler_state = compileProgram(ast, &resolution, typed ? &types : NULL, &chunk);
+    resolutionDtor(&resolution);
+    if (typed)
+    {
+        typeInferenceDtor(&types);
+    }
+    endPhase(options);
+    if (compiler_state != CompilerState_OK)
+    {
+        fprintf(stderr, "Error: %s\n", compilerStateToString(compiler_state));
+        chunkDtor(&chunk);
+        return EXIT_FAILURE;
+    }
+
+    if (options->optimize && options->peephole)
+    {
+        size_t compiled_size = chunk.code_size;
+        PeepholeStatistics peephole = {};
+        beginPhase(options, "peephole");
+        bool optimized = optimizeBytecode(&chunk, &peephole);
+        endPhase(options);
+        if (!optimized)
+        {
+            fprintf(stderr, "Warning: bytecode peephole pass skipped\n");
+        }
+        if (options->optimizer_statistics)
+        {
+            fprintf(stderr, "peephole: %lu -> %lu instructions, %lu jumps threaded, "
+                            "%lu removed, %lu branches fused, %lu superinstructions\n",
+                    compiled_size, chunk.code_size,
+                    peephole.threaded_jumps,
+                    peephole.removed_instructions,
+                    peephole.fused_branches,
+                    peephole.superinstructions);
+        }
+    }
+
+    if (options->disassemble)
+    {
+        chunkDisassemble(&chunk, stdout);
+    }
+
+    beginPhase(options, "execute");
+    if (options->check_jit)
+    {
+        int exit_code = checkJit(&chunk, options);
+        endPhase(options);
+        chunkDtor(&chunk);
+        return exit_code;
+    }
+
+    char error_message[RUNTIME_ERROR_BUFFER_SIZE] = {};
+    VMState state = executeChunk(&chunk, stdout, options->jit ? options->jit_threshold : 0,
+                                 error_message, NULL, options->profile_pairs);
+    endPhase(options);
+    if (state != VMState_OK)
+    {
+        fflush(stdout);
+        fprintf(stderr, "%s\n", error_message);
+    }
+
+    chunkDtor(&chunk);
+
+    return state == VMState_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// Runs the chunk on a fresh VM; a jit_threshold of 0 interprets every loop.
+// profile_pairs reports the most frequent opcode pairs on stderr.
+static VMState executeChunk(const Chunk* chunk, FILE* output, int jit_threshold,
+                            char* error_message, JitStatistics* statistics,
+                            bool profile_pairs)
+{
+    VM vm = {};
+    VMState state = vmCtor(&vm, chunk, output);
+    if (state == VMState_OK && jit_threshold > 0)
+    {
+        state = vmEnableJit(&vm, (uint32_t)jit_threshold);
+    }
+    if (state == VMState_OK)
+    {
+        state = vmRun(&vm);
+    }
+
+    memcpy(error_message, vm.error_message, sizeof(vm.error_message));
+    if (profile_pairs)
+    {
+        fflush(output);
+        vmPrintPairProfile(&vm, stderr, PROFILED_PAIRS_NUMBER);
+    }
+    if (statistics != NULL && vm.jit != NULL)
+    {
+        *statistics = vm.jit->statistics;
+    }
+
+    vmDtor(&vm);
+
+    return state;
+}
+
+
+// Runs the program twice on the VM, interpreted and with the JIT, and
+// compares what the two runs print and how they end. The output of the
+// JIT run goes to stdout.
+static int checkJit(const Chunk* chunk, const Options* options)
+{
+    char*  expected = NULL;
+    char*  actual   = NULL;
+    size_t expected_size = 0;
+    size_t actual_size   = 0;
+    FILE*  expected_output = open_memstream(&expected, &expected_size);
+    FILE*  actual_output   = open_memstream(&actual,   &actual_size);
+    if (expected_output == NULL || actual_output == NULL)
+    {
+        fprintf(stderr, "Cannot capture the output\n");
+        if (expected_output != NULL)
+        {
+            fclose(expected_output);
+        }
+        if (actual_output != NULL)
+        {
+            fclose(actual_output);
+        }
+        free(expected);
+        free(actual);
+        return EXIT_FAILURE;
+    }
+
+    char expected_error[RUNTIME_ERROR_BUFFER_SIZE] = {};
+    char actual_error  [RUNTIME_ERROR_BUFFER_SIZE] = {};
+    JitStatistics statistics = {};
+    VMState expected_state = executeChunk(chunk, expected_output, 0, expected_error, NULL, false);
+    VMState actual_state   = executeChunk(chunk, actual_output, options->jit_threshold,
+                                          actual_error, &statistics, false);
+    fclose(expected_output);
+    fclose(actual_output);
+
+    fwrite(actual, 1, actual_size, stdout);
+    fflush(stdout);
+    if (actual_state != VMState_OK)
+    {
+        fprintf(stderr, "%s\n", actual_error);
+    }
+
+    size_t common = 0;
+    while (common < expected_size && common < actual_size && expected[common] == actual[common])
+    {
+        common++;
+    }
+
+    bool same = expected_state == actual_state && strcmp(expected_error, actual_error) == 0
+             && common == expected_size && common == actual_size;
+
+    fprintf(stderr, "JIT check: %lu loops compiled, %lu rejected, %lu entries, %s\n",
+            statistics.compiled_loops, statistics.rejected_loops, statistics.entries,
+            same ? "same behavior as the interpreter" : "DIFFERENT from the interpreter");
+    if (common < expected_size || common < actual_size)
+    {
+        fprintf(stderr, "  outputs differ from byte %lu\n", common);
+    }
+    if (expected_state != actual_state || strcmp(expected_error, actual_error) != 0)
+    {
+        fprintf(stderr, "  interpreter ended with \"%s\", JIT with \"%s\"\n",
+                expected_error, actual_error);
+    }
+
+    free(expected);
+    free(actual);
+
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+static int runProcessor(Tree* ast, const Options* options)
+{
+    char* assembly = generateProcessorSource(ast);
+    if (assembly == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (options->processor_output_path != NULL
+     && !writeTextFile(options->processor_output_path, assembly))
+    {
+        fprintf(stderr, "Cannot write %s\n", options->processor_output_path);
+        free(assembly);
+        return EXIT_FAILURE;
+    }
+
+    ProcessorProgram program = {};
+    ProcessorState state = processorAssemble(assembly, &program);
+    if (state == ProcessorState_OK)
+    {
+        state = processorRun(&program, stdout);
+    }
+
+    if (state != ProcessorState_OK)
+    {
+        fflush(stdout);
+        fprintf(stderr, "Processor error: %s\n", processorStateToString(state));
+    }
+
+    processorProgramDtor(&program);
+    free(assembly);
+
+    return state == ProcessorState_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+static int runSsa(Tree* ast, const Options* options)
+{
+    SsaFunction function = {};
+    SsaState build_state = ssaBuild(ast, &function);
+    if (build_state != SsaState_OK)
+    {
+        if (build_state != SsaState_RESOLVE_ERROR)
+        {
+            fprintf(stderr, "Error: %s\n", ssaStateToString(build_state));
+        }
+        return EXIT_FAILURE;
+    }
+
+    if (options->dump_ssa)
+    {
+        ssaDump(&function, stdout);
+    }
+
+    SsaInterpreter interpreter = {};
+    SsaInterpreterState state = ssaInterpreterCtor(&interpreter, &function, stdout);
+    if (state == SsaInterpreterState_OK)
+    {
+        state = ssaInterpreterRun(&interpreter);
+    }
+
+    if (state != SsaInterpreterState_OK)
+    {
+        fflush(stdout);
+        fprintf(stderr, "%s\n", interpreter.error_message);
+    }
+
+    ssaInterpreterDtor(&interpreter);
+    ssaDtor(&function);
+
+    return state == SsaInterpreterState_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// The SSA graph is taken out of SSA form onto a fixed register file, as a
+// native backend would see it.
+static int runRegisters(Tree* ast, const Options* options)
+{
+    SsaFunction function = {};
+    SsaState build_state = ssaBuild(ast, &function);
+    if (build_state != SsaState_OK)
+    {
+        if (build_state != SsaState_RESOLVE_ERROR)
+        {
+            fprintf(stderr, "Error: %s\n", ssaStateToString(build_state));
+        }
+        return EXIT_FAILURE;
+    }
+
+    RegisterAllocation allocation = {};
+    RegisterAllocatorState allocator_state = allocateRegisters(&function, options->registers_number,
+                                                               &allocation);
+    if (allocator_state != RegisterAllocatorState_OK)
+    {
+        fprintf(stderr, "Error: %s\n", registerAllocatorStateToString(allocator_state));
+        ssaDtor(&function);
+        return EXIT_FAILURE;
+    }
+
+    RegisterProgram program = {};
+    RegisterMachine machine = {};
+    RegisterMachineState state = lowerToRegisters(&function, &allocation, &program);
+    if (state == RegisterMachineState_OK)
+    {
+        if (options->dump_registers)
+        {
+            registerAllocationDump(&allocation, stdout);
+            registerProgramDump(&program, stdout);
+        }
+
+        state = registerMachineCtor(&machine, &program, stdout);
+        if (state == RegisterMachineState_OK)
+        {
+            state = registerMachineRun(&machine);
+        }
+    }
+    else
+    {
+        snprintf(machine.error_message, sizeof(machine.error_message), "Error: out of memory");
+    }
+
+    if (state != RegisterMachineState_OK)
+    {
+        fflush(stdout);
+        fprintf(stderr, "%s\n", machine.error_message[0] != '\0'
+                                ? machine.error_message : "Error: out of memory");
+    }
+
+    registerMachineDtor(&machine);
+    registerProgramDtor(&program);
+    registerAllocationDtor(&allocation);
+    ssaDtor(&function);
+
+    return state == RegisterMachineState_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// Only writes the C file; the system compiler builds and runs it.
+static int emitC(Tree* ast, const Options* options)
+{
+    Resolution resolution = {};
+    if (resolveProgram(ast, &resolution) != ResolverState_OK)
+    {
+        return EXIT_FAILURE;
+    }
+
+    TypeInference types = {};
+    bool typed = options->optimize && inferTypes(ast, &types) == TypeInferenceState_OK;
+
+    FILE* file = fopen(options->c_output_path, "w");
+    CCodegenState state = CCodegenState_WRITE_ERROR;
+    if (file != NULL)
+    {
+        state = generateCSource(ast, &resolution, typed ? &types : NULL, file);
+        if (fclose(file) != 0)
+        {
+            state = CCodegenState_WRITE_ERROR;
+        }
+    }
+
+    resolutionDtor(&resolution);
+    if (typed)
+    {
+        typeInferenceDtor(&types);
+    }
+
+    if (state == CCodegenState_UNSUPPORTED)
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (state != CCodegenState_OK)
+    {
+        fprintf(stderr, "Cannot write %s%s\n", options->c_output_path,
+                state == CCodegenState_BAD_TREE ? ": malformed syntax tree" : "");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+static char* generateProcessorSource(Tree* ast)
+{
+    Resolution resolution = {};
+    if (resolveProgram(ast, &resolution) != ResolverState_OK)
+    {
+        return NULL;
+    }
+
+    char*  assembly      = NULL;
+    size_t assembly_size = 0;
+    FILE*  stream        = open_memstream(&assembly, &assembly_size);
+    if (stream == NULL)
+    {
+        resolutionDtor(&resolution);
+        return NULL;
+    }
+
+    ProcessorCodegenState state = generateProcessorAssembly(ast, &resolution, stream);
+    fclose(stream);
+    resolutionDtor(&resolution);
+
+    if (state != ProcessorCodegenState_OK)
+    {
+        free(assembly);
+        return NULL;
+    }
+
+    return assembly;
+}
+
+
+static bool writeTextFile(const char* path, const char* text)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    bool written = fputs(text, file) >= 0;
+    return fclose(file) == 0 && written;
+}
+
+
+static const char* backendToString(Backend backend)
+{
+    switch (backend)
+    {
+        case Backend_TREE:      return "tree";
+        case Backend_VM:        return "vm";
+        case Backend_PROCESSOR: return "processor";
+        case Backend_SSA:       return "ssa";
+        case Backend_C:         return "c";
+        case Backend_REGISTER:  return "register";
+        default:                return "unknown";
+    }
+}
+
+
+static double secondsNow(void)
+{
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+
+static bool parseOptions(Options* options, int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* argument = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (strcmp(argument, "--print-ast") == 0)
+        {
+            options->print_ast = true;
+        }
+        else if (strcmp(argument, "--no-run") == 0)
+        {
+            options->run = false;
+        }
+        else if (strcmp(argument, "--disassemble") == 0)
+        {
+            options->disassemble = true;
+        }
+        else if (strcmp(argument, "--dump-ssa") == 0)
+        {
+            options->dump_ssa = true;
+            options->backend  = Backend_SSA;
+        }
+        else if (strcmp(argument, "--dump-registers") == 0)
+        {
+            options->dump_registers = true;
+            options->backend        = Backend_REGISTER;
+        }
+        else if (strcmp(argument, "--registers") == 0 && has_value)
+        {
+            if (!parseIntArgument(argv[++i], &options->registers_number)
+             || options->registers_number < MIN_REGISTERS)
+            {
+                fprintf(stderr, "Register count must be at least %d\n", MIN_REGISTERS);
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--dump-types") == 0)
+        {
+            options->dump_types = true;
+        }
+        else if (strcmp(argument, "--time") == 0)
+        {
+            options->time = true;
+        }
+        else if (strcmp(argument, "--no-optimize") == 0)
+        {
+            options->optimize = false;
+        }
+        else if (strcmp(argument, "--no-peephole") == 0)
+        {
+            options->peephole = false;
+        }
+        else if (strcmp(argument, "--optimizer-stats") == 0)
+        {
+            options->optimizer_statistics = true;
+        }
+        else if (strcmp(argument, "--unroll") == 0 && has_value)
+        {
+            if (!parseIntArgument(argv[++i], &options->unroll_factor)
+             || options->unroll_factor < 1 || options->unroll_factor > MAX_UNROLL_FACTOR)
+            {
+                fprintf(stderr, "Unroll factor must be between 1 and %d\n", MAX_UNROLL_FACTOR);
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--no-jit") == 0)
+        {
+            options->jit = false;
+        }
+        else if (strcmp(argument, "--jit-threshold") == 0 && has_value)
+        {
+            if (!parseIntArgument(argv[++i], &options->jit_threshold) || options->jit_threshold < 1)
+            {
+                fprintf(stderr, "JIT threshold must be at least 1\n");
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--profile-pairs") == 0)
+        {
+            options->profile_pairs = true;
+            options->backend       = Backend_VM;
+        }
+        else if (strcmp(argument, "--profile") == 0)
+        {
+            options->profile = true;
+            options->backend = Backend_TREE;
+        }
+        else if (strcmp(argument, "--profile-top") == 0 && has_value)
+        {
+            if (!parseIntArgument(argv[++i], &options->profile_top) || options->profile_top < 1)
+            {
+                fprintf(stderr, "Profile top must be at least 1\n");
+                return false;
+            }
+            options->profile = true;
+            options->backend = Backend_TREE;
+        }
+        else if (strcmp(argument, "--profile-folded") == 0 && has_value)
+        {
+            options->profile_folded_path = argv[++i];
+            options->profile = true;
+            options->backend = Backend_TREE;
+        }
+        else if (strcmp(argument, "--stats") == 0)
+        {
+            options->statistics = true;
+        }
+        else if (strcmp(argument, "--counters") == 0)
+        {
+            options->hardware_counters = true;
+            options->statistics        = true;
+        }
+        else if (strcmp(argument, "--stats-output") == 0 && has_value)
+        {
+            options->statistics_path = argv[++i];
+            options->statistics      = true;
+        }
+        else if (strcmp(argument, "--check-jit") == 0)
+        {
+            options->check_jit = true;
+            options->backend   = Backend_VM;
+        }
+        else if (strcmp(argument, "--backend") == 0 && has_value)
+        {
+            const char* backend = argv[++i];
+            if (strcmp(backend, "tree") == 0)
+            {
+                options->backend = Backend_TREE;
+            }
+            else if (strcmp(backend, "vm") == 0)
+            {
+                options->backend = Backend_VM;
+            }
+            else if (strcmp(backend, "processor") == 0)
+            {
+                options->backend = Backend_PROCESSOR;
+            }
+            else if (strcmp(backend, "ssa") == 0)
+            {
+                options->backend = Backend_SSA;
+            }
+            else if (strcmp(backend, "register") == 0)
+            {
+                options->backend = Backend_REGISTER;
+            }
+            else
+            {
+                fprintf(stderr, "Unknown backend: %s\n", backend);
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--emit-processor") == 0 && has_value)
+        {
+            options->processor_output_path = argv[++i];
+            options->backend               = Backend_PROCESSOR;
+        }
+        else if (strcmp(argument, "--emit-c") == 0 && has_value)
+        {
+            options->c_output_path = argv[++i];
+            options->backend       = Backend_C;
+        }
+        else if (strcmp(argument, "--dot") == 0 && has_value)
+        {
+            options->graphviz.output_path = argv[++i];
+            options->graphviz.format      = TreeGraphvizFormat_DOT;
+        }
+        else if (strcmp(argument, "--svg") == 0 && has_value)
+        {
+            options->graphviz.output_path = argv[++i];
+            options->graphviz.format      = TreeGraphvizFormat_SVG;
+        }
+        else if (strcmp(argument, "--dump-root") == 0 && has_value)
+        {
+            if (!parseIntArgument(argv[++i], &options->graphviz.root_index))
+            {
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--dump-depth") == 0 && has_value)
+        {
+            if (!parseIntArgument(argv[++i], &options->graphviz.max_depth))
+            {
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--dump-verbose") == 0)
+        {
+            options->graphviz.verbose = true;
+        }
+        else if (strcmp(argument, "--serve") == 0 && has_value)
+        {
+            options->serve_path = argv[++i];
+        }
+        else if ((argument[0] != '-' || strcmp(argument, "-") == 0) && options->source_path == NULL)
+        {
+            options->source_path = argument;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", argument);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static bool parseIntArgument(const char* text, int* value)
+{
+    char* end = NULL;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || parsed < -1 || parsed > __INT_MAX__)
+    {
+        fprintf(stderr, "Bad number: %s\n", text);
+        return false;
+    }
+
+    *value = (int)parsed;
+    return true;
+}
+
+
+// A path of - reads stdin to its end.
+static char* readSourceFile(const char* path)
+{
+    if (strcmp(path, "-") == 0)
+    {
+        return readStream(stdin);
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) != 0)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    long size = ftell(file);
+    rewind(file);
+    if (size < 0)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    char* buffer = (char*)calloc((size_t)size + 1, sizeof(char));
+    if (buffer == NULL)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    size_t read = fread(buffer, sizeof(char), (size_t)size, file);
+    fclose(file);
+    buffer[read] = '\0';
+
+    return buffer;
+}
+
+
+static char* readStream(FILE* stream)
+{
+    size_t capacity = SOURCE_CHUNK_SIZE;
+    size_t size     = 0;
+    char*  buffer   = (char*)malloc(capacity);
+    while (buffer != NULL)
+    {
+        size += fread(buffer + size, sizeof(char), capacity - size - 1, stream);
+        if (size + 1 < capacity)
+        {
+            break;
+        }
+
+        capacity *= 2;
+        char* grown = (char*)realloc(buffer, capacity);
+        if (grown == NULL)
+        {
+            free(buffer);
+        }
+        buffer = grown;
+    }
+
+    if (buffer == NULL || ferror(stream))
+    {
+        free(buffer);
+        return NULL;
+    }
+
+    buffer[size] = '\0';
+    return buffer;
+}
+
+
+static void printUsage(const char* program_name)
+{
+    fprintf(stderr,
+            "Usage: %s [options] [source]\n"
+            "  --print-ast          print the syntax tree\n"
+            "  --no-run             only parse the program\n"
+            "  --backend tree|vm|processor|ssa|register\n"
+            "                       run by walking the tree, on the bytecode VM (default),\n"
+            "                       as Processor assembly on the built-in emulator,\n"
+            "                       by interpreting the SSA graph or on a register machine\n"
+            "  --registers N        registers of the register machine (default %d, min %d)\n"
+            "  --emit-processor PATH\n"
+            "                       also save the Processor assembly to PATH\n"
+            "  --emit-c PATH        write the program as standalone C to PATH instead of\n"
+            "                       running it (build with cc -O2 PATH -lm)\n"
+            "  --disassemble        print the bytecode before running it\n"
+            "  --no-jit             interpret every loop on the VM\n"
+            "  --jit-threshold N    compile a loop to x86-64 after N iterations (default %d)\n"
+            "  --check-jit          run on the VM with and without the JIT and compare\n"
+            "  --profile-pairs      report the most frequent opcode pairs the VM ran\n"
+            "                       (counted in -DVM_PROFILE_PAIRS builds only)\n"
+            "  --profile            run on the tree interpreter and report the statements\n"
+            "                       and operators that took the most time on stderr\n"
+            "  --profile-top N      report N of them (default %d)\n"
+            "  --profile-folded PATH\n"
+            "                       also write folded stacks for flamegraph.pl to PATH\n"
+            "  --dump-ssa           print the SSA graph and run it\n"
+            "  --dump-registers     print the register allocation and code and run it\n"
+            "  --dump-types         print the inferred type of every variable\n"
+            "  --time               report the execution time on stderr\n"
+            "  --stats              report the time, CPU time and heap use of every\n"
+            "                       phase, the token and node counts and the peak RSS\n"
+            "                       as JSON on stderr\n"
+            "  --stats-output PATH  write that JSON to PATH instead\n"
+            "  --counters           add the cycles, instructions, branch and cache misses\n"
+            "                       of every phase to --stats (Linux perf events)\n"
+            "  --no-optimize        run the syntax tree exactly as parsed\n"
+            "  --no-peephole        run the bytecode as compiled, without superinstructions\n"
+            "  --optimizer-stats    report what the AST and bytecode passes changed on stderr\n"
+            "  --unroll N           unroll small counted loops N times (1 = off, max 16)\n"
+            "  --dot PATH           stream the syntax tree as DOT\n"
+            "  --svg PATH           render the syntax tree to one SVG through dot\n"
+            "  --dump-root N        export only the subtree rooted at node N\n"
+            "  --dump-depth N       collapse nodes deeper than N into \"+K more\"\n"
+            "  --dump-verbose       add node indices to the exported labels\n"
+            "  --serve PATH         serve runs from language_client on the Unix socket\n"
+            "                       PATH, keeping the results of repeated runs\n"
+            "A source of - reads the program from stdin.\n",
+            program_name, DEFAULT_REGISTERS, MIN_REGISTERS, DEFAULT_JIT_THRESHOLD,
+            DEFAULT_PROFILE_TOP);
 }
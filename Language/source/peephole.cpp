@@ -0,0 +1,547 @@
+#include "peephole.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "lexical_analysis.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct Peephole
+{
+    Chunk*              chunk;
+    bool*               is_target;      // some jump lands on the instruction
+    bool*               removed;        // dropped by the next compaction
+    uint32_t*           new_offsets;    // old offset -> offset after compaction
+    uint32_t*           worklist;
+    PeepholeStatistics* statistics;
+} Peephole;
+
+static bool threadJumps(Peephole* peephole);
+static uint32_t threadJump(const Peephole* peephole, uint32_t offset, uint32_t target);
+static bool removeUnreachable(Peephole* peephole);
+static void reach(Peephole* peephole, uint32_t offset, size_t* worklist_size);
+static void rewritePairs(Peephole* peephole);
+static void fuseBranches(Peephole* peephole);
+static void fuseOperands(Peephole* peephole);
+static void fuseLoadsAndStores(Peephole* peephole);
+static void markTargets(Peephole* peephole);
+static void compact(Peephole* peephole);
+
+static bool mergeable(const Peephole* peephole, size_t offset);
+static void merge(Peephole* peephole, size_t offset, Instruction fused, int line);
+static bool isBinary(Opcode opcode);
+static bool isConditionalJump(Opcode opcode);
+static Opcode branchOpcode(Opcode comparison, Opcode jump);
+
+
+// public ---------------------------------------------------------------------
+
+
+bool optimizeBytecode(Chunk* chunk, PeepholeStatistics* statistics)
+{
+    assert(chunk != NULL);
+
+    PeepholeStatistics ignored = {};
+    size_t size = chunk->code_size;
+
+    Peephole peephole = {
+        .chunk       = chunk,
+        .is_target   = (bool*)    calloc(size + 1, sizeof(bool)),
+        .removed     = (bool*)    calloc(size + 1, sizeof(bool)),
+        .new_offsets = (uint32_t*)calloc(size + 1, sizeof(uint32_t)),
+        .worklist    = (uint32_t*)calloc(size + 1, sizeof(uint32_t)),
+        .statistics  = statistics != NULL ? statistics : &ignored,
+    };
+
+    bool allocated = peephole.is_target != NULL && peephole.removed  != NULL
+                  && peephole.new_offsets != NULL && peephole.worklist != NULL;
+    if (allocated)
+    {
+        // Removing code can put a jump right before its target and so
+        // make it removable too. Each round removes an instruction or
+        // threads a jump further forward, so the rounds are bounded.
+        bool changed = true;
+        for (size_t round = 0; changed && round < size; round++)
+        {
+            changed = threadJumps(&peephole);
+            changed = removeUnreachable(&peephole) || changed;
+            compact(&peephole);
+        }
+
+        // Each stage sees the stream the one before left, so fused
+        // branches are in place before operands are merged into them.
+        rewritePairs(&peephole);
+        compact(&peephole);
+
+        fuseBranches(&peephole);
+        compact(&peephole);
+
+        fuseOperands(&peephole);
+        compact(&peephole);
+
+        fuseLoadsAndStores(&peephole);
+        compact(&peephole);
+    }
+
+    free(peephole.is_target);
+    free(peephole.removed);
+    free(peephole.new_offsets);
+    free(peephole.worklist);
+
+    return allocated;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static bool threadJumps(Peephole* peephole)
+{
+    assert(peephole != NULL);
+
+    Chunk* chunk = peephole->chunk;
+    bool changed = false;
+    for (size_t offset = 0; offset < chunk->code_size; offset++)
+    {
+        Opcode opcode = instructionOpcode(chunk->code[offset]);
+        if (opcode == OP_SWITCH)
+        {
+            SwitchTable* table = &chunk->switches[instructionOperand(chunk->code[offset])];
+            for (uint32_t entry = 0; entry < table->entries_number; entry++)
+            {
+                uint32_t final = threadJump(peephole, (uint32_t)offset, table->targets[entry]);
+                if (final != table->targets[entry])
+                {
+                    table->targets[entry] = final;
+                    peephole->statistics->threaded_jumps++;
+                    changed = true;
+                }
+            }
+            continue;
+        }
+
+        if (!opcodeHasJumpTarget(opcode))
+        {
+            continue;
+        }
+
+        uint32_t target = instructionOperand(chunk->code[offset]);
+        uint32_t final  = threadJump(peephole, (uint32_t)offset, target);
+        if (final != target)
+        {
+            chunk->code[offset] = makeInstruction(opcode, final);
+            peephole->statistics->threaded_jumps++;
+            changed = true;
+        }
+
+        // A JUMP to the next instruction does nothing.
+        if (opcode == OP_JUMP && final == offset + 1)
+        {
+            peephole->removed[offset] = true;
+            peephole->statistics->removed_instructions++;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+
+// Follows the chain from target while it leads to a JUMP or to a constant
+// that a conditional jump tests at once. The VM and the JIT take a backward
+// jump for the end of a loop, so a forward jump stays forward.
+static uint32_t threadJump(const Peephole* peephole, uint32_t offset, uint32_t target)
+{
+    assert(peephole != NULL);
+
+    const Chunk* chunk = peephole->chunk;
+    bool backward = target <= offset;
+
+    // Every step moves to another instruction, so a chain longer than the
+    // code is a cycle.
+    for (size_t steps = 0; steps < chunk->code_size; steps++)
+    {
+        Instruction instruction = chunk->code[target];
+        Opcode opcode = instructionOpcode(instruction);
+        uint32_t next = target;
+
+        if (opcode == OP_JUMP)
+        {
+            next = instructionOperand(instruction);
+        }
+        else if ((opcode == OP_TRUE || opcode == OP_FALSE) && target + 2 < chunk->code_size
+              && isConditionalJump(instructionOpcode(chunk->code[target + 1])))
+        {
+            Instruction branch = chunk->code[target + 1];
+            bool taken = (opcode == OP_TRUE) == (instructionOpcode(branch) == OP_JUMP_IF_TRUE);
+            next = taken ? instructionOperand(branch) : target + 2;
+        }
+
+        if (next == target || (next <= offset) != backward)
+        {
+            break;
+        }
+        target = next;
+    }
+
+    return target;
+}
+
+
+static bool removeUnreachable(Peephole* peephole)
+{
+    assert(peephole != NULL);
+
+    Chunk* chunk = peephole->chunk;
+    bool changed = false;
+    bool* reached = peephole->is_target;
+    memset(reached, 0, (chunk->code_size + 1) * sizeof(bool));
+
+    size_t worklist_size = 0;
+    if (chunk->code_size > 0)
+    {
+        reached[0] = true;
+        peephole->worklist[worklist_size++] = 0;
+    }
+
+    while (worklist_size > 0)
+    {
+        uint32_t offset = peephole->worklist[--worklist_size];
+        Instruction instruction = chunk->code[offset];
+        Opcode opcode = instructionOpcode(instruction);
+
+        if (opcode != OP_JUMP && opcode != OP_HALT)
+        {
+            reach(peephole, offset + 1, &worklist_size);
+        }
+        if (opcodeHasJumpTarget(opcode))
+        {
+            reach(peephole, instructionOperand(instruction), &worklist_size);
+        }
+        if (opcode == OP_SWITCH)
+        {
+            const SwitchTable* table = &chunk->switches[instructionOperand(instruction)];
+            for (uint32_t entry = 0; entry < table->entries_number; entry++)
+            {
+                reach(peephole, table->targets[entry], &worklist_size);
+            }
+        }
+    }
+
+    for (size_t offset = 0; offset < chunk->code_size; offset++)
+    {
+        if (!reached[offset] && !peephole->removed[offset])
+        {
+            peephole->removed[offset] = true;
+            peephole->statistics->removed_instructions++;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+
+// removeUnreachable keeps the reached instructions in is_target. Each one
+// enters the worklist once, so it never holds more than the code.
+static void reach(Peephole* peephole, uint32_t offset, size_t* worklist_size)
+{
+    assert(peephole      != NULL);
+    assert(worklist_size != NULL);
+
+    if (offset < peephole->chunk->code_size && !peephole->is_target[offset])
+    {
+        peephole->is_target[offset] = true;
+        peephole->worklist[(*worklist_size)++] = offset;
+    }
+}
+
+
+static void rewritePairs(Peephole* peephole)
+{
+    assert(peephole != NULL);
+
+    Chunk* chunk = peephole->chunk;
+    markTargets(peephole);
+
+    for (size_t offset = 0; offset + 1 < chunk->code_size; offset++)
+    {
+        if (!mergeable(peephole, offset))
+        {
+            continue;
+        }
+
+        Instruction first  = chunk->code[offset];
+        Instruction second = chunk->code[offset + 1];
+        Opcode first_opcode  = instructionOpcode(first);
+        Opcode second_opcode = instructionOpcode(second);
+        bool same_slot = instructionOperand(first) == instructionOperand(second);
+
+        if (first_opcode == OP_STORE && second_opcode == OP_LOAD && same_slot)
+        {
+            merge(peephole, offset, makeInstruction(OP_STORE_KEEP, instructionOperand(first)),
+                  chunk->lines[offset]);
+            peephole->statistics->removed_instructions++;
+        }
+        else if (first_opcode == OP_LOAD && second_opcode == OP_STORE && same_slot)
+        {
+            peephole->removed[offset]     = true;
+            peephole->removed[offset + 1] = true;
+            peephole->statistics->removed_instructions += 2;
+            offset++;
+        }
+        // A conditional jump tests truthiness itself.
+        else if (first_opcode == OP_TRUTHY && isConditionalJump(second_opcode))
+        {
+            peephole->removed[offset] = true;
+            peephole->statistics->removed_instructions++;
+        }
+        else if (first_opcode == OP_NOT && isConditionalJump(second_opcode))
+        {
+            Opcode inverse = second_opcode == OP_JUMP_IF_TRUE ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE;
+            merge(peephole, offset, makeInstruction(inverse, instructionOperand(second)),
+                  chunk->lines[offset + 1]);
+            peephole->statistics->removed_instructions++;
+        }
+    }
+}
+
+
+static void fuseBranches(Peephole* peephole)
+{
+    assert(peephole != NULL);
+
+    Chunk* chunk = peephole->chunk;
+    markTargets(peephole);
+
+    for (size_t offset = 0; offset + 1 < chunk->code_size; offset++)
+    {
+        Instruction jump = chunk->code[offset + 1];
+        Opcode fused = branchOpcode(instructionOpcode(chunk->code[offset]), instructionOpcode(jump));
+        if (fused != OP_HALT && mergeable(peephole, offset))
+        {
+            merge(peephole, offset, makeInstruction(fused, instructionOperand(jump)),
+                  chunk->lines[offset]);
+            peephole->statistics->fused_branches++;
+        }
+    }
+}
+
+
+// CONSTANT k or LOAD x right before the binary operator that takes it as
+// the right operand. The line is the operator's, which is where an error
+// is reported.
+static void fuseOperands(Peephole* peephole)
+{
+    assert(peephole != NULL);
+
+    Chunk* chunk = peephole->chunk;
+    markTargets(peephole);
+
+    for (size_t offset = 0; offset + 1 < chunk->code_size; offset++)
+    {
+        Instruction operand = chunk->code[offset];
+        Opcode opcode = instructionOpcode(operand);
+        Opcode binary = instructionOpcode(chunk->code[offset + 1]);
+
+        if ((opcode == OP_CONSTANT || opcode == OP_LOAD) && isBinary(binary)
+         && instructionOperand(operand) <= MAX_PAIRED_OPERAND && mergeable(peephole, offset))
+        {
+            Opcode fused = opcode == OP_CONSTANT ? OP_CONSTANT_BINARY : OP_LOAD_BINARY;
+            merge(peephole, offset,
+                  makeInstruction(fused, makePairedOperand(instructionOperand(operand), binary)),
+                  chunk->lines[offset + 1]);
+            peephole->statistics->superinstructions++;
+        }
+    }
+}
+
+
+static void fuseLoadsAndStores(Peephole* peephole)
+{
+    assert(peephole != NULL);
+
+    Chunk* chunk = peephole->chunk;
+    markTargets(peephole);
+
+    for (size_t offset = 0; offset + 1 < chunk->code_size; offset++)
+    {
+        Instruction first  = chunk->code[offset];
+        Instruction second = chunk->code[offset + 1];
+        Opcode first_opcode  = instructionOpcode(first);
+        Opcode second_opcode = instructionOpcode(second);
+
+        Opcode fused = OP_HALT;
+        if (first_opcode == OP_LOAD && second_opcode == OP_CONSTANT)
+        {
+            fused = OP_LOAD_CONSTANT;
+        }
+        else if (first_opcode == OP_STORE && second_opcode == OP_LOAD)
+        {
+            fused = OP_STORE_LOAD;
+        }
+
+        if (fused != OP_HALT
+         && instructionOperand(first)  <= MAX_PAIRED_OPERAND
+         && instructionOperand(second) <= MAX_PAIRED_OPERAND
+         && mergeable(peephole, offset))
+        {
+            merge(peephole, offset,
+                  makeInstruction(fused, makePairedOperand(instructionOperand(first),
+                                                           instructionOperand(second))),
+                  chunk->lines[offset]);
+            peephole->statistics->superinstructions++;
+        }
+    }
+}
+
+
+static void markTargets(Peephole* peephole)
+{
+    assert(peephole != NULL);
+
+    Chunk* chunk = peephole->chunk;
+    memset(peephole->is_target, 0, (chunk->code_size + 1) * sizeof(bool));
+
+    for (size_t offset = 0; offset < chunk->code_size; offset++)
+    {
+        Instruction instruction = chunk->code[offset];
+        if (opcodeHasJumpTarget(instructionOpcode(instruction)))
+        {
+            peephole->is_target[instructionOperand(instruction)] = true;
+        }
+        else if (instructionOpcode(instruction) == OP_SWITCH)
+        {
+            const SwitchTable* table = &chunk->switches[instructionOperand(instruction)];
+            for (uint32_t entry = 0; entry < table->entries_number; entry++)
+            {
+                peephole->is_target[table->targets[entry]] = true;
+            }
+        }
+    }
+}
+
+
+// Drops the removed instructions. A jump to one goes to the next
+// instruction that stays, which does what the removed ones would have.
+static void compact(Peephole* peephole)
+{
+    assert(peephole != NULL);
+
+    Chunk* chunk = peephole->chunk;
+    size_t size  = chunk->code_size;
+
+    uint32_t kept = 0;
+    for (size_t offset = 0; offset < size; offset++)
+    {
+        peephole->new_offsets[offset] = kept;
+        if (!peephole->removed[offset])
+        {
+            kept++;
+        }
+    }
+    peephole->new_offsets[size] = kept;
+
+    for (size_t offset = 0; offset < size; offset++)
+    {
+        if (peephole->removed[offset])
+        {
+            continue;
+        }
+
+        Instruction instruction = chunk->code[offset];
+        Opcode opcode = instructionOpcode(instruction);
+        if (opcodeHasJumpTarget(opcode))
+        {
+            instruction = makeInstruction(opcode, peephole->new_offsets[instructionOperand(instruction)]);
+        }
+        else if (opcode == OP_SWITCH)
+        {
+            SwitchTable* table = &chunk->switches[instructionOperand(instruction)];
+            for (uint32_t entry = 0; entry < table->entries_number; entry++)
+            {
+                table->targets[entry] = peephole->new_offsets[table->targets[entry]];
+            }
+        }
+
+        uint32_t destination = peephole->new_offsets[offset];
+        chunk->code [destination] = instruction;
+        chunk->lines[destination] = chunk->lines[offset];
+    }
+
+    chunk->code_size = kept;
+    memset(peephole->removed, 0, (size + 1) * sizeof(bool));
+}
+
+
+// The instruction at offset and the next one may become one: neither is
+// already gone and no jump lands between them.
+static bool mergeable(const Peephole* peephole, size_t offset)
+{
+    assert(peephole != NULL);
+
+    return !peephole->removed[offset] && !peephole->removed[offset + 1]
+        && !peephole->is_target[offset + 1];
+}
+
+
+static void merge(Peephole* peephole, size_t offset, Instruction fused, int line)
+{
+    assert(peephole != NULL);
+
+    peephole->chunk->code [offset] = fused;
+    peephole->chunk->lines[offset] = line;
+    peephole->removed[offset + 1]  = true;
+}
+
+
+static bool isBinary(Opcode opcode)
+{
+    return opcodeOperation(opcode) != TOKEN_ERROR && opcodeStackEffect(opcode) == -1;
+}
+
+
+static bool isConditionalJump(Opcode opcode)
+{
+    return opcode == OP_JUMP_IF_FALSE || opcode == OP_JUMP_IF_TRUE;
+}
+
+
+// The fused branch for a comparison and the conditional jump after it,
+// OP_HALT when there is none. The _DOUBLE forms fuse too: the dispatch
+// saved is worth more than the tag checks the fused form adds back.
+// a != b jumps exactly when a == b does not.
+static Opcode branchOpcode(Opcode comparison, Opcode jump)
+{
+    if (!isConditionalJump(jump))
+    {
+        return OP_HALT;
+    }
+
+    bool on_true = jump == OP_JUMP_IF_TRUE;
+    switch (comparison)
+    {
+        case OP_LESS:
+        case OP_LESS_DOUBLE:
+            return on_true ? OP_JUMP_IF_LESS : OP_JUMP_IF_NOT_LESS;
+        case OP_GREATER:
+        case OP_GREATER_DOUBLE:
+            return on_true ? OP_JUMP_IF_GREATER : OP_JUMP_IF_NOT_GREATER;
+        case OP_LESS_EQUAL:
+        case OP_LESS_EQUAL_DOUBLE:
+            return on_true ? OP_JUMP_IF_LESS_EQUAL : OP_JUMP_IF_NOT_LESS_EQUAL;
+        case OP_GREATER_EQUAL:
+        case OP_GREATER_EQUAL_DOUBLE:
+            return on_true ? OP_JUMP_IF_GREATER_EQUAL : OP_JUMP_IF_NOT_GREATER_EQUAL;
+        case OP_EQUAL:
+            return on_true ? OP_JUMP_IF_EQUAL : OP_JUMP_IF_NOT_EQUAL;
+        case OP_NOT_EQUAL:
+            return on_true ? OP_JUMP_IF_NOT_EQUAL : OP_JUMP_IF_EQUAL;
+        default:
+            return OP_HALT;
+    }
+}
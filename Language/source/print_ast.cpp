@@ -1,5 +1,6 @@
 #include "print_ast.h" 
 #include <stdio.h>
+#include <inttypes.h>
 
 static void printIndent(int level)
 {
@@ -9,7 +10,7 @@ static void printIndent(int level)
     }
 }
 
-static const char* syntaxNodeTypeToString(SyntaxNodeType type) 
+const char* syntaxNodeTypeToString(SyntaxNodeType type) 
 {
     static const char* names[] = {
         "PROGRAM",          // 0
@@ -24,12 +25,15 @@ static const char* syntaxNodeTypeToString(SyntaxNodeType type)
         "NUMBER",          // 9
         "STRING",          // 10
         "IDENTIFIER",      // 11
-        "BOOL"             // 12
+        "BOOL",            // 12
+        "STATEMENT",       // 13
+        "PRINT",           // 14
+        "INTEGER"          // 15
     };
     return names[type];
 }
 
-static const char* tokenTypeToString(int type) 
+const char* tokenTypeToString(int type) 
 {
     static const char* names[] = {
         "EOF",        // 0
@@ -61,7 +65,15 @@ static const char* tokenTypeToString(int type)
         "{",          // 26
         "}",          // 27
         ";",          // 28
-        "ERROR"       // 29
+        "ERROR",      // 29
+        "true",       // 30
+        "false",      // 31
+        "INTEGER",    // 32
+        "[",          // 33
+        "]",          // 34
+        ",",          // 35
+        "len",        // 36
+        "array"       // 37
     };
     return names[type];
 }
@@ -82,12 +94,18 @@ void printAST(Tree* tree, int node_index, int indent_level)
         case SyntaxNodeType_NUMBER:
             printf(" (%.2f)", node_data.data.number);
             break;
+        case SyntaxNodeType_INTEGER:
+            printf(" (%" PRId64 ")", node_data.data.integer);
+            break;
         case SyntaxNodeType_IDENTIFIER:
             printf(" (%s)", node_data.data.identifier);
             break;
         case SyntaxNodeType_STRING:
             printf(" \"%s\"", node_data.data.string);
             break;
+        case SyntaxNodeType_BOOL:
+            printf(" (%s)", node_data.data.boolean ? "true" : "false");
+            break;
         case SyntaxNodeType_BINARY_OPERATION:
         case SyntaxNodeType_UNARY_OPERATION:
             printf(" [%s]", tokenTypeToString(node_data.data.operation));
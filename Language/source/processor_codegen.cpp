@@ -0,0 +1,438 @@
+#include "processor_codegen.h"
+
+#include <assert.h>
+
+#include "tree_node_structure.h"
+#include "lexical_analysis.h"
+#include "value.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct ProcessorCodegen
+{
+    Tree*                 ast;
+    const Resolution*     resolution;
+    FILE*                 output;
+    size_t                labels_number;
+    ProcessorCodegenState state;
+} ProcessorCodegen;
+
+static void generateStatements(ProcessorCodegen* codegen, int cell_index);
+static void generateStatement(ProcessorCodegen* codegen, int node_index);
+static void generateValue(ProcessorCodegen* codegen, int node_index);
+static void generateBranch(ProcessorCodegen* codegen, int node_index,
+                           size_t label, bool when_true);
+static void generateComparisonBranch(ProcessorCodegen* codegen, const TreeNode* node,
+                                     size_t label, bool when_true);
+
+static size_t newLabel(ProcessorCodegen* codegen);
+static void emitLabel(ProcessorCodegen* codegen, size_t label);
+static void emitJump(ProcessorCodegen* codegen, const char* mnemonic, size_t label);
+static void emitPushNumber(ProcessorCodegen* codegen, double number);
+static void unsupported(ProcessorCodegen* codegen, const char* what, int line);
+
+static bool isComparison(int operation);
+static const char* comparisonJump(int operation);
+static const char* arithmeticMnemonic(int operation);
+
+
+// public ---------------------------------------------------------------------
+
+
+ProcessorCodegenState generateProcessorAssembly(Tree* ast, const Resolution* resolution,
+                                                FILE* output)
+{
+    assert(ast        != NULL);
+    assert(resolution != NULL);
+    assert(output     != NULL);
+
+    ProcessorCodegen codegen = {
+        .ast           = ast,
+        .resolution    = resolution,
+        .output        = output,
+        .labels_number = 0,
+        .state         = ProcessorCodegenState_OK,
+    };
+
+    fprintf(output, "; %lu variables in RAM cells 0..%lu, cell %lu is scratch\n",
+            resolution->slots_number,
+            resolution->slots_number == 0 ? 0 : resolution->slots_number - 1,
+            resolution->slots_number);
+
+    if (ast->nodes_number > 0)
+    {
+        generateStatements(&codegen, ast->nodes_array[0].left_index);
+    }
+
+    fprintf(output, "hlt\n");
+
+    if (codegen.state == ProcessorCodegenState_OK && ferror(output))
+    {
+        codegen.state = ProcessorCodegenState_WRITE_ERROR;
+    }
+
+    return codegen.state;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static void generateStatements(ProcessorCodegen* codegen, int cell_index)
+{
+    assert(codegen != NULL);
+
+    TreeNode* nodes = codegen->ast->nodes_array;
+    while (cell_index != EMPTY_NODE && codegen->state == ProcessorCodegenState_OK)
+    {
+        generateStatement(codegen, nodes[cell_index].left_index);
+        cell_index = nodes[cell_index].right_index;
+    }
+}
+
+
+static void generateStatement(ProcessorCodegen* codegen, int node_index)
+{
+    assert(codegen != NULL);
+
+    const TreeNode* node = &codegen->ast->nodes_array[node_index];
+
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_VAR_DECLARATION:
+        case SyntaxNodeType_ASSIGNMENT:
+            generateValue(codegen, node->right_index);
+            fprintf(codegen->output, "pop [%d]\n",
+                    codegen->resolution->node_slots[node->left_index]);
+            break;
+
+        case SyntaxNodeType_PRINT:
+            generateValue(codegen, node->left_index);
+            fprintf(codegen->output, "out\n");
+            break;
+
+        case SyntaxNodeType_IF:
+        {
+            const TreeNode* branches = &codegen->ast->nodes_array[node->right_index];
+            size_t end_label = newLabel(codegen);
+
+            if (branches->data.type != SyntaxNodeType_ELSE)
+            {
+                generateBranch(codegen, node->left_index, end_label, false);
+                generateStatement(codegen, node->right_index);
+                emitLabel(codegen, end_label);
+                break;
+            }
+
+            size_t else_label = newLabel(codegen);
+            generateBranch(codegen, node->left_index, else_label, false);
+            generateStatement(codegen, branches->left_index);
+            emitJump(codegen, "jmp", end_label);
+            emitLabel(codegen, else_label);
+            generateStatement(codegen, branches->right_index);
+            emitLabel(codegen, end_label);
+            break;
+        }
+
+        case SyntaxNodeType_WHILE:
+        {
+            size_t body_label      = newLabel(codegen);
+            size_t condition_label = newLabel(codegen);
+
+            emitJump(codegen, "jmp", condition_label);
+            emitLabel(codegen, body_label);
+            generateStatement(codegen, node->right_index);
+            emitLabel(codegen, condition_label);
+            generateBranch(codegen, node->left_index, body_label, true);
+            break;
+        }
+
+        case SyntaxNodeType_BLOCK:
+        case SyntaxNodeType_PROGRAM:
+        case SyntaxNodeType_STATEMENT:
+            generateStatements(codegen, node->left_index);
+            break;
+
+        default:
+            codegen->state = ProcessorCodegenState_BAD_TREE;
+            break;
+    }
+}
+
+
+static void generateValue(ProcessorCodegen* codegen, int node_index)
+{
+    assert(codegen != NULL);
+
+    if (codegen->state != ProcessorCodegenState_OK)
+    {
+        return;
+    }
+
+    const TreeNode* node = &codegen->ast->nodes_array[node_index];
+    int operation = node->data.data.operation;
+
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_NUMBER:
+            emitPushNumber(codegen, node->data.data.number);
+            return;
+
+        // The machine only has doubles: integers beyond 2^53 are rounded.
+        case SyntaxNodeType_INTEGER:
+            emitPushNumber(codegen, (double)node->data.data.integer);
+            return;
+
+        case SyntaxNodeType_BOOL:
+            emitPushNumber(codegen, node->data.data.boolean ? 1 : 0);
+            return;
+
+        case SyntaxNodeType_IDENTIFIER:
+            fprintf(codegen->output, "push [%d]\n", codegen->resolution->node_slots[node_index]);
+            return;
+
+        case SyntaxNodeType_STRING:
+            unsupported(codegen, "strings", node->data.line);
+            return;
+
+        case SyntaxNodeType_UNARY_OPERATION:
+            if (operation == TOKEN_LBRACKET || operation == TOKEN_KEYWORD_LEN)
+            {
+                unsupported(codegen, "arrays", node->data.line);
+                return;
+            }
+            if (operation == TOKEN_MINUS)
+            {
+                generateValue(codegen, node->left_index);
+                emitPushNumber(codegen, -1);
+                fprintf(codegen->output, "mul\n");
+                return;
+            }
+            break;
+
+        case SyntaxNodeType_BINARY_OPERATION:
+            if (operation == TOKEN_LBRACKET || operation == TOKEN_COMMA
+             || operation == TOKEN_KEYWORD_ARRAY)
+            {
+                unsupported(codegen, "arrays", node->data.line);
+                return;
+            }
+            if (arithmeticMnemonic(operation) != NULL)
+            {
+                generateValue(codegen, node->left_index);
+                generateValue(codegen, node->right_index);
+                fprintf(codegen->output, "%s\n", arithmeticMnemonic(operation));
+                return;
+            }
+            break;
+
+        default:
+            codegen->state = ProcessorCodegenState_BAD_TREE;
+            return;
+    }
+
+    // Comparisons, && , || and ! produce 1 or 0 through a branch.
+    size_t true_label = newLabel(codegen);
+    size_t end_label  = newLabel(codegen);
+
+    generateBranch(codegen, node_index, true_label, true);
+    emitPushNumber(codegen, 0);
+    emitJump(codegen, "jmp", end_label);
+    emitLabel(codegen, true_label);
+    emitPushNumber(codegen, 1);
+    emitLabel(codegen, end_label);
+}
+
+
+// Jumps to label when the condition evaluates to when_true and falls
+// through otherwise. && and || never evaluate their right operand when the
+// left one already decides the result.
+static void generateBranch(ProcessorCodegen* codegen, int node_index,
+                           size_t label, bool when_true)
+{
+    assert(codegen != NULL);
+
+    if (codegen->state != ProcessorCodegenState_OK)
+    {
+        return;
+    }
+
+    const TreeNode* node = &codegen->ast->nodes_array[node_index];
+    int operation = node->data.data.operation;
+
+    if (node->data.type == SyntaxNodeType_BOOL)
+    {
+        if (node->data.data.boolean == when_true)
+        {
+            emitJump(codegen, "jmp", label);
+        }
+        return;
+    }
+
+    if (node->data.type == SyntaxNodeType_UNARY_OPERATION && operation == TOKEN_BANG)
+    {
+        generateBranch(codegen, node->left_index, label, !when_true);
+        return;
+    }
+
+    if (node->data.type == SyntaxNodeType_BINARY_OPERATION
+     && (operation == TOKEN_AND || operation == TOKEN_OR))
+    {
+        // "a && b" jumps when false as soon as a is false, "a || b" jumps
+        // when true as soon as a is true; the other cases need a skip label.
+        bool decides_alone = (operation == TOKEN_AND) != when_true;
+        if (decides_alone)
+        {
+            generateBranch(codegen, node->left_index,  label, when_true);
+            generateBranch(codegen, node->right_index, label, when_true);
+            return;
+        }
+
+        size_t skip_label = newLabel(codegen);
+        generateBranch(codegen, node->left_index,  skip_label, !when_true);
+        generateBranch(codegen, node->right_index, label,      when_true);
+        emitLabel(codegen, skip_label);
+        return;
+    }
+
+    if (node->data.type == SyntaxNodeType_BINARY_OPERATION && isComparison(operation))
+    {
+        generateComparisonBranch(codegen, node, label, when_true);
+        return;
+    }
+
+    // NaN is falsy, so "x != 0" is not enough: x is truthy when x > 0 or
+    // x < 0. The value is parked in the scratch cell to compare it twice.
+    size_t scratch = codegen->resolution->slots_number;
+    generateValue(codegen, node_index);
+    fprintf(codegen->output, "pop [%lu]\n", scratch);
+
+    size_t true_label = when_true ? label : newLabel(codegen);
+    fprintf(codegen->output, "push [%lu]\n", scratch);
+    emitPushNumber(codegen, 0);
+    emitJump(codegen, "ja", true_label);
+    fprintf(codegen->output, "push [%lu]\n", scratch);
+    emitPushNumber(codegen, 0);
+    emitJump(codegen, "jb", true_label);
+
+    if (!when_true)
+    {
+        emitJump(codegen, "jmp", label);
+        emitLabel(codegen, true_label);
+    }
+}
+
+
+static void generateComparisonBranch(ProcessorCodegen* codegen, const TreeNode* node,
+                                     size_t label, bool when_true)
+{
+    assert(codegen != NULL);
+    assert(node    != NULL);
+
+    int operation = node->data.data.operation;
+
+    generateValue(codegen, node->left_index);
+    generateValue(codegen, node->right_index);
+
+    if (when_true)
+    {
+        emitJump(codegen, comparisonJump(operation), label);
+        return;
+    }
+
+    if (operation == TOKEN_EQEQ || operation == TOKEN_BANGEQ)
+    {
+        emitJump(codegen, operation == TOKEN_EQEQ ? "jne" : "je", label);
+        return;
+    }
+
+    // !(a < b) is not a >= b once NaN is involved, so the negated ordered
+    // comparisons keep the original jump and skip over an unconditional one.
+    size_t skip_label = newLabel(codegen);
+    emitJump(codegen, comparisonJump(operation), skip_label);
+    emitJump(codegen, "jmp", label);
+    emitLabel(codegen, skip_label);
+}
+
+
+static size_t newLabel(ProcessorCodegen* codegen)
+{
+    assert(codegen != NULL);
+
+    return codegen->labels_number++;
+}
+
+
+static void emitLabel(ProcessorCodegen* codegen, size_t label)
+{
+    assert(codegen != NULL);
+
+    fprintf(codegen->output, "L%lu:\n", label);
+}
+
+
+static void emitJump(ProcessorCodegen* codegen, const char* mnemonic, size_t label)
+{
+    assert(codegen  != NULL);
+    assert(mnemonic != NULL);
+
+    fprintf(codegen->output, "%s L%lu\n", mnemonic, label);
+}
+
+
+static void emitPushNumber(ProcessorCodegen* codegen, double number)
+{
+    assert(codegen != NULL);
+
+    char buffer[NUMBER_TEXT_BUFFER_SIZE] = {};
+    valueFormatNumber(buffer, sizeof(buffer), number);
+    fprintf(codegen->output, "push %s\n", buffer);
+}
+
+
+static void unsupported(ProcessorCodegen* codegen, const char* what, int line)
+{
+    assert(codegen != NULL);
+    assert(what    != NULL);
+
+    fprintf(stderr, "Error: %s are not supported by the Processor backend (line %d)\n",
+            what, line);
+    codegen->state = ProcessorCodegenState_UNSUPPORTED;
+}
+
+
+static bool isComparison(int operation)
+{
+    return comparisonJump(operation) != NULL;
+}
+
+
+static const char* comparisonJump(int operation)
+{
+    switch (operation)
+    {
+        case TOKEN_EQEQ:   return "je";
+        case TOKEN_BANGEQ: return "jne";
+        case TOKEN_LT:     return "jb";
+        case TOKEN_GT:     return "ja";
+        case TOKEN_LTEQ:   return "jbe";
+        case TOKEN_GTEQ:   return "jae";
+        default:           return NULL;
+    }
+}
+
+
+static const char* arithmeticMnemonic(int operation)
+{
+    switch (operation)
+    {
+        case TOKEN_PLUS:    return "add";
+        case TOKEN_MINUS:   return "sub";
+        case TOKEN_STAR:    return "mul";
+        case TOKEN_SLASH:   return "div";
+        case TOKEN_PERCENT: return "mod";
+        default:            return NULL;
+    }
+}
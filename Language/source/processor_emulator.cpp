@@ -0,0 +1,549 @@
+#include "processor_emulator.h"
+
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <assert.h>
+
+#include "value.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct ProcessorLabel
+{
+    const char* name;
+    size_t      length;
+    size_t      address;
+} ProcessorLabel;
+
+typedef struct LabelTable
+{
+    ProcessorLabel* labels;
+    size_t          size;
+    size_t          capacity;
+} LabelTable;
+
+typedef struct Mnemonic
+{
+    const char*     name;
+    ProcessorOpcode opcode;
+} Mnemonic;
+
+static const Mnemonic MNEMONICS[] = {
+    {.name = "push", .opcode = ProcessorOpcode_PUSH_NUMBER},
+    {.name = "pop",  .opcode = ProcessorOpcode_POP        },
+    {.name = "add",  .opcode = ProcessorOpcode_ADD        },
+    {.name = "sub",  .opcode = ProcessorOpcode_SUB        },
+    {.name = "mul",  .opcode = ProcessorOpcode_MUL        },
+    {.name = "div",  .opcode = ProcessorOpcode_DIV        },
+    {.name = "mod",  .opcode = ProcessorOpcode_MOD        },
+    {.name = "out",  .opcode = ProcessorOpcode_OUT        },
+    {.name = "jmp",  .opcode = ProcessorOpcode_JMP        },
+    {.name = "ja",   .opcode = ProcessorOpcode_JA         },
+    {.name = "jae",  .opcode = ProcessorOpcode_JAE        },
+    {.name = "jb",   .opcode = ProcessorOpcode_JB         },
+    {.name = "jbe",  .opcode = ProcessorOpcode_JBE        },
+    {.name = "je",   .opcode = ProcessorOpcode_JE         },
+    {.name = "jne",  .opcode = ProcessorOpcode_JNE        },
+    {.name = "hlt",  .opcode = ProcessorOpcode_HLT        },
+};
+
+static const size_t MNEMONICS_NUMBER = sizeof(MNEMONICS) / sizeof(MNEMONICS[0]);
+static const size_t PROCESSOR_START_SIZE = 64;
+
+static const char* skipSpaces(const char* text);
+static const char* wordEnd(const char* text);
+static bool isLineEnd(const char* text);
+static const char* nextLine(const char* text);
+static bool isJump(ProcessorOpcode opcode);
+static bool findMnemonic(const char* word, size_t length, ProcessorOpcode* opcode);
+static bool addLabel(LabelTable* table, const char* name, size_t length, size_t address);
+static bool findLabel(const LabelTable* table, const char* name, size_t length, size_t* address);
+static bool pushInstruction(ProcessorProgram* program, ProcessorInstruction instruction,
+                            size_t* capacity);
+static int compareLabels(const void* first, const void* second);
+static ProcessorState parseInstruction(const char* line, const LabelTable* labels,
+                                       ProcessorInstruction* instruction);
+static bool growStack(double** stack, size_t* capacity);
+
+
+// public ---------------------------------------------------------------------
+
+
+ProcessorState processorAssemble(const char* source, ProcessorProgram* program)
+{
+    assert(source  != NULL);
+    assert(program != NULL);
+
+    *program = (ProcessorProgram){};
+
+    LabelTable labels = {};
+    size_t address = 0;
+
+    // First pass: label addresses.
+    for (const char* line = source; *line != '\0'; line = nextLine(line))
+    {
+        const char* word = skipSpaces(line);
+        if (isLineEnd(word))
+        {
+            continue;
+        }
+
+        const char* end = wordEnd(word);
+        if (end > word && end[-1] == ':')
+        {
+            if (!addLabel(&labels, word, (size_t)(end - word - 1), address))
+            {
+                free(labels.labels);
+                return ProcessorState_MEMORY_ERROR;
+            }
+            continue;
+        }
+
+        address++;
+    }
+
+    if (labels.size > 0)
+    {
+        qsort(labels.labels, labels.size, sizeof(ProcessorLabel), compareLabels);
+    }
+
+    // Second pass: instructions with resolved jump targets.
+    ProcessorState state = ProcessorState_OK;
+    size_t capacity = 0;
+    for (const char* line = source; *line != '\0' && state == ProcessorState_OK; line = nextLine(line))
+    {
+        const char* word = skipSpaces(line);
+        const char* end  = wordEnd(word);
+        if (isLineEnd(word) || end[-1] == ':')
+        {
+            continue;
+        }
+
+        ProcessorInstruction instruction = {};
+        state = parseInstruction(word, &labels, &instruction);
+        if (state != ProcessorState_OK)
+        {
+            break;
+        }
+
+        if ((instruction.opcode == ProcessorOpcode_PUSH_MEMORY
+          || instruction.opcode == ProcessorOpcode_POP_MEMORY)
+         && instruction.argument >= program->ram_size)
+        {
+            program->ram_size = instruction.argument + 1;
+        }
+
+        if (!pushInstruction(program, instruction, &capacity))
+        {
+            state = ProcessorState_MEMORY_ERROR;
+        }
+    }
+
+    free(labels.labels);
+
+    if (state != ProcessorState_OK)
+    {
+        processorProgramDtor(program);
+    }
+
+    return state;
+}
+
+
+__attribute__((no_sanitize("float-divide-by-zero")))
+ProcessorState processorRun(const ProcessorProgram* program, FILE* output)
+{
+    assert(program != NULL);
+    assert(output  != NULL);
+
+    double* ram = (double*)calloc(program->ram_size + 1, sizeof(double));
+    double* stack = NULL;
+    size_t stack_size = 0;
+    size_t stack_capacity = 0;
+
+    if (ram == NULL || !growStack(&stack, &stack_capacity))
+    {
+        free(ram);
+        return ProcessorState_MEMORY_ERROR;
+    }
+
+    ProcessorState state = ProcessorState_OK;
+    size_t pc = 0;
+
+    while (pc < program->code_size && state == ProcessorState_OK)
+    {
+        const ProcessorInstruction* instruction = &program->code[pc++];
+
+        if (stack_size + 1 >= stack_capacity && !growStack(&stack, &stack_capacity))
+        {
+            state = ProcessorState_MEMORY_ERROR;
+            break;
+        }
+
+        switch (instruction->opcode)
+        {
+            case ProcessorOpcode_PUSH_NUMBER:
+                stack[stack_size++] = instruction->number;
+                continue;
+            case ProcessorOpcode_PUSH_MEMORY:
+                stack[stack_size++] = ram[instruction->argument];
+                continue;
+            case ProcessorOpcode_JMP:
+                pc = instruction->argument;
+                continue;
+            case ProcessorOpcode_HLT:
+                pc = program->code_size;
+                continue;
+            default:
+                break;
+        }
+
+        if (stack_size < 1)
+        {
+            state = ProcessorState_STACK_UNDERFLOW;
+            break;
+        }
+
+        switch (instruction->opcode)
+        {
+            case ProcessorOpcode_POP_MEMORY:
+                ram[instruction->argument] = stack[--stack_size];
+                continue;
+            case ProcessorOpcode_POP:
+                stack_size--;
+                continue;
+            case ProcessorOpcode_OUT:
+            {
+                char buffer[NUMBER_TEXT_BUFFER_SIZE] = {};
+                valueFormatNumber(buffer, sizeof(buffer), stack[--stack_size]);
+                fprintf(output, "%s\n", buffer);
+                continue;
+            }
+            default:
+                break;
+        }
+
+        if (stack_size < 2)
+        {
+            state = ProcessorState_STACK_UNDERFLOW;
+            break;
+        }
+
+        double right = stack[--stack_size];
+        double left  = stack[--stack_size];
+        bool jump = false;
+
+        switch (instruction->opcode)
+        {
+            case ProcessorOpcode_ADD: stack[stack_size++] = left + right;       break;
+            case ProcessorOpcode_SUB: stack[stack_size++] = left - right;       break;
+            case ProcessorOpcode_MUL: stack[stack_size++] = left * right;       break;
+            case ProcessorOpcode_DIV: stack[stack_size++] = left / right;       break;
+            case ProcessorOpcode_MOD: stack[stack_size++] = fmod(left, right);  break;
+            case ProcessorOpcode_JA:  jump = isgreater(left, right);            break;
+            case ProcessorOpcode_JAE: jump = isgreaterequal(left, right);       break;
+            case ProcessorOpcode_JB:  jump = isless(left, right);               break;
+            case ProcessorOpcode_JBE: jump = islessequal(left, right);          break;
+            case ProcessorOpcode_JE:  jump = !isunordered(left, right) && !islessgreater(left, right); break;
+            case ProcessorOpcode_JNE: jump = isunordered(left, right) || islessgreater(left, right);   break;
+            default:                  state = ProcessorState_SYNTAX_ERROR;      break;
+        }
+
+        if (jump)
+        {
+            pc = instruction->argument;
+        }
+    }
+
+    free(ram);
+    free(stack);
+
+    return state;
+}
+
+
+void processorProgramDtor(ProcessorProgram* program)
+{
+    if (program == NULL)
+    {
+        return;
+    }
+
+    free(program->code);
+    *program = (ProcessorProgram){};
+}
+
+
+const char* processorStateToString(ProcessorState state)
+{
+    switch (state)
+    {
+        case ProcessorState_OK:              return "ok";
+        case ProcessorState_SYNTAX_ERROR:    return "syntax error in assembly";
+        case ProcessorState_UNKNOWN_LABEL:   return "jump to an unknown label";
+        case ProcessorState_STACK_UNDERFLOW: return "stack underflow";
+        case ProcessorState_MEMORY_ERROR:    return "out of memory";
+        default:                             return "unknown error";
+    }
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static ProcessorState parseInstruction(const char* line, const LabelTable* labels,
+                                       ProcessorInstruction* instruction)
+{
+    assert(line        != NULL);
+    assert(labels      != NULL);
+    assert(instruction != NULL);
+
+    const char* end = wordEnd(line);
+    ProcessorOpcode opcode = ProcessorOpcode_HLT;
+    if (!findMnemonic(line, (size_t)(end - line), &opcode))
+    {
+        return ProcessorState_SYNTAX_ERROR;
+    }
+
+    const char* argument = skipSpaces(end);
+    bool has_argument = !isLineEnd(argument);
+
+    instruction->opcode = opcode;
+
+    if (opcode == ProcessorOpcode_PUSH_NUMBER || opcode == ProcessorOpcode_POP)
+    {
+        if (!has_argument)
+        {
+            return opcode == ProcessorOpcode_POP ? ProcessorState_OK : ProcessorState_SYNTAX_ERROR;
+        }
+
+        if (*argument == '[')
+        {
+            char* number_end = NULL;
+            unsigned long address = strtoul(argument + 1, &number_end, 10);
+            if (number_end == argument + 1 || *number_end != ']')
+            {
+                return ProcessorState_SYNTAX_ERROR;
+            }
+
+            instruction->opcode   = opcode == ProcessorOpcode_POP ? ProcessorOpcode_POP_MEMORY
+                                                                  : ProcessorOpcode_PUSH_MEMORY;
+            instruction->argument = address;
+            return ProcessorState_OK;
+        }
+
+        if (opcode == ProcessorOpcode_POP)
+        {
+            return ProcessorState_SYNTAX_ERROR;
+        }
+
+        char* number_end = NULL;
+        instruction->number = strtod(argument, &number_end);
+        return number_end == argument ? ProcessorState_SYNTAX_ERROR : ProcessorState_OK;
+    }
+
+    if (isJump(opcode))
+    {
+        if (!has_argument)
+        {
+            return ProcessorState_SYNTAX_ERROR;
+        }
+
+        if (!findLabel(labels, argument, (size_t)(wordEnd(argument) - argument), &instruction->argument))
+        {
+            return ProcessorState_UNKNOWN_LABEL;
+        }
+        return ProcessorState_OK;
+    }
+
+    return has_argument ? ProcessorState_SYNTAX_ERROR : ProcessorState_OK;
+}
+
+
+static const char* skipSpaces(const char* text)
+{
+    assert(text != NULL);
+
+    while (*text == ' ' || *text == '\t' || *text == '\r')
+    {
+        text++;
+    }
+
+    return text;
+}
+
+
+static const char* wordEnd(const char* text)
+{
+    assert(text != NULL);
+
+    while (*text != '\0' && *text != ';' && !isspace((unsigned char)*text))
+    {
+        text++;
+    }
+
+    return text;
+}
+
+
+static bool isLineEnd(const char* text)
+{
+    assert(text != NULL);
+
+    return *text == '\0' || *text == '\n' || *text == ';';
+}
+
+
+static const char* nextLine(const char* text)
+{
+    assert(text != NULL);
+
+    const char* newline = strchr(text, '\n');
+
+    return newline == NULL ? text + strlen(text) : newline + 1;
+}
+
+
+static bool isJump(ProcessorOpcode opcode)
+{
+    return opcode == ProcessorOpcode_JMP
+        || (ProcessorOpcode_JA <= opcode && opcode <= ProcessorOpcode_JNE);
+}
+
+
+static bool findMnemonic(const char* word, size_t length, ProcessorOpcode* opcode)
+{
+    assert(word   != NULL);
+    assert(opcode != NULL);
+
+    for (size_t i = 0; i < MNEMONICS_NUMBER; i++)
+    {
+        if (strlen(MNEMONICS[i].name) == length
+         && strncmp(MNEMONICS[i].name, word, length) == 0)
+        {
+            *opcode = MNEMONICS[i].opcode;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static bool addLabel(LabelTable* table, const char* name, size_t length, size_t address)
+{
+    assert(table != NULL);
+    assert(name  != NULL);
+
+    if (table->size == table->capacity)
+    {
+        size_t new_capacity = table->capacity == 0 ? PROCESSOR_START_SIZE : table->capacity * 2;
+        ProcessorLabel* new_labels = (ProcessorLabel*)realloc(table->labels,
+                                                              new_capacity * sizeof(ProcessorLabel));
+        if (new_labels == NULL)
+        {
+            return false;
+        }
+
+        table->labels   = new_labels;
+        table->capacity = new_capacity;
+    }
+
+    table->labels[table->size++] = (ProcessorLabel){
+        .name    = name,
+        .length  = length,
+        .address = address,
+    };
+
+    return true;
+}
+
+
+static bool findLabel(const LabelTable* table, const char* name, size_t length, size_t* address)
+{
+    assert(table   != NULL);
+    assert(name    != NULL);
+    assert(address != NULL);
+
+    if (table->size == 0)
+    {
+        return false;
+    }
+
+    ProcessorLabel key = {
+        .name    = name,
+        .length  = length,
+        .address = 0,
+    };
+
+    const ProcessorLabel* label = (const ProcessorLabel*)bsearch(&key, table->labels, table->size,
+                                                                 sizeof(ProcessorLabel), compareLabels);
+    if (label == NULL)
+    {
+        return false;
+    }
+
+    *address = label->address;
+    return true;
+}
+
+
+static int compareLabels(const void* first, const void* second)
+{
+    const ProcessorLabel* first_label  = (const ProcessorLabel*)first;
+    const ProcessorLabel* second_label = (const ProcessorLabel*)second;
+
+    if (first_label->length != second_label->length)
+    {
+        return first_label->length < second_label->length ? -1 : 1;
+    }
+
+    return strncmp(first_label->name, second_label->name, first_label->length);
+}
+
+
+static bool pushInstruction(ProcessorProgram* program, ProcessorInstruction instruction,
+                            size_t* capacity)
+{
+    assert(program  != NULL);
+    assert(capacity != NULL);
+
+    if (program->code_size == *capacity)
+    {
+        size_t new_capacity = *capacity == 0 ? PROCESSOR_START_SIZE : *capacity * 2;
+        ProcessorInstruction* new_code = (ProcessorInstruction*)realloc(program->code,
+                                                                        new_capacity * sizeof(ProcessorInstruction));
+        if (new_code == NULL)
+        {
+            return false;
+        }
+
+        program->code = new_code;
+        *capacity     = new_capacity;
+    }
+
+    program->code[program->code_size++] = instruction;
+    return true;
+}
+
+
+static bool growStack(double** stack, size_t* capacity)
+{
+    assert(stack    != NULL);
+    assert(capacity != NULL);
+
+    size_t new_capacity = *capacity == 0 ? PROCESSOR_START_SIZE : *capacity * 2;
+    double* new_stack = (double*)realloc(*stack, new_capacity * sizeof(double));
+    if (new_stack == NULL)
+    {
+        return false;
+    }
+
+    *stack    = new_stack;
+    *capacity = new_capacity;
+
+    return true;
+}
@@ -0,0 +1,321 @@
+#include "profiler.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "tree_node_structure.h"
+#include "print_ast.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct ProfileTable
+{
+    int*      parents;      // nearest profiled ancestor, or EMPTY_NODE
+    uint64_t* self_ticks;
+    int*      ranked;       // profiled nodes by self time
+    size_t    ranked_number;
+} ProfileTable;
+
+static bool buildTable(const Profile* profile, ProfileTable* table);
+static void tableDtor(ProfileTable* table);
+static const char* nodeLabel(const TreeNode* node);
+static double ticksToSeconds(const Profile* profile, uint64_t ticks);
+static double secondsNow(void);
+static int compareSelfTicks(const void* first, const void* second, void* self_ticks);
+
+static const size_t PROFILE_MAX_DEPTH = 256;
+
+
+// public ---------------------------------------------------------------------
+
+
+bool profileCtor(Profile* profile, const Tree* ast)
+{
+    assert(profile != NULL);
+    assert(ast     != NULL);
+
+    *profile = (Profile){};
+    profile->ast          = ast;
+    profile->nodes_number = ast->nodes_number;
+    profile->nodes        = (NodeProfile*)calloc(ast->nodes_number + 1, sizeof(NodeProfile));
+
+    return profile->nodes != NULL;
+}
+
+
+void profileDtor(Profile* profile)
+{
+    assert(profile != NULL);
+
+    free(profile->nodes);
+    *profile = (Profile){};
+}
+
+
+void profileStart(Profile* profile)
+{
+    assert(profile != NULL);
+
+    profile->start_seconds = secondsNow();
+    profile->start_ticks   = profileTicks();
+}
+
+
+void profileStop(Profile* profile)
+{
+    assert(profile != NULL);
+
+    profile->total_ticks = profileTicks() - profile->start_ticks;
+    profile->seconds     = secondsNow() - profile->start_seconds;
+}
+
+
+void profileRecord(Profile* profile, int node, uint64_t start_ticks)
+{
+    assert(profile != NULL);
+    assert(node >= 0 && (size_t)node < profile->nodes_number);
+
+    uint64_t end_ticks = profileTicks();
+    profile->nodes[node].count++;
+    profile->nodes[node].ticks += end_ticks - start_ticks;
+}
+
+
+bool profilePrintHotspots(const Profile* profile, FILE* output, size_t top)
+{
+    assert(profile != NULL);
+    assert(output  != NULL);
+
+    ProfileTable table = {};
+    if (!buildTable(profile, &table))
+    {
+        return false;
+    }
+
+    uint64_t runs = 0;
+    for (size_t node = 0; node < profile->nodes_number; node++)
+    {
+        runs += profile->nodes[node].count;
+    }
+
+    fprintf(output, "profile: %.3f ms, %lu node runs, %lu nodes profiled\n",
+            profile->seconds * 1000, runs, table.ranked_number);
+    fprintf(output, "   self ms   self %%   total ms        count   line  node\n");
+
+    for (size_t rank = 0; rank < top && rank < table.ranked_number; rank++)
+    {
+        int node = table.ranked[rank];
+        const TreeNode* data = &profile->ast->nodes_array[node];
+        double self_seconds = ticksToSeconds(profile, table.self_ticks[node]);
+
+        fprintf(output, "%10.3f  %5.1f%%  %9.3f  %11lu  %5d  %s\n",
+                self_seconds * 1000,
+                profile->seconds > 0 ? self_seconds / profile->seconds * 100 : 0.0,
+                ticksToSeconds(profile, profile->nodes[node].ticks) * 1000,
+                profile->nodes[node].count,
+                data->data.line,
+                nodeLabel(data));
+    }
+
+    tableDtor(&table);
+
+    return true;
+}
+
+
+bool profileWriteFolded(const Profile* profile, FILE* output)
+{
+    assert(profile != NULL);
+    assert(output  != NULL);
+
+    ProfileTable table = {};
+    if (!buildTable(profile, &table))
+    {
+        return false;
+    }
+
+    int stack[PROFILE_MAX_DEPTH] = {};
+    for (size_t rank = 0; rank < table.ranked_number; rank++)
+    {
+        int node = table.ranked[rank];
+        uint64_t nanoseconds = (uint64_t)(ticksToSeconds(profile, table.self_ticks[node]) * 1e9);
+        if (nanoseconds == 0)
+        {
+            continue;
+        }
+
+        // Deeper frames than the stack holds are cut off at the root side.
+        size_t depth = 0;
+        for (int frame = node; frame != EMPTY_NODE && depth < PROFILE_MAX_DEPTH;
+             frame = table.parents[frame])
+        {
+            stack[depth++] = frame;
+        }
+
+        while (depth > 0)
+        {
+            const TreeNode* data = &profile->ast->nodes_array[stack[--depth]];
+            fprintf(output, "%s@%d%s", nodeLabel(data), data->data.line, depth > 0 ? ";" : "");
+        }
+        fprintf(output, " %lu\n", nanoseconds);
+    }
+
+    tableDtor(&table);
+
+    return ferror(output) == 0;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+// Walks the tree from the root with an explicit stack, since statement
+// lists are chains as long as the program.
+static bool buildTable(const Profile* profile, ProfileTable* table)
+{
+    assert(profile != NULL);
+    assert(table   != NULL);
+
+    size_t nodes_number = profile->nodes_number;
+    table->parents    = (int*)malloc((nodes_number + 1) * sizeof(int));
+    table->self_ticks = (uint64_t*)calloc(nodes_number + 1, sizeof(uint64_t));
+    table->ranked     = (int*)malloc((nodes_number + 1) * sizeof(int));
+    int* pending      = (int*)malloc((2 * nodes_number + 2) * sizeof(int));
+    if (table->parents == NULL || table->self_ticks == NULL || table->ranked == NULL
+     || pending == NULL)
+    {
+        free(pending);
+        tableDtor(table);
+        return false;
+    }
+
+    const NodeProfile* nodes = profile->nodes;
+    const TreeNode* tree = profile->ast->nodes_array;
+    for (size_t node = 0; node < nodes_number; node++)
+    {
+        table->parents[node] = EMPTY_NODE;
+    }
+
+    size_t pending_number = 0;
+    if (nodes_number > 0)
+    {
+        pending[pending_number++] = 0;
+        pending[pending_number++] = EMPTY_NODE;
+    }
+
+    while (pending_number > 0)
+    {
+        int parent = pending[--pending_number];
+        int node   = pending[--pending_number];
+        table->parents[node] = parent;
+
+        if (nodes[node].count > 0)
+        {
+            table->self_ticks[node] = nodes[node].ticks;
+            table->ranked[table->ranked_number++] = node;
+            if (parent != EMPTY_NODE)
+            {
+                uint64_t child = nodes[node].ticks;
+                table->self_ticks[parent] -= child < table->self_ticks[parent]
+                                           ? child
+                                           : table->self_ticks[parent];
+            }
+            parent = node;
+        }
+
+        int children[2] = {tree[node].left_index, tree[node].right_index};
+        for (int c = 0; c < 2; c++)
+        {
+            int child = children[c];
+            if (child != EMPTY_NODE && child >= 0 && (size_t)child < nodes_number
+             && pending_number + 2 <= 2 * nodes_number + 2)
+            {
+                pending[pending_number++] = child;
+                pending[pending_number++] = parent;
+            }
+        }
+    }
+
+    free(pending);
+    qsort_r(table->ranked, table->ranked_number, sizeof(int), compareSelfTicks,
+            table->self_ticks);
+
+    return true;
+}
+
+
+static void tableDtor(ProfileTable* table)
+{
+    assert(table != NULL);
+
+    free(table->parents);
+    free(table->self_ticks);
+    free(table->ranked);
+    *table = (ProfileTable){};
+}
+
+
+static const char* nodeLabel(const TreeNode* node)
+{
+    assert(node != NULL);
+
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_VAR_DECLARATION:  return "var";
+        case SyntaxNodeType_ASSIGNMENT:       return "assign";
+        case SyntaxNodeType_IF:               return "if";
+        case SyntaxNodeType_WHILE:            return "while";
+        case SyntaxNodeType_BLOCK:            return "block";
+        case SyntaxNodeType_PRINT:            return "print";
+        case SyntaxNodeType_BINARY_OPERATION:
+        case SyntaxNodeType_UNARY_OPERATION:  return tokenTypeToString(node->data.data.operation);
+        case SyntaxNodeType_PROGRAM:
+        case SyntaxNodeType_STATEMENT:
+        case SyntaxNodeType_ELSE:
+        case SyntaxNodeType_NUMBER:
+        case SyntaxNodeType_INTEGER:
+        case SyntaxNodeType_STRING:
+        case SyntaxNodeType_IDENTIFIER:
+        case SyntaxNodeType_BOOL:
+        default:                              return syntaxNodeTypeToString(node->data.type);
+    }
+}
+
+
+static double ticksToSeconds(const Profile* profile, uint64_t ticks)
+{
+    assert(profile != NULL);
+
+    if (profile->total_ticks == 0)
+    {
+        return 0;
+    }
+
+    return (double)ticks * profile->seconds / (double)profile->total_ticks;
+}
+
+
+static double secondsNow(void)
+{
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+
+static int compareSelfTicks(const void* first, const void* second, void* self_ticks)
+{
+    const uint64_t* ticks = (const uint64_t*)self_ticks;
+    int left  = *(const int*)first;
+    int right = *(const int*)second;
+
+    if (ticks[left] != ticks[right])
+    {
+        return ticks[left] > ticks[right] ? -1 : 1;
+    }
+
+    return (left > right) - (left < right);
+}
@@ -0,0 +1,733 @@
+#include "register_allocator.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct Liveness
+{
+    const SsaFunction* function;
+    size_t    words;            // per set
+    uint64_t* live_in;          // block -> set of values
+    uint64_t* live_out;
+    int*      block_from;       // first and last position of each block
+    int*      block_to;
+    int*      positions;        // value -> index of its instruction in the order
+} Liveness;
+
+static bool layOutBlocks(const SsaFunction* function, RegisterAllocation* allocation);
+static bool checkOperands(const SsaFunction* function, const RegisterAllocation* allocation);
+static bool isAvailable(const SsaFunction* function, int value);
+static bool computeLiveness(Liveness* liveness, const RegisterAllocation* allocation);
+static void blockLiveOut(const Liveness* liveness, int block, uint64_t* set);
+static void liveInFromLiveOut(const Liveness* liveness, int block, uint64_t* set);
+static void livenessDtor(Liveness* liveness);
+static bool buildIntervals(const Liveness* liveness, RegisterAllocation* allocation);
+static void extendInterval(LiveInterval* interval, int position);
+static bool scanIntervals(RegisterAllocation* allocation);
+static void spillInterval(RegisterAllocation* allocation, int* slot_ends, int interval);
+static void countMaxLive(RegisterAllocation* allocation);
+static int  operandsNumber(const SsaInstruction* instruction);
+static bool definesValue(const SsaInstruction* instruction);
+static int  predecessorEdge(const SsaFunction* function, int block, int predecessor);
+static int  compareIntervals(const void* first, const void* second);
+static int  compareInts(const void* first, const void* second);
+static void setAdd(uint64_t* set, int value);
+static void setRemove(uint64_t* set, int value);
+static bool setContains(const uint64_t* set, int value);
+
+// public ---------------------------------------------------------------------
+
+
+RegisterAllocatorState allocateRegisters(const SsaFunction* function, int registers_number,
+                                         RegisterAllocation* allocation)
+{
+    assert(function   != NULL);
+    assert(allocation != NULL);
+
+    *allocation = (RegisterAllocation){};
+    allocation->registers_number = registers_number;
+    if (registers_number < MIN_REGISTERS)
+    {
+        return RegisterAllocatorState_BAD_REGISTERS;
+    }
+
+    allocation->locations = (int*)malloc((function->instructions_number + 1) * sizeof(int));
+    if (allocation->locations == NULL || !layOutBlocks(function, allocation))
+    {
+        registerAllocationDtor(allocation);
+        return RegisterAllocatorState_MEMORY_ERROR;
+    }
+
+    for (size_t value = 0; value < function->instructions_number; value++)
+    {
+        allocation->locations[value] = NO_LOCATION;
+    }
+
+    if (!checkOperands(function, allocation))
+    {
+        registerAllocationDtor(allocation);
+        return RegisterAllocatorState_BAD_FUNCTION;
+    }
+
+    Liveness liveness = {.function = function};
+    bool built = computeLiveness(&liveness, allocation)
+              && buildIntervals(&liveness, allocation)
+              && scanIntervals(allocation);
+    livenessDtor(&liveness);
+    if (!built)
+    {
+        registerAllocationDtor(allocation);
+        return RegisterAllocatorState_MEMORY_ERROR;
+    }
+
+    countMaxLive(allocation);
+
+    return RegisterAllocatorState_OK;
+}
+
+
+void registerAllocationDtor(RegisterAllocation* allocation)
+{
+    assert(allocation != NULL);
+
+    free(allocation->locations);
+    free(allocation->intervals);
+    free(allocation->order);
+
+    *allocation = (RegisterAllocation){};
+}
+
+
+const char* registerAllocatorStateToString(RegisterAllocatorState state)
+{
+    switch (state)
+    {
+        case RegisterAllocatorState_OK:            return "ok";
+        case RegisterAllocatorState_BAD_REGISTERS: return "too few registers";
+        case RegisterAllocatorState_BAD_FUNCTION:  return "value used without a definition";
+        case RegisterAllocatorState_MEMORY_ERROR:  return "out of memory";
+        default:                                   return "unknown error";
+    }
+}
+
+
+void registerAllocationDump(const RegisterAllocation* allocation, FILE* output)
+{
+    assert(allocation != NULL);
+    assert(output     != NULL);
+
+    fprintf(output, "; %lu values, %d registers (%d allocatable), %lu spilled to %lu slots, "
+                    "at most %lu live\n",
+            allocation->intervals_number,
+            allocation->registers_number,
+            allocation->registers_number - SCRATCH_REGISTERS,
+            allocation->spilled_values,
+            allocation->spill_slots,
+            allocation->max_live);
+
+    for (size_t i = 0; i < allocation->intervals_number; i++)
+    {
+        const LiveInterval* interval = &allocation->intervals[i];
+        int location = allocation->locations[interval->value];
+
+        fprintf(output, "v%-5d [%5d, %5d]  ", interval->value, interval->start, interval->end);
+        if (locationIsRegister(location))
+        {
+            fprintf(output, "r%d\n", location);
+        }
+        else
+        {
+            fprintf(output, "slot %d\n", locationSlot(location));
+        }
+    }
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+// Reverse postorder puts a loop header before its body and keeps the body
+// together, so intervals stay short; unreachable blocks are left out.
+static bool layOutBlocks(const SsaFunction* function, RegisterAllocation* allocation)
+{
+    assert(function   != NULL);
+    assert(allocation != NULL);
+
+    size_t reachable = 0;
+    for (size_t block = 0; block < function->blocks_number; block++)
+    {
+        if (function->blocks[block].preorder >= 0)
+        {
+            reachable++;
+        }
+    }
+
+    allocation->order = (int*)malloc((reachable + 1) * sizeof(int));
+    if (allocation->order == NULL)
+    {
+        return false;
+    }
+
+    memcpy(allocation->order, function->reverse_postorder, reachable * sizeof(int));
+    allocation->order_number = reachable;
+
+    return true;
+}
+
+
+// Every operand of a reachable instruction, and every phi argument on an
+// edge from a reachable block, has to be defined in a reachable block; the
+// builder guarantees it, but the lowering relies on it for memory safety.
+static bool checkOperands(const SsaFunction* function, const RegisterAllocation* allocation)
+{
+    assert(function   != NULL);
+    assert(allocation != NULL);
+
+    for (size_t i = 0; i < allocation->order_number; i++)
+    {
+        const SsaBlock* block = &function->blocks[allocation->order[i]];
+        for (int index = 0; index < block->size; index++)
+        {
+            const SsaInstruction* instruction = ssaBlockInstruction(function, block, index);
+            for (int o = 0; o < operandsNumber(instruction); o++)
+            {
+                if (!isAvailable(function, instruction->operands[o]))
+                {
+                    return false;
+                }
+            }
+
+            if (instruction->opcode != SsaOpcode_PHI)
+            {
+                continue;
+            }
+            if (instruction->arguments_number != block->predecessors_number)
+            {
+                return false;
+            }
+            for (int a = 0; a < instruction->arguments_number; a++)
+            {
+                int predecessor = function->predecessors[block->first_predecessor + a];
+                if (function->blocks[predecessor].preorder >= 0
+                 && !isAvailable(function, function->phi_arguments[instruction->argument + a]))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+
+static bool isAvailable(const SsaFunction* function, int value)
+{
+    assert(function != NULL);
+
+    if (value < 0 || (size_t)value >= function->instructions_number)
+    {
+        return false;
+    }
+
+    const SsaInstruction* instruction = &function->instructions[value];
+    return definesValue(instruction)
+        && instruction->block >= 0 && (size_t)instruction->block < function->blocks_number
+        && function->blocks[instruction->block].preorder >= 0;
+}
+
+
+static bool computeLiveness(Liveness* liveness, const RegisterAllocation* allocation)
+{
+    assert(liveness   != NULL);
+    assert(allocation != NULL);
+
+    const SsaFunction* function = liveness->function;
+    size_t blocks_number = function->blocks_number;
+    liveness->words = (function->instructions_number + 63) / 64 + 1;
+
+    liveness->live_in    = (uint64_t*)calloc(blocks_number * liveness->words + 1, sizeof(uint64_t));
+    liveness->live_out   = (uint64_t*)calloc(blocks_number * liveness->words + 1, sizeof(uint64_t));
+    liveness->block_from = (int*)calloc(blocks_number + 1, sizeof(int));
+    liveness->block_to   = (int*)calloc(blocks_number + 1, sizeof(int));
+    liveness->positions  = (int*)calloc(function->instructions_number + 1, sizeof(int));
+    uint64_t* set = (uint64_t*)calloc(liveness->words, sizeof(uint64_t));
+    if (liveness->live_in == NULL || liveness->live_out  == NULL
+     || liveness->block_from == NULL || liveness->block_to == NULL
+     || liveness->positions  == NULL || set == NULL)
+    {
+        free(set);
+        return false;
+    }
+
+    int index = 0;
+    for (size_t i = 0; i < allocation->order_number; i++)
+    {
+        int block = allocation->order[i];
+        const SsaBlock* data = &function->blocks[block];
+
+        liveness->block_from[block] = 2 * index;
+        for (int k = 0; k < data->size; k++)
+        {
+            liveness->positions[function->schedule[data->first + k]] = index++;
+        }
+        liveness->block_to[block] = data->size > 0 ? 2 * index - 1 : 2 * index;
+        if (data->size == 0)
+        {
+            index++;
+        }
+    }
+
+    // Backwards order converges fastest; loops need the extra rounds.
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = allocation->order_number; i-- > 0;)
+        {
+            int block = allocation->order[i];
+            uint64_t* live_out = &liveness->live_out[(size_t)block * liveness->words];
+            uint64_t* live_in  = &liveness->live_in [(size_t)block * liveness->words];
+
+            memset(set, 0, liveness->words * sizeof(uint64_t));
+            blockLiveOut(liveness, block, set);
+            memcpy(live_out, set, liveness->words * sizeof(uint64_t));
+
+            liveInFromLiveOut(liveness, block, set);
+            if (memcmp(live_in, set, liveness->words * sizeof(uint64_t)) != 0)
+            {
+                memcpy(live_in, set, liveness->words * sizeof(uint64_t));
+                changed = true;
+            }
+        }
+    }
+
+    free(set);
+
+    return true;
+}
+
+
+// What a successor needs on entry plus the phi arguments that flow along
+// the edge from this block. A block's live-in never holds its own phis: they
+// are defined in it.
+static void blockLiveOut(const Liveness* liveness, int block, uint64_t* set)
+{
+    assert(liveness != NULL);
+    assert(set      != NULL);
+
+    const SsaFunction* function = liveness->function;
+    const SsaBlock* data = &function->blocks[block];
+
+    for (int s = 0; s < 2; s++)
+    {
+        int successor = data->successors[s];
+        if (successor == NO_BLOCK || (s == 1 && successor == data->successors[0]))
+        {
+            continue;
+        }
+
+        const uint64_t* live_in = &liveness->live_in[(size_t)successor * liveness->words];
+        for (size_t word = 0; word < liveness->words; word++)
+        {
+            set[word] |= live_in[word];
+        }
+
+        const SsaBlock* successor_data = &function->blocks[successor];
+        int edge = predecessorEdge(function, successor, block);
+        if (edge < 0)
+        {
+            continue;
+        }
+
+        for (int p = 0; p < successor_data->phis_number; p++)
+        {
+            const SsaInstruction* phi = ssaBlockInstruction(function, successor_data, p);
+            setAdd(set, function->phi_arguments[phi->argument + edge]);
+        }
+    }
+}
+
+
+static void liveInFromLiveOut(const Liveness* liveness, int block, uint64_t* set)
+{
+    assert(liveness != NULL);
+    assert(set      != NULL);
+
+    const SsaFunction* function = liveness->function;
+    const SsaBlock* data = &function->blocks[block];
+
+    for (int k = data->size; k-- > 0;)
+    {
+        int value = function->schedule[data->first + k];
+        const SsaInstruction* instruction = &function->instructions[value];
+
+        setRemove(set, value);
+        for (int o = 0; o < operandsNumber(instruction); o++)
+        {
+            setAdd(set, instruction->operands[o]);
+        }
+    }
+}
+
+
+static void livenessDtor(Liveness* liveness)
+{
+    assert(liveness != NULL);
+
+    free(liveness->live_in);
+    free(liveness->live_out);
+    free(liveness->block_from);
+    free(liveness->block_to);
+    free(liveness->positions);
+}
+
+
+// A phi is written on the edges into its block, so it starts with the
+// block; its arguments are read at the end of the predecessors.
+static bool buildIntervals(const Liveness* liveness, RegisterAllocation* allocation)
+{
+    assert(liveness   != NULL);
+    assert(allocation != NULL);
+
+    const SsaFunction* function = liveness->function;
+    size_t values_number = function->instructions_number;
+
+    int* interval_of = (int*)malloc((values_number + 1) * sizeof(int));
+    allocation->intervals = (LiveInterval*)malloc((values_number + 1) * sizeof(LiveInterval));
+    if (interval_of == NULL || allocation->intervals == NULL)
+    {
+        free(interval_of);
+        return false;
+    }
+
+    for (size_t value = 0; value < values_number; value++)
+    {
+        interval_of[value] = -1;
+    }
+
+    for (size_t i = 0; i < allocation->order_number; i++)
+    {
+        const SsaBlock* data = &function->blocks[allocation->order[i]];
+        for (int k = 0; k < data->size; k++)
+        {
+            int value = function->schedule[data->first + k];
+            if (!definesValue(&function->instructions[value]))
+            {
+                continue;
+            }
+
+            int position = k < data->phis_number
+                         ? liveness->block_from[allocation->order[i]]
+                         : 2 * liveness->positions[value] + 1;
+            interval_of[value] = (int)allocation->intervals_number;
+            allocation->intervals[allocation->intervals_number++] = (LiveInterval){
+                .value = value,
+                .start = position,
+                .end   = position,
+            };
+        }
+    }
+
+    for (size_t i = 0; i < allocation->order_number; i++)
+    {
+        int block = allocation->order[i];
+        const SsaBlock* data = &function->blocks[block];
+        const uint64_t* live_in  = &liveness->live_in [(size_t)block * liveness->words];
+        const uint64_t* live_out = &liveness->live_out[(size_t)block * liveness->words];
+
+        for (size_t value = 0; value < values_number; value++)
+        {
+            if (interval_of[value] < 0)
+            {
+                continue;
+            }
+            LiveInterval* interval = &allocation->intervals[interval_of[value]];
+            if (setContains(live_in, (int)value))
+            {
+                extendInterval(interval, liveness->block_from[block]);
+            }
+            if (setContains(live_out, (int)value))
+            {
+                extendInterval(interval, liveness->block_to[block]);
+            }
+        }
+
+        for (int k = data->phis_number; k < data->size; k++)
+        {
+            const SsaInstruction* instruction = ssaBlockInstruction(function, data, k);
+            int position = 2 * liveness->positions[function->schedule[data->first + k]];
+            for (int o = 0; o < operandsNumber(instruction); o++)
+            {
+                extendInterval(&allocation->intervals[interval_of[instruction->operands[o]]],
+                               position);
+            }
+        }
+    }
+
+    free(interval_of);
+    qsort(allocation->intervals, allocation->intervals_number, sizeof(LiveInterval),
+          compareIntervals);
+
+    return true;
+}
+
+
+static void extendInterval(LiveInterval* interval, int position)
+{
+    assert(interval != NULL);
+
+    if (position < interval->start)
+    {
+        interval->start = position;
+    }
+    if (position > interval->end)
+    {
+        interval->end = position;
+    }
+}
+
+
+// active holds the intervals in registers, sorted by end, so expiring is a
+// prefix and the spill candidate is the last one.
+static bool scanIntervals(RegisterAllocation* allocation)
+{
+    assert(allocation != NULL);
+
+    int allocatable = allocation->registers_number - SCRATCH_REGISTERS;
+    size_t intervals_number = allocation->intervals_number;
+    int* slot_ends      = (int*)malloc((intervals_number + 1) * sizeof(int));
+    int* active         = (int*)malloc((size_t)(allocatable + 1) * sizeof(int));
+    int* free_registers = (int*)malloc((size_t)(allocatable + 1) * sizeof(int));
+    if (active == NULL || free_registers == NULL || slot_ends == NULL)
+    {
+        free(active);
+        free(free_registers);
+        free(slot_ends);
+        return false;
+    }
+
+    int free_number = 0;
+    for (int reg = allocatable; reg-- > 0;)
+    {
+        free_registers[free_number++] = reg;
+    }
+
+    int active_number = 0;
+    for (size_t i = 0; i < intervals_number; i++)
+    {
+        const LiveInterval* current = &allocation->intervals[i];
+
+        int expired = 0;
+        while (expired < active_number
+            && allocation->intervals[active[expired]].end < current->start)
+        {
+            free_registers[free_number++] =
+                allocation->locations[allocation->intervals[active[expired]].value];
+            expired++;
+        }
+        memmove(active, active + expired, (size_t)(active_number - expired) * sizeof(int));
+        active_number -= expired;
+
+        if (free_number > 0)
+        {
+            allocation->locations[current->value] = free_registers[--free_number];
+        }
+        else if (allocation->intervals[active[active_number - 1]].end > current->end)
+        {
+            int victim = active[--active_number];
+            allocation->locations[current->value] =
+                allocation->locations[allocation->intervals[victim].value];
+            spillInterval(allocation, slot_ends, victim);
+        }
+        else
+        {
+            spillInterval(allocation, slot_ends, (int)i);
+            continue;
+        }
+
+        int position = active_number;
+        while (position > 0 && allocation->intervals[active[position - 1]].end > current->end)
+        {
+            active[position] = active[position - 1];
+            position--;
+        }
+        active[position] = (int)i;
+        active_number++;
+    }
+
+    free(active);
+    free(free_registers);
+    free(slot_ends);
+
+    return true;
+}
+
+
+// A spilled value keeps its slot for its whole interval, so a slot is only
+// handed on to an interval that starts after its last holder ended. A
+// victim taken out of a register started before the current interval,
+// which is why every free slot is checked against its own start.
+static void spillInterval(RegisterAllocation* allocation, int* slot_ends, int interval)
+{
+    assert(allocation != NULL);
+    assert(slot_ends  != NULL);
+
+    const LiveInterval* spilled = &allocation->intervals[interval];
+    int slot = (int)allocation->spill_slots;
+    for (int s = 0; s < (int)allocation->spill_slots; s++)
+    {
+        if (slot_ends[s] < spilled->start)
+        {
+            slot = s;
+            break;
+        }
+    }
+
+    if (slot == (int)allocation->spill_slots)
+    {
+        allocation->spill_slots++;
+    }
+    slot_ends[slot] = spilled->end;
+
+    allocation->locations[spilled->value] = spillLocation(slot);
+    allocation->spilled_values++;
+}
+
+
+static void countMaxLive(RegisterAllocation* allocation)
+{
+    assert(allocation != NULL);
+
+    size_t intervals_number = allocation->intervals_number;
+    int* ends = (int*)malloc((intervals_number + 1) * sizeof(int));
+    if (ends == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < intervals_number; i++)
+    {
+        ends[i] = allocation->intervals[i].end;
+    }
+    qsort(ends, intervals_number, sizeof(int), compareInts);
+
+    size_t ended = 0;
+    for (size_t i = 0; i < intervals_number; i++)
+    {
+        while (ends[ended] < allocation->intervals[i].start)
+        {
+            ended++;
+        }
+        if (i + 1 - ended > allocation->max_live)
+        {
+            allocation->max_live = i + 1 - ended;
+        }
+    }
+
+    free(ends);
+}
+
+
+static int operandsNumber(const SsaInstruction* instruction)
+{
+    assert(instruction != NULL);
+
+    switch (instruction->opcode)
+    {
+        case SsaOpcode_UNARY:
+        case SsaOpcode_TRUTHY:
+        case SsaOpcode_PRINT:
+        case SsaOpcode_BRANCH:
+            return 1;
+
+        case SsaOpcode_BINARY:
+            return 2;
+
+        default:
+            return 0;
+    }
+}
+
+
+static bool definesValue(const SsaInstruction* instruction)
+{
+    assert(instruction != NULL);
+
+    switch (instruction->opcode)
+    {
+        case SsaOpcode_CONSTANT:
+        case SsaOpcode_PHI:
+        case SsaOpcode_UNARY:
+        case SsaOpcode_BINARY:
+        case SsaOpcode_TRUTHY:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+
+static int predecessorEdge(const SsaFunction* function, int block, int predecessor)
+{
+    assert(function != NULL);
+
+    const SsaBlock* data = &function->blocks[block];
+    for (int p = 0; p < data->predecessors_number; p++)
+    {
+        if (function->predecessors[data->first_predecessor + p] == predecessor)
+        {
+            return p;
+        }
+    }
+
+    return -1;
+}
+
+
+static int compareIntervals(const void* first, const void* second)
+{
+    const LiveInterval* left  = (const LiveInterval*)first;
+    const LiveInterval* right = (const LiveInterval*)second;
+
+    if (left->start != right->start)
+    {
+        return left->start < right->start ? -1 : 1;
+    }
+
+    return left->value < right->value ? -1 : left->value > right->value;
+}
+
+
+static int compareInts(const void* first, const void* second)
+{
+    int left  = *(const int*)first;
+    int right = *(const int*)second;
+
+    return (left > right) - (left < right);
+}
+
+
+static void setAdd(uint64_t* set, int value)
+{
+    set[value / 64] |= (uint64_t)1 << (value % 64);
+}
+
+
+static void setRemove(uint64_t* set, int value)
+{
+    set[value / 64] &= ~((uint64_t)1 << (value % 64));
+}
+
+
+static bool setContains(const uint64_t* set, int value)
+{
+    return (set[value / 64] >> (value % 64)) & 1;
+}
@@ -0,0 +1,810 @@
+#include "register_machine.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "lexical_analysis.h"
+#include "print_ast.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct Move
+{
+    int destination;            // locations
+    int source;
+} Move;
+
+typedef struct Fixup
+{
+    size_t instruction;
+    int    target;
+    int    block;
+} Fixup;
+
+typedef struct Lowering
+{
+    const SsaFunction*        function;
+    const RegisterAllocation* allocation;
+    RegisterProgram*          program;
+    int*                      block_starts;
+    Fixup*                    fixups;
+    size_t                    fixups_number;
+    size_t                    fixups_capacity;
+    Move*                     moves;
+    int                       scratch;      // the first scratch register
+} Lowering;
+
+static bool lowerBlock(Lowering* lowering, size_t order_index);
+static bool lowerInstruction(Lowering* lowering, const SsaInstruction* instruction, int value);
+static bool lowerBranch(Lowering* lowering, const SsaInstruction* instruction, int block);
+static bool lowerEdge(Lowering* lowering, int from, int to, int line);
+static bool emitMove(Lowering* lowering, int destination, int source, int line);
+static bool useOperand(Lowering* lowering, int value, int scratch, int line, int* reg);
+static int  resultRegister(const Lowering* lowering, int value);
+static bool storeResult(Lowering* lowering, int value, int line);
+static bool emit(Lowering* lowering, RegisterInstruction instruction);
+static bool addFixup(Lowering* lowering, size_t instruction, int target, int block);
+static int  predecessorEdge(const SsaFunction* function, int block, int predecessor);
+static bool growArray(void** array, size_t* capacity, size_t element_size);
+static void dumpInstruction(const RegisterProgram* program, const RegisterInstruction* instruction,
+                            FILE* output);
+static void registerMachineError(RegisterMachine* machine, RuntimeState state,
+                                 const RegisterInstruction* instruction, Value left, Value right);
+static void sweepArena(RegisterMachine* machine);
+
+static const size_t PROGRAM_START_SIZE = 64;
+
+static inline RegisterInstruction registerInstruction(RegisterOpcode opcode, int line)
+{
+    return (RegisterInstruction){
+        .opcode      = opcode,
+        .operation   = 0,
+        .destination = NO_LOCATION,
+        .operands    = {NO_LOCATION, NO_LOCATION},
+        .argument    = 0,
+        .targets     = {0, 0},
+        .line        = line,
+    };
+}
+
+
+// public ---------------------------------------------------------------------
+
+
+RegisterMachineState lowerToRegisters(const SsaFunction* function,
+                                      const RegisterAllocation* allocation,
+                                      RegisterProgram* program)
+{
+    assert(function   != NULL);
+    assert(allocation != NULL);
+    assert(program    != NULL);
+
+    *program = (RegisterProgram){};
+    program->constants        = function->constants;
+    program->registers_number = allocation->registers_number;
+    program->slots_number     = allocation->spill_slots;
+
+    Lowering lowering = {
+        .function        = function,
+        .allocation      = allocation,
+        .program         = program,
+        .block_starts    = (int*)calloc(function->blocks_number + 1, sizeof(int)),
+        .fixups          = NULL,
+        .fixups_number   = 0,
+        .fixups_capacity = 0,
+        .moves           = (Move*)malloc((function->instructions_number + 1) * sizeof(Move)),
+        .scratch         = allocation->registers_number - SCRATCH_REGISTERS,
+    };
+
+    bool lowered = lowering.block_starts != NULL && lowering.moves != NULL;
+    for (size_t i = 0; lowered && i < allocation->order_number; i++)
+    {
+        lowered = lowerBlock(&lowering, i);
+    }
+
+    for (size_t i = 0; lowered && i < lowering.fixups_number; i++)
+    {
+        const Fixup* fixup = &lowering.fixups[i];
+        program->code[fixup->instruction].targets[fixup->target] =
+            lowering.block_starts[fixup->block];
+    }
+
+    free(lowering.block_starts);
+    free(lowering.fixups);
+    free(lowering.moves);
+
+    if (!lowered)
+    {
+        registerProgramDtor(program);
+        return RegisterMachineState_MEMORY_ERROR;
+    }
+
+    return RegisterMachineState_OK;
+}
+
+
+void registerProgramDtor(RegisterProgram* program)
+{
+    assert(program != NULL);
+
+    free(program->code);
+    *program = (RegisterProgram){};
+}
+
+
+void registerProgramDump(const RegisterProgram* program, FILE* output)
+{
+    assert(program != NULL);
+    assert(output  != NULL);
+
+    fprintf(output, "; %lu instructions, %lu moves, %lu spills, %lu reloads, %lu slots\n",
+            program->code_size,
+            program->moves,
+            program->spills,
+            program->reloads,
+            program->slots_number);
+
+    for (size_t i = 0; i < program->code_size; i++)
+    {
+        fprintf(output, "%05lu  ", i);
+        dumpInstruction(program, &program->code[i], output);
+        fputc('\n', output);
+    }
+}
+
+
+RegisterMachineState registerMachineCtor(RegisterMachine* machine,
+                                         const RegisterProgram* program, FILE* output)
+{
+    assert(machine != NULL);
+    assert(program != NULL);
+    assert(output  != NULL);
+
+    *machine = (RegisterMachine){};
+    machine->program = program;
+    machine->output  = output;
+    arenaCtor(&machine->arena);
+
+    machine->registers = (Value*)calloc((size_t)program->registers_number + 1, sizeof(Value));
+    machine->slots     = (Value*)calloc(program->slots_number + 1, sizeof(Value));
+    if (machine->registers == NULL || machine->slots == NULL)
+    {
+        machine->state = RegisterMachineState_MEMORY_ERROR;
+        return machine->state;
+    }
+
+    return RegisterMachineState_OK;
+}
+
+
+__attribute__((no_sanitize("float-divide-by-zero")))
+RegisterMachineState registerMachineRun(RegisterMachine* machine)
+{
+    assert(machine != NULL);
+
+    if (machine->state != RegisterMachineState_OK)
+    {
+        return machine->state;
+    }
+
+    const RegisterInstruction* code = machine->program->code;
+    const Value* constants = machine->program->constants;
+    Value* registers = machine->registers;
+    Value* slots     = machine->slots;
+
+    size_t pc = 0;
+    while (pc < machine->program->code_size)
+    {
+        const RegisterInstruction* instruction = &code[pc++];
+        switch (instruction->opcode)
+        {
+            case RegisterOpcode_LOAD_CONSTANT:
+                registers[instruction->destination] = constants[instruction->argument];
+                break;
+
+            case RegisterOpcode_MOVE:
+                registers[instruction->destination] = registers[instruction->operands[0]];
+                break;
+
+            case RegisterOpcode_UNARY:
+            {
+                if (arenaShouldSweep(&machine->arena))
+                {
+                    sweepArena(machine);
+                }
+
+                Value operand = registers[instruction->operands[0]];
+                RuntimeState state = valueUnaryOperation(instruction->operation, operand,
+                                                         &machine->arena,
+                                                         &registers[instruction->destination]);
+                if (state != RuntimeState_OK)
+                {
+                    registerMachineError(machine, state, instruction, operand, operand);
+                    return machine->state;
+                }
+                break;
+            }
+
+            case RegisterOpcode_BINARY:
+            {
+                if (arenaShouldSweep(&machine->arena))
+                {
+                    sweepArena(machine);
+                }
+
+                Value left  = registers[instruction->operands[0]];
+                Value right = registers[instruction->operands[1]];
+                RuntimeState state = valueBinaryOperation(instruction->operation, left, right,
+                                                          &machine->arena,
+                                                          &registers[instruction->destination]);
+                if (state != RuntimeState_OK)
+                {
+                    registerMachineError(machine, state, instruction, left, right);
+                    return machine->state;
+                }
+                break;
+            }
+
+            case RegisterOpcode_TRUTHY:
+                registers[instruction->destination] =
+                    valueBool(valueIsTruthy(registers[instruction->operands[0]]));
+                break;
+
+            case RegisterOpcode_PRINT:
+                valuePrint(machine->output, registers[instruction->operands[0]]);
+                fputc('\n', machine->output);
+                break;
+
+            case RegisterOpcode_JUMP:
+                pc = (size_t)instruction->targets[0];
+                break;
+
+            case RegisterOpcode_BRANCH:
+                pc = (size_t)(valueIsTruthy(registers[instruction->operands[0]])
+                            ? instruction->targets[0]
+                            : instruction->targets[1]);
+                break;
+
+            case RegisterOpcode_RETURN:
+                return machine->state;
+
+            case RegisterOpcode_SPILL:
+                slots[instruction->argument] = registers[instruction->operands[0]];
+                break;
+
+            case RegisterOpcode_RELOAD:
+                registers[instruction->destination] = slots[instruction->argument];
+                break;
+
+            default:
+                assert(0 && "Unknown register opcode");
+                return machine->state;
+        }
+    }
+
+    return machine->state;
+}
+
+
+void registerMachineDtor(RegisterMachine* machine)
+{
+    assert(machine != NULL);
+
+    free(machine->registers);
+    free(machine->slots);
+    arenaDtor(&machine->arena);
+
+    machine->registers = NULL;
+    machine->slots     = NULL;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static bool lowerBlock(Lowering* lowering, size_t order_index)
+{
+    assert(lowering != NULL);
+
+    const SsaFunction* function = lowering->function;
+    int block = lowering->allocation->order[order_index];
+    const SsaBlock* data = &function->blocks[block];
+    lowering->block_starts[block] = (int)lowering->program->code_size;
+
+    for (int k = data->phis_number; k < data->size; k++)
+    {
+        int value = function->schedule[data->first + k];
+        const SsaInstruction* instruction = &function->instructions[value];
+
+        switch (instruction->opcode)
+        {
+            case SsaOpcode_JUMP:
+            {
+                int successor = data->successors[0];
+                if (!lowerEdge(lowering, block, successor, instruction->line))
+                {
+                    return false;
+                }
+
+                // The next block in the order needs no jump.
+                bool next = order_index + 1 < lowering->allocation->order_number
+                         && lowering->allocation->order[order_index + 1] == successor;
+                if (next)
+                {
+                    return true;
+                }
+                return emit(lowering, registerInstruction(RegisterOpcode_JUMP, instruction->line))
+                    && addFixup(lowering, lowering->program->code_size - 1, 0, successor);
+            }
+
+            case SsaOpcode_BRANCH:
+                return lowerBranch(lowering, instruction, block);
+
+            case SsaOpcode_RETURN:
+                return emit(lowering,
+                            registerInstruction(RegisterOpcode_RETURN, instruction->line));
+
+            default:
+                if (!lowerInstruction(lowering, instruction, value))
+                {
+                    return false;
+                }
+                break;
+        }
+    }
+
+    return emit(lowering, registerInstruction(RegisterOpcode_RETURN, 0));
+}
+
+
+static bool lowerInstruction(Lowering* lowering, const SsaInstruction* instruction, int value)
+{
+    assert(lowering    != NULL);
+    assert(instruction != NULL);
+
+    int line = instruction->line;
+    RegisterInstruction lowered = registerInstruction(RegisterOpcode_LOAD_CONSTANT, line);
+
+    switch (instruction->opcode)
+    {
+        case SsaOpcode_CONSTANT:
+            lowered.argument = instruction->argument;
+            break;
+
+        case SsaOpcode_UNARY:
+        case SsaOpcode_TRUTHY:
+            lowered.opcode = instruction->opcode == SsaOpcode_UNARY
+                           ? RegisterOpcode_UNARY
+                           : RegisterOpcode_TRUTHY;
+            lowered.operation = instruction->operation;
+            if (!useOperand(lowering, instruction->operands[0], 0, line, &lowered.operands[0]))
+            {
+                return false;
+            }
+            break;
+
+        case SsaOpcode_BINARY:
+            lowered.opcode    = RegisterOpcode_BINARY;
+            lowered.operation = instruction->operation;
+            if (!useOperand(lowering, instruction->operands[0], 0, line, &lowered.operands[0])
+             || !useOperand(lowering, instruction->operands[1], 1, line, &lowered.operands[1]))
+            {
+                return false;
+            }
+            break;
+
+        case SsaOpcode_PRINT:
+            lowered.opcode = RegisterOpcode_PRINT;
+            return useOperand(lowering, instruction->operands[0], 0, line, &lowered.operands[0])
+                && emit(lowering, lowered);
+
+        case SsaOpcode_PHI:
+        case SsaOpcode_NOP:
+        default:
+            return true;
+    }
+
+    lowered.destination = resultRegister(lowering, value);
+
+    return emit(lowering, lowered) && storeResult(lowering, value, line);
+}
+
+
+// An edge into a block with phis gets a stub after the branch that copies
+// the arguments and jumps on.
+static bool lowerBranch(Lowering* lowering, const SsaInstruction* instruction, int block)
+{
+    assert(lowering    != NULL);
+    assert(instruction != NULL);
+
+    const SsaBlock* data = &lowering->function->blocks[block];
+    RegisterInstruction branch = registerInstruction(RegisterOpcode_BRANCH, instruction->line);
+    if (!useOperand(lowering, instruction->operands[0], 0, instruction->line, &branch.operands[0])
+     || !emit(lowering, branch))
+    {
+        return false;
+    }
+
+    size_t branch_index = lowering->program->code_size - 1;
+    for (int s = 0; s < 2; s++)
+    {
+        int successor = data->successors[s];
+        if (lowering->function->blocks[successor].phis_number == 0)
+        {
+            if (!addFixup(lowering, branch_index, s, successor))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        lowering->program->code[branch_index].targets[s] = (int)lowering->program->code_size;
+        if (!lowerEdge(lowering, block, successor, instruction->line)
+         || !emit(lowering, registerInstruction(RegisterOpcode_JUMP, instruction->line))
+         || !addFixup(lowering, lowering->program->code_size - 1, 0, successor))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// Emits a copy whose destination no pending copy still reads while there
+// is one; otherwise only cycles are left, and one of their destinations is
+// saved to the scratch register so that its copy can go first.
+static bool lowerEdge(Lowering* lowering, int from, int to, int line)
+{
+    assert(lowering != NULL);
+
+    const SsaFunction* function = lowering->function;
+    const int* locations = lowering->allocation->locations;
+    const SsaBlock* data = &function->blocks[to];
+    int edge = predecessorEdge(function, to, from);
+    if (edge < 0)
+    {
+        return true;
+    }
+
+    Move* moves = lowering->moves;
+    size_t moves_number = 0;
+    for (int p = 0; p < data->phis_number; p++)
+    {
+        const SsaInstruction* phi = ssaBlockInstruction(function, data, p);
+        int destination = locations[function->schedule[data->first + p]];
+        int source      = locations[function->phi_arguments[phi->argument + edge]];
+        if (destination != source)
+        {
+            moves[moves_number++] = (Move){.destination = destination, .source = source};
+        }
+    }
+
+    lowering->program->moves += moves_number;
+
+    while (moves_number > 0)
+    {
+        size_t ready = moves_number;
+        for (size_t i = 0; i < moves_number && ready == moves_number; i++)
+        {
+            bool read = false;
+            for (size_t j = 0; j < moves_number && !read; j++)
+            {
+                read = moves[j].source == moves[i].destination;
+            }
+            if (!read)
+            {
+                ready = i;
+            }
+        }
+
+        if (ready < moves_number)
+        {
+            if (!emitMove(lowering, moves[ready].destination, moves[ready].source, line))
+            {
+                return false;
+            }
+            moves[ready] = moves[--moves_number];
+            continue;
+        }
+
+        int saved = moves[0].destination;
+        if (!emitMove(lowering, lowering->scratch, saved, line))
+        {
+            return false;
+        }
+        for (size_t j = 0; j < moves_number; j++)
+        {
+            if (moves[j].source == saved)
+            {
+                moves[j].source = lowering->scratch;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+static bool emitMove(Lowering* lowering, int destination, int source, int line)
+{
+    assert(lowering != NULL);
+
+    RegisterInstruction move = registerInstruction(RegisterOpcode_MOVE, line);
+    if (locationIsRegister(destination) && locationIsRegister(source))
+    {
+        move.destination = destination;
+        move.operands[0] = source;
+        return emit(lowering, move);
+    }
+
+    // A slot to slot copy goes through the second scratch register.
+    int reg = source;
+    if (!locationIsRegister(source))
+    {
+        reg = locationIsRegister(destination) ? destination : lowering->scratch + 1;
+        move.opcode      = RegisterOpcode_RELOAD;
+        move.destination = reg;
+        move.argument    = locationSlot(source);
+        lowering->program->reloads++;
+        if (!emit(lowering, move))
+        {
+            return false;
+        }
+        if (reg == destination)
+        {
+            return true;
+        }
+    }
+
+    RegisterInstruction spill = registerInstruction(RegisterOpcode_SPILL, line);
+    spill.operands[0] = reg;
+    spill.argument    = locationSlot(destination);
+    lowering->program->spills++;
+
+    return emit(lowering, spill);
+}
+
+
+static bool useOperand(Lowering* lowering, int value, int scratch, int line, int* reg)
+{
+    assert(lowering != NULL);
+    assert(reg      != NULL);
+
+    int location = lowering->allocation->locations[value];
+    if (locationIsRegister(location))
+    {
+        *reg = location;
+        return true;
+    }
+
+    RegisterInstruction reload = registerInstruction(RegisterOpcode_RELOAD, line);
+    reload.destination = lowering->scratch + scratch;
+    reload.argument    = locationSlot(location);
+    lowering->program->reloads++;
+    *reg = reload.destination;
+
+    return emit(lowering, reload);
+}
+
+
+static int resultRegister(const Lowering* lowering, int value)
+{
+    assert(lowering != NULL);
+
+    int location = lowering->allocation->locations[value];
+    return locationIsRegister(location) ? location : lowering->scratch;
+}
+
+
+static bool storeResult(Lowering* lowering, int value, int line)
+{
+    assert(lowering != NULL);
+
+    int location = lowering->allocation->locations[value];
+    if (locationIsRegister(location))
+    {
+        return true;
+    }
+
+    RegisterInstruction spill = registerInstruction(RegisterOpcode_SPILL, line);
+    spill.operands[0] = lowering->scratch;
+    spill.argument    = locationSlot(location);
+    lowering->program->spills++;
+
+    return emit(lowering, spill);
+}
+
+
+static bool emit(Lowering* lowering, RegisterInstruction instruction)
+{
+    assert(lowering != NULL);
+
+    RegisterProgram* program = lowering->program;
+    if (program->code_size == program->code_capacity
+     && !growArray((void**)&program->code, &program->code_capacity, sizeof(RegisterInstruction)))
+    {
+        return false;
+    }
+
+    program->code[program->code_size++] = instruction;
+
+    return true;
+}
+
+
+static bool addFixup(Lowering* lowering, size_t instruction, int target, int block)
+{
+    assert(lowering != NULL);
+
+    if (lowering->fixups_number == lowering->fixups_capacity
+     && !growArray((void**)&lowering->fixups, &lowering->fixups_capacity, sizeof(Fixup)))
+    {
+        return false;
+    }
+
+    lowering->fixups[lowering->fixups_number++] = (Fixup){
+        .instruction = instruction,
+        .target      = target,
+        .block       = block,
+    };
+
+    return true;
+}
+
+
+static int predecessorEdge(const SsaFunction* function, int block, int predecessor)
+{
+    assert(function != NULL);
+
+    const SsaBlock* data = &function->blocks[block];
+    for (int p = 0; p < data->predecessors_number; p++)
+    {
+        if (function->predecessors[data->first_predecessor + p] == predecessor)
+        {
+            return p;
+        }
+    }
+
+    return -1;
+}
+
+
+static bool growArray(void** array, size_t* capacity, size_t element_size)
+{
+    assert(array    != NULL);
+    assert(capacity != NULL);
+
+    size_t new_capacity = *capacity == 0 ? PROGRAM_START_SIZE : *capacity * 2;
+    void* new_array = realloc(*array, new_capacity * element_size);
+    if (new_array == NULL)
+    {
+        return false;
+    }
+
+    *array    = new_array;
+    *capacity = new_capacity;
+
+    return true;
+}
+
+
+static void dumpInstruction(const RegisterProgram* program, const RegisterInstruction* instruction,
+                            FILE* output)
+{
+    assert(program     != NULL);
+    assert(instruction != NULL);
+    assert(output      != NULL);
+
+    switch (instruction->opcode)
+    {
+        case RegisterOpcode_LOAD_CONSTANT:
+            fprintf(output, "r%d = ", instruction->destination);
+            valuePrint(output, program->constants[instruction->argument]);
+            break;
+
+        case RegisterOpcode_MOVE:
+            fprintf(output, "r%d = r%d", instruction->destination, instruction->operands[0]);
+            break;
+
+        case RegisterOpcode_UNARY:
+            fprintf(output, "r%d = %s r%d", instruction->destination,
+                    tokenTypeToString(instruction->operation), instruction->operands[0]);
+            break;
+
+        case RegisterOpcode_BINARY:
+            fprintf(output, "r%d = r%d %s r%d", instruction->destination, instruction->operands[0],
+                    tokenTypeToString(instruction->operation), instruction->operands[1]);
+            break;
+
+        case RegisterOpcode_TRUTHY:
+            fprintf(output, "r%d = truthy r%d", instruction->destination, instruction->operands[0]);
+            break;
+
+        case RegisterOpcode_PRINT:
+            fprintf(output, "print r%d", instruction->operands[0]);
+            break;
+
+        case RegisterOpcode_JUMP:
+            fprintf(output, "jump %05d", instruction->targets[0]);
+            break;
+
+        case RegisterOpcode_BRANCH:
+            fprintf(output, "branch r%d ? %05d : %05d", instruction->operands[0],
+                    instruction->targets[0], instruction->targets[1]);
+            break;
+
+        case RegisterOpcode_RETURN:
+            fputs("return", output);
+            break;
+
+        case RegisterOpcode_SPILL:
+            fprintf(output, "slot %d = r%d", instruction->argument, instruction->operands[0]);
+            break;
+
+        case RegisterOpcode_RELOAD:
+            fprintf(output, "r%d = slot %d", instruction->destination, instruction->argument);
+            break;
+
+        default:
+            fputs("?", output);
+            break;
+    }
+}
+
+
+static void registerMachineError(RegisterMachine* machine, RuntimeState state,
+                                 const RegisterInstruction* instruction, Value left, Value right)
+{
+    assert(machine     != NULL);
+    assert(instruction != NULL);
+
+    int line = instruction->line;
+    const char* operation = tokenTypeToString(instruction->operation);
+
+    if (state == RuntimeState_MEMORY_ERROR)
+    {
+        snprintf(machine->error_message, sizeof(machine->error_message),
+                 "Runtime error: out of memory (line %d)", line);
+        machine->state = RegisterMachineState_MEMORY_ERROR;
+        return;
+    }
+
+    if (state == RuntimeState_INDEX_ERROR || state == RuntimeState_LENGTH_ERROR
+     || state == RuntimeState_SIZE_ERROR)
+    {
+        snprintf(machine->error_message, sizeof(machine->error_message),
+                 "Runtime error: %s (line %d)", runtimeStateToString(state), line);
+    }
+    else if (instruction->opcode == RegisterOpcode_UNARY)
+    {
+        snprintf(machine->error_message, sizeof(machine->error_message),
+                 "Runtime error: cannot apply '%s' to %s (line %d)",
+                 operation, valueTypeToString(valueType(left)), line);
+    }
+    else
+    {
+        snprintf(machine->error_message, sizeof(machine->error_message),
+                 "Runtime error: cannot apply '%s' to %s and %s (line %d)",
+                 operation,
+                 valueTypeToString(valueType(left)),
+                 valueTypeToString(valueType(right)),
+                 line);
+    }
+
+    machine->state = RegisterMachineState_RUNTIME_ERROR;
+}
+
+
+// The registers, scratch ones included, and the spill slots hold every
+// value the code can still read.
+static void sweepArena(RegisterMachine* machine)
+{
+    assert(machine != NULL);
+
+    valueMarkAll(machine->registers, (size_t)machine->program->registers_number);
+    valueMarkAll(machine->slots, machine->program->slots_number);
+    arenaSweep(&machine->arena);
+}
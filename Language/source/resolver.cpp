@@ -0,0 +1,316 @@
+#include "resolver.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tree_node_structure.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct SlotTable
+{
+    int*   entries;     // slot indices, NO_SLOT marks an empty bucket
+    size_t capacity;
+} SlotTable;
+
+typedef struct NodeStack
+{
+    int*   items;
+    size_t size;
+    size_t capacity;
+} NodeStack;
+
+static bool collectNodes(Tree* ast, NodeStack* order);
+static bool nodeStackPush(NodeStack* stack, int node_index);
+static uint64_t hashName(const char* name);
+static int* findBucket(SlotTable* table, const Resolution* resolution, const char* name);
+static int defineSlot(SlotTable* table, Resolution* resolution, const char* name);
+static bool growTable(SlotTable* table, const Resolution* resolution);
+
+static const size_t SLOT_TABLE_START_SIZE = 64;
+static const size_t NODE_STACK_START_SIZE = 64;
+
+
+// public ---------------------------------------------------------------------
+
+
+ResolverState resolveProgram(Tree* ast, Resolution* resolution)
+{
+    assert(ast        != NULL);
+    assert(resolution != NULL);
+
+    *resolution = (Resolution){};
+    resolution->nodes_number = ast->nodes_number;
+    resolution->node_slots   = (int*)malloc((ast->nodes_number + 1) * sizeof(int));
+    resolution->slot_names   = (const char**)calloc(ast->nodes_number + 1, sizeof(const char*));
+    if (resolution->node_slots == NULL || resolution->slot_names == NULL)
+    {
+        resolutionDtor(resolution);
+        return ResolverState_MEMORY_ERROR;
+    }
+
+    for (size_t i = 0; i < ast->nodes_number; i++)
+    {
+        resolution->node_slots[i] = NO_SLOT;
+    }
+
+    NodeStack order = {};
+    SlotTable table = {};
+    ResolverState state = ResolverState_OK;
+
+    if (!collectNodes(ast, &order) || !growTable(&table, resolution))
+    {
+        state = ResolverState_MEMORY_ERROR;
+    }
+
+    // Targets first: a variable may be read textually before the statement
+    // that assigns it (inside a loop), and it then starts out as 0.
+    for (size_t i = 0; i < order.size && state == ResolverState_OK; i++)
+    {
+        TreeNode node = ast->nodes_array[order.items[i]];
+        if (node.data.type != SyntaxNodeType_VAR_DECLARATION
+         && node.data.type != SyntaxNodeType_ASSIGNMENT)
+        {
+            continue;
+        }
+
+        int name_node = node.left_index;
+        int slot = defineSlot(&table, resolution, ast->nodes_array[name_node].data.data.identifier);
+        if (slot == NO_SLOT)
+        {
+            state = ResolverState_MEMORY_ERROR;
+        }
+        resolution->node_slots[name_node] = slot;
+    }
+
+    for (size_t i = 0; i < order.size && state == ResolverState_OK; i++)
+    {
+        int node_index = order.items[i];
+        TreeNode node = ast->nodes_array[node_index];
+        if (node.data.type != SyntaxNodeType_IDENTIFIER
+         || resolution->node_slots[node_index] != NO_SLOT)
+        {
+            continue;
+        }
+
+        int* bucket = findBucket(&table, resolution, node.data.data.identifier);
+        if (*bucket == NO_SLOT)
+        {
+            fprintf(stderr, "Error: undefined variable '%s' (line %d)\n",
+                    node.data.data.identifier, node.data.line);
+            state = ResolverState_UNDEFINED_VARIABLE;
+            break;
+        }
+
+        resolution->node_slots[node_index] = *bucket;
+    }
+
+    free(order.items);
+    free(table.entries);
+
+    if (state != ResolverState_OK)
+    {
+        resolutionDtor(resolution);
+    }
+
+    return state;
+}
+
+
+int resolutionFindSlot(const Resolution* resolution, const char* name)
+{
+    assert(resolution != NULL);
+    assert(name       != NULL);
+
+    for (size_t slot = 0; slot < resolution->slots_number; slot++)
+    {
+        if (strcmp(resolution->slot_names[slot], name) == 0)
+        {
+            return (int)slot;
+        }
+    }
+
+    return NO_SLOT;
+}
+
+
+size_t resolutionFirstFreeTemporary(const Resolution* resolution)
+{
+    assert(resolution != NULL);
+
+    size_t prefix_length = strlen(TEMPORARY_PREFIX);
+    size_t first_free    = 0;
+    for (size_t slot = 0; slot < resolution->slots_number; slot++)
+    {
+        const char* name = resolution->slot_names[slot];
+        if (strncmp(name, TEMPORARY_PREFIX, prefix_length) == 0)
+        {
+            size_t number = strtoul(name + prefix_length, NULL, 10);
+            if (number >= first_free)
+            {
+                first_free = number + 1;
+            }
+        }
+    }
+
+    return first_free;
+}
+
+
+void resolutionDtor(Resolution* resolution)
+{
+    if (resolution == NULL)
+    {
+        return;
+    }
+
+    free(resolution->node_slots);
+    free(resolution->slot_names);
+    *resolution = (Resolution){};
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static bool collectNodes(Tree* ast, NodeStack* order)
+{
+    assert(ast   != NULL);
+    assert(order != NULL);
+
+    if (ast->nodes_number == 0)
+    {
+        return true;
+    }
+
+    NodeStack stack = {};
+    bool success = nodeStackPush(&stack, 0);
+
+    while (success && stack.size > 0)
+    {
+        int node_index = stack.items[--stack.size];
+        TreeNode node = ast->nodes_array[node_index];
+
+        success = nodeStackPush(order, node_index)
+               && (node.right_index == EMPTY_NODE || nodeStackPush(&stack, node.right_index))
+               && (node.left_index  == EMPTY_NODE || nodeStackPush(&stack, node.left_index));
+    }
+
+    free(stack.items);
+    return success;
+}
+
+
+static bool nodeStackPush(NodeStack* stack, int node_index)
+{
+    assert(stack != NULL);
+
+    if (stack->size == stack->capacity)
+    {
+        size_t new_capacity = stack->capacity == 0 ? NODE_STACK_START_SIZE : stack->capacity * 2;
+        int* new_items = (int*)realloc(stack->items, new_capacity * sizeof(int));
+        if (new_items == NULL)
+        {
+            return false;
+        }
+
+        stack->items    = new_items;
+        stack->capacity = new_capacity;
+    }
+
+    stack->items[stack->size++] = node_index;
+    return true;
+}
+
+
+static uint64_t hashName(const char* name)
+{
+    assert(name != NULL);
+
+    uint64_t hash = 14695981039346656037ull;
+    for (; *name != '\0'; name++)
+    {
+        hash ^= (unsigned char)*name;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+
+static int* findBucket(SlotTable* table, const Resolution* resolution, const char* name)
+{
+    assert(table      != NULL);
+    assert(resolution != NULL);
+    assert(name       != NULL);
+
+    size_t mask  = table->capacity - 1;
+    size_t index = (size_t)hashName(name) & mask;
+
+    while (table->entries[index] != NO_SLOT
+        && strcmp(resolution->slot_names[table->entries[index]], name) != 0)
+    {
+        index = (index + 1) & mask;
+    }
+
+    return &table->entries[index];
+}
+
+
+static int defineSlot(SlotTable* table, Resolution* resolution, const char* name)
+{
+    assert(table      != NULL);
+    assert(resolution != NULL);
+    assert(name       != NULL);
+
+    int* bucket = findBucket(table, resolution, name);
+    if (*bucket != NO_SLOT)
+    {
+        return *bucket;
+    }
+
+    int slot = (int)resolution->slots_number++;
+    resolution->slot_names[slot] = name;
+    *bucket = slot;
+
+    if (resolution->slots_number * 2 > table->capacity && !growTable(table, resolution))
+    {
+        return NO_SLOT;
+    }
+
+    return slot;
+}
+
+
+static bool growTable(SlotTable* table, const Resolution* resolution)
+{
+    assert(table      != NULL);
+    assert(resolution != NULL);
+
+    size_t new_capacity = table->capacity == 0 ? SLOT_TABLE_START_SIZE : table->capacity * 2;
+    int* new_entries = (int*)malloc(new_capacity * sizeof(int));
+    if (new_entries == NULL)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < new_capacity; i++)
+    {
+        new_entries[i] = NO_SLOT;
+    }
+
+    free(table->entries);
+    table->entries  = new_entries;
+    table->capacity = new_capacity;
+
+    for (size_t slot = 0; slot < resolution->slots_number; slot++)
+    {
+        *findBucket(table, resolution, resolution->slot_names[slot]) = (int)slot;
+    }
+
+    return true;
+}
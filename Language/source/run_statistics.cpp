@@ -0,0 +1,432 @@
+#include "run_statistics.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+    #include <malloc.h>
+#endif
+
+#include "tree_node_structure.h"
+
+// The bytes in use on the heap come from the sanitizer runtime when there
+// is one, since its allocator replaces glibc's, and from glibc's mallinfo2
+// otherwise.
+#if defined(__SANITIZE_ADDRESS__)
+    #define RUN_STATISTICS_SANITIZED
+#endif
+#if defined(__has_feature)
+    #if __has_feature(address_sanitizer) && !defined(RUN_STATISTICS_SANITIZED)
+        #define RUN_STATISTICS_SANITIZED
+    #endif
+#endif
+
+#if defined(RUN_STATISTICS_SANITIZED)
+    #define RUN_STATISTICS_HEAP_FROM_SANITIZER
+#elif defined(__GLIBC__)
+    #define RUN_STATISTICS_HEAP_FROM_MALLINFO
+#endif
+
+// Counting the calls means replacing malloc, calloc and realloc for the
+// whole process with versions that count and call glibc's own, so only
+// builds with -DRUN_STATISTICS_COUNT_ALLOCATIONS do it, and never with a
+// sanitizer, which must see every call. free is left alone, since the
+// memory still comes from glibc.
+#if defined(RUN_STATISTICS_COUNT_ALLOCATIONS) && (defined(RUN_STATISTICS_SANITIZED) || !defined(__GLIBC__))
+    #undef RUN_STATISTICS_COUNT_ALLOCATIONS
+#endif
+
+// Why the report's allocation counts are null, so a reader of the JSON
+// alone can tell a build that does not count from a phase that made no
+// calls.
+#if defined(RUN_STATISTICS_COUNT_ALLOCATIONS)
+    static const char* const ALLOCATIONS_NOT_COUNTED_BECAUSE = NULL;
+#elif defined(RUN_STATISTICS_SANITIZED)
+    static const char* const ALLOCATIONS_NOT_COUNTED_BECAUSE =
+        "sanitizer build: its allocator must see every call";
+#elif !defined(__GLIBC__)
+    static const char* const ALLOCATIONS_NOT_COUNTED_BECAUSE =
+        "not built against glibc, whose malloc the counters wrap";
+#else
+    static const char* const ALLOCATIONS_NOT_COUNTED_BECAUSE =
+        "built without -DRUN_STATISTICS_COUNT_ALLOCATIONS";
+#endif
+
+
+// static ---------------------------------------------------------------------
+
+
+static PhaseStatistics measureNow(const RunStatistics* statistics);
+static double secondsOf(clockid_t clock);
+static void writeJsonString(FILE* output, const char* text);
+static void writePhase(FILE* output, const RunStatistics* statistics,
+                       const PhaseStatistics* phase);
+static void writeEvents(FILE* output, const RunStatistics* statistics,
+                        const PhaseStatistics* phase);
+static int64_t heapBytesInUse(void);
+
+#ifdef RUN_STATISTICS_HEAP_FROM_SANITIZER
+extern "C" size_t __sanitizer_get_current_allocated_bytes(void);
+#endif
+
+#ifdef RUN_STATISTICS_COUNT_ALLOCATIONS
+
+extern "C" void* __libc_malloc(size_t size) noexcept;
+extern "C" void* __libc_calloc(size_t number, size_t size) noexcept;
+extern "C" void* __libc_realloc(void* pointer, size_t size) noexcept;
+
+// Relaxed atomics: any thread may allocate, and only the totals matter.
+static uint64_t allocations_number = 0;
+static uint64_t allocated_bytes    = 0;
+
+extern "C" void* malloc(size_t size) noexcept
+{
+    __atomic_fetch_add(&allocations_number, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocated_bytes, size, __ATOMIC_RELAXED);
+
+    return __libc_malloc(size);
+}
+
+
+extern "C" void* calloc(size_t number, size_t size) noexcept
+{
+    __atomic_fetch_add(&allocations_number, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocated_bytes, number * size, __ATOMIC_RELAXED);
+
+    return __libc_calloc(number, size);
+}
+
+
+extern "C" void* realloc(void* pointer, size_t size) noexcept
+{
+    __atomic_fetch_add(&allocations_number, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocated_bytes, size, __ATOMIC_RELAXED);
+
+    return __libc_realloc(pointer, size);
+}
+
+#endif
+
+
+// public ---------------------------------------------------------------------
+
+
+void runStatisticsBeginPhase(RunStatistics* statistics, const char* name)
+{
+    assert(statistics != NULL);
+    assert(name       != NULL);
+    assert(!statistics->measuring);
+
+    statistics->started      = measureNow(statistics);
+    statistics->started.name = name;
+    statistics->measuring    = true;
+}
+
+
+void runStatisticsEndPhase(RunStatistics* statistics)
+{
+    assert(statistics != NULL);
+    assert(statistics->measuring);
+
+    PhaseStatistics now = measureNow(statistics);
+    const PhaseStatistics* started = &statistics->started;
+    statistics->measuring = false;
+
+    if (statistics->phases_number == RUN_STATISTICS_MAX_PHASES)
+    {
+        return;
+    }
+
+    PhaseStatistics* phase = &statistics->phases[statistics->phases_number++];
+    *phase = (PhaseStatistics){
+        .name            = started->name,
+        .wall_seconds    = now.wall_seconds    - started->wall_seconds,
+        .cpu_seconds     = now.cpu_seconds     - started->cpu_seconds,
+        .allocations     = now.allocations     - started->allocations,
+        .allocated_bytes = now.allocated_bytes - started->allocated_bytes,
+        .heap_bytes      = now.heap_bytes      - started->heap_bytes,
+    };
+    for (size_t event = 0; event < HARDWARE_EVENTS_NUMBER; event++)
+    {
+        phase->events[event] = now.events[event] - started->events[event];
+    }
+}
+
+
+void runStatisticsCountTree(RunStatistics* statistics, const Tree* ast)
+{
+    assert(statistics != NULL);
+    assert(ast        != NULL);
+
+    if (statistics->nodes_capacity == 0)
+    {
+        statistics->parsed_nodes_number = ast->nodes_number;
+    }
+    statistics->nodes_number   = ast->nodes_number;
+    statistics->nodes_capacity = ast->nodes_capacity;
+}
+
+
+bool runStatisticsCountsAllocations(void)
+{
+#ifdef RUN_STATISTICS_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+bool runStatisticsMeasuresHeap(void)
+{
+#if defined(RUN_STATISTICS_HEAP_FROM_SANITIZER) || defined(RUN_STATISTICS_HEAP_FROM_MALLINFO)
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+bool runStatisticsWriteJson(const RunStatistics* statistics, FILE* output, int exit_code)
+{
+    assert(statistics != NULL);
+    assert(output     != NULL);
+
+    PhaseStatistics total = {.name = "total"};
+    for (size_t phase = 0; phase < statistics->phases_number; phase++)
+    {
+        total.wall_seconds    += statistics->phases[phase].wall_seconds;
+        total.cpu_seconds     += statistics->phases[phase].cpu_seconds;
+        total.allocations     += statistics->phases[phase].allocations;
+        total.allocated_bytes += statistics->phases[phase].allocated_bytes;
+        total.heap_bytes      += statistics->phases[phase].heap_bytes;
+        for (size_t event = 0; event < HARDWARE_EVENTS_NUMBER; event++)
+        {
+            total.events[event] += statistics->phases[phase].events[event];
+        }
+    }
+
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+
+    size_t node_bytes = sizeof(TreeNode);
+    size_t unused_nodes = statistics->nodes_capacity - statistics->nodes_number;
+
+    fprintf(output, "{\n  \"source\": ");
+    writeJsonString(output, statistics->source_path);
+    fprintf(output, ",\n  \"source_bytes\": %lu,\n", statistics->source_bytes);
+    fprintf(output, "  \"tokens\": %lu,\n", statistics->tokens_number);
+    fprintf(output, "  \"exit_code\": %d,\n", exit_code);
+    fprintf(output, "  \"tree\": {\"parsed_nodes\": %lu, \"nodes\": %lu, \"capacity\": %lu, "
+                    "\"node_bytes\": %lu, \"unused_bytes\": %lu},\n",
+            statistics->parsed_nodes_number,
+            statistics->nodes_number,
+            statistics->nodes_capacity,
+            node_bytes,
+            unused_nodes * node_bytes);
+    fprintf(output, "  \"allocations_counted\": %s, \"allocations_not_counted_because\": ",
+            runStatisticsCountsAllocations() ? "true" : "false");
+    writeJsonString(output, ALLOCATIONS_NOT_COUNTED_BECAUSE);
+    fprintf(output, ",\n  \"heap_measured\": %s,\n",
+            runStatisticsMeasuresHeap() ? "true" : "false");
+    fprintf(output, "  \"hardware_counters\": %s, \"hardware_counters_error\": ",
+            statistics->counters != NULL ? "true" : "false");
+    writeJsonString(output, statistics->counters_error != 0
+                          ? strerror(statistics->counters_error)
+                          : NULL);
+    fprintf(output, ",\n");
+    fprintf(output, "  \"phases\": [\n");
+    for (size_t phase = 0; phase < statistics->phases_number; phase++)
+    {
+        fprintf(output, "    ");
+        writePhase(output, statistics, &statistics->phases[phase]);
+        fprintf(output, "%s\n", phase + 1 < statistics->phases_number ? "," : "");
+    }
+    fprintf(output, "  ],\n  \"total\": ");
+    writePhase(output, statistics, &total);
+    fprintf(output, ",\n  \"peak_rss_kb\": %ld\n}\n", usage.ru_maxrss);
+
+    return ferror(output) == 0;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static PhaseStatistics measureNow(const RunStatistics* statistics)
+{
+    assert(statistics != NULL);
+
+    PhaseStatistics now = {
+        .name         = NULL,
+        .wall_seconds = secondsOf(CLOCK_MONOTONIC),
+        .cpu_seconds  = secondsOf(CLOCK_PROCESS_CPUTIME_ID),
+    };
+
+#ifdef RUN_STATISTICS_COUNT_ALLOCATIONS
+    now.allocations     = __atomic_load_n(&allocations_number, __ATOMIC_RELAXED);
+    now.allocated_bytes = __atomic_load_n(&allocated_bytes,    __ATOMIC_RELAXED);
+#endif
+    now.heap_bytes = heapBytesInUse();
+
+    if (statistics->counters != NULL)
+    {
+        hardwareCountersRead(statistics->counters, now.events);
+    }
+
+    return now;
+}
+
+
+static double secondsOf(clockid_t clock)
+{
+    struct timespec now = {};
+    clock_gettime(clock, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+
+static void writeJsonString(FILE* output, const char* text)
+{
+    assert(output != NULL);
+
+    if (text == NULL)
+    {
+        fprintf(output, "null");
+        return;
+    }
+
+    fputc('"', output);
+    for (const char* c = text; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fprintf(output, "\\%c", *c);
+        }
+        else if ((unsigned char)*c < 0x20)
+        {
+            fprintf(output, "\\u%04x", (unsigned)(unsigned char)*c);
+        }
+        else
+        {
+            fputc(*c, output);
+        }
+    }
+    fputc('"', output);
+}
+
+
+// Allocation counts and the heap change are null rather than 0 when they
+// were not measured.
+static void writePhase(FILE* output, const RunStatistics* statistics,
+                       const PhaseStatistics* phase)
+{
+    assert(output     != NULL);
+    assert(statistics != NULL);
+    assert(phase      != NULL);
+
+    fprintf(output, "{\"name\": ");
+    writeJsonString(output, phase->name);
+    fprintf(output, ", \"wall_ms\": %.6f, \"cpu_ms\": %.6f",
+            phase->wall_seconds * 1000, phase->cpu_seconds * 1000);
+    if (runStatisticsCountsAllocations())
+    {
+        fprintf(output, ", \"allocations\": %" PRIu64 ", \"allocated_bytes\": %" PRIu64,
+                phase->allocations, phase->allocated_bytes);
+    }
+    else
+    {
+        fprintf(output, ", \"allocations\": null, \"allocated_bytes\": null");
+    }
+
+    if (runStatisticsMeasuresHeap())
+    {
+        fprintf(output, ", \"heap_change_bytes\": %" PRId64, phase->heap_bytes);
+    }
+    else
+    {
+        fprintf(output, ", \"heap_change_bytes\": null");
+    }
+
+    if (statistics->counters != NULL)
+    {
+        writeEvents(output, statistics, phase);
+    }
+    fprintf(output, "}");
+}
+
+
+// Events the CPU does not count are null, and so is what derives from them.
+static void writeEvents(FILE* output, const RunStatistics* statistics,
+                        const PhaseStatistics* phase)
+{
+    assert(output     != NULL);
+    assert(statistics != NULL);
+    assert(phase      != NULL);
+
+    const HardwareCounters* counters = statistics->counters;
+    for (size_t event = 0; event < HARDWARE_EVENTS_NUMBER; event++)
+    {
+        fprintf(output, ", \"%s\": ", hardwareEventToString((HardwareEvent)event));
+        if (hardwareCounterAvailable(counters, (HardwareEvent)event))
+        {
+            fprintf(output, "%" PRIu64, phase->events[event]);
+        }
+        else
+        {
+            fprintf(output, "null");
+        }
+    }
+
+    const uint64_t* events = phase->events;
+    fprintf(output, ", \"ipc\": ");
+    if (hardwareCounterAvailable(counters, HardwareEvent_CYCLES)
+     && hardwareCounterAvailable(counters, HardwareEvent_INSTRUCTIONS)
+     && events[HardwareEvent_CYCLES] > 0)
+    {
+        fprintf(output, "%.3f", (double)events[HardwareEvent_INSTRUCTIONS]
+                              / (double)events[HardwareEvent_CYCLES]);
+    }
+    else
+    {
+        fprintf(output, "null");
+    }
+
+    bool per_token = phase->name != NULL
+                  && (strcmp(phase->name, "lex") == 0 || strcmp(phase->name, "parse") == 0);
+    size_t items = per_token ? statistics->tokens_number : statistics->parsed_nodes_number;
+    fprintf(output, ", \"%s\": {", per_token ? "per_token" : "per_node");
+    for (size_t event = 0; event < HARDWARE_EVENTS_NUMBER; event++)
+    {
+        fprintf(output, "%s\"%s\": ", event > 0 ? ", " : "",
+                hardwareEventToString((HardwareEvent)event));
+        if (hardwareCounterAvailable(counters, (HardwareEvent)event) && items > 0)
+        {
+            fprintf(output, "%.3f", (double)phase->events[event] / (double)items);
+        }
+        else
+        {
+            fprintf(output, "null");
+        }
+    }
+    fprintf(output, "}");
+}
+
+
+// Blocks glibc has handed out and not got back, from its arenas and from
+// mmap, or the bytes the sanitizer's allocator holds for the program.
+static int64_t heapBytesInUse(void)
+{
+#if defined(RUN_STATISTICS_HEAP_FROM_SANITIZER)
+    return (int64_t)__sanitizer_get_current_allocated_bytes();
+#elif defined(RUN_STATISTICS_HEAP_FROM_MALLINFO)
+    struct mallinfo2 info = mallinfo2();
+    return (int64_t)(info.uordblks + info.hblkhd);
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,1437 @@
+#include "ssa.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tree_node_structure.h"
+#include "lexical_analysis.h"
+#include "print_ast.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef struct BlockBuilder
+{
+    int*   predecessors;
+    size_t predecessors_number;
+    size_t predecessors_capacity;
+    bool   sealed;
+} BlockBuilder;
+
+typedef struct Definition
+{
+    int block;      // NO_BLOCK marks an empty bucket
+    int slot;
+    int value;
+} Definition;
+
+typedef struct IncompletePhi
+{
+    int block;
+    int slot;
+    int phi;
+} IncompletePhi;
+
+typedef struct SsaBuilder
+{
+    Tree*          ast;
+    Resolution     resolution;
+    SsaFunction*   function;
+    SsaState       state;
+
+    BlockBuilder*  block_builders;
+    size_t         block_builders_capacity;
+
+    Definition*    definitions;
+    size_t         definitions_capacity;
+    size_t         definitions_used;
+
+    IncompletePhi* incomplete_phis;
+    size_t         incomplete_phis_number;
+    size_t         incomplete_phis_capacity;
+
+    int            current_block;
+    int            zero;
+} SsaBuilder;
+
+static void lowerStatements(SsaBuilder* builder, int cell_index);
+static void lowerStatement(SsaBuilder* builder, int node_index);
+static void lowerIf(SsaBuilder* builder, const TreeNode* node);
+static void lowerWhile(SsaBuilder* builder, const TreeNode* node);
+static int lowerExpression(SsaBuilder* builder, int node_index);
+static int lowerLogical(SsaBuilder* builder, int node_index);
+
+static int readVariable(SsaBuilder* builder, int slot, int block);
+static int readVariableRecursive(SsaBuilder* builder, int slot, int block);
+static void writeVariable(SsaBuilder* builder, int slot, int block, int value);
+static void addPhiOperands(SsaBuilder* builder, int phi);
+static void sealBlock(SsaBuilder* builder, int block);
+static Definition* findDefinition(Definition* definitions, size_t capacity, int block, int slot);
+static bool growDefinitions(SsaBuilder* builder);
+
+static int newBlock(SsaBuilder* builder);
+static void addEdge(SsaBuilder* builder, int from, int to);
+static void terminate(SsaBuilder* builder, SsaOpcode opcode, int condition,
+                      int first_target, int second_target, int line);
+static int emit(SsaBuilder* builder, int block, SsaOpcode opcode, int operation,
+                int first, int second, int line, int node);
+static int emitConstant(SsaBuilder* builder, Value value, int line, int node);
+static int emitPhi(SsaBuilder* builder, int block, int slot, int line);
+static int appendPhiArguments(SsaBuilder* builder, const int* arguments, size_t number);
+
+static bool finishFunction(SsaBuilder* builder);
+static void removeTrivialPhis(SsaFunction* function, int* forward);
+static int findForward(int* forward, int value);
+static bool scheduleBlocks(SsaFunction* function);
+static bool flattenPredecessors(SsaBuilder* builder);
+static void builderDtor(SsaBuilder* builder);
+
+static bool growArray(void** array, size_t* capacity, size_t needed, size_t element_size);
+static void dumpValue(const SsaFunction* function, int value, FILE* output);
+
+static const size_t SSA_START_SIZE = 64;
+
+
+// public ---------------------------------------------------------------------
+
+
+SsaState ssaBuild(Tree* ast, SsaFunction* function)
+{
+    assert(ast      != NULL);
+    assert(function != NULL);
+
+    *function = (SsaFunction){};
+    arenaCtor(&function->arena);
+
+    SsaBuilder builder = {};
+    builder.ast      = ast;
+    builder.function = function;
+    builder.state    = SsaState_OK;
+
+    ResolverState resolver_state = resolveProgram(ast, &builder.resolution);
+    if (resolver_state != ResolverState_OK)
+    {
+        return resolver_state == ResolverState_MEMORY_ERROR ? SsaState_MEMORY_ERROR
+                                                            : SsaState_RESOLVE_ERROR;
+    }
+
+    function->nodes_number = ast->nodes_number;
+    function->node_values  = (int*)malloc((ast->nodes_number + 1) * sizeof(int));
+    function->slots_number = builder.resolution.slots_number;
+    function->slot_names   = (const char**)calloc(function->slots_number + 1, sizeof(const char*));
+    if (function->node_values == NULL || function->slot_names == NULL || !growDefinitions(&builder))
+    {
+        builderDtor(&builder);
+        return SsaState_MEMORY_ERROR;
+    }
+
+    for (size_t node = 0; node < ast->nodes_number; node++)
+    {
+        function->node_values[node] = NO_VALUE;
+    }
+
+    for (size_t slot = 0; slot < function->slots_number; slot++)
+    {
+        const char* name = builder.resolution.slot_names[slot];
+        function->slot_names[slot] = arenaStrndup(&function->arena, name, strlen(name));
+        if (function->slot_names[slot] == NULL)
+        {
+            builderDtor(&builder);
+            return SsaState_MEMORY_ERROR;
+        }
+    }
+
+    builder.current_block = newBlock(&builder);
+    if (builder.state == SsaState_OK)
+    {
+        sealBlock(&builder, builder.current_block);
+        builder.zero = emitConstant(&builder, valueSmallInteger(0), 0, EMPTY_NODE);
+    }
+
+    if (ast->nodes_number > 0 && builder.state == SsaState_OK)
+    {
+        lowerStatements(&builder, ast->nodes_array[0].left_index);
+    }
+
+    terminate(&builder, SsaOpcode_RETURN, NO_VALUE, NO_BLOCK, NO_BLOCK, 0);
+
+    if (builder.state == SsaState_OK && !finishFunction(&builder))
+    {
+        builder.state = SsaState_MEMORY_ERROR;
+    }
+
+    SsaState state = builder.state;
+    builderDtor(&builder);
+
+    if (state == SsaState_OK)
+    {
+        state = ssaBuildDominators(function);
+    }
+
+    if (state != SsaState_OK)
+    {
+        ssaDtor(function);
+    }
+
+    return state;
+}
+
+
+void ssaDtor(SsaFunction* function)
+{
+    if (function == NULL)
+    {
+        return;
+    }
+
+    free(function->instructions);
+    free(function->schedule);
+    free(function->blocks);
+    free(function->predecessors);
+    free(function->reverse_postorder);
+    free(function->phi_arguments);
+    free(function->constants);
+    free(function->node_values);
+    free(function->slot_names);
+    arenaDtor(&function->arena);
+
+    *function = (SsaFunction){};
+}
+
+
+SsaState ssaBuildDominators(SsaFunction* function)
+{
+    assert(function != NULL);
+
+    size_t blocks_number = function->blocks_number;
+    int* order_number = (int*)malloc((blocks_number + 1) * sizeof(int));
+    int* stack        = (int*)malloc((blocks_number + 1) * sizeof(int));
+    int* next_edge    = (int*)calloc(blocks_number + 1, sizeof(int));
+    int* postorder    = (int*)malloc((blocks_number + 1) * sizeof(int));
+    free(function->reverse_postorder);
+    function->reverse_postorder = (int*)malloc((blocks_number + 1) * sizeof(int));
+
+    if (order_number == NULL || stack == NULL || next_edge == NULL || postorder == NULL
+     || function->reverse_postorder == NULL)
+    {
+        free(order_number);
+        free(stack);
+        free(next_edge);
+        free(postorder);
+        return SsaState_MEMORY_ERROR;
+    }
+
+    for (size_t block = 0; block < blocks_number; block++)
+    {
+        order_number[block] = -1;
+        function->blocks[block].immediate_dominator = NO_BLOCK;
+        function->blocks[block].first_child         = NO_BLOCK;
+        function->blocks[block].next_sibling        = NO_BLOCK;
+        function->blocks[block].preorder            = -1;
+        function->blocks[block].postorder           = -1;
+    }
+
+    // Postorder of the reachable blocks, iteratively.
+    size_t reachable = 0;
+    size_t depth = 0;
+    stack[depth++] = 0;
+    order_number[0] = 0;
+    while (depth > 0)
+    {
+        int block = stack[depth - 1];
+        const SsaBlock* data = &function->blocks[block];
+        if (next_edge[block] < 2)
+        {
+            int successor = data->successors[next_edge[block]++];
+            if (successor != NO_BLOCK && order_number[successor] == -1)
+            {
+                order_number[successor] = 0;
+                stack[depth++] = successor;
+            }
+            continue;
+        }
+
+        postorder[reachable++] = block;
+        depth--;
+    }
+
+    for (size_t i = 0; i < reachable; i++)
+    {
+        int block = postorder[reachable - 1 - i];
+        function->reverse_postorder[i] = block;
+        order_number[block] = (int)i;
+    }
+
+    // Immediate dominators until nothing changes.
+    int* idom = postorder;
+    for (size_t block = 0; block < blocks_number; block++)
+    {
+        idom[block] = NO_BLOCK;
+    }
+    idom[0] = 0;
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = 1; i < reachable; i++)
+        {
+            int block = function->reverse_postorder[i];
+            const SsaBlock* data = &function->blocks[block];
+
+            int new_idom = NO_BLOCK;
+            for (int p = 0; p < data->predecessors_number; p++)
+            {
+                int predecessor = function->predecessors[data->first_predecessor + p];
+                if (idom[predecessor] == NO_BLOCK)
+                {
+                    continue;
+                }
+                if (new_idom == NO_BLOCK)
+                {
+                    new_idom = predecessor;
+                    continue;
+                }
+
+                int first  = predecessor;
+                int second = new_idom;
+                while (first != second)
+                {
+                    while (order_number[first]  > order_number[second]) first  = idom[first];
+                    while (order_number[second] > order_number[first])  second = idom[second];
+                }
+                new_idom = first;
+            }
+
+            if (idom[block] != new_idom)
+            {
+                idom[block] = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    // Children in reverse postorder, then preorder/postorder numbers.
+    for (size_t i = reachable; i-- > 1;)
+    {
+        int block = function->reverse_postorder[i];
+        SsaBlock* data = &function->blocks[block];
+        data->immediate_dominator = idom[block];
+        data->next_sibling        = function->blocks[idom[block]].first_child;
+        function->blocks[idom[block]].first_child = block;
+    }
+
+    int counter = 0;
+    depth = 0;
+    stack[depth++] = 0;
+    function->blocks[0].preorder = counter++;
+    for (size_t block = 0; block < blocks_number; block++)
+    {
+        next_edge[block] = function->blocks[block].first_child;
+    }
+
+    while (depth > 0)
+    {
+        int block = stack[depth - 1];
+        int child = next_edge[block];
+        if (child != NO_BLOCK)
+        {
+            next_edge[block] = function->blocks[child].next_sibling;
+            function->blocks[child].preorder = counter++;
+            stack[depth++] = child;
+            continue;
+        }
+
+        function->blocks[block].postorder = counter++;
+        depth--;
+    }
+
+    free(order_number);
+    free(stack);
+    free(next_edge);
+    free(postorder);
+
+    return SsaState_OK;
+}
+
+
+bool ssaDominates(const SsaFunction* function, int dominator, int block)
+{
+    assert(function != NULL);
+
+    const SsaBlock* first  = &function->blocks[dominator];
+    const SsaBlock* second = &function->blocks[block];
+
+    return first->preorder  >= 0 && second->preorder >= 0
+        && first->preorder  <= second->preorder
+        && second->postorder <= first->postorder;
+}
+
+
+const char* ssaOpcodeToString(SsaOpcode opcode)
+{
+    switch (opcode)
+    {
+        case SsaOpcode_CONSTANT: return "const";
+        case SsaOpcode_PHI:      return "phi";
+        case SsaOpcode_UNARY:    return "unary";
+        case SsaOpcode_BINARY:   return "binary";
+        case SsaOpcode_TRUTHY:   return "truthy";
+        case SsaOpcode_PRINT:    return "print";
+        case SsaOpcode_JUMP:     return "jump";
+        case SsaOpcode_BRANCH:   return "branch";
+        case SsaOpcode_RETURN:   return "return";
+        case SsaOpcode_NOP:      return "nop";
+        default:                 return "unknown";
+    }
+}
+
+
+const char* ssaStateToString(SsaState state)
+{
+    switch (state)
+    {
+        case SsaState_OK:            return "ok";
+        case SsaState_RESOLVE_ERROR: return "undefined variable";
+        case SsaState_BAD_TREE:      return "malformed syntax tree";
+        case SsaState_MEMORY_ERROR:  return "out of memory";
+        default:                     return "unknown error";
+    }
+}
+
+
+void ssaDump(const SsaFunction* function, FILE* output)
+{
+    assert(function != NULL);
+    assert(output   != NULL);
+
+    for (size_t b = 0; b < function->blocks_number; b++)
+    {
+        const SsaBlock* block = &function->blocks[b];
+
+        fprintf(output, "b%lu:", b);
+        if (block->immediate_dominator != NO_BLOCK)
+        {
+            fprintf(output, "  ; idom b%d", block->immediate_dominator);
+        }
+        if (block->predecessors_number > 0)
+        {
+            fprintf(output, "%s preds", block->immediate_dominator != NO_BLOCK ? "," : "  ;");
+            for (int p = 0; p < block->predecessors_number; p++)
+            {
+                fprintf(output, " b%d", function->predecessors[block->first_predecessor + p]);
+            }
+        }
+        fputc('\n', output);
+
+        for (int i = 0; i < block->size; i++)
+        {
+            int value = function->schedule[block->first + i];
+            const SsaInstruction* instruction = &function->instructions[value];
+            fputs("    ", output);
+
+            switch (instruction->opcode)
+            {
+                case SsaOpcode_CONSTANT:
+                    fprintf(output, "v%d = const ", value);
+                    valuePrint(output, function->constants[instruction->argument]);
+                    break;
+
+                case SsaOpcode_PHI:
+                    fprintf(output, "v%d = phi", value);
+                    for (int a = 0; a < instruction->arguments_number; a++)
+                    {
+                        fputs(a == 0 ? " " : ", ", output);
+                        dumpValue(function, function->phi_arguments[instruction->argument + a], output);
+                    }
+                    if (instruction->variable != NO_SLOT)
+                    {
+                        fprintf(output, "  ; %s", function->slot_names[instruction->variable]);
+                    }
+                    break;
+
+                case SsaOpcode_UNARY:
+                    fprintf(output, "v%d = %s ", value, tokenTypeToString(instruction->operation));
+                    dumpValue(function, instruction->operands[0], output);
+                    break;
+
+                case SsaOpcode_BINARY:
+                    fprintf(output, "v%d = ", value);
+                    dumpValue(function, instruction->operands[0], output);
+                    fprintf(output, " %s ", tokenTypeToString(instruction->operation));
+                    dumpValue(function, instruction->operands[1], output);
+                    break;
+
+                case SsaOpcode_TRUTHY:
+                    fprintf(output, "v%d = truthy ", value);
+                    dumpValue(function, instruction->operands[0], output);
+                    break;
+
+                case SsaOpcode_PRINT:
+                    fputs("print ", output);
+                    dumpValue(function, instruction->operands[0], output);
+                    break;
+
+                case SsaOpcode_JUMP:
+                    fprintf(output, "jump b%d", block->successors[0]);
+                    break;
+
+                case SsaOpcode_BRANCH:
+                    fputs("branch ", output);
+                    dumpValue(function, instruction->operands[0], output);
+                    fprintf(output, ", b%d, b%d", block->successors[0], block->successors[1]);
+                    break;
+
+                case SsaOpcode_RETURN:
+                case SsaOpcode_NOP:
+                default:
+                    fputs(ssaOpcodeToString(instruction->opcode), output);
+                    break;
+            }
+
+            fputc('\n', output);
+        }
+    }
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static void lowerStatements(SsaBuilder* builder, int cell_index)
+{
+    assert(builder != NULL);
+
+    while (cell_index != EMPTY_NODE && builder->state == SsaState_OK)
+    {
+        const TreeNode* cell = &builder->ast->nodes_array[cell_index];
+        lowerStatement(builder, cell->left_index);
+        cell_index = cell->right_index;
+    }
+}
+
+
+static void lowerStatement(SsaBuilder* builder, int node_index)
+{
+    assert(builder != NULL);
+
+    const TreeNode* node = &builder->ast->nodes_array[node_index];
+
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_VAR_DECLARATION:
+        case SyntaxNodeType_ASSIGNMENT:
+        {
+            int value = lowerExpression(builder, node->right_index);
+            int slot  = builder->resolution.node_slots[node->left_index];
+            writeVariable(builder, slot, builder->current_block, value);
+            break;
+        }
+
+        case SyntaxNodeType_PRINT:
+        {
+            int value = lowerExpression(builder, node->left_index);
+            emit(builder, builder->current_block, SsaOpcode_PRINT, 0,
+                 value, NO_VALUE, node->data.line, node_index);
+            break;
+        }
+
+        case SyntaxNodeType_IF:
+            lowerIf(builder, node);
+            break;
+
+        case SyntaxNodeType_WHILE:
+            lowerWhile(builder, node);
+            break;
+
+        case SyntaxNodeType_BLOCK:
+        case SyntaxNodeType_PROGRAM:
+        case SyntaxNodeType_STATEMENT:
+            lowerStatements(builder, node->left_index);
+            break;
+
+        default:
+            builder->state = SsaState_BAD_TREE;
+            break;
+    }
+}
+
+
+static void lowerIf(SsaBuilder* builder, const TreeNode* node)
+{
+    assert(builder != NULL);
+    assert(node    != NULL);
+
+    int line        = node->data.line;
+    int branches    = node->right_index;
+    int then_node   = branches;
+    int else_node   = EMPTY_NODE;
+    if (builder->ast->nodes_array[branches].data.type == SyntaxNodeType_ELSE)
+    {
+        then_node = builder->ast->nodes_array[branches].left_index;
+        else_node = builder->ast->nodes_array[branches].right_index;
+    }
+
+    int condition  = lowerExpression(builder, node->left_index);
+    int then_block = newBlock(builder);
+    int else_block = else_node != EMPTY_NODE ? newBlock(builder) : NO_BLOCK;
+    int join_block = newBlock(builder);
+    if (builder->state != SsaState_OK)
+    {
+        return;
+    }
+
+    terminate(builder, SsaOpcode_BRANCH, condition, then_block,
+              else_block != NO_BLOCK ? else_block : join_block, line);
+
+    sealBlock(builder, then_block);
+    builder->current_block = then_block;
+    lowerStatement(builder, then_node);
+    terminate(builder, SsaOpcode_JUMP, NO_VALUE, join_block, NO_BLOCK, line);
+
+    if (else_block != NO_BLOCK)
+    {
+        sealBlock(builder, else_block);
+        builder->current_block = else_block;
+        lowerStatement(builder, else_node);
+        terminate(builder, SsaOpcode_JUMP, NO_VALUE, join_block, NO_BLOCK, line);
+    }
+
+    sealBlock(builder, join_block);
+    builder->current_block = join_block;
+}
+
+
+// header: condition, branch to body or exit; body ends with a jump back.
+// The header is sealed only after the body, once the back edge exists.
+static void lowerWhile(SsaBuilder* builder, const TreeNode* node)
+{
+    assert(builder != NULL);
+    assert(node    != NULL);
+
+    int line   = node->data.line;
+    int header = newBlock(builder);
+    if (builder->state != SsaState_OK)
+    {
+        return;
+    }
+
+    terminate(builder, SsaOpcode_JUMP, NO_VALUE, header, NO_BLOCK, line);
+    builder->current_block = header;
+
+    int condition  = lowerExpression(builder, node->left_index);
+    int body_block = newBlock(builder);
+    int exit_block = newBlock(builder);
+    if (builder->state != SsaState_OK)
+    {
+        return;
+    }
+
+    terminate(builder, SsaOpcode_BRANCH, condition, body_block, exit_block, line);
+
+    sealBlock(builder, body_block);
+    builder->current_block = body_block;
+    lowerStatement(builder, node->right_index);
+    terminate(builder, SsaOpcode_JUMP, NO_VALUE, header, NO_BLOCK, line);
+
+    sealBlock(builder, header);
+    sealBlock(builder, exit_block);
+    builder->current_block = exit_block;
+}
+
+
+static int lowerExpression(SsaBuilder* builder, int node_index)
+{
+    assert(builder != NULL);
+
+    if (builder->state != SsaState_OK)
+    {
+        return NO_VALUE;
+    }
+
+    const TreeNode* node = &builder->ast->nodes_array[node_index];
+    int line  = node->data.line;
+    int value = NO_VALUE;
+
+    switch (node->data.type)
+    {
+        case SyntaxNodeType_NUMBER:
+            value = emitConstant(builder, valueNumber(node->data.data.number), line, node_index);
+            break;
+
+        case SyntaxNodeType_INTEGER:
+        {
+            Value integer = {};
+            if (valueMakeInteger(node->data.data.integer, &builder->function->arena, &integer)
+                != RuntimeState_OK)
+            {
+                builder->state = SsaState_MEMORY_ERROR;
+                break;
+            }
+            value = emitConstant(builder, integer, line, node_index);
+            break;
+        }
+
+        case SyntaxNodeType_BOOL:
+            value = emitConstant(builder, valueBool(node->data.data.boolean), line, node_index);
+            break;
+
+        case SyntaxNodeType_STRING:
+            value = emitConstant(builder, valueString(node->data.data.string), line, node_index);
+            break;
+
+        case SyntaxNodeType_IDENTIFIER:
+            value = readVariable(builder, builder->resolution.node_slots[node_index],
+                                 builder->current_block);
+            break;
+
+        case SyntaxNodeType_UNARY_OPERATION:
+        {
+            int operation = node->data.data.operation;
+            int operand   = lowerExpression(builder, node->left_index);
+            value = emit(builder, builder->current_block, SsaOpcode_UNARY, operation,
+                         operand, NO_VALUE, line, node_index);
+            break;
+        }
+
+        case SyntaxNodeType_BINARY_OPERATION:
+        {
+            int operation = node->data.data.operation;
+            if (operation == TOKEN_AND || operation == TOKEN_OR)
+            {
+                value = lowerLogical(builder, node_index);
+                break;
+            }
+
+            int right_index = node->right_index;
+            int left  = lowerExpression(builder, node->left_index);
+            int right = lowerExpression(builder, right_index);
+            value = emit(builder, builder->current_block, SsaOpcode_BINARY, operation,
+                         left, right, line, node_index);
+            break;
+        }
+
+        default:
+            builder->state = SsaState_BAD_TREE;
+            return NO_VALUE;
+    }
+
+    if (builder->state == SsaState_OK)
+    {
+        builder->function->node_values[node_index] = value;
+    }
+
+    return value;
+}
+
+
+// a && b:  left block branches on a to the right block or straight to the
+// join; the join merges truthy(a) with truthy(b). || swaps the targets.
+static int lowerLogical(SsaBuilder* builder, int node_index)
+{
+    assert(builder != NULL);
+
+    const TreeNode* node = &builder->ast->nodes_array[node_index];
+    int  line        = node->data.line;
+    bool is_and      = node->data.data.operation == TOKEN_AND;
+    int  right_index = node->right_index;
+
+    int left = lowerExpression(builder, node->left_index);
+    int left_truth = emit(builder, builder->current_block, SsaOpcode_TRUTHY, 0,
+                          left, NO_VALUE, line, EMPTY_NODE);
+    int right_block = newBlock(builder);
+    int join_block  = newBlock(builder);
+    if (builder->state != SsaState_OK)
+    {
+        return NO_VALUE;
+    }
+
+    terminate(builder, SsaOpcode_BRANCH, left_truth,
+              is_and ? right_block : join_block,
+              is_and ? join_block  : right_block, line);
+
+    sealBlock(builder, right_block);
+    builder->current_block = right_block;
+    int right = lowerExpression(builder, right_index);
+    int right_truth = emit(builder, builder->current_block, SsaOpcode_TRUTHY, 0,
+                           right, NO_VALUE, line, EMPTY_NODE);
+    terminate(builder, SsaOpcode_JUMP, NO_VALUE, join_block, NO_BLOCK, line);
+
+    sealBlock(builder, join_block);
+    builder->current_block = join_block;
+
+    int phi = emitPhi(builder, join_block, NO_SLOT, line);
+    int arguments[2] = { left_truth, right_truth };
+    int first = appendPhiArguments(builder, arguments, 2);
+    if (builder->state != SsaState_OK)
+    {
+        return NO_VALUE;
+    }
+
+    SsaInstruction* instruction   = &builder->function->instructions[phi];
+    instruction->argument         = first;
+    instruction->arguments_number = 2;
+    instruction->node             = node_index;
+
+    return phi;
+}
+
+
+static int readVariable(SsaBuilder* builder, int slot, int block)
+{
+    assert(builder != NULL);
+
+    if (builder->state != SsaState_OK)
+    {
+        return NO_VALUE;
+    }
+
+    const Definition* definition = findDefinition(builder->definitions,
+                                                  builder->definitions_capacity, block, slot);
+    if (definition->block != NO_BLOCK)
+    {
+        return definition->value;
+    }
+
+    return readVariableRecursive(builder, slot, block);
+}
+
+
+static int readVariableRecursive(SsaBuilder* builder, int slot, int block)
+{
+    assert(builder != NULL);
+
+    const BlockBuilder* data = &builder->block_builders[block];
+    int value = NO_VALUE;
+
+    if (!data->sealed)
+    {
+        value = emitPhi(builder, block, slot, 0);
+        if (!growArray((void**)&builder->incomplete_phis, &builder->incomplete_phis_capacity,
+                       builder->incomplete_phis_number + 1, sizeof(IncompletePhi)))
+        {
+            builder->state = SsaState_MEMORY_ERROR;
+            return NO_VALUE;
+        }
+        builder->incomplete_phis[builder->incomplete_phis_number++] = (IncompletePhi){
+            .block = block,
+            .slot  = slot,
+            .phi   = value,
+        };
+    }
+    else if (data->predecessors_number == 0)
+    {
+        value = builder->zero;
+    }
+    else if (data->predecessors_number == 1)
+    {
+        value = readVariable(builder, slot, data->predecessors[0]);
+    }
+    else
+    {
+        // Written before the operands are read to break cycles through loops.
+        value = emitPhi(builder, block, slot, 0);
+        writeVariable(builder, slot, block, value);
+        addPhiOperands(builder, value);
+    }
+
+    writeVariable(builder, slot, block, value);
+    return value;
+}
+
+
+static void writeVariable(SsaBuilder* builder, int slot, int block, int value)
+{
+    assert(builder != NULL);
+
+    if (builder->state != SsaState_OK)
+    {
+        return;
+    }
+
+    Definition* definition = findDefinition(builder->definitions, builder->definitions_capacity,
+                                            block, slot);
+    if (definition->block == NO_BLOCK)
+    {
+        builder->definitions_used++;
+    }
+
+    *definition = (Definition){
+        .block = block,
+        .slot  = slot,
+        .value = value,
+    };
+
+    if (builder->definitions_used * 2 > builder->definitions_capacity && !growDefinitions(builder))
+    {
+        builder->state = SsaState_MEMORY_ERROR;
+    }
+}
+
+
+static void addPhiOperands(SsaBuilder* builder, int phi)
+{
+    assert(builder != NULL);
+
+    int block = builder->function->instructions[phi].block;
+    int slot  = builder->function->instructions[phi].variable;
+    size_t predecessors_number = builder->block_builders[block].predecessors_number;
+
+    int* arguments = (int*)malloc((predecessors_number + 1) * sizeof(int));
+    if (arguments == NULL)
+    {
+        builder->state = SsaState_MEMORY_ERROR;
+        return;
+    }
+
+    // Reading may seal nothing new but can create phis elsewhere, so the
+    // arguments are gathered first and stored contiguously afterwards.
+    for (size_t p = 0; p < predecessors_number; p++)
+    {
+        arguments[p] = readVariable(builder, slot, builder->block_builders[block].predecessors[p]);
+    }
+
+    int first = appendPhiArguments(builder, arguments, predecessors_number);
+    free(arguments);
+    if (builder->state != SsaState_OK)
+    {
+        return;
+    }
+
+    builder->function->instructions[phi].argument         = first;
+    builder->function->instructions[phi].arguments_number = (int)predecessors_number;
+}
+
+
+static void sealBlock(SsaBuilder* builder, int block)
+{
+    assert(builder != NULL);
+
+    if (builder->state != SsaState_OK)
+    {
+        return;
+    }
+
+    // Phis of this block are completed in place; completing one can only
+    // add incomplete phis for other, still unsealed blocks.
+    for (size_t i = 0; i < builder->incomplete_phis_number; i++)
+    {
+        IncompletePhi incomplete = builder->incomplete_phis[i];
+        if (incomplete.block != block)
+        {
+            continue;
+        }
+
+        addPhiOperands(builder, incomplete.phi);
+        builder->incomplete_phis[i] = builder->incomplete_phis[--builder->incomplete_phis_number];
+        i--;
+    }
+
+    builder->block_builders[block].sealed = true;
+}
+
+
+static Definition* findDefinition(Definition* definitions, size_t capacity, int block, int slot)
+{
+    assert(definitions != NULL);
+
+    uint64_t hash = ((uint64_t)(uint32_t)block << 32) | (uint32_t)slot;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+
+    size_t mask  = capacity - 1;
+    size_t index = (size_t)hash & mask;
+    while (definitions[index].block != NO_BLOCK
+       && (definitions[index].block != block || definitions[index].slot != slot))
+    {
+        index = (index + 1) & mask;
+    }
+
+    return &definitions[index];
+}
+
+
+static bool growDefinitions(SsaBuilder* builder)
+{
+    assert(builder != NULL);
+
+    size_t new_capacity = builder->definitions_capacity == 0 ? SSA_START_SIZE
+                                                             : builder->definitions_capacity * 2;
+    Definition* new_definitions = (Definition*)malloc(new_capacity * sizeof(Definition));
+    if (new_definitions == NULL)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < new_capacity; i++)
+    {
+        new_definitions[i].block = NO_BLOCK;
+    }
+
+    for (size_t i = 0; i < builder->definitions_capacity; i++)
+    {
+        const Definition* definition = &builder->definitions[i];
+        if (definition->block != NO_BLOCK)
+        {
+            *findDefinition(new_definitions, new_capacity,
+                            definition->block, definition->slot) = *definition;
+        }
+    }
+
+    free(builder->definitions);
+    builder->definitions          = new_definitions;
+    builder->definitions_capacity = new_capacity;
+
+    return true;
+}
+
+
+static int newBlock(SsaBuilder* builder)
+{
+    assert(builder != NULL);
+
+    SsaFunction* function = builder->function;
+    if (builder->state != SsaState_OK
+     || !growArray((void**)&function->blocks, &function->blocks_capacity,
+                   function->blocks_number + 1, sizeof(SsaBlock))
+     || !growArray((void**)&builder->block_builders, &builder->block_builders_capacity,
+                   function->blocks_number + 1, sizeof(BlockBuilder)))
+    {
+        builder->state = SsaState_MEMORY_ERROR;
+        return NO_BLOCK;
+    }
+
+    int block = (int)function->blocks_number++;
+    function->blocks[block] = (SsaBlock){
+        .first                = 0,
+        .size                 = 0,
+        .phis_number          = 0,
+        .successors           = { NO_BLOCK, NO_BLOCK },
+        .first_predecessor    = 0,
+        .predecessors_number  = 0,
+        .immediate_dominator  = NO_BLOCK,
+        .first_child          = NO_BLOCK,
+        .next_sibling         = NO_BLOCK,
+        .preorder             = -1,
+        .postorder            = -1,
+    };
+    builder->block_builders[block] = (BlockBuilder){};
+
+    return block;
+}
+
+
+static void addEdge(SsaBuilder* builder, int from, int to)
+{
+    assert(builder != NULL);
+
+    BlockBuilder* target = &builder->block_builders[to];
+    if (!growArray((void**)&target->predecessors, &target->predecessors_capacity,
+                   target->predecessors_number + 1, sizeof(int)))
+    {
+        builder->state = SsaState_MEMORY_ERROR;
+        return;
+    }
+
+    target->predecessors[target->predecessors_number++] = from;
+}
+
+
+static void terminate(SsaBuilder* builder, SsaOpcode opcode, int condition,
+                      int first_target, int second_target, int line)
+{
+    assert(builder != NULL);
+
+    if (builder->state != SsaState_OK)
+    {
+        return;
+    }
+
+    int block = builder->current_block;
+    emit(builder, block, opcode, 0, condition, NO_VALUE, line, EMPTY_NODE);
+
+    int targets[2] = { first_target, second_target };
+    for (int i = 0; i < 2 && builder->state == SsaState_OK; i++)
+    {
+        builder->function->blocks[block].successors[i] = targets[i];
+        if (targets[i] != NO_BLOCK)
+        {
+            addEdge(builder, block, targets[i]);
+        }
+    }
+}
+
+
+static int emit(SsaBuilder* builder, int block, SsaOpcode opcode, int operation,
+                int first, int second, int line, int node)
+{
+    assert(builder != NULL);
+
+    SsaFunction* function = builder->function;
+    if (builder->state != SsaState_OK
+     || !growArray((void**)&function->instructions, &function->instructions_capacity,
+                   function->instructions_number + 1, sizeof(SsaInstruction)))
+    {
+        builder->state = SsaState_MEMORY_ERROR;
+        return NO_VALUE;
+    }
+
+    int value = (int)function->instructions_number++;
+    function->instructions[value] = (SsaInstruction){
+        .opcode           = opcode,
+        .operation        = operation,
+        .operands         = { first, second },
+        .argument         = 0,
+        .arguments_number = 0,
+        .block            = block,
+        .line             = line,
+        .node             = node,
+        .variable         = NO_SLOT,
+    };
+
+    return value;
+}
+
+
+static int emitConstant(SsaBuilder* builder, Value value, int line, int node)
+{
+    assert(builder != NULL);
+
+    SsaFunction* function = builder->function;
+    if (builder->state != SsaState_OK
+     || !growArray((void**)&function->constants, &function->constants_capacity,
+                   function->constants_number + 1, sizeof(Value)))
+    {
+        builder->state = SsaState_MEMORY_ERROR;
+        return NO_VALUE;
+    }
+
+    if (valueIsString(value))
+    {
+        const char* text = valueAsString(value);
+        char* copy = arenaStrndup(&function->arena, text, strlen(text));
+        if (copy == NULL)
+        {
+            builder->state = SsaState_MEMORY_ERROR;
+            return NO_VALUE;
+        }
+        value = valueString(copy);
+    }
+
+    int constant = (int)function->constants_number++;
+    function->constants[constant] = value;
+
+    int instruction = emit(builder, builder->current_block, SsaOpcode_CONSTANT, 0,
+                           NO_VALUE, NO_VALUE, line, node);
+    if (instruction != NO_VALUE)
+    {
+        function->instructions[instruction].argument = constant;
+    }
+
+    return instruction;
+}
+
+
+static int emitPhi(SsaBuilder* builder, int block, int slot, int line)
+{
+    assert(builder != NULL);
+
+    int phi = emit(builder, block, SsaOpcode_PHI, 0, NO_VALUE, NO_VALUE, line, EMPTY_NODE);
+    if (phi != NO_VALUE)
+    {
+        builder->function->instructions[phi].variable = slot;
+    }
+
+    return phi;
+}
+
+
+static int appendPhiArguments(SsaBuilder* builder, const int* arguments, size_t number)
+{
+    assert(builder   != NULL);
+    assert(arguments != NULL);
+
+    SsaFunction* function = builder->function;
+    if (builder->state != SsaState_OK
+     || !growArray((void**)&function->phi_arguments, &function->phi_arguments_capacity,
+                   function->phi_arguments_number + number, sizeof(int)))
+    {
+        builder->state = SsaState_MEMORY_ERROR;
+        return 0;
+    }
+
+    int first = (int)function->phi_arguments_number;
+    memcpy(function->phi_arguments + first, arguments, number * sizeof(int));
+    function->phi_arguments_number += number;
+
+    return first;
+}
+
+
+static bool finishFunction(SsaBuilder* builder)
+{
+    assert(builder != NULL);
+
+    SsaFunction* function = builder->function;
+    int* forward = (int*)malloc((function->instructions_number + 1) * sizeof(int));
+    if (forward == NULL)
+    {
+        return false;
+    }
+
+    for (size_t value = 0; value < function->instructions_number; value++)
+    {
+        forward[value] = (int)value;
+    }
+
+    removeTrivialPhis(function, forward);
+
+    for (size_t value = 0; value < function->instructions_number; value++)
+    {
+        SsaInstruction* instruction = &function->instructions[value];
+        for (int i = 0; i < 2; i++)
+        {
+            if (instruction->operands[i] != NO_VALUE)
+            {
+                instruction->operands[i] = findForward(forward, instruction->operands[i]);
+            }
+        }
+    }
+
+    for (size_t node = 0; node < function->nodes_number; node++)
+    {
+        if (function->node_values[node] != NO_VALUE)
+        {
+            function->node_values[node] = findForward(forward, function->node_values[node]);
+        }
+    }
+
+    free(forward);
+
+    return scheduleBlocks(function) && flattenPredecessors(builder);
+}
+
+
+// A phi whose arguments are all one value v (or itself) is v. Removing one
+// can make phis that use it trivial, so the scan repeats until it settles.
+static void removeTrivialPhis(SsaFunction* function, int* forward)
+{
+    assert(function != NULL);
+    assert(forward  != NULL);
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t value = 0; value < function->instructions_number; value++)
+        {
+            SsaInstruction* instruction = &function->instructions[value];
+            if (instruction->opcode != SsaOpcode_PHI)
+            {
+                continue;
+            }
+
+            int same    = NO_VALUE;
+            bool unique = true;
+            for (int a = 0; a < instruction->arguments_number; a++)
+            {
+                int* argument = &function->phi_arguments[instruction->argument + a];
+                *argument = findForward(forward, *argument);
+                if (*argument == (int)value || *argument == same)
+                {
+                    continue;
+                }
+                if (same != NO_VALUE)
+                {
+                    unique = false;
+                    break;
+                }
+                same = *argument;
+            }
+
+            if (unique && same != NO_VALUE)
+            {
+                forward[value] = same;
+                instruction->opcode = SsaOpcode_NOP;
+                changed = true;
+            }
+        }
+    }
+}
+
+
+static int findForward(int* forward, int value)
+{
+    assert(forward != NULL);
+
+    int root = value;
+    while (forward[root] != root)
+    {
+        root = forward[root];
+    }
+
+    while (forward[value] != root)
+    {
+        int next = forward[value];
+        forward[value] = root;
+        value = next;
+    }
+
+    return root;
+}
+
+
+// Lays the instructions out block by block: phis first, then the body in
+// the order it was lowered, which ends with the terminator.
+static bool scheduleBlocks(SsaFunction* function)
+{
+    assert(function != NULL);
+
+    function->schedule = (int*)malloc((function->instructions_number + 1) * sizeof(int));
+    if (function->schedule == NULL)
+    {
+        return false;
+    }
+
+    for (size_t value = 0; value < function->instructions_number; value++)
+    {
+        const SsaInstruction* instruction = &function->instructions[value];
+        if (instruction->opcode == SsaOpcode_NOP)
+        {
+            continue;
+        }
+
+        SsaBlock* block = &function->blocks[instruction->block];
+        block->size++;
+        if (instruction->opcode == SsaOpcode_PHI)
+        {
+            block->phis_number++;
+        }
+    }
+
+    int position = 0;
+    for (size_t b = 0; b < function->blocks_number; b++)
+    {
+        SsaBlock* block = &function->blocks[b];
+        block->first = position;
+        position += block->size;
+        block->size = 0;
+    }
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        bool phis = pass == 0;
+        for (size_t value = 0; value < function->instructions_number; value++)
+        {
+            const SsaInstruction* instruction = &function->instructions[value];
+            if (instruction->opcode == SsaOpcode_NOP
+             || (instruction->opcode == SsaOpcode_PHI) != phis)
+            {
+                continue;
+            }
+
+            SsaBlock* block = &function->blocks[instruction->block];
+            function->schedule[block->first + block->size++] = (int)value;
+        }
+    }
+
+    return true;
+}
+
+
+static bool flattenPredecessors(SsaBuilder* builder)
+{
+    assert(builder != NULL);
+
+    SsaFunction* function = builder->function;
+    size_t total = 0;
+    for (size_t block = 0; block < function->blocks_number; block++)
+    {
+        total += builder->block_builders[block].predecessors_number;
+    }
+
+    function->predecessors = (int*)malloc((total + 1) * sizeof(int));
+    if (function->predecessors == NULL)
+    {
+        return false;
+    }
+
+    int position = 0;
+    for (size_t block = 0; block < function->blocks_number; block++)
+    {
+        const BlockBuilder* data = &builder->block_builders[block];
+        function->blocks[block].first_predecessor   = position;
+        function->blocks[block].predecessors_number = (int)data->predecessors_number;
+        if (data->predecessors_number > 0)
+        {
+            memcpy(function->predecessors + position, data->predecessors,
+                   data->predecessors_number * sizeof(int));
+        }
+        position += (int)data->predecessors_number;
+    }
+
+    return true;
+}
+
+
+static void builderDtor(SsaBuilder* builder)
+{
+    assert(builder != NULL);
+
+    for (size_t block = 0; block < builder->function->blocks_number; block++)
+    {
+        free(builder->block_builders[block].predecessors);
+    }
+
+    free(builder->block_builders);
+    free(builder->definitions);
+    free(builder->incomplete_phis);
+    resolutionDtor(&builder->resolution);
+}
+
+
+static bool growArray(void** array, size_t* capacity, size_t needed, size_t element_size)
+{
+    assert(array    != NULL);
+    assert(capacity != NULL);
+
+    if (needed <= *capacity)
+    {
+        return true;
+    }
+
+    size_t new_capacity = *capacity == 0 ? SSA_START_SIZE : *capacity;
+    while (new_capacity < needed)
+    {
+        new_capacity *= 2;
+    }
+
+    void* new_array = realloc(*array, new_capacity * element_size);
+    if (new_array == NULL)
+    {
+        return false;
+    }
+
+    *array    = new_array;
+    *capacity = new_capacity;
+
+    return true;
+}
+
+
+static void dumpValue(const SsaFunction* function, int value, FILE* output)
+{
+    assert(function != NULL);
+    assert(output   != NULL);
+
+    if (value == NO_VALUE)
+    {
+        fputs("?", output);
+        return;
+    }
+
+    fprintf(output, "v%d", value);
+}
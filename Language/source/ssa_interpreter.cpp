@@ -0,0 +1,265 @@
+#include "ssa_interpreter.h"
+
+#include <assert.h>
+
+#include "lexical_analysis.h"
+#include "print_ast.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+static bool runBlock(SsaInterpreter* interpreter, int block, int* next_block);
+static void enterBlock(SsaInterpreter* interpreter, int from, int to);
+static void ssaInterpreterError(SsaInterpreter* interpreter, RuntimeState state,
+                                const SsaInstruction* instruction, Value left, Value right);
+static void sweepArena(SsaInterpreter* interpreter);
+
+
+// public ---------------------------------------------------------------------
+
+
+SsaInterpreterState ssaInterpreterCtor(SsaInterpreter* interpreter,
+                                       const SsaFunction* function, FILE* output)
+{
+    assert(interpreter != NULL);
+    assert(function    != NULL);
+    assert(output      != NULL);
+
+    *interpreter = (SsaInterpreter){};
+    interpreter->function = function;
+    interpreter->output   = output;
+    arenaCtor(&interpreter->arena);
+
+    size_t values_number = function->instructions_number + 1;
+    interpreter->values     = (Value*)calloc(values_number, sizeof(Value));
+    interpreter->phi_values = (Value*)calloc(values_number, sizeof(Value));
+    if (interpreter->values == NULL || interpreter->phi_values == NULL)
+    {
+        interpreter->state = SsaInterpreterState_MEMORY_ERROR;
+        return interpreter->state;
+    }
+
+    return SsaInterpreterState_OK;
+}
+
+
+SsaInterpreterState ssaInterpreterRun(SsaInterpreter* interpreter)
+{
+    assert(interpreter != NULL);
+
+    int block = 0;
+    while (interpreter->state == SsaInterpreterState_OK && block != NO_BLOCK)
+    {
+        int next_block = NO_BLOCK;
+        if (!runBlock(interpreter, block, &next_block))
+        {
+            break;
+        }
+
+        if (next_block != NO_BLOCK)
+        {
+            enterBlock(interpreter, block, next_block);
+        }
+        block = next_block;
+    }
+
+    return interpreter->state;
+}
+
+
+void ssaInterpreterDtor(SsaInterpreter* interpreter)
+{
+    assert(interpreter != NULL);
+
+    free(interpreter->values);
+    free(interpreter->phi_values);
+    arenaDtor(&interpreter->arena);
+
+    interpreter->values     = NULL;
+    interpreter->phi_values = NULL;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+__attribute__((no_sanitize("float-divide-by-zero")))
+static bool runBlock(SsaInterpreter* interpreter, int block, int* next_block)
+{
+    assert(interpreter != NULL);
+    assert(next_block  != NULL);
+
+    const SsaFunction* function = interpreter->function;
+    const SsaBlock*    data     = &function->blocks[block];
+    Value*             values   = interpreter->values;
+
+    for (int i = data->phis_number; i < data->size; i++)
+    {
+        int value = function->schedule[data->first + i];
+        const SsaInstruction* instruction = &function->instructions[value];
+
+        switch (instruction->opcode)
+        {
+            case SsaOpcode_CONSTANT:
+                values[value] = function->constants[instruction->argument];
+                break;
+
+            case SsaOpcode_UNARY:
+            {
+                if (arenaShouldSweep(&interpreter->arena))
+                {
+                    sweepArena(interpreter);
+                }
+
+                Value operand = values[instruction->operands[0]];
+                RuntimeState state = valueUnaryOperation(instruction->operation, operand,
+                                                         &interpreter->arena, &values[value]);
+                if (state != RuntimeState_OK)
+                {
+                    ssaInterpreterError(interpreter, state, instruction, operand, operand);
+                    return false;
+                }
+                break;
+            }
+
+            case SsaOpcode_BINARY:
+            {
+                if (arenaShouldSweep(&interpreter->arena))
+                {
+                    sweepArena(interpreter);
+                }
+
+                Value left  = values[instruction->operands[0]];
+                Value right = values[instruction->operands[1]];
+                RuntimeState state = valueBinaryOperation(instruction->operation, left, right,
+                                                          &interpreter->arena, &values[value]);
+                if (state != RuntimeState_OK)
+                {
+                    ssaInterpreterError(interpreter, state, instruction, left, right);
+                    return false;
+                }
+                break;
+            }
+
+            case SsaOpcode_TRUTHY:
+                values[value] = valueBool(valueIsTruthy(values[instruction->operands[0]]));
+                break;
+
+            case SsaOpcode_PRINT:
+                valuePrint(interpreter->output, values[instruction->operands[0]]);
+                fputc('\n', interpreter->output);
+                break;
+
+            case SsaOpcode_JUMP:
+                *next_block = data->successors[0];
+                return true;
+
+            case SsaOpcode_BRANCH:
+                *next_block = valueIsTruthy(values[instruction->operands[0]])
+                            ? data->successors[0]
+                            : data->successors[1];
+                return true;
+
+            case SsaOpcode_RETURN:
+                *next_block = NO_BLOCK;
+                return true;
+
+            case SsaOpcode_PHI:
+            case SsaOpcode_NOP:
+            default:
+                break;
+        }
+    }
+
+    *next_block = NO_BLOCK;
+    return true;
+}
+
+
+// Phi arguments are ordered like the predecessors, and all phis of a block
+// read their arguments before any of them is written.
+static void enterBlock(SsaInterpreter* interpreter, int from, int to)
+{
+    assert(interpreter != NULL);
+
+    const SsaFunction* function = interpreter->function;
+    const SsaBlock*    data     = &function->blocks[to];
+    if (data->phis_number == 0)
+    {
+        return;
+    }
+
+    int edge = 0;
+    while (edge < data->predecessors_number
+        && function->predecessors[data->first_predecessor + edge] != from)
+    {
+        edge++;
+    }
+
+    for (int i = 0; i < data->phis_number; i++)
+    {
+        const SsaInstruction* phi = ssaBlockInstruction(function, data, i);
+        int argument = function->phi_arguments[phi->argument + edge];
+        interpreter->phi_values[i] = interpreter->values[argument];
+    }
+
+    for (int i = 0; i < data->phis_number; i++)
+    {
+        interpreter->values[function->schedule[data->first + i]] = interpreter->phi_values[i];
+    }
+}
+
+
+static void ssaInterpreterError(SsaInterpreter* interpreter, RuntimeState state,
+                                const SsaInstruction* instruction, Value left, Value right)
+{
+    assert(interpreter != NULL);
+    assert(instruction != NULL);
+
+    int line = instruction->line;
+    const char* operation = tokenTypeToString(instruction->operation);
+
+    if (state == RuntimeState_MEMORY_ERROR)
+    {
+        snprintf(interpreter->error_message, sizeof(interpreter->error_message),
+                 "Runtime error: out of memory (line %d)", line);
+        interpreter->state = SsaInterpreterState_MEMORY_ERROR;
+        return;
+    }
+
+    if (state == RuntimeState_INDEX_ERROR || state == RuntimeState_LENGTH_ERROR
+     || state == RuntimeState_SIZE_ERROR)
+    {
+        snprintf(interpreter->error_message, sizeof(interpreter->error_message),
+                 "Runtime error: %s (line %d)", runtimeStateToString(state), line);
+    }
+    else if (instruction->opcode == SsaOpcode_UNARY)
+    {
+        snprintf(interpreter->error_message, sizeof(interpreter->error_message),
+                 "Runtime error: cannot apply '%s' to %s (line %d)",
+                 operation, valueTypeToString(valueType(left)), line);
+    }
+    else
+    {
+        snprintf(interpreter->error_message, sizeof(interpreter->error_message),
+                 "Runtime error: cannot apply '%s' to %s and %s (line %d)",
+                 operation,
+                 valueTypeToString(valueType(left)),
+                 valueTypeToString(valueType(right)),
+                 line);
+    }
+
+    interpreter->state = SsaInterpreterState_RUNTIME_ERROR;
+}
+
+
+// Every value an instruction can read is in values, including ones whose
+// instruction will not run again; those are kept until it is overwritten.
+static void sweepArena(SsaInterpreter* interpreter)
+{
+    assert(interpreter != NULL);
+
+    valueMarkAll(interpreter->values, interpreter->function->instructions_number);
+    arenaSweep(&interpreter->arena);
+}
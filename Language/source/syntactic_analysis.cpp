@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <assert.h>
 
 #include "tree.h"
@@ -25,12 +26,20 @@ static int parseRelationalExpression(Parser* parser);
 static int parseAdditiveExpression(Parser* parser);
 static int parseMultiplicativeExpression(Parser* parser);
 static int parseUnaryExpression(Parser* parser);
+static int parsePostfixExpression(Parser* parser);
 static int parsePrimaryExpression(Parser* parser);
+static int parseArrayLiteral(Parser* parser);
+static int parseLength(Parser* parser);
+static int parseFilledArray(Parser* parser);
 
-// static int parsePrint(Parser* parser);
+static int parsePrint(Parser* parser);
 
-static int createNumberNode(Tree* ast, double value);
-static int createIdentifierNode(Tree* ast, const char* name);
+static int parseStatementList(Parser* parser, int list_node, TokenType end_type);
+static int createNumberNode(Parser* parser, double value);
+static int createIntegerNode(Parser* parser, int64_t value);
+static int createIdentifierNode(Parser* parser, const char* name, size_t length);
+static int createUnaryNode(Parser* parser, int operation, int line, int operand);
+static int createBinaryNode(Parser* parser, int operation, int line, int left, int right);
 
 static void advance(Parser* parser);
 static bool check(Parser* parser, TokenType type);
@@ -56,15 +65,14 @@ void parseProgram(Parser* parser)
 {
     assert(parser != NULL);
 
-    tree_node_type root_data = {.type = SyntaxNodeType_PROGRAM};
+    tree_node_type root_data = {
+        .type = SyntaxNodeType_PROGRAM,
+        .line = parser->current_token.line,
+    };
     int root_index = treeCreateNewNode(parser->ast, root_data);
     parser->current_node = root_index;
 
-    while (!check(parser, TOKEN_EOF))
-    {
-        int statement_node = parseStatement(parser); 
-        treeInsertOnLeft(parser->ast, parser->current_node, statement_node);
-    }
+    parseStatementList(parser, root_index, TOKEN_EOF);
 
     return;
 }
@@ -109,6 +117,10 @@ static int parseStatement(Parser* parser)
     {
         return parseBlock(parser); 
     }
+    else if (check(parser, TOKEN_PRINT))
+    {
+        return parsePrint(parser);
+    }
 
     fprintf(stderr, "Неизвестный оператор (line %d)\n", 
             parser->current_token.line); 
@@ -118,18 +130,26 @@ static int parseStatement(Parser* parser)
 
 static int parseVarDeclaration(Parser* parser)
 {
-    char* var_name = strndup(parser->current_token.start, 
-                             (size_t)parser->current_token.length); 
+    assert(parser != NULL);
+
+    int line = parser->current_token.line;
+    advance(parser);
+
+    Token name_token = parser->current_token;
     expect(parser, TOKEN_IDENTIFIER, "Ожидался идектификатор");
+    int name_node = createIdentifierNode(parser, name_token.start, 
+                                         (size_t)name_token.length);
     expect(parser, TOKEN_EQ, "Ожидалось =");
 
     int expression_node = parseExpression(parser);
     expect(parser, TOKEN_SEMICOLON, "Ожидалось ';'");
 
-    tree_node_type var_data = {.type = SyntaxNodeType_VAR_DECLARATION};
+    tree_node_type var_data = {
+        .type = SyntaxNodeType_VAR_DECLARATION,
+        .line = line,
+    };
     int var_node = treeCreateNewNode(parser->ast, var_data);
 
-    int name_node = createIdentifierNode(parser->ast, var_name);
     treeInsertOnLeft(parser->ast, var_node, name_node);
     treeInsertOnRight(parser->ast, var_node, expression_node);
 
@@ -137,20 +157,23 @@ static int parseVarDeclaration(Parser* parser)
 }
 
 
-int parseAssignment(Parser* parser)
+static int parseAssignment(Parser* parser)
 {
     assert(parser != NULL);
 
-    char* var_name = strndup(parser->current_token.start, 
-                             (size_t)parser->current_token.length);
-    int name_node = createIdentifierNode(parser->ast, var_name);
+    int line = parser->current_token.line;
+    int name_node = createIdentifierNode(parser, parser->current_token.start,
+                                         (size_t)parser->current_token.length);
     advance(parser);
 
     expect(parser, TOKEN_EQ, "Ожидалось '='");
     int expression_node = parseExpression(parser);
 
     expect(parser, TOKEN_SEMICOLON, "Ожидалось ';'");
-    tree_node_type assignment_data = {.type = SyntaxNodeType_ASSIGNMENT};
+    tree_node_type assignment_data = {
+        .type = SyntaxNodeType_ASSIGNMENT,
+        .line = line,
+    };
     int assignment_node = treeCreateNewNode(parser->ast, assignment_data); 
 
     treeInsertOnLeft(parser->ast, assignment_node, name_node);
@@ -164,52 +187,85 @@ static int parseIf(Parser* parser)
 {
     assert(parser != NULL);
 
+    int line = parser->current_token.line;
     advance(parser);
     expect(parser, TOKEN_LPAREN, "Ожидалось '('");
 
     int condition_node = parseExpression(parser);
-    expect(parser, TOKEN_LPAREN, "Ожидалось ')' в if");
+    expect(parser, TOKEN_RPAREN, "Ожидалось ')' в if");
 
     int then_block = parseBlock(parser);
-    int else_block = EMPTY_NODE;
+    int branches_node = then_block;
     if (check(parser, TOKEN_KEYWORD_ELSE))
     {
+        int else_line = parser->current_token.line;
         advance(parser);
-        else_block = parseBlock(parser); 
+
+        int else_branch = check(parser, TOKEN_KEYWORD_IF) ? parseIf(parser)
+                                                          : parseBlock(parser);
+
+        tree_node_type else_data = {
+            .type = SyntaxNodeType_ELSE,
+            .line = else_line,
+        };
+        branches_node = treeCreateNewNode(parser->ast, else_data);
+        treeInsertOnLeft(parser->ast, branches_node, then_block);
+        treeInsertOnRight(parser->ast, branches_node, else_branch);
     }
 
-    tree_node_type if_data = {.type = SyntaxNodeType_IF};
+    tree_node_type if_data = {
+        .type = SyntaxNodeType_IF,
+        .line = line,
+    };
     int if_node = treeCreateNewNode(parser->ast, if_data);
 
     treeInsertOnLeft(parser->ast, if_node, condition_node);
-    treeInsertOnRight(parser->ast, if_node, then_block);
-    if (else_block != EMPTY_NODE)
-    {
-        treeInsertOnRight(parser->ast, if_node, else_block); 
-    }
+    treeInsertOnRight(parser->ast, if_node, branches_node);
 
     return if_node;
 }
 
 
+static int parsePrint(Parser* parser)
+{
+    assert(parser != NULL);
+
+    int line = parser->current_token.line;
+    advance(parser);
+    expect(parser, TOKEN_LPAREN, "Ожидалось '('");
+
+    int expression_node = parseExpression(parser);
+    expect(parser, TOKEN_RPAREN, "Ожидалось ')'");
+    expect(parser, TOKEN_SEMICOLON, "Ожидалось ';'");
+
+    tree_node_type print_data = {
+        .type = SyntaxNodeType_PRINT,
+        .line = line,
+    };
+    int print_node = treeCreateNewNode(parser->ast, print_data);
+    treeInsertOnLeft(parser->ast, print_node, expression_node);
+
+    return print_node;
+}
+
+
 static int parseBlock(Parser* parser)
 {
     assert(parser != NULL);
 
+    int line = parser->current_token.line;
     expect(parser, TOKEN_LBRACE, "Ожидалось '{'");
     
-    tree_node_type block_data = {.type = SyntaxNodeType_BLOCK};
+    tree_node_type block_data = {
+        .type = SyntaxNodeType_BLOCK,
+        .line = line,
+    };
     int block_node = treeCreateNewNode(parser->ast, block_data);
 
     int previous_node = parser->current_node;
     parser->current_node = block_node;
 
-    while(!check(parser, TOKEN_RBRACE)
-       && !check(parser, TOKEN_EOF))
-    {
-        int statement_node = parseStatement(parser);
-        treeInsertOnLeft(parser->ast, block_node, statement_node); 
-    }
+    parseStatementList(parser, block_node, TOKEN_RBRACE);
 
     expect(parser, TOKEN_RBRACE, "Ожидалось '}'");
     parser->current_node = previous_node;
@@ -218,6 +274,41 @@ static int parseBlock(Parser* parser)
 }
 
 
+// Statements hang off the list node as a chain of STATEMENT cells linked
+// through their right children, so a statement keeps both of its own.
+static int parseStatementList(Parser* parser, int list_node, TokenType end_type)
+{
+    assert(parser != NULL);
+
+    int last_cell = EMPTY_NODE;
+    while (!check(parser, end_type)
+        && !check(parser, TOKEN_EOF))
+    {
+        int line = parser->current_token.line;
+        int statement_node = parseStatement(parser);
+
+        tree_node_type cell_data = {
+            .type = SyntaxNodeType_STATEMENT,
+            .line = line,
+        };
+        int cell_node = treeCreateNewNode(parser->ast, cell_data);
+        treeInsertOnLeft(parser->ast, cell_node, statement_node);
+
+        if (last_cell == EMPTY_NODE)
+        {
+            treeInsertOnLeft(parser->ast, list_node, cell_node);
+        }
+        else
+        {
+            treeInsertOnRight(parser->ast, last_cell, cell_node);
+        }
+        last_cell = cell_node;
+    }
+
+    return list_node;
+}
+
+
 static int parseExpression(Parser* parser)
 {
     assert(parser != NULL);
@@ -230,6 +321,7 @@ static int parseWhile(Parser* parser)
 {
     assert(parser != NULL);
 
+    int line = parser->current_token.line;
     advance(parser);
     expect(parser, TOKEN_LPAREN, "Ожидалось '('");
 
@@ -240,6 +332,7 @@ static int parseWhile(Parser* parser)
 
     tree_node_type while_data = {
         .type = SyntaxNodeType_WHILE,
+        .line = line,
     };
 
     int while_node = treeCreateNewNode(parser->ast, while_data);
@@ -250,9 +343,6 @@ static int parseWhile(Parser* parser)
 }
 
 
-
-
-
 static int parseLogicalOr(Parser* parser)
 {
     assert(parser != NULL);
@@ -260,10 +350,12 @@ static int parseLogicalOr(Parser* parser)
     int left = parseLogicalAnd(parser);
     while (check(parser, TOKEN_OR))
     {
+        int line = parser->current_token.line;
         advance(parser);
         int right = parseLogicalAnd(parser); 
         tree_node_type operation_data = {
             .type = SyntaxNodeType_BINARY_OPERATION,
+            .line = line,
             .data = {
                 .operation = TOKEN_OR
             },
@@ -286,11 +378,13 @@ static int parseLogicalAnd(Parser* parser)
     int left = parseEquality(parser);
     while (check(parser, TOKEN_AND))
     {
+        int line = parser->current_token.line;
         advance(parser);
         int right = parseEquality(parser);
 
         tree_node_type operation_data = {
             .type = SyntaxNodeType_BINARY_OPERATION,
+            .line = line,
             .data = {
                 .operation = TOKEN_AND
             },
@@ -315,12 +409,14 @@ static int parseEquality(Parser* parser)
         || check(parser, TOKEN_BANGEQ))
     {
         TokenType operation = parser->current_token.type;
+        int line = parser->current_token.line;
         advance(parser);
 
         int right = parseRelationalExpression(parser);
 
         tree_node_type operation_data = {
             .type = SyntaxNodeType_BINARY_OPERATION,
+            .line = line,
             .data = {
                 .operation = operation
             }
@@ -348,12 +444,14 @@ static int parseRelationalExpression(Parser* parser)
         || check(parser, TOKEN_GTEQ))
     {
         TokenType operation = parser->current_token.type;
+        int line = parser->current_token.line;
         advance(parser);
 
         int right = parseAdditiveExpression(parser);
 
         tree_node_type operation_data = {
             .type = SyntaxNodeType_BINARY_OPERATION,
+            .line = line,
             .data = {
                 .operation = operation
             }
@@ -379,12 +477,14 @@ static int parseAdditiveExpression(Parser* parser)
         || check(parser, TOKEN_MINUS))
     {
         TokenType operation = parser->current_token.type;
+        int line = parser->current_token.line;
         advance(parser);
 
         int right = parseMultiplicativeExpression(parser);
 
         tree_node_type operation_data = {
             .type = SyntaxNodeType_BINARY_OPERATION,
+            .line = line,
             .data = {
                 .operation = operation
             }
@@ -411,12 +511,14 @@ static int parseMultiplicativeExpression(Parser* parser)
         || check(parser, TOKEN_PERCENT))
     {
         TokenType operation = parser->current_token.type;
+        int line = parser->current_token.line;
         advance(parser);
 
         int right = parseUnaryExpression(parser);
 
         tree_node_type operation_data = {
             .type = SyntaxNodeType_BINARY_OPERATION,
+            .line = line,
             .data = {
                 .operation = operation
             }
@@ -441,21 +543,48 @@ static int parseUnaryExpression(Parser* parser)
      || check(parser, TOKEN_MINUS))
     {
         TokenType operation = parser->current_token.type; 
+        int line = parser->current_token.line;
         advance(parser);
 
-        int operation_node = parseUnaryExpression(parser);
+        int operand_node = parseUnaryExpression(parser);
 
         tree_node_type operation_data = {
             .type = SyntaxNodeType_UNARY_OPERATION,
+            .line = line,
             .data = {
                 .operation = operation
             }
         };
         
-        return treeCreateNewNode(parser->ast, operation_data);
+        int operation_node = treeCreateNewNode(parser->ast, operation_data);
+        treeInsertOnLeft(parser->ast, operation_node, operand_node);
+
+        return operation_node;
+    }
+
+    return parsePostfixExpression(parser);
+}
+
+
+// a[i] is a binary '[' node, so indexing goes through the same operator
+// paths as arithmetic in every backend.
+static int parsePostfixExpression(Parser* parser)
+{
+    assert(parser != NULL);
+
+    int expression = parsePrimaryExpression(parser);
+    while (check(parser, TOKEN_LBRACKET))
+    {
+        int line = parser->current_token.line;
+        advance(parser);
+
+        int index = parseExpression(parser);
+        expect(parser, TOKEN_RBRACKET, "Ожидалось ']'");
+
+        expression = createBinaryNode(parser, TOKEN_LBRACKET, line, expression, index);
     }
 
-    return parsePrimaryExpression(parser);
+    return expression;
 }
 
 
@@ -466,16 +595,52 @@ static int parsePrimaryExpression(Parser* parser)
     if (check(parser, TOKEN_NUMBER))
     {
         double value = strtod(parser->current_token.start, NULL);
-        int node = createNumberNode(parser->ast, value);
+        int node = createNumberNode(parser, value);
+        advance(parser);
+        return node;
+    }
+    else if (check(parser, TOKEN_INTEGER))
+    {
+        // Literals beyond the int64_t range are doubles, as results are.
+        errno = 0;
+        long long value = strtoll(parser->current_token.start, NULL, 10);
+        int node = errno == ERANGE ? createNumberNode(parser, strtod(parser->current_token.start, NULL))
+                                   : createIntegerNode(parser, value);
         advance(parser);
         return node;
     }
     else if (check(parser, TOKEN_IDENTIFIER))
     {
-        char* name = strndup(parser->current_token.start, 
-                             (size_t)parser->current_token.length);
-        int node = createIdentifierNode(parser->ast, name);
-        free(name);
+        int node = createIdentifierNode(parser, parser->current_token.start,
+                                        (size_t)parser->current_token.length);
+        advance(parser);
+        return node;
+    }
+    else if (check(parser, TOKEN_STRING))
+    {
+        tree_node_type data = {
+            .type = SyntaxNodeType_STRING,
+            .line = parser->current_token.line,
+            .data = {
+                .string = strndup(parser->current_token.start + 1,
+                                  (size_t)parser->current_token.length - 2),
+            },
+        };
+        int node = treeCreateNewNode(parser->ast, data);
+        advance(parser);
+        return node;
+    }
+    else if (check(parser, TOKEN_KEYWORD_TRUE)
+          || check(parser, TOKEN_KEYWORD_FALSE))
+    {
+        tree_node_type data = {
+            .type = SyntaxNodeType_BOOL,
+            .line = parser->current_token.line,
+            .data = {
+                .boolean = check(parser, TOKEN_KEYWORD_TRUE),
+            },
+        };
+        int node = treeCreateNewNode(parser->ast, data);
         advance(parser);
         return node;
     }
@@ -486,12 +651,90 @@ static int parsePrimaryExpression(Parser* parser)
         expect(parser, TOKEN_RPAREN, "Ожидалось ')'");
         return expression;
     }
+    else if (check(parser, TOKEN_LBRACKET))
+    {
+        return parseArrayLiteral(parser);
+    }
+    else if (check(parser, TOKEN_KEYWORD_LEN))
+    {
+        return parseLength(parser);
+    }
+    else if (check(parser, TOKEN_KEYWORD_ARRAY))
+    {
+        return parseFilledArray(parser);
+    }
+
+    if (check(parser, TOKEN_ERROR))
+    {
+        fprintf(stderr, "Error: %.*s (line %d)\n",
+                parser->current_token.length,
+                parser->current_token.start,
+                parser->current_token.line);
+        exit(EXIT_FAILURE);
+    }
 
-    fprintf(stderr, "Не удалось распознать токен\n");
+    fprintf(stderr, "Не удалось распознать токен (line %d)\n",
+            parser->current_token.line);
     exit(EXIT_FAILURE);
 }
 
 
+// [a, b, c] becomes ((['[' a] ',' b] ',' c): a unary '[' makes a
+// one-element array and each ',' appends the next element to it.
+static int parseArrayLiteral(Parser* parser)
+{
+    assert(parser != NULL);
+
+    int line = parser->current_token.line;
+    advance(parser);
+
+    int array = createUnaryNode(parser, TOKEN_LBRACKET, line, parseExpression(parser));
+    while (check(parser, TOKEN_COMMA))
+    {
+        int comma_line = parser->current_token.line;
+        advance(parser);
+
+        array = createBinaryNode(parser, TOKEN_COMMA, comma_line, array, parseExpression(parser));
+    }
+
+    expect(parser, TOKEN_RBRACKET, "Ожидалось ']'");
+    return array;
+}
+
+
+static int parseLength(Parser* parser)
+{
+    assert(parser != NULL);
+
+    int line = parser->current_token.line;
+    advance(parser);
+    expect(parser, TOKEN_LPAREN, "Ожидалось '(' после len");
+
+    int operand = parseExpression(parser);
+    expect(parser, TOKEN_RPAREN, "Ожидалось ')'");
+
+    return createUnaryNode(parser, TOKEN_KEYWORD_LEN, line, operand);
+}
+
+
+// array(n, x) becomes (n 'array' x): n elements that all equal x.
+static int parseFilledArray(Parser* parser)
+{
+    assert(parser != NULL);
+
+    int line = parser->current_token.line;
+    advance(parser);
+    expect(parser, TOKEN_LPAREN, "Ожидалось '(' после array");
+
+    int length = parseExpression(parser);
+    expect(parser, TOKEN_COMMA, "Ожидалось ','");
+    int element = parseExpression(parser);
+    expect(parser, TOKEN_RPAREN, "Ожидалось ')'");
+
+    return createBinaryNode(parser, TOKEN_KEYWORD_ARRAY, line, length, element);
+}
+
+
 static void advance(Parser* parser)
 {
     assert(parser != NULL);
@@ -526,31 +769,85 @@ static bool expect(Parser* parser, TokenType type, const char* error_message)
 
 
 
-static int createNumberNode(Tree* ast, double value)
+static int createNumberNode(Parser* parser, double value)
 {
-    assert(ast != NULL);
+    assert(parser != NULL);
 
     tree_node_type data = {
         .type = SyntaxNodeType_NUMBER,
+        .line = parser->current_token.line,
         .data = {
             .number = value, 
         },
     };
 
-    return treeCreateNewNode(ast, data);
+    return treeCreateNewNode(parser->ast, data);
+}
+
+static int createIntegerNode(Parser* parser, int64_t value)
+{
+    assert(parser != NULL);
+
+    tree_node_type data = {
+        .type = SyntaxNodeType_INTEGER,
+        .line = parser->current_token.line,
+        .data = {
+            .integer = value,
+        },
+    };
+
+    return treeCreateNewNode(parser->ast, data);
 }
 
-static int createIdentifierNode(Tree* ast, const char* name)
+static int createIdentifierNode(Parser* parser, const char* name, size_t length)
 {
-    assert(ast  != NULL);
-    assert(name != NULL);
+    assert(parser != NULL);
+    assert(name   != NULL);
 
     tree_node_type data = {
         .type = SyntaxNodeType_IDENTIFIER,
+        .line = parser->current_token.line,
+        .data = {
+            .identifier = strndup(name, length),
+        },
+    };
+
+    return treeCreateNewNode(parser->ast, data);
+}
+
+static int createUnaryNode(Parser* parser, int operation, int line, int operand)
+{
+    assert(parser != NULL);
+
+    tree_node_type data = {
+        .type = SyntaxNodeType_UNARY_OPERATION,
+        .line = line,
+        .data = {
+            .operation = operation,
+        },
+    };
+
+    int node = treeCreateNewNode(parser->ast, data);
+    treeInsertOnLeft(parser->ast, node, operand);
+
+    return node;
+}
+
+static int createBinaryNode(Parser* parser, int operation, int line, int left, int right)
+{
+    assert(parser != NULL);
+
+    tree_node_type data = {
+        .type = SyntaxNodeType_BINARY_OPERATION,
+        .line = line,
         .data = {
-            .identifier = strdup(name),
+            .operation = operation,
         },
     };
 
-    return treeCreateNewNode(ast, data);
+    int node = treeCreateNewNode(parser->ast, data);
+    treeInsertOnLeft(parser->ast, node, left);
+    treeInsertOnRight(parser->ast, node, right);
+
+    return node;
 }
@@ -0,0 +1,491 @@
+#include "type_inference.h"
+
+#include <string.h>
+#include <assert.h>
+
+#include "tree_node_structure.h"
+#include "lexical_analysis.h"
+#include "print_ast.h"
+#include "resolver.h"
+#include "ssa.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+static void runInference(const SsaFunction* function, StaticType* values, NumberKind* kinds);
+static StaticType instructionType(const SsaFunction* function, const StaticType* values,
+                                  const SsaInstruction* instruction);
+static NumberKind instructionKind(const SsaFunction* function, const NumberKind* kinds,
+                                  const SsaInstruction* instruction);
+static StaticType operationType(int operation, StaticType left, StaticType right);
+static StaticType pairType(int operation, ValueType left, ValueType right);
+static void checkInstructions(const SsaFunction* function, const StaticType* values,
+                              TypeInference* types);
+static void collectSlotTypes(Tree* ast, const Resolution* resolution, TypeInference* types);
+static ValueType someType(StaticType type);
+
+
+// public ---------------------------------------------------------------------
+
+
+TypeInferenceState inferTypes(Tree* ast, TypeInference* types)
+{
+    assert(ast   != NULL);
+    assert(types != NULL);
+
+    *types = (TypeInference){};
+    arenaCtor(&types->names_arena);
+
+    SsaFunction function = {};
+    SsaState ssa_state = ssaBuild(ast, &function);
+    switch (ssa_state)
+    {
+        case SsaState_OK:            break;
+        case SsaState_RESOLVE_ERROR: return TypeInferenceState_RESOLVE_ERROR;
+        case SsaState_BAD_TREE:      return TypeInferenceState_BAD_TREE;
+        case SsaState_MEMORY_ERROR:
+        default:                     return TypeInferenceState_MEMORY_ERROR;
+    }
+
+    Resolution resolution = {};
+    StaticType* values = (StaticType*)calloc(function.instructions_number + 1, sizeof(StaticType));
+    NumberKind* kinds  = (NumberKind*)calloc(function.instructions_number + 1, sizeof(NumberKind));
+    types->nodes_number = ast->nodes_number;
+    types->slots_number = function.slots_number;
+    types->node_types   = (StaticType*)calloc(ast->nodes_number + 1, sizeof(StaticType));
+    types->node_kinds   = (NumberKind*)calloc(ast->nodes_number + 1, sizeof(NumberKind));
+    types->slot_types   = (StaticType*)calloc(function.slots_number + 1, sizeof(StaticType));
+    types->slot_names   = (const char**)calloc(function.slots_number + 1, sizeof(const char*));
+
+    bool built = values != NULL && kinds != NULL && types->node_types != NULL
+              && types->node_kinds != NULL && types->slot_types != NULL
+              && types->slot_names != NULL && resolveProgram(ast, &resolution) == ResolverState_OK;
+
+    for (size_t slot = 0; slot < function.slots_number && built; slot++)
+    {
+        const char* name = function.slot_names[slot];
+        types->slot_names[slot] = arenaStrndup(&types->names_arena, name, strlen(name));
+        built = types->slot_names[slot] != NULL;
+    }
+
+    if (built)
+    {
+        runInference(&function, values, kinds);
+        checkInstructions(&function, values, types);
+
+        for (size_t node = 0; node < ast->nodes_number; node++)
+        {
+            int value = function.node_values[node];
+            types->node_types[node] = value == NO_VALUE ? StaticType_NONE : values[value];
+            types->node_kinds[node] = value == NO_VALUE ? NumberKind_NONE : kinds[value];
+        }
+
+        collectSlotTypes(ast, &resolution, types);
+    }
+
+    resolutionDtor(&resolution);
+    free(values);
+    free(kinds);
+    ssaDtor(&function);
+
+    if (!built)
+    {
+        typeInferenceDtor(types);
+        return TypeInferenceState_MEMORY_ERROR;
+    }
+
+    return TypeInferenceState_OK;
+}
+
+
+void typeInferenceDtor(TypeInference* types)
+{
+    if (types == NULL)
+    {
+        return;
+    }
+
+    free(types->node_types);
+    free(types->node_kinds);
+    free(types->slot_types);
+    free(types->slot_names);
+    arenaDtor(&types->names_arena);
+
+    types->node_types = NULL;
+    types->node_kinds = NULL;
+    types->slot_types = NULL;
+    types->slot_names = NULL;
+}
+
+
+bool staticTypeIsDouble(const TypeInference* types, int node_index)
+{
+    return types != NULL && types->node_types[node_index] == StaticType_NUMBER
+        && types->node_kinds[node_index] == NumberKind_DOUBLE;
+}
+
+
+const char* staticTypeToString(StaticType type)
+{
+    if (type == StaticType_NONE)
+    {
+        return "none";
+    }
+
+    if ((type & (type - 1)) != 0)
+    {
+        return "dynamic";
+    }
+
+    return valueTypeToString(someType(type));
+}
+
+
+void typeInferenceDump(const TypeInference* types, FILE* output)
+{
+    assert(types  != NULL);
+    assert(output != NULL);
+
+    for (size_t slot = 0; slot < types->slots_number; slot++)
+    {
+        fprintf(output, "%s: %s\n", types->slot_names[slot], staticTypeToString(types->slot_types[slot]));
+    }
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+// Types only grow, and each has a few bits, so repeating the passes over
+// the reachable blocks until nothing changes ends quickly. Number kinds
+// grow the same way alongside.
+static void runInference(const SsaFunction* function, StaticType* values, NumberKind* kinds)
+{
+    assert(function != NULL);
+    assert(values   != NULL);
+    assert(kinds    != NULL);
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t block = 0; block < function->blocks_number; block++)
+        {
+            const SsaBlock* data = &function->blocks[block];
+            if (data->preorder < 0)
+            {
+                continue;
+            }
+
+            for (int i = 0; i < data->size; i++)
+            {
+                int value = function->schedule[data->first + i];
+                StaticType type = instructionType(function, values, &function->instructions[value]);
+                NumberKind kind = instructionKind(function, kinds, &function->instructions[value]);
+                if (type != values[value] || kind != kinds[value])
+                {
+                    values[value] = type;
+                    kinds[value]  = kind;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+
+static StaticType instructionType(const SsaFunction* function, const StaticType* values,
+                                  const SsaInstruction* instruction)
+{
+    assert(function    != NULL);
+    assert(values      != NULL);
+    assert(instruction != NULL);
+
+    switch (instruction->opcode)
+    {
+        case SsaOpcode_CONSTANT:
+            return (StaticType)(1 << valueType(function->constants[instruction->argument]));
+
+        case SsaOpcode_PHI:
+        {
+            StaticType type = StaticType_NONE;
+            for (int i = 0; i < instruction->arguments_number; i++)
+            {
+                type |= values[function->phi_arguments[instruction->argument + i]];
+            }
+            return type;
+        }
+
+        case SsaOpcode_UNARY:
+        {
+            StaticType operand = values[instruction->operands[0]];
+            switch (instruction->operation)
+            {
+                case TOKEN_BANG:
+                    return operand == StaticType_NONE ? StaticType_NONE : StaticType_BOOL;
+                case TOKEN_LBRACKET:
+                    return (operand & StaticType_NUMBER) != 0 ? StaticType_ARRAY : StaticType_NONE;
+                case TOKEN_KEYWORD_LEN:
+                    return (operand & (StaticType_ARRAY | StaticType_STRING)) != 0 ? StaticType_NUMBER
+                                                                                  : StaticType_NONE;
+                default:
+                    return operand & (StaticType_NUMBER | StaticType_ARRAY);
+            }
+        }
+
+        case SsaOpcode_BINARY:
+            return operationType(instruction->operation,
+                                 values[instruction->operands[0]],
+                                 values[instruction->operands[1]]);
+
+        case SsaOpcode_TRUTHY:
+            return values[instruction->operands[0]] == StaticType_NONE ? StaticType_NONE
+                                                                        : StaticType_BOOL;
+
+        case SsaOpcode_PRINT:
+        case SsaOpcode_JUMP:
+        case SsaOpcode_BRANCH:
+        case SsaOpcode_RETURN:
+        case SsaOpcode_NOP:
+        default:
+            return StaticType_NONE;
+    }
+}
+
+
+// Mirrors valueBinaryOperation and valueUnaryOperation: arithmetic on two
+// integers may give either kind (a fraction, an overflow, -0), with a
+// double it gives a double, and array elements are doubles. Only numbers
+// matter, so the kinds of other values are left as they come.
+static NumberKind instructionKind(const SsaFunction* function, const NumberKind* kinds,
+                                  const SsaInstruction* instruction)
+{
+    assert(function    != NULL);
+    assert(kinds       != NULL);
+    assert(instruction != NULL);
+
+    switch (instruction->opcode)
+    {
+        case SsaOpcode_CONSTANT:
+        {
+            Value constant = function->constants[instruction->argument];
+            if (!valueIsNumber(constant))
+            {
+                return NumberKind_NONE;
+            }
+            return valueIsInteger(constant) ? NumberKind_INTEGER : NumberKind_DOUBLE;
+        }
+
+        case SsaOpcode_PHI:
+        {
+            NumberKind kind = NumberKind_NONE;
+            for (int i = 0; i < instruction->arguments_number; i++)
+            {
+                kind |= kinds[function->phi_arguments[instruction->argument + i]];
+            }
+            return kind;
+        }
+
+        case SsaOpcode_UNARY:
+        {
+            NumberKind operand = kinds[instruction->operands[0]];
+            switch (instruction->operation)
+            {
+                case TOKEN_MINUS:
+                    return (operand & NumberKind_INTEGER) != 0 ? NumberKind_ANY : operand;
+                case TOKEN_KEYWORD_LEN:
+                    return NumberKind_INTEGER;
+                default:
+                    return NumberKind_NONE;
+            }
+        }
+
+        case SsaOpcode_BINARY:
+        {
+            NumberKind left  = kinds[instruction->operands[0]];
+            NumberKind right = kinds[instruction->operands[1]];
+            switch (instruction->operation)
+            {
+                case TOKEN_PLUS:
+                case TOKEN_MINUS:
+                case TOKEN_STAR:
+                case TOKEN_SLASH:
+                case TOKEN_PERCENT:
+                    if (left == NumberKind_NONE || right == NumberKind_NONE)
+                    {
+                        return NumberKind_NONE;
+                    }
+                    return left == NumberKind_DOUBLE || right == NumberKind_DOUBLE ? NumberKind_DOUBLE
+                                                                                 : NumberKind_ANY;
+                case TOKEN_LBRACKET:
+                    return NumberKind_DOUBLE;
+                default:
+                    return NumberKind_NONE;
+            }
+        }
+
+        default:
+            return NumberKind_NONE;
+    }
+}
+
+
+// The union of the results over every pair of operand types the operator
+// accepts.
+static StaticType operationType(int operation, StaticType left, StaticType right)
+{
+    StaticType type = StaticType_NONE;
+    for (int left_type = ValueType_NUMBER; left_type <= ValueType_ARRAY; left_type++)
+    {
+        for (int right_type = ValueType_NUMBER; right_type <= ValueType_ARRAY; right_type++)
+        {
+            if ((left & (1 << left_type)) != 0 && (right & (1 << right_type)) != 0)
+            {
+                type |= pairType(operation, (ValueType)left_type, (ValueType)right_type);
+            }
+        }
+    }
+
+    return type;
+}
+
+
+// Mirrors valueBinaryOperation.
+static StaticType pairType(int operation, ValueType left, ValueType right)
+{
+    bool numbers = left == ValueType_NUMBER && right == ValueType_NUMBER;
+    bool strings = left == ValueType_STRING && right == ValueType_STRING;
+    // Element-wise: an array with an array or a number.
+    bool arrays  = (left == ValueType_ARRAY && (right == ValueType_ARRAY || right == ValueType_NUMBER))
+                || (right == ValueType_ARRAY && left == ValueType_NUMBER);
+
+    switch (operation)
+    {
+        case TOKEN_AND:
+        case TOKEN_OR:
+        case TOKEN_EQEQ:
+        case TOKEN_BANGEQ:
+            return StaticType_BOOL;
+
+        case TOKEN_LT:
+        case TOKEN_GT:
+        case TOKEN_LTEQ:
+        case TOKEN_GTEQ:
+            return numbers || strings ? StaticType_BOOL : arrays ? StaticType_ARRAY : StaticType_NONE;
+
+        case TOKEN_PLUS:
+            return numbers ? StaticType_NUMBER : strings ? StaticType_STRING
+                 : arrays  ? StaticType_ARRAY  : StaticType_NONE;
+
+        case TOKEN_MINUS:
+        case TOKEN_STAR:
+        case TOKEN_SLASH:
+        case TOKEN_PERCENT:
+            return numbers ? StaticType_NUMBER : arrays ? StaticType_ARRAY : StaticType_NONE;
+
+        case TOKEN_LBRACKET:
+            return left == ValueType_ARRAY && right == ValueType_NUMBER ? StaticType_NUMBER
+                                                                       : StaticType_NONE;
+
+        case TOKEN_COMMA:
+            return left == ValueType_ARRAY && right == ValueType_NUMBER ? StaticType_ARRAY
+                                                                       : StaticType_NONE;
+
+        case TOKEN_KEYWORD_ARRAY:
+            return numbers ? StaticType_ARRAY : StaticType_NONE;
+
+        default:
+            return StaticType_NONE;
+    }
+}
+
+
+// An operator whose operands have types but which yields none always fails.
+// The first one in program order is reported.
+static void checkInstructions(const SsaFunction* function, const StaticType* values,
+                              TypeInference* types)
+{
+    assert(function != NULL);
+    assert(values   != NULL);
+    assert(types    != NULL);
+
+    for (size_t value = 0; value < function->instructions_number; value++)
+    {
+        const SsaInstruction* instruction = &function->instructions[value];
+        if ((instruction->opcode != SsaOpcode_UNARY && instruction->opcode != SsaOpcode_BINARY)
+         || values[value] != StaticType_NONE
+         || function->blocks[instruction->block].preorder < 0)
+        {
+            continue;
+        }
+
+        StaticType left  = values[instruction->operands[0]];
+        StaticType right = instruction->opcode == SsaOpcode_BINARY ? values[instruction->operands[1]]
+                                                                   : left;
+        if (left == StaticType_NONE || right == StaticType_NONE)
+        {
+            continue;
+        }
+
+        if (types->errors_number++ > 0)
+        {
+            continue;
+        }
+
+        const char* operation = tokenTypeToString(instruction->operation);
+        if (instruction->opcode == SsaOpcode_UNARY)
+        {
+            snprintf(types->error_message, sizeof(types->error_message),
+                     "Type error: cannot apply '%s' to %s (line %d)",
+                     operation, staticTypeToString(left), instruction->line);
+        }
+        else
+        {
+            snprintf(types->error_message, sizeof(types->error_message),
+                     "Type error: cannot apply '%s' to %s and %s (line %d)",
+                     operation, staticTypeToString(left), staticTypeToString(right),
+                     instruction->line);
+        }
+    }
+}
+
+
+static void collectSlotTypes(Tree* ast, const Resolution* resolution, TypeInference* types)
+{
+    assert(ast        != NULL);
+    assert(resolution != NULL);
+    assert(types      != NULL);
+
+    for (size_t node = 0; node < ast->nodes_number; node++)
+    {
+        const TreeNode* data = &ast->nodes_array[node];
+        if (data->data.type == SyntaxNodeType_IDENTIFIER && resolution->node_slots[node] != NO_SLOT)
+        {
+            types->slot_types[resolution->node_slots[node]] |= types->node_types[node];
+        }
+        else if ((data->data.type == SyntaxNodeType_ASSIGNMENT
+               || data->data.type == SyntaxNodeType_VAR_DECLARATION)
+              && data->left_index != EMPTY_NODE && data->right_index != EMPTY_NODE
+              && resolution->node_slots[data->left_index] != NO_SLOT)
+        {
+            types->slot_types[resolution->node_slots[data->left_index]] |= types->node_types[data->right_index];
+        }
+    }
+}
+
+
+static ValueType someType(StaticType type)
+{
+    if ((type & StaticType_NUMBER) != 0)
+    {
+        return ValueType_NUMBER;
+    }
+
+    if ((type & StaticType_ARRAY) != 0)
+    {
+        return ValueType_ARRAY;
+    }
+
+    return (type & StaticType_BOOL) != 0 ? ValueType_BOOL : ValueType_STRING;
+}
@@ -0,0 +1,1009 @@
+#include "value.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+#include "lexical_analysis.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+typedef enum NumberOrder
+{
+    NumberOrder_LESS      = 0,
+    NumberOrder_EQUAL     = 1,
+    NumberOrder_GREATER   = 2,
+    NumberOrder_UNORDERED = 3,
+} NumberOrder;
+
+static bool numbersEqual(double left, double right);
+static NumberOrder compareNumbers(Value left, Value right);
+static NumberOrder compareIntegerToDouble(int64_t left, double right);
+static NumberOrder compareDoubles(double left, double right);
+static RuntimeState concatenateStrings(const char* left, const char* right,
+                                       Arena* arena, Value* result);
+static RuntimeState compareValues(int operation, Value left, Value right, Value* result);
+
+// The elements of one or more arrays. Arrays never change: each one is a
+// view of the first length elements of its storage. Appending to the
+// longest view writes into the spare capacity, so building a literal one
+// element at a time copies each element a constant number of times on
+// average; appending to a shorter view copies.
+typedef struct ArrayStorage
+{
+    size_t used;        // elements some array covers
+    size_t capacity;
+    alignas(16) double elements[];
+} ArrayStorage;
+
+static ArrayObject* newArray(size_t length, size_t capacity, Arena* arena);
+static RuntimeState arrayBinaryOperation(int operation, Value left, Value right,
+                                         Arena* arena, Value* result);
+static RuntimeState indexArray(const ArrayObject* array, Value index, Value* result);
+static RuntimeState fillArray(Value length, Value element, Arena* arena, Value* result);
+static RuntimeState appendToArray(const ArrayObject* array, Value element,
+                                  Arena* arena, Value* result);
+static RuntimeState negateArray(const ArrayObject* array, Arena* arena, Value* result);
+static void applyElementWise(int operation, const double* left, bool left_is_number,
+                             const double* right, bool right_is_number,
+                             double* result, size_t length);
+static bool arrayIsTruthy(const ArrayObject* array);
+static bool arraysEqual(const ArrayObject* left, const ArrayObject* right);
+static void printArray(FILE* output, const ArrayObject* array);
+
+// 2^63 as a double, the first one above every int64_t.
+static const double INTEGER_LIMIT = 9223372036854775808.0;
+
+// The capacity of a one-element array, room for a short literal.
+static const size_t ARRAY_START_CAPACITY = 8;
+
+
+struct ArrayObject
+{
+    size_t        length;
+    ArrayStorage* storage;
+};
+
+
+// public ---------------------------------------------------------------------
+
+
+#ifndef VALUE_TAGGED_UNION
+
+Value valueString(const char* string)
+{
+    assert(((uintptr_t)string & ~VALUE_PAYLOAD_MASK) == 0);
+
+    Value value = {.bits = VALUE_STRING_TAG | (uint64_t)(uintptr_t)string};
+    return value;
+}
+
+
+Value valueStringObject(const char* string)
+{
+    assert(((uintptr_t)string & ~VALUE_PAYLOAD_MASK) == 0);
+
+    Value value = {.bits = VALUE_STRING_OBJECT_TAG | (uint64_t)(uintptr_t)string};
+    return value;
+}
+
+
+Value valueArray(const ArrayObject* array)
+{
+    assert(((uintptr_t)array & ~VALUE_PAYLOAD_MASK) == 0);
+
+    Value value = {.bits = VALUE_ARRAY_TAG | (uint64_t)(uintptr_t)array};
+    return value;
+}
+
+
+ValueType valueType(Value value)
+{
+    if (valueIsNumber(value))
+    {
+        return ValueType_NUMBER;
+    }
+
+    if (valueIsArray(value))
+    {
+        return ValueType_ARRAY;
+    }
+
+    return (value.bits & VALUE_SIGN) != 0 ? ValueType_STRING : ValueType_BOOL;
+}
+
+
+int64_t valueAsInteger(Value value)
+{
+    assert(valueIsInteger(value));
+
+    if (valueIsSmallInteger(value))
+    {
+        return valueAsSmallInteger(value);
+    }
+
+    return *(const int64_t*)(uintptr_t)(value.bits & VALUE_PAYLOAD_MASK);
+}
+
+
+RuntimeState valueMakeInteger(int64_t integer, Arena* arena, Value* result)
+{
+    assert(result != NULL);
+
+    if (valueIntegerIsSmall(integer))
+    {
+        *result = valueSmallInteger(integer);
+        return RuntimeState_OK;
+    }
+
+    int64_t* box = arena == NULL ? NULL : (int64_t*)arenaAllocObject(arena, sizeof(int64_t));
+    if (box == NULL)
+    {
+        return RuntimeState_MEMORY_ERROR;
+    }
+
+    assert(((uintptr_t)box & ~VALUE_PAYLOAD_MASK) == 0);
+
+    *box = integer;
+    result->bits = VALUE_BOXED_TAG | (uint64_t)(uintptr_t)box;
+    return RuntimeState_OK;
+}
+
+#else
+
+RuntimeState valueMakeInteger(int64_t integer, Arena*, Value* result)
+{
+    assert(result != NULL);
+
+    *result = valueSmallInteger(integer);
+    return RuntimeState_OK;
+}
+
+#endif
+
+
+void valueMarkAll(const Value* values, size_t values_number)
+{
+    assert(values != NULL || values_number == 0);
+
+    for (size_t i = 0; i < values_number; i++)
+    {
+#ifndef VALUE_TAGGED_UNION
+        if (valueIsInteger(values[i]) && !valueIsSmallInteger(values[i]))
+        {
+            arenaMarkObject((void*)(uintptr_t)(values[i].bits & VALUE_PAYLOAD_MASK));
+        }
+        bool string_object = (values[i].bits & VALUE_ARRAY_MASK) == VALUE_STRING_OBJECT_TAG;
+#else
+        bool string_object = valueIsString(values[i]) && values[i].is_object;
+#endif
+        if (string_object)
+        {
+            arenaMarkObject((void*)(uintptr_t)valueAsString(values[i]));
+        }
+        if (valueIsArray(values[i]))
+        {
+            const ArrayObject* array = valueAsArray(values[i]);
+            arenaMarkObject((void*)(uintptr_t)array);
+            arenaMarkObject(array->storage);
+        }
+    }
+}
+
+
+double valueAsNumber(Value value)
+{
+    return valueIsInteger(value) ? (double)valueAsInteger(value) : valueAsDouble(value);
+}
+
+
+bool valueIsTruthy(Value value)
+{
+    switch (valueType(value))
+    {
+        case ValueType_BOOL:   return valueAsBool(value);
+        case ValueType_NUMBER: return valueIsInteger(value) ? valueAsInteger(value) != 0
+                                                            : isless(0.0, fabs(valueAsDouble(value)));
+        case ValueType_STRING: return valueAsString(value)[0] != '\0';
+        case ValueType_ARRAY:  return arrayIsTruthy(valueAsArray(value));
+        default:               return false;
+    }
+}
+
+
+bool valueEquals(Value left, Value right)
+{
+    if (valueType(left) != valueType(right))
+    {
+        return false;
+    }
+
+    switch (valueType(left))
+    {
+        case ValueType_NUMBER: return compareNumbers(left, right) == NumberOrder_EQUAL;
+        case ValueType_BOOL:   return valueAsBool(left) == valueAsBool(right);
+        case ValueType_STRING: return strcmp(valueAsString(left), valueAsString(right)) == 0;
+        case ValueType_ARRAY:  return arraysEqual(valueAsArray(left), valueAsArray(right));
+        default:               return false;
+    }
+}
+
+
+RuntimeState valueBinaryOperation(int operation, Value left, Value right,
+                                  Arena* arena, Value* result)
+{
+    assert(result != NULL);
+
+    switch (operation)
+    {
+        case TOKEN_AND:
+            *result = valueBool(valueIsTruthy(left) && valueIsTruthy(right));
+            return RuntimeState_OK;
+        case TOKEN_OR:
+            *result = valueBool(valueIsTruthy(left) || valueIsTruthy(right));
+            return RuntimeState_OK;
+        case TOKEN_EQEQ:
+            *result = valueBool(valueEquals(left, right));
+            return RuntimeState_OK;
+        case TOKEN_BANGEQ:
+            *result = valueBool(!valueEquals(left, right));
+            return RuntimeState_OK;
+        case TOKEN_KEYWORD_ARRAY:
+            return fillArray(left, right, arena, result);
+        default:
+            break;
+    }
+
+    if (valueIsArray(left) || valueIsArray(right))
+    {
+        return arrayBinaryOperation(operation, left, right, arena, result);
+    }
+
+    switch (operation)
+    {
+        case TOKEN_LT:
+        case TOKEN_GT:
+        case TOKEN_LTEQ:
+        case TOKEN_GTEQ:
+            return compareValues(operation, left, right, result);
+        default:
+            break;
+    }
+
+    if (operation == TOKEN_PLUS && valueIsString(left) && valueIsString(right))
+    {
+        return concatenateStrings(valueAsString(left), valueAsString(right), arena, result);
+    }
+
+    if (!valueIsNumber(left) || !valueIsNumber(right))
+    {
+        return RuntimeState_TYPE_ERROR;
+    }
+
+    int64_t integer = 0;
+    if (valueIsInteger(left) && valueIsInteger(right)
+     && integerBinaryOperation(operation, valueAsInteger(left), valueAsInteger(right), &integer))
+    {
+        return valueMakeInteger(integer, arena, result);
+    }
+
+    double left_number  = valueAsNumber(left);
+    double right_number = valueAsNumber(right);
+
+    switch (operation)
+    {
+        case TOKEN_PLUS:    *result = valueNumber(left_number + right_number);      break;
+        case TOKEN_MINUS:   *result = valueNumber(left_number - right_number);      break;
+        case TOKEN_STAR:    *result = valueNumber(left_number * right_number);      break;
+        case TOKEN_SLASH:   *result = valueNumber(numberDivide(left_number, right_number)); break;
+        case TOKEN_PERCENT: *result = valueNumber(fmod(left_number, right_number)); break;
+        default:            return RuntimeState_TYPE_ERROR;
+    }
+
+    return RuntimeState_OK;
+}
+
+
+RuntimeState valueUnaryOperation(int operation, Value operand, Arena* arena, Value* result)
+{
+    assert(result != NULL);
+
+    switch (operation)
+    {
+        case TOKEN_BANG:
+            *result = valueBool(!valueIsTruthy(operand));
+            return RuntimeState_OK;
+        case TOKEN_MINUS:
+            if (valueIsArray(operand))
+            {
+                return negateArray(valueAsArray(operand), arena, result);
+            }
+            if (!valueIsNumber(operand))
+            {
+                return RuntimeState_TYPE_ERROR;
+            }
+            // -0 and -INT64_MIN are not integers.
+            if (valueIsInteger(operand) && valueAsInteger(operand) != 0
+             && valueAsInteger(operand) != INT64_MIN)
+            {
+                return valueMakeInteger(-valueAsInteger(operand), arena, result);
+            }
+            *result = valueNumber(-valueAsNumber(operand));
+            return RuntimeState_OK;
+        case TOKEN_LBRACKET:
+        {
+            if (!valueIsNumber(operand))
+            {
+                return RuntimeState_TYPE_ERROR;
+            }
+            ArrayObject* array = newArray(1, ARRAY_START_CAPACITY, arena);
+            if (array == NULL)
+            {
+                return RuntimeState_MEMORY_ERROR;
+            }
+            array->storage->elements[0] = valueAsNumber(operand);
+            *result = valueArray(array);
+            return RuntimeState_OK;
+        }
+        case TOKEN_KEYWORD_LEN:
+            if (valueIsArray(operand))
+            {
+                return valueMakeInteger((int64_t)valueAsArray(operand)->length, arena, result);
+            }
+            if (valueIsString(operand))
+            {
+                return valueMakeInteger((int64_t)strlen(valueAsString(operand)), arena, result);
+            }
+            return RuntimeState_TYPE_ERROR;
+        default:
+            return RuntimeState_TYPE_ERROR;
+    }
+}
+
+
+bool integerBinaryOperation(int operation, int64_t left, int64_t right, int64_t* result)
+{
+    assert(result != NULL);
+
+    switch (operation)
+    {
+        case TOKEN_PLUS:
+            return !__builtin_add_overflow(left, right, result);
+        case TOKEN_MINUS:
+            return !__builtin_sub_overflow(left, right, result);
+        case TOKEN_STAR:
+            // -5 * 0 is -0.
+            return !__builtin_mul_overflow(left, right, result) && (*result != 0 || (left >= 0 && right >= 0));
+        case TOKEN_SLASH:
+            // Only exact quotients: 7 / 2 is 3.5 and 0 / -2 is -0.
+            if (right == 0 || (left == INT64_MIN && right == -1) || left % right != 0
+             || (left == 0 && right < 0))
+            {
+                return false;
+            }
+            *result = left / right;
+            return true;
+        case TOKEN_PERCENT:
+            // fmod keeps the sign of the dividend, so -4 % 2 is -0.
+            if (right == 0)
+            {
+                return false;
+            }
+            *result = right == -1 ? 0 : left % right;
+            return *result != 0 || left >= 0;
+        default:
+            return false;
+    }
+}
+
+
+__attribute__((no_sanitize("float-divide-by-zero")))
+double numberDivide(double left, double right)
+{
+    return left / right;
+}
+
+
+const char* valueTypeToString(ValueType type)
+{
+    switch (type)
+    {
+        case ValueType_NUMBER: return "number";
+        case ValueType_BOOL:   return "bool";
+        case ValueType_STRING: return "string";
+        case ValueType_ARRAY:  return "array";
+        default:               return "unknown";
+    }
+}
+
+
+const char* runtimeStateToString(RuntimeState state)
+{
+    switch (state)
+    {
+        case RuntimeState_OK:           return "ok";
+        case RuntimeState_TYPE_ERROR:   return "wrong operand types";
+        case RuntimeState_MEMORY_ERROR: return "out of memory";
+        case RuntimeState_INDEX_ERROR:  return "index out of range";
+        case RuntimeState_LENGTH_ERROR: return "arrays of different lengths";
+        case RuntimeState_SIZE_ERROR:   return "array size is not a whole number >= 0";
+        default:                        return "unknown error";
+    }
+}
+
+
+void valueFormatNumber(char* buffer, size_t buffer_size, double number)
+{
+    assert(buffer != NULL);
+
+    // The sign of a NaN depends on how the backend got there, so every
+    // NaN prints the same.
+    if (isnan(number))
+    {
+        snprintf(buffer, buffer_size, "nan");
+        return;
+    }
+
+    // Shortest of %.15g and %.17g that reads back as the same double.
+    snprintf(buffer, buffer_size, "%.15g", number);
+    if (!numbersEqual(strtod(buffer, NULL), number))
+    {
+        snprintf(buffer, buffer_size, "%.17g", number);
+    }
+}
+
+
+void valueFormatInteger(char* buffer, size_t buffer_size, int64_t integer)
+{
+    assert(buffer != NULL);
+
+    snprintf(buffer, buffer_size, "%" PRId64, integer);
+}
+
+
+void valuePrint(FILE* output, Value value)
+{
+    assert(output != NULL);
+
+    switch (valueType(value))
+    {
+        case ValueType_NUMBER:
+        {
+            char buffer[NUMBER_TEXT_BUFFER_SIZE] = {};
+            if (valueIsInteger(value))
+            {
+                valueFormatInteger(buffer, sizeof(buffer), valueAsInteger(value));
+            }
+            else
+            {
+                valueFormatNumber(buffer, sizeof(buffer), valueAsDouble(value));
+            }
+            fputs(buffer, output);
+            break;
+        }
+        case ValueType_BOOL:
+            fputs(valueAsBool(value) ? "true" : "false", output);
+            break;
+        case ValueType_STRING:
+            fputs(valueAsString(value), output);
+            break;
+        case ValueType_ARRAY:
+            printArray(output, valueAsArray(value));
+            break;
+        default:
+            break;
+    }
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static bool numbersEqual(double left, double right)
+{
+    return !isunordered(left, right)
+        && !isless(left, right)
+        && !isgreater(left, right);
+}
+
+
+static NumberOrder compareNumbers(Value left, Value right)
+{
+    if (valueIsInteger(left) && valueIsInteger(right))
+    {
+        int64_t left_integer  = valueAsInteger(left);
+        int64_t right_integer = valueAsInteger(right);
+        return left_integer < right_integer ? NumberOrder_LESS
+             : left_integer > right_integer ? NumberOrder_GREATER
+             :                                NumberOrder_EQUAL;
+    }
+
+    if (valueIsInteger(left))
+    {
+        return compareIntegerToDouble(valueAsInteger(left), valueAsDouble(right));
+    }
+
+    if (valueIsInteger(right))
+    {
+        NumberOrder order = compareIntegerToDouble(valueAsInteger(right), valueAsDouble(left));
+        return order == NumberOrder_LESS    ? NumberOrder_GREATER
+             : order == NumberOrder_GREATER ? NumberOrder_LESS
+             :                                order;
+    }
+
+    return compareDoubles(valueAsDouble(left), valueAsDouble(right));
+}
+
+
+// Exact, unlike converting the integer to a double: 2^53 + 1 is greater
+// than the double 2^53.
+static NumberOrder compareIntegerToDouble(int64_t left, double right)
+{
+    if (isnan(right))
+    {
+        return NumberOrder_UNORDERED;
+    }
+
+    if (isgreaterequal(right, INTEGER_LIMIT))
+    {
+        return NumberOrder_LESS;
+    }
+
+    if (isless(right, -INTEGER_LIMIT))
+    {
+        return NumberOrder_GREATER;
+    }
+
+    // right is within the int64_t range, so its integral part converts exactly.
+    double  whole         = trunc(right);
+    int64_t right_integer = (int64_t)whole;
+    if (left != right_integer)
+    {
+        return left < right_integer ? NumberOrder_LESS : NumberOrder_GREATER;
+    }
+
+    return compareDoubles(0, right - whole);
+}
+
+
+static NumberOrder compareDoubles(double left, double right)
+{
+    return isless(left, right)       ? NumberOrder_LESS
+         : isgreater(left, right)    ? NumberOrder_GREATER
+         : numbersEqual(left, right) ? NumberOrder_EQUAL
+         :                             NumberOrder_UNORDERED;
+}
+
+
+static RuntimeState concatenateStrings(const char* left, const char* right,
+                                       Arena* arena, Value* result)
+{
+    assert(left   != NULL);
+    assert(right  != NULL);
+    assert(result != NULL);
+
+    if (arena == NULL)
+    {
+        return RuntimeState_MEMORY_ERROR;
+    }
+
+    size_t left_length  = strlen(left);
+    size_t right_length = strlen(right);
+
+    char* string = (char*)arenaAllocObject(arena, left_length + right_length + 1);
+    if (string == NULL)
+    {
+        return RuntimeState_MEMORY_ERROR;
+    }
+
+    memcpy(string, left, left_length);
+    memcpy(string + left_length, right, right_length + 1);
+
+    *result = valueStringObject(string);
+    return RuntimeState_OK;
+}
+
+
+static RuntimeState compareValues(int operation, Value left, Value right, Value* result)
+{
+    assert(result != NULL);
+
+    int order = 0;
+    if (valueIsNumber(left) && valueIsNumber(right))
+    {
+        NumberOrder number_order = compareNumbers(left, right);
+        switch (operation)
+        {
+            case TOKEN_LT:   *result = valueBool(number_order == NumberOrder_LESS);    break;
+            case TOKEN_GT:   *result = valueBool(number_order == NumberOrder_GREATER); break;
+            case TOKEN_LTEQ: *result = valueBool(number_order == NumberOrder_LESS
+                                              || number_order == NumberOrder_EQUAL);   break;
+            case TOKEN_GTEQ: *result = valueBool(number_order == NumberOrder_GREATER
+                                              || number_order == NumberOrder_EQUAL);   break;
+            default:         return RuntimeState_TYPE_ERROR;
+        }
+
+        return RuntimeState_OK;
+    }
+
+    if (!valueIsString(left) || !valueIsString(right))
+    {
+        return RuntimeState_TYPE_ERROR;
+    }
+
+    order = strcmp(valueAsString(left), valueAsString(right));
+    switch (operation)
+    {
+        case TOKEN_LT:   *result = valueBool(order <  0); break;
+        case TOKEN_GT:   *result = valueBool(order >  0); break;
+        case TOKEN_LTEQ: *result = valueBool(order <= 0); break;
+        case TOKEN_GTEQ: *result = valueBool(order >= 0); break;
+        default:         return RuntimeState_TYPE_ERROR;
+    }
+
+    return RuntimeState_OK;
+}
+
+
+static ArrayObject* newArray(size_t length, size_t capacity, Arena* arena)
+{
+    assert(length <= capacity);
+
+    if (arena == NULL || capacity > (SIZE_MAX - sizeof(ArrayStorage)) / sizeof(double))
+    {
+        return NULL;
+    }
+
+    ArrayObject*  array   = (ArrayObject*) arenaAllocObject(arena, sizeof(ArrayObject));
+    ArrayStorage* storage = (ArrayStorage*)arenaAllocObject(arena, sizeof(ArrayStorage)
+                                                                   + capacity * sizeof(double));
+    if (array == NULL || storage == NULL)
+    {
+        return NULL;
+    }
+
+    storage->used     = length;
+    storage->capacity = capacity;
+    array->length     = length;
+    array->storage    = storage;
+
+    return array;
+}
+
+
+// At least one operand is an array. A number on the other side applies to
+// every element as a double.
+static RuntimeState arrayBinaryOperation(int operation, Value left, Value right,
+                                         Arena* arena, Value* result)
+{
+    assert(result != NULL);
+
+    switch (operation)
+    {
+        case TOKEN_LBRACKET:
+            return valueIsArray(left) ? indexArray(valueAsArray(left), right, result)
+                                      : RuntimeState_TYPE_ERROR;
+        case TOKEN_COMMA:
+            return valueIsArray(left) ? appendToArray(valueAsArray(left), right, arena, result)
+                                      : RuntimeState_TYPE_ERROR;
+        case TOKEN_PLUS:
+        case TOKEN_MINUS:
+        case TOKEN_STAR:
+        case TOKEN_SLASH:
+        case TOKEN_PERCENT:
+        case TOKEN_LT:
+        case TOKEN_GT:
+        case TOKEN_LTEQ:
+        case TOKEN_GTEQ:
+            break;
+        default:
+            return RuntimeState_TYPE_ERROR;
+    }
+
+    if ((!valueIsArray(left) && !valueIsNumber(left)) || (!valueIsArray(right) && !valueIsNumber(right)))
+    {
+        return RuntimeState_TYPE_ERROR;
+    }
+
+    double left_number  = valueIsArray(left)  ? 0 : valueAsNumber(left);
+    double right_number = valueIsArray(right) ? 0 : valueAsNumber(right);
+    const double* left_elements  = valueIsArray(left)  ? valueAsArray(left)->storage->elements
+                                                       : &left_number;
+    const double* right_elements = valueIsArray(right) ? valueAsArray(right)->storage->elements
+                                                       : &right_number;
+
+    size_t length = valueIsArray(left) ? valueAsArray(left)->length : valueAsArray(right)->length;
+    if (valueIsArray(left) && valueIsArray(right) && valueAsArray(right)->length != length)
+    {
+        return RuntimeState_LENGTH_ERROR;
+    }
+
+    ArrayObject* array = newArray(length, length, arena);
+    if (array == NULL)
+    {
+        return RuntimeState_MEMORY_ERROR;
+    }
+
+    applyElementWise(operation, left_elements, !valueIsArray(left), right_elements,
+                     !valueIsArray(right), array->storage->elements, length);
+
+    *result = valueArray(array);
+    return RuntimeState_OK;
+}
+
+
+// The index is a number with an integral value within the array.
+static RuntimeState indexArray(const ArrayObject* array, Value index, Value* result)
+{
+    assert(array  != NULL);
+    assert(result != NULL);
+
+    if (!valueIsNumber(index))
+    {
+        return RuntimeState_TYPE_ERROR;
+    }
+
+    double position = valueAsNumber(index);
+    if (!isgreaterequal(position, 0) || !isless(position, (double)array->length)
+     || islessgreater(trunc(position), position))
+    {
+        return RuntimeState_INDEX_ERROR;
+    }
+
+    *result = valueNumber(array->storage->elements[(size_t)position]);
+    return RuntimeState_OK;
+}
+
+
+// The length is a whole number, 0 included. One too large for memory is a
+// memory error, like any other allocation that fails.
+static RuntimeState fillArray(Value length, Value element, Arena* arena, Value* result)
+{
+    assert(result != NULL);
+
+    if (!valueIsNumber(length) || !valueIsNumber(element))
+    {
+        return RuntimeState_TYPE_ERROR;
+    }
+
+    double size = valueAsNumber(length);
+    if (!isgreaterequal(size, 0) || !isless(size, INTEGER_LIMIT) || islessgreater(trunc(size), size))
+    {
+        return RuntimeState_SIZE_ERROR;
+    }
+
+    ArrayObject* array = newArray((size_t)size, (size_t)size, arena);
+    if (array == NULL)
+    {
+        return RuntimeState_MEMORY_ERROR;
+    }
+
+    double number = valueAsNumber(element);
+    for (size_t i = 0; i < array->length; i++)
+    {
+        array->storage->elements[i] = number;
+    }
+
+    *result = valueArray(array);
+    return RuntimeState_OK;
+}
+
+
+static RuntimeState appendToArray(const ArrayObject* array, Value element,
+                                  Arena* arena, Value* result)
+{
+    assert(array  != NULL);
+    assert(result != NULL);
+
+    if (!valueIsNumber(element))
+    {
+        return RuntimeState_TYPE_ERROR;
+    }
+
+    ArrayStorage* storage = array->storage;
+    ArrayObject* appended = NULL;
+    if (array->length == storage->used && storage->used < storage->capacity)
+    {
+        appended = arena == NULL ? NULL : (ArrayObject*)arenaAllocObject(arena, sizeof(ArrayObject));
+        if (appended == NULL)
+        {
+            return RuntimeState_MEMORY_ERROR;
+        }
+        appended->length  = array->length + 1;
+        appended->storage = storage;
+        storage->used++;
+    }
+    else
+    {
+        size_t capacity = array->length < ARRAY_START_CAPACITY / 2 ? ARRAY_START_CAPACITY
+                                                                    : 2 * array->length;
+        appended = newArray(array->length + 1, capacity, arena);
+        if (appended == NULL)
+        {
+            return RuntimeState_MEMORY_ERROR;
+        }
+        memcpy(appended->storage->elements, storage->elements, array->length * sizeof(double));
+    }
+
+    appended->storage->elements[array->length] = valueAsNumber(element);
+    *result = valueArray(appended);
+    return RuntimeState_OK;
+}
+
+
+static RuntimeState negateArray(const ArrayObject* array, Arena* arena, Value* result)
+{
+    assert(array  != NULL);
+    assert(result != NULL);
+
+    ArrayObject* negated = newArray(array->length, array->length, arena);
+    if (negated == NULL)
+    {
+        return RuntimeState_MEMORY_ERROR;
+    }
+
+    const double* elements = array->storage->elements;
+    double*       target   = negated->storage->elements;
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128d SIGN = _mm_set1_pd(-0.0);
+    for (; i + 2 <= array->length; i += 2)
+    {
+        _mm_store_pd(target + i, _mm_xor_pd(_mm_load_pd(elements + i), SIGN));
+    }
+#endif
+    for (; i < array->length; i++)
+    {
+        target[i] = -elements[i];
+    }
+
+    *result = valueArray(negated);
+    return RuntimeState_OK;
+}
+
+
+// One pass over the elements, two at a time with SSE2: elements start
+// 16-byte aligned, so the loads and stores are aligned ones. x and y name
+// the left and right element in vector_ and scalar_, and a number operand
+// is broadcast to every lane. % has no vector form and runs fmod.
+#ifdef __SSE2__
+    #define ARRAY_VECTOR_LOOP(load_x_, load_y_, vector_)                            \
+        for (; i + 2 <= length; i += 2)                                             \
+        {                                                                           \
+            __m128d x = (load_x_);                                                  \
+            __m128d y = (load_y_);                                                  \
+            _mm_store_pd(result + i, (vector_));                                    \
+        }
+#else
+    #define ARRAY_VECTOR_LOOP(load_x_, load_y_, vector_)
+#endif
+
+#define ARRAY_LOOP(load_x_, load_y_, vector_, scalar_)                              \
+    do                                                                              \
+    {                                                                               \
+        size_t i = 0;                                                               \
+        ARRAY_VECTOR_LOOP(load_x_, load_y_, vector_)                                \
+        for (; i < length; i++)                                                     \
+        {                                                                           \
+            double x = left [left_is_number  ? 0 : i];                              \
+            double y = right[right_is_number ? 0 : i];                              \
+            result[i] = (scalar_);                                                  \
+        }                                                                           \
+    } while (0)
+
+#define ARRAY_KERNEL(vector_, scalar_)                                              \
+    do                                                                              \
+    {                                                                               \
+        if (left_is_number)                                                         \
+        {                                                                           \
+            ARRAY_LOOP(_mm_set1_pd(*left), _mm_load_pd(right + i), vector_, scalar_); \
+        }                                                                           \
+        else if (right_is_number)                                                   \
+        {                                                                           \
+            ARRAY_LOOP(_mm_load_pd(left + i), _mm_set1_pd(*right), vector_, scalar_); \
+        }                                                                           \
+        else                                                                        \
+        {                                                                           \
+            ARRAY_LOOP(_mm_load_pd(left + i), _mm_load_pd(right + i), vector_, scalar_); \
+        }                                                                           \
+    } while (0)
+
+__attribute__((no_sanitize("float-divide-by-zero")))
+static void applyElementWise(int operation, const double* left, bool left_is_number,
+                             const double* right, bool right_is_number,
+                             double* result, size_t length)
+{
+    assert(left   != NULL);
+    assert(right  != NULL);
+    assert(result != NULL);
+
+#ifdef __SSE2__
+    const __m128d ONE = _mm_set1_pd(1.0);
+#endif
+
+    switch (operation)
+    {
+        case TOKEN_PLUS:  ARRAY_KERNEL(_mm_add_pd(x, y), x + y); break;
+        case TOKEN_MINUS: ARRAY_KERNEL(_mm_sub_pd(x, y), x - y); break;
+        case TOKEN_STAR:  ARRAY_KERNEL(_mm_mul_pd(x, y), x * y); break;
+        case TOKEN_SLASH: ARRAY_KERNEL(_mm_div_pd(x, y), x / y); break;
+        case TOKEN_LT:    ARRAY_KERNEL(_mm_and_pd(_mm_cmplt_pd(x, y), ONE), isless(x, y)         ? 1.0 : 0.0); break;
+        case TOKEN_GT:    ARRAY_KERNEL(_mm_and_pd(_mm_cmpgt_pd(x, y), ONE), isgreater(x, y)      ? 1.0 : 0.0); break;
+        case TOKEN_LTEQ:  ARRAY_KERNEL(_mm_and_pd(_mm_cmple_pd(x, y), ONE), islessequal(x, y)    ? 1.0 : 0.0); break;
+        case TOKEN_GTEQ:  ARRAY_KERNEL(_mm_and_pd(_mm_cmpge_pd(x, y), ONE), isgreaterequal(x, y) ? 1.0 : 0.0); break;
+        case TOKEN_PERCENT:
+        default:
+            for (size_t i = 0; i < length; i++)
+            {
+                result[i] = fmod(left[left_is_number ? 0 : i], right[right_is_number ? 0 : i]);
+            }
+            break;
+    }
+}
+
+#undef ARRAY_VECTOR_LOOP
+#undef ARRAY_LOOP
+#undef ARRAY_KERNEL
+
+
+static bool arrayIsTruthy(const ArrayObject* array)
+{
+    assert(array != NULL);
+
+    for (size_t i = 0; i < array->length; i++)
+    {
+        if (!isless(0.0, fabs(array->storage->elements[i])))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static bool arraysEqual(const ArrayObject* left, const ArrayObject* right)
+{
+    assert(left  != NULL);
+    assert(right != NULL);
+
+    if (left->length != right->length)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < left->length; i++)
+    {
+        if (!numbersEqual(left->storage->elements[i], right->storage->elements[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static void printArray(FILE* output, const ArrayObject* array)
+{
+    assert(output != NULL);
+    assert(array  != NULL);
+
+    char buffer[NUMBER_TEXT_BUFFER_SIZE] = {};
+    fputc('[', output);
+    for (size_t i = 0; i < array->length; i++)
+    {
+        valueFormatNumber(buffer, sizeof(buffer), array->storage->elements[i]);
+        fputs(i == 0 ? "" : ", ", output);
+        fputs(buffer, output);
+    }
+    fputc(']', output);
+}
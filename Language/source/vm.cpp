@@ -0,0 +1,780 @@
+#include "vm.h"
+
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "lexical_analysis.h"
+#include "print_ast.h"
+
+
+// static ---------------------------------------------------------------------
+
+
+static void vmError(VM* vm, RuntimeState state, size_t offset, Opcode opcode,
+                    Value left, Value right, bool is_unary);
+static void sweepArena(VM* vm, const Value* sp);
+
+// Computed goto pays off only while every handler ends in its own indirect
+// jump, which the branch predictor learns per opcode. GCC's crossjumping
+// merges the identical handler tails back into a few shared jumps (108
+// dispatches became 9 once the _DOUBLE handlers shrank), so it is off here.
+#if defined(VM_COMPUTED_GOTO) && defined(__GNUC__) && !defined(__clang__)
+    #define VM_KEEP_DISPATCHES __attribute__((optimize("no-crossjumping")))
+#else
+    #define VM_KEEP_DISPATCHES
+#endif
+
+
+// public ---------------------------------------------------------------------
+
+
+VMState vmCtor(VM* vm, const Chunk* chunk, FILE* output)
+{
+    assert(vm     != NULL);
+    assert(chunk  != NULL);
+    assert(output != NULL);
+
+    *vm = (VM){};
+    vm->chunk  = chunk;
+    vm->output = output;
+    arenaCtor(&vm->arena);
+
+    vm->frame = (Value*)malloc((chunk->slots_number + 1) * sizeof(Value));
+    vm->stack = (Value*)malloc((chunk->max_stack    + 1) * sizeof(Value));
+    if (vm->frame == NULL || vm->stack == NULL)
+    {
+        vm->state = VMState_MEMORY_ERROR;
+        return vm->state;
+    }
+
+    for (size_t slot = 0; slot < chunk->slots_number; slot++)
+    {
+        vm->frame[slot] = valueSmallInteger(0);
+    }
+
+#ifdef VM_PROFILE_PAIRS
+    vm->pair_counts = (uint64_t*)calloc((size_t)(OPCODES_NUMBER * OPCODES_NUMBER), sizeof(uint64_t));
+    if (vm->pair_counts == NULL)
+    {
+        vm->state = VMState_MEMORY_ERROR;
+        return vm->state;
+    }
+#endif
+
+    return VMState_OK;
+}
+
+
+VMState vmEnableJit(VM* vm, uint32_t threshold)
+{
+    assert(vm != NULL);
+    assert(vm->jit == NULL);
+
+    if (vm->state != VMState_OK)
+    {
+        return vm->state;
+    }
+
+    vm->jit = (Jit*)calloc(1, sizeof(Jit));
+    if (vm->jit == NULL || !jitCtor(vm->jit, vm->chunk, &vm->arena, vm->frame, vm->stack,
+                                    vm->output, threshold))
+    {
+        free(vm->jit);
+        vm->jit   = NULL;
+        vm->state = VMState_MEMORY_ERROR;
+    }
+
+    return vm->state;
+}
+
+
+__attribute__((no_sanitize("float-divide-by-zero"))) VM_KEEP_DISPATCHES
+VMState vmRun(VM* vm)
+{
+    assert(vm != NULL);
+
+    if (vm->state != VMState_OK)
+    {
+        return vm->state;
+    }
+
+    const Instruction* code      = vm->chunk->code;
+    const Value*       constants = vm->chunk->constants;
+    const Instruction* ip        = code;
+    Value*             frame     = vm->frame;
+    Value*             sp        = vm->stack;
+    Instruction        instruction = 0;
+#ifdef VM_PROFILE_PAIRS
+    Opcode             previous    = OP_HALT;
+#endif
+
+#define VM_OPERAND() instructionOperand(instruction)
+
+// A backward jump closes a while loop. With the JIT on, a hot loop runs as
+// machine code from its first instruction until control leaves it, and the
+// VM goes on where the code stopped.
+#define VM_JUMP()                                                                   \
+    do                                                                              \
+    {                                                                               \
+        const Instruction* target = code + VM_OPERAND();                           \
+        if (target < ip && vm->jit != NULL && sp == vm->stack)                      \
+        {                                                                           \
+            uint32_t end = (uint32_t)(ip - code - 1);                               \
+            JitCode native = jitBackEdge(vm->jit, VM_OPERAND(), end);               \
+            if (native != NULL)                                                     \
+            {                                                                       \
+                uint64_t exit = native(frame, vm->stack, &vm->jit->runtime);        \
+                vm->jit->statistics.entries++;                                      \
+                target = code + (uint32_t)exit;                                     \
+                sp     = vm->stack + (exit >> 32);                                  \
+            }                                                                       \
+        }                                                                           \
+        ip = target;                                                                \
+    } while (0)
+
+// Conditions are almost always comparison results, so booleans skip the
+// generic truthiness switch.
+#define VM_TRUTHY(value_) (valueIsBool(value_) ? valueAsBool(value_) : valueIsTruthy(value_))
+
+// Doubles and small integers are handled here: two doubles first, then two
+// integers as integers, then a mix as doubles, which small integers convert
+// to exactly.
+// integer_failed_ is true when an integer result has to be a double; a
+// result outside the small range is boxed by slow_binary, which also takes
+// big integers and strings.
+#define VM_IS_FAST_NUMBER(value_) (valueIsDouble(value_) || valueIsSmallInteger(value_))
+#define VM_AS_DOUBLE(value_)      (valueIsDouble(value_) ? valueAsDouble(value_)          \
+                                                        : (double)valueAsSmallInteger(value_))
+
+#define VM_NUMBER_BINARY(expression_, integer_failed_)                              \
+    do                                                                              \
+    {                                                                               \
+        if (valueIsDouble(sp[-2]) && valueIsDouble(sp[-1]))                         \
+        {                                                                           \
+            double left  = valueAsDouble(sp[-2]);                                   \
+            double right = valueAsDouble(sp[-1]);                                   \
+            sp[-2] = valueNumber(expression_);                                      \
+            sp--;                                                                   \
+            VM_DISPATCH();                                                          \
+        }                                                                           \
+        if (valueIsSmallInteger(sp[-2]) && valueIsSmallInteger(sp[-1]))             \
+        {                                                                           \
+            int64_t left    = valueAsSmallInteger(sp[-2]);                          \
+            int64_t right   = valueAsSmallInteger(sp[-1]);                          \
+            int64_t integer = 0;                                                    \
+            if (!(integer_failed_))                                                 \
+            {                                                                       \
+                if (!valueIntegerIsSmall(integer))                                  \
+                {                                                                   \
+                    goto slow_binary;                                               \
+                }                                                                   \
+                sp[-2] = valueSmallInteger(integer);                                \
+                sp--;                                                               \
+                VM_DISPATCH();                                                      \
+            }                                                                       \
+        }                                                                           \
+        if (VM_IS_FAST_NUMBER(sp[-2]) && VM_IS_FAST_NUMBER(sp[-1]))                 \
+        {                                                                           \
+            double left  = VM_AS_DOUBLE(sp[-2]);                                    \
+            double right = VM_AS_DOUBLE(sp[-1]);                                    \
+            sp[-2] = valueNumber(expression_);                                      \
+            sp--;                                                                   \
+            VM_DISPATCH();                                                          \
+        }                                                                           \
+        goto slow_binary;                                                           \
+    } while (0)
+
+// The _DOUBLE opcodes: type inference proved both operands doubles.
+#define VM_DOUBLE_BINARY(expression_)                                               \
+    do                                                                              \
+    {                                                                               \
+        assert(valueIsDouble(sp[-2]) && valueIsDouble(sp[-1]));                    \
+        double left  = valueAsDouble(sp[-2]);                                       \
+        double right = valueAsDouble(sp[-1]);                                       \
+        sp[-2] = valueNumber(expression_);                                          \
+        sp--;                                                                       \
+        VM_DISPATCH();                                                              \
+    } while (0)
+
+#define VM_DOUBLE_BINARY_BOOL(expression_)                                          \
+    do                                                                              \
+    {                                                                               \
+        assert(valueIsDouble(sp[-2]) && valueIsDouble(sp[-1]));                    \
+        double left  = valueAsDouble(sp[-2]);                                       \
+        double right = valueAsDouble(sp[-1]);                                       \
+        sp[-2] = valueBool(expression_);                                            \
+        sp--;                                                                       \
+        VM_DISPATCH();                                                              \
+    } while (0)
+
+// finish_ is VM_PUSH_OUTCOME for the comparisons and VM_BRANCH_IF or
+// VM_BRANCH_UNLESS for the fused compare-and-branch instructions; slow_ is
+// where other operands go.
+#define VM_NUMBER_COMPARISON(double_expression_, integer_expression_, finish_, slow_) \
+    do                                                                              \
+    {                                                                               \
+        if (valueIsDouble(sp[-2]) && valueIsDouble(sp[-1]))                         \
+        {                                                                           \
+            double left  = valueAsDouble(sp[-2]);                                   \
+            double right = valueAsDouble(sp[-1]);                                   \
+            finish_(double_expression_);                                            \
+        }                                                                           \
+        if (valueIsSmallInteger(sp[-2]) && valueIsSmallInteger(sp[-1]))             \
+        {                                                                           \
+            int64_t left  = valueAsSmallInteger(sp[-2]);                            \
+            int64_t right = valueAsSmallInteger(sp[-1]);                            \
+            finish_(integer_expression_);                                           \
+        }                                                                           \
+        if (VM_IS_FAST_NUMBER(sp[-2]) && VM_IS_FAST_NUMBER(sp[-1]))                 \
+        {                                                                           \
+            double left  = VM_AS_DOUBLE(sp[-2]);                                    \
+            double right = VM_AS_DOUBLE(sp[-1]);                                    \
+            finish_(double_expression_);                                            \
+        }                                                                           \
+        goto slow_;                                                                 \
+    } while (0)
+
+#define VM_PUSH_OUTCOME(outcome_)                                                   \
+    do                                                                              \
+    {                                                                               \
+        sp[-2] = valueBool(outcome_);                                               \
+        sp--;                                                                       \
+        VM_DISPATCH();                                                              \
+    } while (0)
+
+#define VM_BRANCH_IF(outcome_)                                                      \
+    do                                                                              \
+    {                                                                               \
+        bool taken = (outcome_);                                                    \
+        sp -= 2;                                                                    \
+        if (taken)                                                                  \
+        {                                                                           \
+            VM_JUMP();                                                              \
+        }                                                                           \
+        VM_DISPATCH();                                                              \
+    } while (0)
+
+#define VM_BRANCH_UNLESS(outcome_) VM_BRANCH_IF(!(outcome_))
+
+// The integer forms of valueBinaryOperation. Sums of small integers
+// cannot overflow. Small operands have fewer than 53 bits, so their double
+// quotient is an integer exactly when the division is exact, and it is
+// cheaper than an integer division.
+#define VM_ADD_FAILED      (integer = left + right, false)
+#define VM_SUBTRACT_FAILED (integer = left - right, false)
+#define VM_MULTIPLY_FAILED (__builtin_mul_overflow(left, right, &integer)              \
+                            || (integer == 0 && (left < 0 || right < 0)))
+#define VM_DIVIDE_FAILED   (right == 0 || (left == 0 && right < 0)                        \
+                            || (integer = (int64_t)((double)left / (double)right),         \
+                                islessgreater((double)integer, (double)left / (double)right)))
+#define VM_MODULO_FAILED   (right == 0 || (integer = left % right, integer == 0 && left < 0))
+
+// -0 is a double and -VALUE_SMALL_INTEGER_MIN is not small.
+#define VM_NEGATE()                                                                 \
+    do                                                                              \
+    {                                                                               \
+        if (valueIsDouble(sp[-1]))                                                  \
+        {                                                                           \
+            sp[-1] = valueNumber(-valueAsDouble(sp[-1]));                           \
+            VM_DISPATCH();                                                          \
+        }                                                                           \
+        if (valueIsSmallInteger(sp[-1]) && valueAsSmallInteger(sp[-1]) != 0         \
+         && valueAsSmallInteger(sp[-1]) != VALUE_SMALL_INTEGER_MIN)                 \
+        {                                                                           \
+            sp[-1] = valueSmallInteger(-valueAsSmallInteger(sp[-1]));               \
+            VM_DISPATCH();                                                          \
+        }                                                                           \
+        goto slow_unary;                                                            \
+    } while (0)
+
+#ifdef VM_PROFILE_PAIRS
+    #define VM_COUNT_PAIR()                                                         \
+        do                                                                          \
+        {                                                                           \
+            Opcode next_ = instructionOpcode(instruction);                          \
+            vm->pair_counts[previous * OPCODES_NUMBER + next_]++;                   \
+            previous = next_;                                                       \
+        } while (0)
+#else
+    #define VM_COUNT_PAIR() do {} while (0)
+#endif
+
+#ifdef VM_COMPUTED_GOTO
+    static void* const DISPATCH_TABLE[] = {
+        &&op_CONSTANT, &&op_TRUE, &&op_FALSE, &&op_LOAD, &&op_STORE, &&op_POP,
+        &&op_ADD, &&op_SUBTRACT, &&op_MULTIPLY, &&op_DIVIDE, &&op_MODULO,
+        &&op_EQUAL, &&op_NOT_EQUAL, &&op_LESS, &&op_GREATER, &&op_LESS_EQUAL,
+        &&op_GREATER_EQUAL, &&op_NOT, &&op_NEGATE, &&op_TRUTHY, &&op_JUMP,
+        &&op_JUMP_IF_FALSE, &&op_JUMP_IF_TRUE, &&op_PRINT, &&op_HALT,
+        &&op_ADD_DOUBLE, &&op_SUBTRACT_DOUBLE, &&op_MULTIPLY_DOUBLE, &&op_DIVIDE_DOUBLE,
+        &&op_MODULO_DOUBLE, &&op_LESS_DOUBLE, &&op_GREATER_DOUBLE, &&op_LESS_EQUAL_DOUBLE,
+        &&op_GREATER_EQUAL_DOUBLE, &&op_NEGATE_DOUBLE, &&op_STORE_KEEP,
+        &&op_JUMP_IF_LESS, &&op_JUMP_IF_NOT_LESS, &&op_JUMP_IF_GREATER, &&op_JUMP_IF_NOT_GREATER,
+        &&op_JUMP_IF_LESS_EQUAL, &&op_JUMP_IF_NOT_LESS_EQUAL, &&op_JUMP_IF_GREATER_EQUAL,
+        &&op_JUMP_IF_NOT_GREATER_EQUAL, &&op_JUMP_IF_EQUAL, &&op_JUMP_IF_NOT_EQUAL,
+        &&op_LOAD_CONSTANT, &&op_STORE_LOAD, &&op_CONSTANT_BINARY, &&op_LOAD_BINARY,
+        &&op_SWITCH, &&op_INDEX, &&op_APPEND, &&op_ARRAY, &&op_LENGTH, &&op_FILL,
+    };
+    static_assert(sizeof(DISPATCH_TABLE) / sizeof(DISPATCH_TABLE[0]) == (size_t)OPCODES_NUMBER,
+                  "every opcode needs a dispatch label");
+
+    #define VM_CASE(name_) op_##name_:
+    #define VM_DISPATCH()                                                           \
+        do                                                                          \
+        {                                                                           \
+            instruction = *ip++;                                                    \
+            VM_COUNT_PAIR();                                                        \
+            goto *DISPATCH_TABLE[instructionOpcode(instruction)];                   \
+        } while (0)
+    #define VM_EXECUTE() goto *DISPATCH_TABLE[instructionOpcode(instruction)]
+
+    VM_DISPATCH();
+#else
+    #define VM_CASE(name_) case OP_##name_:
+    #define VM_DISPATCH() goto dispatch
+    #define VM_EXECUTE()  goto execute
+
+dispatch:
+    instruction = *ip++;
+    VM_COUNT_PAIR();
+execute:
+    switch (instructionOpcode(instruction))
+#endif
+    {
+        VM_CASE(CONSTANT)
+            *sp++ = constants[VM_OPERAND()];
+            VM_DISPATCH();
+
+        VM_CASE(TRUE)
+            *sp++ = valueBool(true);
+            VM_DISPATCH();
+
+        VM_CASE(FALSE)
+            *sp++ = valueBool(false);
+            VM_DISPATCH();
+
+        VM_CASE(LOAD)
+            *sp++ = frame[VM_OPERAND()];
+            VM_DISPATCH();
+
+        VM_CASE(STORE)
+            frame[VM_OPERAND()] = *--sp;
+            VM_DISPATCH();
+
+        VM_CASE(POP)
+            sp--;
+            VM_DISPATCH();
+
+        VM_CASE(ADD)
+            VM_NUMBER_BINARY(left + right, VM_ADD_FAILED);
+
+        VM_CASE(SUBTRACT)
+            VM_NUMBER_BINARY(left - right, VM_SUBTRACT_FAILED);
+
+        VM_CASE(MULTIPLY)
+            VM_NUMBER_BINARY(left * right, VM_MULTIPLY_FAILED);
+
+        VM_CASE(DIVIDE)
+            VM_NUMBER_BINARY(left / right, VM_DIVIDE_FAILED);
+
+        VM_CASE(MODULO)
+            VM_NUMBER_BINARY(fmod(left, right), VM_MODULO_FAILED);
+
+        VM_CASE(LESS)
+            VM_NUMBER_COMPARISON(isless(left, right), left < right, VM_PUSH_OUTCOME, slow_binary);
+
+        VM_CASE(GREATER)
+            VM_NUMBER_COMPARISON(isgreater(left, right), left > right, VM_PUSH_OUTCOME, slow_binary);
+
+        VM_CASE(LESS_EQUAL)
+            VM_NUMBER_COMPARISON(islessequal(left, right), left <= right, VM_PUSH_OUTCOME, slow_binary);
+
+        VM_CASE(GREATER_EQUAL)
+            VM_NUMBER_COMPARISON(isgreaterequal(left, right), left >= right, VM_PUSH_OUTCOME, slow_binary);
+
+        VM_CASE(EQUAL)
+            sp[-2] = valueBool(valueEquals(sp[-2], sp[-1]));
+            sp--;
+            VM_DISPATCH();
+
+        VM_CASE(NOT_EQUAL)
+            sp[-2] = valueBool(!valueEquals(sp[-2], sp[-1]));
+            sp--;
+            VM_DISPATCH();
+
+        VM_CASE(NOT)
+            sp[-1] = valueBool(!valueIsTruthy(sp[-1]));
+            VM_DISPATCH();
+
+        VM_CASE(NEGATE)
+            VM_NEGATE();
+
+        VM_CASE(TRUTHY)
+            sp[-1] = valueBool(valueIsTruthy(sp[-1]));
+            VM_DISPATCH();
+
+        VM_CASE(JUMP)
+            VM_JUMP();
+            VM_DISPATCH();
+
+        VM_CASE(JUMP_IF_FALSE)
+            sp--;
+            if (!VM_TRUTHY(*sp))
+            {
+                VM_JUMP();
+            }
+            VM_DISPATCH();
+
+        VM_CASE(JUMP_IF_TRUE)
+            sp--;
+            if (VM_TRUTHY(*sp))
+            {
+                VM_JUMP();
+            }
+            VM_DISPATCH();
+
+        VM_CASE(PRINT)
+            valuePrint(vm->output, *--sp);
+            fputc('\n', vm->output);
+            VM_DISPATCH();
+
+        VM_CASE(HALT)
+            return vm->state;
+
+        VM_CASE(ADD_DOUBLE)
+            VM_DOUBLE_BINARY(left + right);
+
+        VM_CASE(SUBTRACT_DOUBLE)
+            VM_DOUBLE_BINARY(left - right);
+
+        VM_CASE(MULTIPLY_DOUBLE)
+            VM_DOUBLE_BINARY(left * right);
+
+        VM_CASE(DIVIDE_DOUBLE)
+            VM_DOUBLE_BINARY(left / right);
+
+        VM_CASE(MODULO_DOUBLE)
+            VM_DOUBLE_BINARY(fmod(left, right));
+
+        VM_CASE(LESS_DOUBLE)
+            VM_DOUBLE_BINARY_BOOL(isless(left, right));
+
+        VM_CASE(GREATER_DOUBLE)
+            VM_DOUBLE_BINARY_BOOL(isgreater(left, right));
+
+        VM_CASE(LESS_EQUAL_DOUBLE)
+            VM_DOUBLE_BINARY_BOOL(islessequal(left, right));
+
+        VM_CASE(GREATER_EQUAL_DOUBLE)
+            VM_DOUBLE_BINARY_BOOL(isgreaterequal(left, right));
+
+        VM_CASE(NEGATE_DOUBLE)
+            assert(valueIsDouble(sp[-1]));
+            sp[-1] = valueNumber(-valueAsDouble(sp[-1]));
+            VM_DISPATCH();
+
+        VM_CASE(STORE_KEEP)
+            frame[VM_OPERAND()] = sp[-1];
+            VM_DISPATCH();
+
+        VM_CASE(JUMP_IF_LESS)
+            VM_NUMBER_COMPARISON(isless(left, right), left < right, VM_BRANCH_IF, slow_branch);
+
+        VM_CASE(JUMP_IF_NOT_LESS)
+            VM_NUMBER_COMPARISON(isless(left, right), left < right, VM_BRANCH_UNLESS, slow_branch);
+
+        VM_CASE(JUMP_IF_GREATER)
+            VM_NUMBER_COMPARISON(isgreater(left, right), left > right, VM_BRANCH_IF, slow_branch);
+
+        VM_CASE(JUMP_IF_NOT_GREATER)
+            VM_NUMBER_COMPARISON(isgreater(left, right), left > right, VM_BRANCH_UNLESS, slow_branch);
+
+        VM_CASE(JUMP_IF_LESS_EQUAL)
+            VM_NUMBER_COMPARISON(islessequal(left, right), left <= right, VM_BRANCH_IF, slow_branch);
+
+        VM_CASE(JUMP_IF_NOT_LESS_EQUAL)
+            VM_NUMBER_COMPARISON(islessequal(left, right), left <= right, VM_BRANCH_UNLESS, slow_branch);
+
+        VM_CASE(JUMP_IF_GREATER_EQUAL)
+            VM_NUMBER_COMPARISON(isgreaterequal(left, right), left >= right, VM_BRANCH_IF, slow_branch);
+
+        VM_CASE(JUMP_IF_NOT_GREATER_EQUAL)
+            VM_NUMBER_COMPARISON(isgreaterequal(left, right), left >= right, VM_BRANCH_UNLESS, slow_branch);
+
+        VM_CASE(JUMP_IF_EQUAL)
+            VM_BRANCH_IF(valueEquals(sp[-2], sp[-1]));
+
+        VM_CASE(JUMP_IF_NOT_EQUAL)
+            VM_BRANCH_UNLESS(valueEquals(sp[-2], sp[-1]));
+
+        VM_CASE(LOAD_CONSTANT)
+            sp[0] = frame[operandFirst(VM_OPERAND())];
+            sp[1] = constants[operandSecond(VM_OPERAND())];
+            sp += 2;
+            VM_DISPATCH();
+
+        VM_CASE(STORE_LOAD)
+            frame[operandFirst(VM_OPERAND())] = sp[-1];
+            sp[-1] = frame[operandSecond(VM_OPERAND())];
+            VM_DISPATCH();
+
+        // The binary opcode runs as if it had been dispatched, so its slow
+        // path reports its own operation.
+        VM_CASE(CONSTANT_BINARY)
+            *sp++ = constants[operandFirst(VM_OPERAND())];
+            instruction = makeInstruction((Opcode)operandSecond(VM_OPERAND()), 0);
+            VM_EXECUTE();
+
+        VM_CASE(LOAD_BINARY)
+            *sp++ = frame[operandFirst(VM_OPERAND())];
+            instruction = makeInstruction((Opcode)operandSecond(VM_OPERAND()), 0);
+            VM_EXECUTE();
+
+        // Cases are always ahead, so no loop closes here.
+        VM_CASE(SWITCH)
+        {
+            const SwitchTable* table = &vm->chunk->switches[VM_OPERAND()];
+            uint32_t entry = switchTableFind(table, *--sp);
+            if (entry < table->entries_number)
+            {
+                ip = code + table->targets[entry];
+            }
+            VM_DISPATCH();
+        }
+
+        // Arrays are always on the generic path.
+        VM_CASE(INDEX)
+        VM_CASE(APPEND)
+        VM_CASE(FILL)
+            goto slow_binary;
+
+        VM_CASE(ARRAY)
+        VM_CASE(LENGTH)
+            goto slow_unary;
+
+#ifndef VM_COMPUTED_GOTO
+        default:
+            return vm->state;
+#endif
+    }
+
+// The slow paths are the only ones that allocate. Their operands are
+// still on the stack, so the frame and the stack hold every live value.
+slow_binary:
+    {
+        if (arenaShouldSweep(&vm->arena))
+        {
+            sweepArena(vm, sp);
+        }
+
+        Opcode opcode = instructionOpcode(instruction);
+        Value result = {};
+        RuntimeState state = valueBinaryOperation(opcodeOperation(opcode), sp[-2], sp[-1],
+                                                  &vm->arena, &result);
+        if (state != RuntimeState_OK)
+        {
+            vmError(vm, state, (size_t)(ip - code - 1), opcode, sp[-2], sp[-1], false);
+            return vm->state;
+        }
+
+        sp[-2] = result;
+        sp--;
+        VM_DISPATCH();
+    }
+
+// Comparisons of strings, big integers and arrays in a fused branch; an
+// array comparison gives an array of 1s and 0s.
+slow_branch:
+    {
+        if (arenaShouldSweep(&vm->arena))
+        {
+            sweepArena(vm, sp);
+        }
+
+        Instruction parts[2] = {};
+        instructionUnfuse(instruction, parts);
+        Opcode comparison = instructionOpcode(parts[0]);
+        Value result = {};
+        RuntimeState state = valueBinaryOperation(opcodeOperation(comparison), sp[-2], sp[-1],
+                                                  &vm->arena, &result);
+        if (state != RuntimeState_OK)
+        {
+            vmError(vm, state, (size_t)(ip - code - 1), comparison, sp[-2], sp[-1], false);
+            return vm->state;
+        }
+
+        VM_BRANCH_IF(VM_TRUTHY(result) == (instructionOpcode(parts[1]) == OP_JUMP_IF_TRUE));
+    }
+
+slow_unary:
+    {
+        if (arenaShouldSweep(&vm->arena))
+        {
+            sweepArena(vm, sp);
+        }
+
+        Opcode opcode = instructionOpcode(instruction);
+        Value result = {};
+        RuntimeState state = valueUnaryOperation(opcodeOperation(opcode), sp[-1], &vm->arena, &result);
+        if (state != RuntimeState_OK)
+        {
+            vmError(vm, state, (size_t)(ip - code - 1), opcode, sp[-1], sp[-1], true);
+            return vm->state;
+        }
+
+        sp[-1] = result;
+        VM_DISPATCH();
+    }
+
+#undef VM_OPERAND
+#undef VM_JUMP
+#undef VM_TRUTHY
+#undef VM_IS_FAST_NUMBER
+#undef VM_AS_DOUBLE
+#undef VM_NUMBER_BINARY
+#undef VM_NUMBER_COMPARISON
+#undef VM_PUSH_OUTCOME
+#undef VM_BRANCH_IF
+#undef VM_BRANCH_UNLESS
+#undef VM_EXECUTE
+#undef VM_ADD_FAILED
+#undef VM_SUBTRACT_FAILED
+#undef VM_MULTIPLY_FAILED
+#undef VM_DIVIDE_FAILED
+#undef VM_MODULO_FAILED
+#undef VM_NEGATE
+#undef VM_COUNT_PAIR
+#undef VM_CASE
+#undef VM_DISPATCH
+}
+
+
+void vmPrintPairProfile(const VM* vm, FILE* output, size_t top)
+{
+    assert(vm     != NULL);
+    assert(output != NULL);
+
+    if (vm->pair_counts == NULL)
+    {
+        fprintf(output, "pairs: not counted, build with -DVM_PROFILE_PAIRS\n");
+        return;
+    }
+
+    const size_t PAIRS_NUMBER = (size_t)(OPCODES_NUMBER * OPCODES_NUMBER);
+    uint64_t total = 0;
+    for (size_t pair = 0; pair < PAIRS_NUMBER; pair++)
+    {
+        total += vm->pair_counts[pair];
+    }
+
+    // Selection by repeated scans: the table is small and top is a handful.
+    uint64_t bound = UINT64_MAX;
+    size_t   bound_pair = 0;
+    for (size_t rank = 0; rank < top; rank++)
+    {
+        size_t   best_pair  = PAIRS_NUMBER;
+        uint64_t best_count = 0;
+        for (size_t pair = 0; pair < PAIRS_NUMBER; pair++)
+        {
+            uint64_t count = vm->pair_counts[pair];
+            bool below = count < bound || (count == bound && pair > bound_pair);
+            if (below && count > 0 && (best_pair == PAIRS_NUMBER || count > best_count))
+            {
+                best_pair  = pair;
+                best_count = count;
+            }
+        }
+
+        if (best_pair == PAIRS_NUMBER)
+        {
+            break;
+        }
+
+        fprintf(output, "%-22s %-22s %12lu  %5.1f%%\n",
+                opcodeToString((Opcode)(best_pair / (size_t)OPCODES_NUMBER)),
+                opcodeToString((Opcode)(best_pair % (size_t)OPCODES_NUMBER)),
+                best_count, 100.0 * (double)best_count / (double)total);
+
+        bound      = best_count;
+        bound_pair = best_pair;
+    }
+}
+
+
+void vmDtor(VM* vm)
+{
+    if (vm == NULL)
+    {
+        return;
+    }
+
+    free(vm->frame);
+    free(vm->stack);
+    free(vm->pair_counts);
+    jitDtor(vm->jit);
+    free(vm->jit);
+    arenaDtor(&vm->arena);
+
+    vm->frame = NULL;
+    vm->stack = NULL;
+    vm->pair_counts = NULL;
+    vm->jit   = NULL;
+    vm->chunk = NULL;
+}
+
+
+// static ---------------------------------------------------------------------
+
+
+static void vmError(VM* vm, RuntimeState state, size_t offset, Opcode opcode,
+                    Value left, Value right, bool is_unary)
+{
+    assert(vm != NULL);
+
+    int line = vm->chunk->lines[offset];
+    const char* operation = tokenTypeToString(opcodeOperation(opcode));
+
+    if (state == RuntimeState_MEMORY_ERROR)
+    {
+        snprintf(vm->error_message, sizeof(vm->error_message),
+                 "Runtime error: out of memory (line %d)", line);
+        vm->state = VMState_MEMORY_ERROR;
+        return;
+    }
+
+    if (state == RuntimeState_INDEX_ERROR || state == RuntimeState_LENGTH_ERROR
+     || state == RuntimeState_SIZE_ERROR)
+    {
+        snprintf(vm->error_message, sizeof(vm->error_message),
+                 "Runtime error: %s (line %d)", runtimeStateToString(state), line);
+    }
+    else if (is_unary)
+    {
+        snprintf(vm->error_message, sizeof(vm->error_message),
+                 "Runtime error: cannot apply '%s' to %s (line %d)",
+                 operation, valueTypeToString(valueType(left)), line);
+    }
+    else
+    {
+        snprintf(vm->error_message, sizeof(vm->error_message),
+                 "Runtime error: cannot apply '%s' to %s and %s (line %d)",
+                 operation,
+                 valueTypeToString(valueType(left)),
+                 valueTypeToString(valueType(right)),
+                 line);
+    }
+
+    vm->state = VMState_RUNTIME_ERROR;
+}
+
+
+static void sweepArena(VM* vm, const Value* sp)
+{
+    assert(vm != NULL);
+    assert(sp != NULL);
+
+    valueMarkAll(vm->frame, vm->chunk->slots_number);
+    valueMarkAll(vm->stack, (size_t)(sp - vm->stack));
+    arenaSweep(&vm->arena);
+}
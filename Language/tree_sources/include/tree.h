@@ -33,6 +33,11 @@ int treeGetRightNode_(Tree* tree, int node_index LOGGER_PARAMETERS);
 int treeCreateNewNode_(Tree* tree, tree_node_type data LOGGER_PARAMETERS);
 int treeInsertOnLeft_(Tree* tree, int node_parent_index, int node_index LOGGER_PARAMETERS);
 int treeInsertOnRight_(Tree* tree, int node_parent_index, int node_index LOGGER_PARAMETERS);
+void treeSetNodeData_(Tree* tree, int node_index, tree_node_type data LOGGER_PARAMETERS);
+// Puts the replacement subtree where node_index was. The old node stays in
+// the array (the destructor still frees it) but is no longer reachable.
+int treeReplaceNode_(Tree* tree, int node_index, int replacement_index LOGGER_PARAMETERS);
+void treeDetachNode_(Tree* tree, int node_index LOGGER_PARAMETERS);
 
 
 #if defined(DUMP) || defined(LOGGER)
@@ -70,6 +75,15 @@ int treeInsertOnRight_(Tree* tree, int node_parent_index, int node_index LOGGER_
 
     #define treeInsertOnRight(tree_, node_parent_index_, node_index_) \
         treeInsertOnRight_(tree_, node_parent_index_, node_index_, __FILE__, __LINE__, __PRETTY_FUNCTION__)
+
+    #define treeSetNodeData(tree_, node_index_, data_) \
+        treeSetNodeData_(tree_, node_index_, data_, __FILE__, __LINE__, __PRETTY_FUNCTION__)
+
+    #define treeReplaceNode(tree_, node_index_, replacement_index_) \
+        treeReplaceNode_(tree_, node_index_, replacement_index_, __FILE__, __LINE__, __PRETTY_FUNCTION__)
+
+    #define treeDetachNode(tree_, node_index_) \
+        treeDetachNode_(tree_, node_index_, __FILE__, __LINE__, __PRETTY_FUNCTION__)
 #else
     #define treeNodesQuantity(tree_) \
         treeNodesQuantity_(tree_)
@@ -97,6 +111,15 @@ int treeInsertOnRight_(Tree* tree, int node_parent_index, int node_index LOGGER_
 
     #define treeInsertOnRight(tree_, node_parent_index_, node_index_) \
         treeInsertOnRight_(tree_, node_parent_index_, node_index_)
+
+    #define treeSetNodeData(tree_, node_index_, data_) \
+        treeSetNodeData_(tree_, node_index_, data_)
+
+    #define treeReplaceNode(tree_, node_index_, replacement_index_) \
+        treeReplaceNode_(tree_, node_index_, replacement_index_)
+
+    #define treeDetachNode(tree_, node_index_) \
+        treeDetachNode_(tree_, node_index_)
 #endif
 
 #endif // DESICION_TREE_H
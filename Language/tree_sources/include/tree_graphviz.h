@@ -0,0 +1,54 @@
+#ifndef TREE_GRAPHVIZ_H
+#define TREE_GRAPHVIZ_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "tree.h"
+
+const int GRAPHVIZ_UNLIMITED_DEPTH = -1;
+
+typedef enum TreeGraphvizFormat
+{
+    TreeGraphvizFormat_DOT = 0,
+    TreeGraphvizFormat_SVG = 1,
+} TreeGraphvizFormat;
+
+typedef enum TreeGraphvizState
+{
+    TreeGraphvizState_OK            = 0,
+    TreeGraphvizState_BAD_ROOT      = 1,
+    TreeGraphvizState_OPEN_ERROR    = 2,
+    TreeGraphvizState_WRITE_ERROR   = 3,
+    TreeGraphvizState_RENDER_ERROR  = 4,
+    TreeGraphvizState_MEMORY_ERROR  = 5,
+} TreeGraphvizState;
+
+typedef struct TreeGraphvizOptions
+{
+    const char*        output_path;
+    TreeGraphvizFormat format;
+    int                root_index;  // subtree to export, 0 is the whole tree
+    int                max_depth;   // deeper nodes collapse into "+N more"
+    bool               verbose;     // print parent/left/right indices in labels
+} TreeGraphvizOptions;
+
+typedef struct TreeGraphvizResult
+{
+    size_t nodes_written;
+    size_t nodes_collapsed;
+    size_t bytes_written;
+} TreeGraphvizResult;
+
+TreeGraphvizOptions treeGraphvizDefaultOptions(const char* output_path);
+
+// Streams the tree (or the subtree at options->root_index) as DOT. With the
+// SVG format the DOT text is piped straight into `dot -Tsvg` without
+// touching a temporary file. result may be NULL.
+TreeGraphvizState treeExportGraphviz(Tree*                      tree,
+                                     const TreeGraphvizOptions* options,
+                                     TreeGraphvizResult*        result);
+
+const char* treeGraphvizStateToString(TreeGraphvizState state);
+
+#endif // TREE_GRAPHVIZ_H
@@ -304,10 +304,114 @@ int treeInsertOnRight_(Tree* tree, int node_parent_index, int node_index LOGGER_
 }
 
 
+// --------------------------------------- SET -------------------------------------------------------------------------
+
+
+void treeSetNodeData_(Tree* tree, int node_index, tree_node_type data LOGGER_PARAMETERS)
+{
+    assert(tree != NULL);
+    assert(tree->nodes_array != NULL);
+    assert(0 <= node_index && node_index < (int)tree->nodes_number);
+
+#ifdef LOGGER
+    ASSERT_LOGGER_
+#endif
+
+    tree->nodes_array[node_index].data = data;
+
+#ifdef LOGGER
+    PASTE_DATA_LOGGER_
+
+    treeLogState(tree);
+#endif
+}
+
+
 // --------------------------------------- DELETE ----------------------------------------------------------------------
 
 
+int treeReplaceNode_(Tree* tree, int node_index, int replacement_index LOGGER_PARAMETERS)
+{
+    assert(tree != NULL);
+    assert(tree->nodes_array != NULL);
+    assert(0 <= node_index && node_index < (int)tree->nodes_number);
+    assert(0 <= replacement_index && replacement_index < (int)tree->nodes_number);
+
+#ifdef LOGGER
+    ASSERT_LOGGER_
+#endif
+
+    int parent_index = tree->nodes_array[node_index].parent_index;
+    if (parent_index == EMPTY_NODE)
+    {
+        return EMPTY_NODE;
+    }
+
+    TreeNode* parent = &tree->nodes_array[parent_index];
+    if (parent->left_index == node_index)
+    {
+        parent->left_index = replacement_index;
+    }
+    else
+    {
+        parent->right_index = replacement_index;
+    }
+
+    tree->nodes_array[replacement_index].parent_index = parent_index;
 
+    TreeNode* node = &tree->nodes_array[node_index];
+    if (node->left_index == replacement_index)
+    {
+        node->left_index = EMPTY_NODE;
+    }
+    if (node->right_index == replacement_index)
+    {
+        node->right_index = EMPTY_NODE;
+    }
+    node->parent_index = EMPTY_NODE;
+
+#ifdef LOGGER
+    PASTE_DATA_LOGGER_
+
+    treeLogState(tree);
+#endif
+
+    return replacement_index;
+}
+
+
+void treeDetachNode_(Tree* tree, int node_index LOGGER_PARAMETERS)
+{
+    assert(tree != NULL);
+    assert(tree->nodes_array != NULL);
+    assert(0 <= node_index && node_index < (int)tree->nodes_number);
+
+#ifdef LOGGER
+    ASSERT_LOGGER_
+#endif
+
+    int parent_index = tree->nodes_array[node_index].parent_index;
+    if (parent_index != EMPTY_NODE)
+    {
+        TreeNode* parent = &tree->nodes_array[parent_index];
+        if (parent->left_index == node_index)
+        {
+            parent->left_index = EMPTY_NODE;
+        }
+        else
+        {
+            parent->right_index = EMPTY_NODE;
+        }
+    }
+
+    tree->nodes_array[node_index].parent_index = EMPTY_NODE;
+
+#ifdef LOGGER
+    PASTE_DATA_LOGGER_
+
+    treeLogState(tree);
+#endif
+}
 
 
 // --------------------------------------- DESTRUCTOR ------------------------------------------------------------------
@@ -2,26 +2,27 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
 #include <assert.h>
 
 #include "tree_node_structure.h"
+#include "tree_graphviz.h"
+#include "print_ast.h"
 
 
 // static --------------------------------------------------------------------------------------------------------------
 
 
 static void treePrintRecursively(Tree* tree, int node_index);
+static void printNodeValue(TreeNode node);
 
 #if defined(DUMP) || defined(LOGGER)
-static void treeMakeGraphvizPng(Tree* tree);
+static void treeMakeGraphvizSvg(Tree* tree);
 static const char* getLineFromFile(const char* file_name, int line_number);
-static void graphvizWriteNodes(FILE* graphviz_file, Tree* tree);
 
-static const char* TEMP_GRAPHVIZ_FILE_PATH = "tmp_.dot";
-static const char* GRAPHVIZ_PNG_PATH       = "pictures/dump";
+static const char* GRAPHVIZ_SVG_PATH = "pictures/dump.svg";
 
-static const size_t FILE_BUFFER_SIZE    = 1024;
-static const size_t COMMAND_BUFFER_SIZE = 128;
+static const size_t FILE_BUFFER_SIZE = 1024;
 #endif
 
 #ifdef DUMP
@@ -33,7 +34,6 @@ static void closeLogTreeFile(void);
 
 static const char* LOG_FILE_PATH = "log.htm";
 
-static const char* CTOR_FUNCTION = "treeCtor_";
 static const char* DTOR_FUNCTION = "treeDtor_";
 
 static FILE* log_tree_file = NULL;
@@ -60,19 +60,12 @@ void treePrintDataFromArray(Tree* tree)
     {
         TreeNode node = tree->nodes_array[node_index];
 
-    printf("Index of current node %lu. Value: ", node_index);
-    if (node.data.node_type == ArithmeticTreeNodeType_NUMBER)
-    {
-        printf("%lg\n", node.data.numerical_data);
-    }
-    else
-    {
-        printf("%s\n", node.data.function.text);
-    }
+        printf("Index of current node %lu. Value: ", node_index);
+        printNodeValue(node);
 
-    printf("\tIndex of parent node = %d\n", node.parent_index);
-    printf("\tIndex of left node   = %d\n", node.left_index);
-    printf("\tIndex of right node  = %d\n", node.right_index);
+        printf("\tIndex of parent node = %d\n", node.parent_index);
+        printf("\tIndex of left node   = %d\n", node.left_index);
+        printf("\tIndex of right node  = %d\n", node.right_index);
     }
 }
 
@@ -125,25 +118,15 @@ void treeLogState_(Tree* tree, const char* original_function)
     fprintf(log_tree_file, "\tnumber of nodes   = %lu\n", tree->nodes_number);
     fprintf(log_tree_file, "\tcapacity of nodes = %lu\n", tree->nodes_capacity);
 
-    if (strcmp(CTOR_FUNCTION, original_function) != 0
-     && strcmp(DTOR_FUNCTION, original_function) != 0)
+    // Rendering a picture per step does not scale past toy trees, so the
+    // log gets a single SVG of the final tree when it is destroyed.
+    if (strcmp(DTOR_FUNCTION, original_function) == 0)
     {
         fprintf(log_tree_file, "Image of tree:</h3>\n");
 
-        treeMakeGraphvizPng(tree);
-
-        static char command[COMMAND_BUFFER_SIZE] = {};
-
-        sprintf(command, "mv %s.png %s%lu.png",
-                        GRAPHVIZ_PNG_PATH,
-                        GRAPHVIZ_PNG_PATH,
-                        logs_writed);
+        treeMakeGraphvizSvg(tree);
 
-        system(command);
-
-        fprintf(log_tree_file, "<img src=\"%s%lu.png\" />",
-                               GRAPHVIZ_PNG_PATH,
-                               logs_writed);
+        fprintf(log_tree_file, "<img src=\"%s\" />", GRAPHVIZ_SVG_PATH);
     }
 
     logs_writed++;
@@ -169,14 +152,14 @@ void treeDumpToHtm_(Tree* tree)
                          tree->function,
                          tree->line,
                          getLineFromFile(tree->file, tree->line));
-    fprintf(log_tree_file, "<h3>Tree pointer [%p]\n", tree);
-    fprintf(log_tree_file, "\tnumber of nodes   = %lu\n", tree->nodes_number);
-    fprintf(log_tree_file, "\tcapacity of nodes = %lu\n", tree->nodes_capacity);
+    fprintf(output_file, "<h3>Tree pointer [%p]\n", tree);
+    fprintf(output_file, "\tnumber of nodes   = %lu\n", tree->nodes_number);
+    fprintf(output_file, "\tcapacity of nodes = %lu\n", tree->nodes_capacity);
     fprintf(output_file, "Image of tree:</h3>\n");
 
-    treeMakeGraphvizPng(tree);
+    treeMakeGraphvizSvg(tree);
 
-    fprintf(output_file, "<img src=\"%s.png\" />", GRAPHVIZ_PNG_PATH);
+    fprintf(output_file, "<img src=\"%s\" />", GRAPHVIZ_SVG_PATH);
 
     fclose(output_file);
 }
@@ -196,14 +179,7 @@ static void treePrintRecursively(Tree* tree, int node_index)
     TreeNode node = tree->nodes_array[node_index];
 
     printf("Index of current node %d. Value: ", node_index);
-    if (node.data.node_type == ArithmeticTreeNodeType_NUMBER)
-    {
-        printf("%lg\n", node.data.numerical_data);
-    }
-    else
-    {
-        printf("%s\n", node.data.function.text);
-    }
+    printNodeValue(node);
 
     printf("\tIndex of parent node = %d\n", node.parent_index);
     printf("\tIndex of left node   = %d\n", node.left_index);
@@ -213,87 +189,55 @@ static void treePrintRecursively(Tree* tree, int node_index)
     treePrintRecursively(tree, node.right_index);
 }
 
-#if defined(DUMP) || defined(LOGGER)
-static void treeMakeGraphvizPng(Tree* tree)
+static void printNodeValue(TreeNode node)
 {
-    assert(tree != NULL);
+    printf("%s", syntaxNodeTypeToString(node.data.type));
 
-    FILE* graphviz_file = fopen(TEMP_GRAPHVIZ_FILE_PATH, "w");
-    if (graphviz_file == NULL)
+    switch (node.data.type)
     {
-        return;
+        case SyntaxNodeType_NUMBER:
+            printf(" %lg\n", node.data.data.number);
+            break;
+        case SyntaxNodeType_INTEGER:
+            printf(" %" PRId64 "\n", node.data.data.integer);
+            break;
+        case SyntaxNodeType_IDENTIFIER:
+            printf(" %s\n", node.data.data.identifier);
+            break;
+        case SyntaxNodeType_STRING:
+            printf(" \"%s\"\n", node.data.data.string);
+            break;
+        case SyntaxNodeType_BOOL:
+            printf(" %s\n", node.data.data.boolean ? "true" : "false");
+            break;
+        case SyntaxNodeType_BINARY_OPERATION:
+        case SyntaxNodeType_UNARY_OPERATION:
+            printf(" %s\n", tokenTypeToString(node.data.data.operation));
+            break;
+        default:
+            printf("\n");
+            break;
     }
-
-    fprintf(graphviz_file, "digraph G\n{");
-    fprintf(graphviz_file, "    bgcolor=\"gray20\";\n");
-    fprintf(graphviz_file, "    graph [splines=polyline, bgcolor=\"transparent\"]");
-    fprintf(graphviz_file, "    node [shape=box, fontname=\"Arial\", fontsize=12, "
-                           "fontcolor=white];\n\n");
-
-    graphvizWriteNodes(graphviz_file, tree);
-
-    fprintf(graphviz_file, "}\n");
-
-    fclose(graphviz_file);
-
-    static char command[COMMAND_BUFFER_SIZE] = {};
-
-    sprintf(command, "dot -Tpng %s -o %s.png", TEMP_GRAPHVIZ_FILE_PATH, GRAPHVIZ_PNG_PATH);
-
-    system(command);
 }
 
-
-static void graphvizWriteNodes(FILE* graphviz_file, Tree* tree)
+#if defined(DUMP) || defined(LOGGER)
+static void treeMakeGraphvizSvg(Tree* tree)
 {
-    for (int node_index = 0; node_index < (int)tree->nodes_number; node_index++)
-    {
-
-        fprintf(graphviz_file,
-                "node%d [label=<" \
-                "<TABLE BORDER=\"0\" CELLBORDER=\"1\" CELLSPACING=\"0\" BGCOLOR=\"#705833\" ",
-                node_index);
-
-        fprintf(graphviz_file, "COLOR=\"white\">\n");
+    assert(tree != NULL);
 
-        TreeNode node = tree->nodes_array[node_index];
-        fprintf(graphviz_file,
-            "<TR><TD COLSPAN=\"2\">parent = %d</TD></TR>\n" \
-            "<TR><TD COLSPAN=\"2\">index %d</TD></TR>\n" \
-            "<TR><TD COLSPAN=\"2\">data = ",
-            node.parent_index,
-            node_index);
-        if (node.data.node_type == ArithmeticTreeNodeType_NUMBER)
-        {
-            fprintf(graphviz_file, "%lg\n", node.data.numerical_data);
-        }
-        else if (node.data.node_type == ArithmeticTreeNodeType_VARIABLE)
-        {
-            fprintf(graphviz_file, "%s\n", node.data.variable_text);
-        }
-        else
-        {
-            fprintf(graphviz_file, "%s\n", node.data.function.text);
-        }
-        fprintf(graphviz_file, "</TD></TR>\n" \
-            "<TR><TD>left = %d</TD><TD>right = %d</TD></TR>\n" \
-            "</TABLE>\n" \
-            ">];\n",
-            node.left_index,
-            node.right_index);
+    if (tree->nodes_number == 0)
+    {
+        return;
     }
 
-    for (int node_index = 0; node_index < (int)tree->nodes_number; node_index++)
+    TreeGraphvizOptions options = treeGraphvizDefaultOptions(GRAPHVIZ_SVG_PATH);
+    options.format  = TreeGraphvizFormat_SVG;
+    options.verbose = true;
+
+    TreeGraphvizState state = treeExportGraphviz(tree, &options, NULL);
+    if (state != TreeGraphvizState_OK)
     {
-        TreeNode node = tree->nodes_array[node_index];
-        if (node.parent_index != EMPTY_NODE)
-        {
-            fprintf(graphviz_file,
-                    "node%d -> node%d [color=\"orange\"];\n",
-                    // "node%d -> node%d [color=\"red\"];\n",
-                    node.parent_index,
-                    node_index);
-        }
+        fprintf(stderr, "Graphviz dump failed: %s\n", treeGraphvizStateToString(state));
     }
 }
 
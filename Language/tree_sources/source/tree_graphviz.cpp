@@ -0,0 +1,574 @@
+#include "tree_graphviz.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include "tree_node_structure.h"
+#include "print_ast.h"
+
+
+// static --------------------------------------------------------------------------------------------------------------
+
+
+typedef struct GraphvizWriter
+{
+    FILE*  file;
+    char*  buffer;
+    size_t used;
+    size_t capacity;
+    size_t bytes_written;
+    bool   failed;
+} GraphvizWriter;
+
+typedef struct GraphvizStackItem
+{
+    int node_index;
+    int depth;
+} GraphvizStackItem;
+
+typedef struct GraphvizStack
+{
+    GraphvizStackItem* items;
+    size_t             size;
+    size_t             capacity;
+} GraphvizStack;
+
+static bool writerInit(GraphvizWriter* writer, FILE* file);
+static void writerDtor(GraphvizWriter* writer);
+static void writerFlush(GraphvizWriter* writer);
+static void writerWrite(GraphvizWriter* writer, const char* text, size_t length);
+static void writerPuts(GraphvizWriter* writer, const char* text);
+static void writerInt(GraphvizWriter* writer, long long value);
+static void writerEscaped(GraphvizWriter* writer, const char* text);
+
+static bool stackPush(GraphvizStack* stack, int node_index, int depth);
+static GraphvizStackItem stackPop(GraphvizStack* stack);
+
+static void writeHeader(GraphvizWriter* writer);
+static void writeNode(GraphvizWriter* writer, Tree* tree, int node_index, bool verbose);
+static void writeEdge(GraphvizWriter* writer, const char* from_prefix, int from,
+                      const char* to_prefix, int to, bool is_right);
+static void writeCollapsed(GraphvizWriter* writer, int node_index, size_t hidden_nodes);
+static size_t countDescendants(Tree* tree, GraphvizStack* stack, int node_index);
+static TreeGraphvizState writeGraph(GraphvizWriter*            writer,
+                                    Tree*                      tree,
+                                    const TreeGraphvizOptions* options,
+                                    TreeGraphvizResult*        result);
+
+static const size_t WRITER_BUFFER_SIZE    = 1 << 16;
+static const size_t STACK_START_SIZE      = 64;
+static const size_t COMMAND_BUFFER_SIZE   = 512;
+static const size_t INT_BUFFER_SIZE       = 24;
+static const size_t MAX_LABEL_TEXT_LENGTH = 32;
+
+
+// public --------------------------------------------------------------------------------------------------------------
+
+
+TreeGraphvizOptions treeGraphvizDefaultOptions(const char* output_path)
+{
+    return (TreeGraphvizOptions){
+        .output_path = output_path,
+        .format      = TreeGraphvizFormat_DOT,
+        .root_index  = 0,
+        .max_depth   = GRAPHVIZ_UNLIMITED_DEPTH,
+        .verbose     = false,
+    };
+}
+
+
+TreeGraphvizState treeExportGraphviz(Tree*                      tree,
+                                     const TreeGraphvizOptions* options,
+                                     TreeGraphvizResult*        result)
+{
+    assert(tree                 != NULL);
+    assert(options              != NULL);
+    assert(options->output_path != NULL);
+
+    if (options->root_index < 0 || options->root_index >= (int)tree->nodes_number)
+    {
+        return TreeGraphvizState_BAD_ROOT;
+    }
+
+    FILE* output = NULL;
+    if (options->format == TreeGraphvizFormat_SVG)
+    {
+        if (strchr(options->output_path, '\'') != NULL)
+        {
+            return TreeGraphvizState_OPEN_ERROR;
+        }
+
+        char command[COMMAND_BUFFER_SIZE] = {};
+        snprintf(command, sizeof(command), "dot -Tsvg -o '%s'", options->output_path);
+        output = popen(command, "w");
+    }
+    else
+    {
+        output = fopen(options->output_path, "w");
+    }
+
+    if (output == NULL)
+    {
+        return TreeGraphvizState_OPEN_ERROR;
+    }
+
+    GraphvizWriter writer = {};
+    if (!writerInit(&writer, output))
+    {
+        if (options->format == TreeGraphvizFormat_SVG)
+        {
+            pclose(output);
+        }
+        else
+        {
+            fclose(output);
+        }
+
+        return TreeGraphvizState_MEMORY_ERROR;
+    }
+
+    TreeGraphvizResult local_result = {};
+    TreeGraphvizState state = writeGraph(&writer, tree, options, &local_result);
+
+    writerFlush(&writer);
+    if (state == TreeGraphvizState_OK && writer.failed)
+    {
+        state = TreeGraphvizState_WRITE_ERROR;
+    }
+    local_result.bytes_written = writer.bytes_written;
+    writerDtor(&writer);
+
+    if (options->format == TreeGraphvizFormat_SVG)
+    {
+        if (pclose(output) != 0 && state == TreeGraphvizState_OK)
+        {
+            state = TreeGraphvizState_RENDER_ERROR;
+        }
+    }
+    else if (fclose(output) != 0 && state == TreeGraphvizState_OK)
+    {
+        state = TreeGraphvizState_WRITE_ERROR;
+    }
+
+    if (result != NULL)
+    {
+        *result = local_result;
+    }
+
+    return state;
+}
+
+
+const char* treeGraphvizStateToString(TreeGraphvizState state)
+{
+    switch (state)
+    {
+        case TreeGraphvizState_OK:           return "ok";
+        case TreeGraphvizState_BAD_ROOT:     return "root node is out of range";
+        case TreeGraphvizState_OPEN_ERROR:   return "cannot open output";
+        case TreeGraphvizState_WRITE_ERROR:  return "cannot write output";
+        case TreeGraphvizState_RENDER_ERROR: return "dot failed to render";
+        case TreeGraphvizState_MEMORY_ERROR: return "out of memory";
+        default:                             return "unknown error";
+    }
+}
+
+
+// static --------------------------------------------------------------------------------------------------------------
+
+
+static TreeGraphvizState writeGraph(GraphvizWriter*            writer,
+                                    Tree*                      tree,
+                                    const TreeGraphvizOptions* options,
+                                    TreeGraphvizResult*        result)
+{
+    assert(writer  != NULL);
+    assert(tree    != NULL);
+    assert(options != NULL);
+    assert(result  != NULL);
+
+    GraphvizStack stack       = {};
+    GraphvizStack count_stack = {};
+    TreeGraphvizState state   = TreeGraphvizState_OK;
+
+    writeHeader(writer);
+
+    if (!stackPush(&stack, options->root_index, 0))
+    {
+        return TreeGraphvizState_MEMORY_ERROR;
+    }
+
+    while (stack.size > 0 && !writer->failed)
+    {
+        GraphvizStackItem item = stackPop(&stack);
+        TreeNode node = tree->nodes_array[item.node_index];
+
+        writeNode(writer, tree, item.node_index, options->verbose);
+        result->nodes_written++;
+
+        bool has_children = node.left_index  != EMPTY_NODE
+                         || node.right_index != EMPTY_NODE;
+        if (!has_children)
+        {
+            continue;
+        }
+
+        if (options->max_depth >= 0 && item.depth >= options->max_depth)
+        {
+            size_t hidden_nodes = countDescendants(tree, &count_stack, item.node_index);
+            if (hidden_nodes == 0)
+            {
+                state = TreeGraphvizState_MEMORY_ERROR;
+                break;
+            }
+
+            writeCollapsed(writer, item.node_index, hidden_nodes);
+            result->nodes_collapsed += hidden_nodes;
+            continue;
+        }
+
+        if (node.right_index != EMPTY_NODE)
+        {
+            writeEdge(writer, "n", item.node_index, "n", node.right_index, true);
+            if (!stackPush(&stack, node.right_index, item.depth + 1))
+            {
+                state = TreeGraphvizState_MEMORY_ERROR;
+                break;
+            }
+        }
+
+        if (node.left_index != EMPTY_NODE)
+        {
+            writeEdge(writer, "n", item.node_index, "n", node.left_index, false);
+            if (!stackPush(&stack, node.left_index, item.depth + 1))
+            {
+                state = TreeGraphvizState_MEMORY_ERROR;
+                break;
+            }
+        }
+    }
+
+    writerPuts(writer, "}\n");
+
+    free(stack.items);
+    free(count_stack.items);
+
+    return state;
+}
+
+
+static void writeHeader(GraphvizWriter* writer)
+{
+    assert(writer != NULL);
+
+    writerPuts(writer,
+               "digraph G\n{\n"
+               "    graph [bgcolor=\"gray20\", splines=line, ordering=out];\n"
+               "    node  [shape=box, style=filled, fillcolor=\"#705833\", color=white, "
+               "fontname=\"Arial\", fontsize=12, fontcolor=white];\n"
+               "    edge  [color=\"orange\"];\n\n");
+}
+
+
+static void writeNode(GraphvizWriter* writer, Tree* tree, int node_index, bool verbose)
+{
+    assert(writer != NULL);
+    assert(tree   != NULL);
+
+    TreeNode node = tree->nodes_array[node_index];
+
+    writerPuts(writer, "    n");
+    writerInt(writer, node_index);
+    writerPuts(writer, " [label=\"");
+    writerPuts(writer, syntaxNodeTypeToString(node.data.type));
+
+    switch (node.data.type)
+    {
+        case SyntaxNodeType_NUMBER:
+        {
+            char number[INT_BUFFER_SIZE * 2] = {};
+            int length = snprintf(number, sizeof(number), "\\n%lg", node.data.data.number);
+            writerWrite(writer, number, (size_t)length);
+            break;
+        }
+        case SyntaxNodeType_INTEGER:
+        {
+            char number[INT_BUFFER_SIZE * 2] = {};
+            int length = snprintf(number, sizeof(number), "\\n%" PRId64, node.data.data.integer);
+            writerWrite(writer, number, (size_t)length);
+            break;
+        }
+        case SyntaxNodeType_IDENTIFIER:
+            writerPuts(writer, "\\n");
+            writerEscaped(writer, node.data.data.identifier);
+            break;
+        case SyntaxNodeType_STRING:
+            writerPuts(writer, "\\n\\\"");
+            writerEscaped(writer, node.data.data.string);
+            writerPuts(writer, "\\\"");
+            break;
+        case SyntaxNodeType_BOOL:
+            writerPuts(writer, node.data.data.boolean ? "\\ntrue" : "\\nfalse");
+            break;
+        case SyntaxNodeType_BINARY_OPERATION:
+        case SyntaxNodeType_UNARY_OPERATION:
+            writerPuts(writer, "\\n");
+            writerEscaped(writer, tokenTypeToString(node.data.data.operation));
+            break;
+        default:
+            break;
+    }
+
+    if (verbose)
+    {
+        writerPuts(writer, "\\nindex ");
+        writerInt(writer, node_index);
+        writerPuts(writer, " parent ");
+        writerInt(writer, node.parent_index);
+        writerPuts(writer, "\\nleft ");
+        writerInt(writer, node.left_index);
+        writerPuts(writer, " right ");
+        writerInt(writer, node.right_index);
+    }
+
+    writerPuts(writer, "\"];\n");
+}
+
+
+static void writeEdge(GraphvizWriter* writer, const char* from_prefix, int from,
+                      const char* to_prefix, int to, bool is_right)
+{
+    assert(writer      != NULL);
+    assert(from_prefix != NULL);
+    assert(to_prefix   != NULL);
+
+    writerPuts(writer, "    ");
+    writerPuts(writer, from_prefix);
+    writerInt(writer, from);
+    writerPuts(writer, " -> ");
+    writerPuts(writer, to_prefix);
+    writerInt(writer, to);
+    writerPuts(writer, is_right ? " [color=\"skyblue\"];\n" : ";\n");
+}
+
+
+static void writeCollapsed(GraphvizWriter* writer, int node_index, size_t hidden_nodes)
+{
+    assert(writer != NULL);
+
+    writerPuts(writer, "    m");
+    writerInt(writer, node_index);
+    writerPuts(writer, " [label=\"+");
+    writerInt(writer, (long long)hidden_nodes);
+    writerPuts(writer, " more\", style=dashed, fillcolor=\"gray30\"];\n");
+
+    writeEdge(writer, "n", node_index, "m", node_index, false);
+}
+
+
+static size_t countDescendants(Tree* tree, GraphvizStack* stack, int node_index)
+{
+    assert(tree  != NULL);
+    assert(stack != NULL);
+
+    size_t descendants = 0;
+    stack->size = 0;
+
+    TreeNode node = tree->nodes_array[node_index];
+    if ((node.left_index  != EMPTY_NODE && !stackPush(stack, node.left_index,  0))
+     || (node.right_index != EMPTY_NODE && !stackPush(stack, node.right_index, 0)))
+    {
+        return 0;
+    }
+
+    while (stack->size > 0)
+    {
+        GraphvizStackItem item = stackPop(stack);
+        descendants++;
+
+        TreeNode child = tree->nodes_array[item.node_index];
+        if ((child.left_index  != EMPTY_NODE && !stackPush(stack, child.left_index,  0))
+         || (child.right_index != EMPTY_NODE && !stackPush(stack, child.right_index, 0)))
+        {
+            return 0;
+        }
+    }
+
+    return descendants;
+}
+
+
+static bool stackPush(GraphvizStack* stack, int node_index, int depth)
+{
+    assert(stack != NULL);
+
+    if (stack->size == stack->capacity)
+    {
+        size_t new_capacity = stack->capacity == 0 ? STACK_START_SIZE : stack->capacity * 2;
+        GraphvizStackItem* new_items = (GraphvizStackItem*)realloc(stack->items,
+                                                                   new_capacity * sizeof(GraphvizStackItem));
+        if (new_items == NULL)
+        {
+            return false;
+        }
+
+        stack->items    = new_items;
+        stack->capacity = new_capacity;
+    }
+
+    stack->items[stack->size++] = (GraphvizStackItem){
+        .node_index = node_index,
+        .depth      = depth,
+    };
+
+    return true;
+}
+
+
+static GraphvizStackItem stackPop(GraphvizStack* stack)
+{
+    assert(stack       != NULL);
+    assert(stack->size  > 0);
+
+    return stack->items[--stack->size];
+}
+
+
+static bool writerInit(GraphvizWriter* writer, FILE* file)
+{
+    assert(writer != NULL);
+    assert(file   != NULL);
+
+    writer->buffer = (char*)calloc(WRITER_BUFFER_SIZE, sizeof(char));
+    if (writer->buffer == NULL)
+    {
+        return false;
+    }
+
+    writer->file     = file;
+    writer->capacity = WRITER_BUFFER_SIZE;
+
+    return true;
+}
+
+
+static void writerDtor(GraphvizWriter* writer)
+{
+    assert(writer != NULL);
+
+    free(writer->buffer);
+    writer->buffer   = NULL;
+    writer->used     = 0;
+    writer->capacity = 0;
+}
+
+
+static void writerFlush(GraphvizWriter* writer)
+{
+    assert(writer != NULL);
+
+    if (writer->used == 0 || writer->failed)
+    {
+        writer->used = 0;
+        return;
+    }
+
+    if (fwrite(writer->buffer, sizeof(char), writer->used, writer->file) != writer->used)
+    {
+        writer->failed = true;
+    }
+
+    writer->bytes_written += writer->used;
+    writer->used = 0;
+}
+
+
+static void writerWrite(GraphvizWriter* writer, const char* text, size_t length)
+{
+    assert(writer != NULL);
+    assert(text   != NULL);
+
+    while (length > 0)
+    {
+        if (writer->used == writer->capacity)
+        {
+            writerFlush(writer);
+        }
+
+        size_t chunk = writer->capacity - writer->used;
+        if (chunk > length)
+        {
+            chunk = length;
+        }
+
+        memcpy(writer->buffer + writer->used, text, chunk);
+        writer->used += chunk;
+        text         += chunk;
+        length       -= chunk;
+    }
+}
+
+
+static void writerPuts(GraphvizWriter* writer, const char* text)
+{
+    assert(writer != NULL);
+    assert(text   != NULL);
+
+    writerWrite(writer, text, strlen(text));
+}
+
+
+static void writerInt(GraphvizWriter* writer, long long value)
+{
+    assert(writer != NULL);
+
+    char digits[INT_BUFFER_SIZE] = {};
+    size_t position = sizeof(digits);
+
+    bool negative = value < 0;
+    unsigned long long magnitude = negative ? 0ull - (unsigned long long)value
+                                            : (unsigned long long)value;
+    do
+    {
+        digits[--position] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (negative)
+    {
+        digits[--position] = '-';
+    }
+
+    writerWrite(writer, digits + position, sizeof(digits) - position);
+}
+
+
+static void writerEscaped(GraphvizWriter* writer, const char* text)
+{
+    assert(writer != NULL);
+
+    if (text == NULL)
+    {
+        writerPuts(writer, "(null)");
+        return;
+    }
+
+    for (size_t i = 0; text[i] != '\0'; i++)
+    {
+        if (i == MAX_LABEL_TEXT_LENGTH)
+        {
+            writerPuts(writer, "...");
+            return;
+        }
+
+        switch (text[i])
+        {
+            case '"':  writerPuts(writer, "\\\""); break;
+            case '\\': writerPuts(writer, "\\\\"); break;
+            case '\n': writerPuts(writer, "\\n");  break;
+            default:   writerWrite(writer, text + i, 1); break;
+        }
+    }
+}